@@ -0,0 +1 @@
+../../../YYKit/YYKit/Image/YYAPNGCore.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../YYKit/YYKit/Cache/YYCacheBinaryCodec.h
\ No newline at end of file
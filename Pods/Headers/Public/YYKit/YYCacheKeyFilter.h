@@ -0,0 +1 @@
+../../../YYKit/YYKit/Cache/YYCacheKeyFilter.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../YYKit/YYKit/Cache/YYCacheStatistics.h
\ No newline at end of file
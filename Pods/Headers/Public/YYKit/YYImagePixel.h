@@ -0,0 +1 @@
+../../../YYKit/YYKit/Image/YYImagePixel.h
\ No newline at end of file
@@ -11,7 +11,7 @@
 
 #import <Foundation/Foundation.h>
 
-@class YYMemoryCache, YYDiskCache;
+@class YYMemoryCache, YYDiskCache, YYCacheStatistics;
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -142,6 +142,50 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)setObject:(nullable id<NSCoding>)object forKey:(NSString *)key withBlock:(nullable void(^)(void))block;
 
+/**
+ Returns the values associated with the given keys.
+ This method may blocks the calling thread until file read finished.
+ 
+ @discussion The keys are looked up in memory cache first, and the missing keys
+ are read from disk cache in batch, then the found objects are set to memory cache.
+ 
+ @param keys An array of keys.
+ @return A dictionary which key is the found key and value is the object, the 
+    missing keys are not included.
+ */
+- (NSDictionary<NSString *, id<NSCoding>> *)objectsForKeys:(NSArray<NSString *> *)keys;
+
+/**
+ Returns the values associated with the given keys.
+ This method returns immediately and invoke the passed block in background queue
+ when the operation finished.
+ 
+ @param keys  An array of keys.
+ @param block A block which will be invoked in background queue when finished.
+ */
+- (void)objectsForKeys:(NSArray<NSString *> *)keys withBlock:(nullable void(^)(NSDictionary<NSString *, id<NSCoding>> *objects))block;
+
+/**
+ Sets the values of the specified keys in memory cache, and in disk cache in one transaction.
+ This method may blocks the calling thread until file write finished.
+ 
+ @param objects The objects to be stored in the cache.
+ @param keys    The keys with which to associate the objects, the count should be 
+    same as `objects`.
+ */
+- (void)setObjects:(NSArray<id<NSCoding>> *)objects forKeys:(NSArray<NSString *> *)keys;
+
+/**
+ Sets the values of the specified keys in memory cache, and in disk cache in one transaction.
+ This method returns immediately and invoke the passed block in background queue
+ when the operation finished.
+ 
+ @param objects The objects to be stored in the cache.
+ @param keys    The keys with which to associate the objects.
+ @param block   A block which will be invoked in background queue when finished.
+ */
+- (void)setObjects:(NSArray<id<NSCoding>> *)objects forKeys:(NSArray<NSString *> *)keys withBlock:(nullable void(^)(void))block;
+
 /**
  Removes the value of the specified key in the cache.
  This method may blocks the calling thread until file delete finished.
@@ -186,6 +230,25 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)removeAllObjectsWithProgressBlock:(nullable void(^)(int removedCount, int totalCount))progress
                                  endBlock:(nullable void(^)(BOOL error))end;
 
+#pragma mark - Statistics
+///=============================================================================
+/// @name Statistics
+///=============================================================================
+
+/**
+ A snapshot of the statistics of the tiered lookup path: a hit means the object
+ is found in either tier, and the latency includes both tiers. The statistics of
+ each tier are available from `memoryCache.statistics` and `diskCache.statistics`.
+ 
+ @discussion The objects in the memory tier are not archived, so the tiered path
+ doesn't know their sizes: `bytesRead` and `bytesWritten` are always 0 here. The
+ archived sizes are counted by `diskCache.statistics`.
+ */
+@property (readonly) YYCacheStatistics *statistics;
+
+/** Reset the statistics of this cache and both tiers to zero. */
+- (void)resetStatistics;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -12,8 +12,11 @@
 #import "YYCache.h"
 #import "YYMemoryCache.h"
 #import "YYDiskCache.h"
+#import "YYCacheStatistics.h"
 
-@implementation YYCache
+@implementation YYCache {
+    YYCacheStatisticsRecorder *_statistics;
+}
 
 - (instancetype) init {
     NSLog(@"Use \"initWithName\" or \"initWithPath\" to create YYCache instance.");
@@ -39,6 +42,7 @@
     _name = name;
     _diskCache = diskCache;
     _memoryCache = memoryCache;
+    _statistics = [YYCacheStatisticsRecorder new];
     return self;
 }
 
@@ -67,6 +71,7 @@
 }
 
 - (id<NSCoding>)objectForKey:(NSString *)key {
+    uint64_t begin = YYCacheStatisticsTime();
     id<NSCoding> object = [_memoryCache objectForKey:key];
     if (!object) {
         object = [_diskCache objectForKey:key];
@@ -74,6 +79,8 @@
             [_memoryCache setObject:object forKey:key];
         }
     }
+    // the memory tier's objects are not archived, so the bytes are only counted by the disk tier
+    [_statistics recordGetWithHit:object != nil bytes:0 latency:YYCacheStatisticsTime() - begin stripe:0];
     return object;
 }
 
@@ -90,8 +97,10 @@
 }
 
 - (void)setObject:(id<NSCoding>)object forKey:(NSString *)key {
+    uint64_t begin = YYCacheStatisticsTime();
     [_memoryCache setObject:object forKey:key];
     [_diskCache setObject:object forKey:key];
+    if (object) [_statistics recordSetWithBytes:0 latency:YYCacheStatisticsTime() - begin stripe:0];
 }
 
 - (void)setObject:(id<NSCoding>)object forKey:(NSString *)key withBlock:(void (^)(void))block {
@@ -99,6 +108,72 @@
     [_diskCache setObject:object forKey:key withBlock:block];
 }
 
+- (NSDictionary *)objectsForKeys:(NSArray *)keys {
+    if (keys.count == 0) return @{};
+    uint64_t begin = YYCacheStatisticsTime();
+    NSMutableDictionary *objects = [NSMutableDictionary new];
+    NSMutableArray *missingKeys = [NSMutableArray new];
+    for (NSString *key in keys) {
+        id<NSCoding> object = [_memoryCache objectForKey:key];
+        if (object) objects[key] = object;
+        else [missingKeys addObject:key];
+    }
+    if (missingKeys.count) {
+        NSDictionary *diskObjects = [_diskCache objectsForKeys:missingKeys];
+        [diskObjects enumerateKeysAndObjectsUsingBlock:^(NSString *key, id<NSCoding> object, BOOL *stop) {
+            [_memoryCache setObject:object forKey:key];
+        }];
+        [objects addEntriesFromDictionary:diskObjects];
+    }
+    [_statistics recordGetsWithHitCount:objects.count missCount:keys.count - objects.count
+                                  bytes:0 latency:YYCacheStatisticsTime() - begin stripe:0];
+    return objects;
+}
+
+- (void)objectsForKeys:(NSArray *)keys withBlock:(void (^)(NSDictionary *objects))block {
+    if (!block) return;
+    NSMutableDictionary *objects = [NSMutableDictionary new];
+    NSMutableArray *missingKeys = [NSMutableArray new];
+    for (NSString *key in keys) {
+        id<NSCoding> object = [_memoryCache objectForKey:key];
+        if (object) objects[key] = object;
+        else [missingKeys addObject:key];
+    }
+    if (missingKeys.count == 0) {
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            block(objects);
+        });
+    } else {
+        YYMemoryCache *memoryCache = _memoryCache;
+        [_diskCache objectsForKeys:missingKeys withBlock:^(NSDictionary *diskObjects) {
+            [diskObjects enumerateKeysAndObjectsUsingBlock:^(NSString *key, id<NSCoding> object, BOOL *stop) {
+                [memoryCache setObject:object forKey:key];
+            }];
+            [objects addEntriesFromDictionary:diskObjects];
+            block(objects);
+        }];
+    }
+}
+
+- (void)setObjects:(NSArray *)objects forKeys:(NSArray *)keys {
+    NSUInteger count = MIN(objects.count, keys.count);
+    if (count == 0) return;
+    uint64_t begin = YYCacheStatisticsTime();
+    for (NSUInteger i = 0; i < count; i++) {
+        [_memoryCache setObject:objects[i] forKey:keys[i]];
+    }
+    [_diskCache setObjects:objects forKeys:keys];
+    [_statistics recordSetsWithCount:count bytes:0 latency:YYCacheStatisticsTime() - begin stripe:0];
+}
+
+- (void)setObjects:(NSArray *)objects forKeys:(NSArray *)keys withBlock:(void (^)(void))block {
+    NSUInteger count = MIN(objects.count, keys.count);
+    for (NSUInteger i = 0; i < count; i++) {
+        [_memoryCache setObject:objects[i] forKey:keys[i]];
+    }
+    [_diskCache setObjects:objects forKeys:keys withBlock:block];
+}
+
 - (void)removeObjectForKey:(NSString *)key {
     [_memoryCache removeObjectForKey:key];
     [_diskCache removeObjectForKey:key];
@@ -126,6 +201,16 @@
     
 }
 
+- (YYCacheStatistics *)statistics {
+    return [_statistics snapshot];
+}
+
+- (void)resetStatistics {
+    [_statistics reset];
+    [_memoryCache resetStatistics];
+    [_diskCache resetStatistics];
+}
+
 - (NSString *)description {
     if (_name) return [NSString stringWithFormat:@"<%@: %p> (%@)", self.class, self, _name];
     else return [NSString stringWithFormat:@"<%@: %p>", self.class, self];
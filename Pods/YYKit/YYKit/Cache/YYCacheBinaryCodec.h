@@ -0,0 +1,58 @@
+//
+//  YYCacheBinaryCodec.h
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by agent on 26/10/17.
+//  Copyright (c) 2026 agent.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ YYCacheBinaryCodec is a compact binary encoder/decoder for cache values, it's
+ much faster than NSKeyedArchiver and the output is smaller.
+
+ @discussion These objects are encoded directly:
+
+ * NSString, NSNumber, NSData, NSDate, NSNull
+ * NSArray, NSDictionary (with encodable elements)
+ * Models which conform to `YYModel` protocol, their properties are encoded with
+   `modelEncodeWithCoder:` and decoded with `modelInitWithCoder:` (see NSObject+YYModel).
+
+ Other objects which conform to NSCoding are encoded with NSKeyedArchiver inside
+ the binary data. The mutability of containers and strings is not kept.
+
+ Short strings (such as dictionary keys) are written once and referenced later,
+ so the repeated keys of a feed payload cost only 1 or 2 bytes.
+ */
+@interface YYCacheBinaryCodec : NSObject
+
+/**
+ Encode an object to binary data.
+
+ @param object An object, see the discussion of this class for supported types.
+ @return The encoded data, or nil if the object (or its elements) can't be encoded.
+ */
++ (nullable NSData *)dataWithObject:(id)object;
+
+/**
+ Decode an object from binary data.
+
+ @param data The data created by `dataWithObject:`.
+ @return The decoded object, or nil if the data is invalid.
+ */
++ (nullable id)objectWithData:(NSData *)data;
+
+/**
+ Whether the data is created by `dataWithObject:` (checks the header only).
+ */
++ (BOOL)isBinaryData:(NSData *)data;
+
+@end
+
+NS_ASSUME_NONNULL_END
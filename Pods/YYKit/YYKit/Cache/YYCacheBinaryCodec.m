@@ -0,0 +1,523 @@
+//
+//  YYCacheBinaryCodec.m
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by agent on 26/10/17.
+//  Copyright (c) 2026 agent.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import "YYCacheBinaryCodec.h"
+#import "NSObject+YYModel.h"
+
+/*
+ Format:
+ header: 'Y' 'Y' 'B' version(1)
+ value:  tag(1 byte) + payload, see YYCacheBinaryTag
+ varint: unsigned LEB128
+ */
+
+static const uint8_t kYYCacheBinaryHeader[4] = {'Y', 'Y', 'B', 1};
+
+/// Strings not longer than this are written to the string table.
+static const NSUInteger kYYCacheBinaryStringTableLengthMax = 32;
+
+/// The maximum nesting level of containers and models.
+static const NSUInteger kYYCacheBinaryDepthMax = 64;
+
+typedef NS_ENUM(uint8_t, YYCacheBinaryTag) {
+    YYCacheBinaryTagNull = 0,    ///< NSNull
+    YYCacheBinaryTagTrue,        ///< @YES
+    YYCacheBinaryTagFalse,       ///< @NO
+    YYCacheBinaryTagInt,         ///< zigzag varint
+    YYCacheBinaryTagUInt64,      ///< 8 bytes, little endian (larger than INT64_MAX)
+    YYCacheBinaryTagDouble,      ///< 8 bytes, little endian
+    YYCacheBinaryTagString,      ///< varint length + UTF-8 bytes
+    YYCacheBinaryTagStringDef,   ///< same as String, and append to the string table
+    YYCacheBinaryTagStringRef,   ///< varint index of the string table
+    YYCacheBinaryTagData,        ///< varint length + bytes
+    YYCacheBinaryTagDate,        ///< double of timeIntervalSinceReferenceDate
+    YYCacheBinaryTagArray,       ///< varint count + values
+    YYCacheBinaryTagDictionary,  ///< varint count + (key value) pairs
+    YYCacheBinaryTagModel,       ///< class name (string value) + varint count + (string value) pairs
+    YYCacheBinaryTagArchived,    ///< varint length + NSKeyedArchiver data
+};
+
+
+/**
+ A keyed coder which holds the values in a dictionary, used to get or set the
+ properties of a model with `modelEncodeWithCoder:` and `modelInitWithCoder:`.
+ */
+@interface _YYCacheModelCoder : NSCoder
+@property (nonatomic, strong) NSMutableDictionary *values;
+@end
+
+@implementation _YYCacheModelCoder
+
+- (instancetype)init {
+    self = [super init];
+    _values = [NSMutableDictionary new];
+    return self;
+}
+
+- (BOOL)allowsKeyedCoding {
+    return YES;
+}
+
+- (BOOL)containsValueForKey:(NSString *)key {
+    return _values[key] != nil;
+}
+
+- (void)encodeObject:(id)object forKey:(NSString *)key {
+    if (object && key) _values[key] = object;
+}
+
+- (void)encodeConditionalObject:(id)object forKey:(NSString *)key {
+    [self encodeObject:object forKey:key];
+}
+
+- (void)encodeBool:(BOOL)value forKey:(NSString *)key { [self encodeObject:@(value) forKey:key]; }
+- (void)encodeInt:(int)value forKey:(NSString *)key { [self encodeObject:@(value) forKey:key]; }
+- (void)encodeInt32:(int32_t)value forKey:(NSString *)key { [self encodeObject:@(value) forKey:key]; }
+- (void)encodeInt64:(int64_t)value forKey:(NSString *)key { [self encodeObject:@(value) forKey:key]; }
+- (void)encodeInteger:(NSInteger)value forKey:(NSString *)key { [self encodeObject:@(value) forKey:key]; }
+- (void)encodeFloat:(float)value forKey:(NSString *)key { [self encodeObject:@(value) forKey:key]; }
+- (void)encodeDouble:(double)value forKey:(NSString *)key { [self encodeObject:@(value) forKey:key]; }
+
+- (id)decodeObjectForKey:(NSString *)key {
+    return key ? _values[key] : nil;
+}
+
+- (NSNumber *)_numberForKey:(NSString *)key {
+    id value = [self decodeObjectForKey:key];
+    return [value isKindOfClass:[NSNumber class]] ? value : nil;
+}
+
+- (BOOL)decodeBoolForKey:(NSString *)key { return [self _numberForKey:key].boolValue; }
+- (int)decodeIntForKey:(NSString *)key { return [self _numberForKey:key].intValue; }
+- (int32_t)decodeInt32ForKey:(NSString *)key { return [self _numberForKey:key].intValue; }
+- (int64_t)decodeInt64ForKey:(NSString *)key { return [self _numberForKey:key].longLongValue; }
+- (NSInteger)decodeIntegerForKey:(NSString *)key { return [self _numberForKey:key].integerValue; }
+- (float)decodeFloatForKey:(NSString *)key { return [self _numberForKey:key].floatValue; }
+- (double)decodeDoubleForKey:(NSString *)key { return [self _numberForKey:key].doubleValue; }
+
+@end
+
+
+
+@interface _YYCacheBinaryEncoder : NSObject
+@end
+
+@implementation _YYCacheBinaryEncoder {
+    @package
+    NSMutableData *_data;
+    NSMutableDictionary *_strings; ///< string -> index in string table
+    NSUInteger _depth;
+}
+
+- (instancetype)init {
+    self = [super init];
+    _data = [NSMutableData dataWithCapacity:256];
+    [_data appendBytes:kYYCacheBinaryHeader length:sizeof(kYYCacheBinaryHeader)];
+    _strings = [NSMutableDictionary new];
+    return self;
+}
+
+- (void)_writeTag:(YYCacheBinaryTag)tag {
+    [_data appendBytes:&tag length:1];
+}
+
+- (void)_writeVarint:(uint64_t)value {
+    uint8_t buffer[10];
+    int length = 0;
+    while (value >= 0x80) {
+        buffer[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (uint8_t)value;
+    [_data appendBytes:buffer length:length];
+}
+
+- (void)_writeFixed64:(uint64_t)value {
+    value = CFSwapInt64HostToLittle(value);
+    [_data appendBytes:&value length:8];
+}
+
+- (void)_writeDouble:(double)value {
+    uint64_t bits;
+    memcpy(&bits, &value, 8);
+    [self _writeFixed64:bits];
+}
+
+- (void)_writeBytes:(const void *)bytes length:(NSUInteger)length {
+    [self _writeVarint:length];
+    if (length) [_data appendBytes:bytes length:length];
+}
+
+- (void)_writeString:(NSString *)string {
+    NSUInteger length = string.length;
+    BOOL shared = length <= kYYCacheBinaryStringTableLengthMax;
+    if (shared) {
+        NSNumber *index = _strings[string];
+        if (index) {
+            [self _writeTag:YYCacheBinaryTagStringRef];
+            [self _writeVarint:index.unsignedIntegerValue];
+            return;
+        }
+        _strings[string] = @(_strings.count);
+    }
+    [self _writeTag:shared ? YYCacheBinaryTagStringDef : YYCacheBinaryTagString];
+
+    const char *cstr = CFStringGetCStringPtr((__bridge CFStringRef)string, kCFStringEncodingUTF8);
+    if (cstr && strlen(cstr) == length) { // ASCII string without '\0'
+        [self _writeBytes:cstr length:length];
+        return;
+    }
+    NSUInteger max = [string maximumLengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    char stackBuffer[256];
+    char *buffer = max <= sizeof(stackBuffer) ? stackBuffer : malloc(max);
+    NSUInteger used = 0;
+    [string getBytes:buffer maxLength:max usedLength:&used encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, length) remainingRange:NULL];
+    [self _writeBytes:buffer length:used];
+    if (buffer != stackBuffer) free(buffer);
+}
+
+- (BOOL)_writeNumber:(NSNumber *)number {
+    if (CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID()) {
+        [self _writeTag:number.boolValue ? YYCacheBinaryTagTrue : YYCacheBinaryTagFalse];
+        return YES;
+    }
+    if (CFNumberIsFloatType((__bridge CFNumberRef)number)) {
+        [self _writeTag:YYCacheBinaryTagDouble];
+        [self _writeDouble:number.doubleValue];
+        return YES;
+    }
+    const char *type = number.objCType;
+    if (type[0] == 'Q' || type[0] == 'L' || type[0] == 'I') {
+        unsigned long long value = number.unsignedLongLongValue;
+        if (value > INT64_MAX) {
+            [self _writeTag:YYCacheBinaryTagUInt64];
+            [self _writeFixed64:value];
+            return YES;
+        }
+    }
+    int64_t value = number.longLongValue;
+    [self _writeTag:YYCacheBinaryTagInt];
+    [self _writeVarint:((uint64_t)value << 1) ^ (uint64_t)(value >> 63)]; // zigzag
+    return YES;
+}
+
+- (BOOL)_writeModel:(id)model {
+    _YYCacheModelCoder *coder = [_YYCacheModelCoder new];
+    [model modelEncodeWithCoder:coder];
+    [self _writeTag:YYCacheBinaryTagModel];
+    [self _writeString:NSStringFromClass([model class])];
+    [self _writeVarint:coder.values.count];
+    __block BOOL succeed = YES;
+    [coder.values enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+        [self _writeString:key];
+        if (![self writeObject:value]) {
+            succeed = NO;
+            *stop = YES;
+        }
+    }];
+    return succeed;
+}
+
+- (BOOL)_writeArchivedObject:(id)object {
+    if (![object conformsToProtocol:@protocol(NSCoding)]) return NO;
+    NSData *data = nil;
+    @try {
+        data = [NSKeyedArchiver archivedDataWithRootObject:object];
+    }
+    @catch (NSException *exception) {
+        // nothing to do...
+    }
+    if (!data) return NO;
+    [self _writeTag:YYCacheBinaryTagArchived];
+    [self _writeBytes:data.bytes length:data.length];
+    return YES;
+}
+
+- (BOOL)writeObject:(id)object {
+    if (!object) return NO;
+    if (_depth >= kYYCacheBinaryDepthMax) return NO;
+
+    if ([object isKindOfClass:[NSString class]]) {
+        [self _writeString:object];
+        return YES;
+    }
+    if ([object isKindOfClass:[NSNumber class]]) {
+        if ([object isKindOfClass:[NSDecimalNumber class]]) return [self _writeArchivedObject:object];
+        return [self _writeNumber:object];
+    }
+    if ([object isKindOfClass:[NSData class]]) {
+        [self _writeTag:YYCacheBinaryTagData];
+        [self _writeBytes:((NSData *)object).bytes length:((NSData *)object).length];
+        return YES;
+    }
+    if ([object isKindOfClass:[NSDate class]]) {
+        [self _writeTag:YYCacheBinaryTagDate];
+        [self _writeDouble:((NSDate *)object).timeIntervalSinceReferenceDate];
+        return YES;
+    }
+    if (object == (id)kCFNull) {
+        [self _writeTag:YYCacheBinaryTagNull];
+        return YES;
+    }
+
+    BOOL succeed = YES;
+    _depth++;
+    if ([object isKindOfClass:[NSArray class]]) {
+        [self _writeTag:YYCacheBinaryTagArray];
+        [self _writeVarint:((NSArray *)object).count];
+        for (id value in (NSArray *)object) {
+            if (![self writeObject:value]) {
+                succeed = NO;
+                break;
+            }
+        }
+    } else if ([object isKindOfClass:[NSDictionary class]]) {
+        [self _writeTag:YYCacheBinaryTagDictionary];
+        [self _writeVarint:((NSDictionary *)object).count];
+        __block BOOL pairSucceed = YES;
+        [((NSDictionary *)object) enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            if (![self writeObject:key] || ![self writeObject:value]) {
+                pairSucceed = NO;
+                *stop = YES;
+            }
+        }];
+        succeed = pairSucceed;
+    } else if ([[object class] conformsToProtocol:@protocol(YYModel)]) {
+        succeed = [self _writeModel:object];
+    } else {
+        succeed = [self _writeArchivedObject:object];
+    }
+    _depth--;
+    return succeed;
+}
+
+@end
+
+
+
+@interface _YYCacheBinaryDecoder : NSObject
+@end
+
+@implementation _YYCacheBinaryDecoder {
+    @package
+    const uint8_t *_cur;
+    const uint8_t *_end;
+    NSMutableArray *_strings; ///< the string table
+    NSUInteger _depth;
+}
+
+- (instancetype)initWithData:(NSData *)data {
+    self = [super init];
+    _cur = (const uint8_t *)data.bytes + sizeof(kYYCacheBinaryHeader);
+    _end = (const uint8_t *)data.bytes + data.length;
+    _strings = [NSMutableArray new];
+    return self;
+}
+
+- (BOOL)_readVarint:(uint64_t *)value {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && _cur < _end; shift += 7) {
+        uint8_t byte = *_cur++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (BOOL)_readFixed64:(uint64_t *)value {
+    if (_end - _cur < 8) return NO;
+    memcpy(value, _cur, 8);
+    *value = CFSwapInt64LittleToHost(*value);
+    _cur += 8;
+    return YES;
+}
+
+- (BOOL)_readDouble:(double *)value {
+    uint64_t bits;
+    if (![self _readFixed64:&bits]) return NO;
+    memcpy(value, &bits, 8);
+    return YES;
+}
+
+/// Read a length and skip the bytes, returns NULL if the data is truncated.
+- (const uint8_t *)_readBytesWithLength:(NSUInteger *)length {
+    uint64_t len;
+    if (![self _readVarint:&len]) return NULL;
+    if (len > (uint64_t)(_end - _cur)) return NULL;
+    const uint8_t *bytes = _cur;
+    _cur += len;
+    *length = (NSUInteger)len;
+    return bytes;
+}
+
+- (NSString *)_readStringPayload {
+    NSUInteger length;
+    const uint8_t *bytes = [self _readBytesWithLength:&length];
+    if (!bytes) return nil;
+    return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+}
+
+- (NSString *)_readString {
+    id value = [self readObject];
+    return [value isKindOfClass:[NSString class]] ? value : nil;
+}
+
+- (id)_readModel {
+    NSString *className = [self _readString];
+    Class cls = className ? NSClassFromString(className) : Nil;
+    if (!cls || ![cls conformsToProtocol:@protocol(YYModel)]) return nil;
+    uint64_t count;
+    if (![self _readVarint:&count] || count > (uint64_t)(_end - _cur)) return nil;
+    _YYCacheModelCoder *coder = [_YYCacheModelCoder new];
+    for (uint64_t i = 0; i < count; i++) {
+        NSString *key = [self _readString];
+        id value = [self readObject];
+        if (!key || !value) return nil;
+        coder.values[key] = value;
+    }
+    return [[cls new] modelInitWithCoder:coder];
+}
+
+- (id)readObject {
+    if (_cur >= _end) return nil;
+    YYCacheBinaryTag tag = *_cur++;
+    switch (tag) {
+        case YYCacheBinaryTagNull: return (id)kCFNull;
+        case YYCacheBinaryTagTrue: return @YES;
+        case YYCacheBinaryTagFalse: return @NO;
+        case YYCacheBinaryTagInt: {
+            uint64_t value;
+            if (![self _readVarint:&value]) return nil;
+            return @((int64_t)(value >> 1) ^ -(int64_t)(value & 1));
+        }
+        case YYCacheBinaryTagUInt64: {
+            uint64_t value;
+            if (![self _readFixed64:&value]) return nil;
+            return @(value);
+        }
+        case YYCacheBinaryTagDouble: {
+            double value;
+            if (![self _readDouble:&value]) return nil;
+            return @(value);
+        }
+        case YYCacheBinaryTagString: {
+            return [self _readStringPayload];
+        }
+        case YYCacheBinaryTagStringDef: {
+            NSString *string = [self _readStringPayload];
+            if (string) [_strings addObject:string];
+            return string;
+        }
+        case YYCacheBinaryTagStringRef: {
+            uint64_t index;
+            if (![self _readVarint:&index] || index >= _strings.count) return nil;
+            return _strings[(NSUInteger)index];
+        }
+        case YYCacheBinaryTagData: {
+            NSUInteger length;
+            const uint8_t *bytes = [self _readBytesWithLength:&length];
+            if (!bytes) return nil;
+            return [NSData dataWithBytes:bytes length:length];
+        }
+        case YYCacheBinaryTagDate: {
+            double value;
+            if (![self _readDouble:&value]) return nil;
+            return [NSDate dateWithTimeIntervalSinceReferenceDate:value];
+        }
+        case YYCacheBinaryTagArchived: {
+            NSUInteger length;
+            const uint8_t *bytes = [self _readBytesWithLength:&length];
+            if (!bytes) return nil;
+            NSData *data = [NSData dataWithBytesNoCopy:(void *)bytes length:length freeWhenDone:NO];
+            id object = nil;
+            @try {
+                object = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+            }
+            @catch (NSException *exception) {
+                // nothing to do...
+            }
+            return object;
+        }
+        default: break;
+    }
+
+    if (_depth >= kYYCacheBinaryDepthMax) return nil;
+    id result = nil;
+    _depth++;
+    switch (tag) {
+        case YYCacheBinaryTagArray: {
+            uint64_t count;
+            if (![self _readVarint:&count] || count > (uint64_t)(_end - _cur)) break; // each value has 1 byte at least
+            NSMutableArray *array = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
+            for (uint64_t i = 0; i < count; i++) {
+                id value = [self readObject];
+                if (!value) {
+                    array = nil;
+                    break;
+                }
+                [array addObject:value];
+            }
+            result = array;
+        } break;
+        case YYCacheBinaryTagDictionary: {
+            uint64_t count;
+            if (![self _readVarint:&count] || count > (uint64_t)(_end - _cur)) break;
+            NSMutableDictionary *dic = [NSMutableDictionary dictionaryWithCapacity:(NSUInteger)count];
+            for (uint64_t i = 0; i < count; i++) {
+                id key = [self readObject];
+                id value = [self readObject];
+                if (!key || !value) {
+                    dic = nil;
+                    break;
+                }
+                dic[key] = value;
+            }
+            result = dic;
+        } break;
+        case YYCacheBinaryTagModel: {
+            result = [self _readModel];
+        } break;
+        default: break;
+    }
+    _depth--;
+    return result;
+}
+
+@end
+
+
+
+@implementation YYCacheBinaryCodec
+
++ (NSData *)dataWithObject:(id)object {
+    if (!object) return nil;
+    _YYCacheBinaryEncoder *encoder = [_YYCacheBinaryEncoder new];
+    if (![encoder writeObject:object]) return nil;
+    return encoder->_data;
+}
+
++ (id)objectWithData:(NSData *)data {
+    if (![self isBinaryData:data]) return nil;
+    _YYCacheBinaryDecoder *decoder = [[_YYCacheBinaryDecoder alloc] initWithData:data];
+    id object = [decoder readObject];
+    if (decoder->_cur != decoder->_end) return nil; // trailing garbage
+    return object;
+}
+
++ (BOOL)isBinaryData:(NSData *)data {
+    if (data.length <= sizeof(kYYCacheBinaryHeader)) return NO;
+    return memcmp(data.bytes, kYYCacheBinaryHeader, sizeof(kYYCacheBinaryHeader)) == 0;
+}
+
+@end
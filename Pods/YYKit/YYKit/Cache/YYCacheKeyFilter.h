@@ -0,0 +1,82 @@
+//
+//  YYCacheKeyFilter.h
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by agent on 26/10/17.
+//  Copyright (c) 2026 agent.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ YYCacheKeyFilter is a bloom filter of cache keys, it tells whether a key is
+ definitely not in the cache, without touching the cache's storage.
+
+ @discussion A key added to the filter is never reported as missing; a key not
+ added may be reported as present with a small probability (about 1% when the
+ added count is not larger than the capacity). Keys can't be removed, so the
+ owner should rebuild the filter when it's saturated.
+
+ The hashes are computed from the UTF-8 bytes of the key, so a filter written
+ to file can be read by another launch of the app.
+
+ `mayContainKey:` can be called while another thread is adding keys (it may miss
+ the key being added), but `addKey:` and `removeAllKeys` should be serialized.
+ */
+@interface YYCacheKeyFilter : NSObject
+
+/** The number of keys the filter is sized for. */
+@property (readonly) NSUInteger capacity;
+
+/** The number of added keys (a key added twice is counted twice). */
+@property (readonly) NSUInteger count;
+
+/** Whether the added count is larger than the capacity, the false positive rate increases. */
+@property (readonly, getter=isSaturated) BOOL saturated;
+
+/**
+ Create an empty filter.
+
+ @param capacity The expected number of keys, it's 1024 at least.
+ */
+- (instancetype)initWithCapacity:(NSUInteger)capacity NS_DESIGNATED_INITIALIZER;
+
+/**
+ Read a filter from file.
+
+ @param path The file written by `writeToFile:`.
+ @return A filter, or nil if the file is missing or invalid.
+ */
++ (nullable instancetype)filterWithContentsOfFile:(NSString *)path;
+
+/**
+ Write the filter to file atomically.
+
+ @return Whether succeed.
+ */
+- (BOOL)writeToFile:(NSString *)path;
+
+/** Add a key to the filter. */
+- (void)addKey:(NSString *)key;
+
+/**
+ Whether the key may be in the filter.
+
+ @return NO if the key is definitely not added, YES if it may be added.
+ */
+- (BOOL)mayContainKey:(NSString *)key;
+
+/** Remove all keys, the capacity is not changed. */
+- (void)removeAllKeys;
+
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
++ (instancetype)new UNAVAILABLE_ATTRIBUTE;
+
+@end
+
+NS_ASSUME_NONNULL_END
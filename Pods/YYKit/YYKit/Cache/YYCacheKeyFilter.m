@@ -0,0 +1,153 @@
+//
+//  YYCacheKeyFilter.m
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by agent on 26/10/17.
+//  Copyright (c) 2026 agent.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import "YYCacheKeyFilter.h"
+
+/*
+ File format (host byte order, little endian on iOS):
+ header: 'Y' 'Y' 'F' version(1), hash count(4), capacity(8), count(8), bit count(8)
+ bits:   bit count / 8 bytes
+ */
+
+static const uint8_t kYYCacheKeyFilterMagic[4] = {'Y', 'Y', 'F', 1};
+
+/// 10 bits and 7 hashes for each key, the false positive rate is about 1%.
+static const NSUInteger kYYCacheKeyFilterBitsPerKey = 10;
+static const uint32_t kYYCacheKeyFilterHashCount = 7;
+
+static const NSUInteger kYYCacheKeyFilterCapacityMin = 1024;
+
+typedef struct {
+    uint8_t magic[4];
+    uint32_t hashCount;
+    uint64_t capacity;
+    uint64_t count;
+    uint64_t bitCount;
+} _YYCacheKeyFilterHeader;
+
+static inline uint64_t _YYCacheKeyFilterFmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+/// Two hashes of the key's UTF-8 bytes (FNV-1a, then mixed), the positions
+/// of the key are `h1 + i * h2` (double hashing).
+static void _YYCacheKeyFilterHash(NSString *key, uint64_t *h1, uint64_t *h2) {
+    const char *str = key.UTF8String;
+    uint64_t h = 14695981039346656037ULL;
+    if (str) {
+        for (const uint8_t *p = (const uint8_t *)str; *p; p++) {
+            h ^= *p;
+            h *= 1099511628211ULL;
+        }
+    }
+    *h1 = _YYCacheKeyFilterFmix64(h);
+    *h2 = _YYCacheKeyFilterFmix64(h ^ 0x9e3779b97f4a7c15ULL) | 1;
+}
+
+
+@implementation YYCacheKeyFilter {
+    uint8_t *_bits;
+    uint64_t _bitCount;
+    uint32_t _hashCount;
+}
+
+- (instancetype)init {
+    @throw [NSException exceptionWithName:@"YYCacheKeyFilter init error" reason:@"YYCacheKeyFilter must be initialized with a capacity. Use 'initWithCapacity:' instead." userInfo:nil];
+    return [self initWithCapacity:0];
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+    self = [super init];
+    if (capacity < kYYCacheKeyFilterCapacityMin) capacity = kYYCacheKeyFilterCapacityMin;
+    _capacity = capacity;
+    _hashCount = kYYCacheKeyFilterHashCount;
+    _bitCount = ((uint64_t)capacity * kYYCacheKeyFilterBitsPerKey + 63) / 64 * 64;
+    _bits = calloc((size_t)(_bitCount / 8), 1);
+    if (!_bits) return nil;
+    return self;
+}
+
++ (instancetype)filterWithContentsOfFile:(NSString *)path {
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    if (data.length < sizeof(_YYCacheKeyFilterHeader)) return nil;
+    _YYCacheKeyFilterHeader header;
+    memcpy(&header, data.bytes, sizeof(header));
+    if (memcmp(header.magic, kYYCacheKeyFilterMagic, sizeof(kYYCacheKeyFilterMagic)) != 0) return nil;
+    if (header.hashCount == 0 || header.bitCount == 0 || header.bitCount % 64 != 0) return nil;
+    if (header.capacity < kYYCacheKeyFilterCapacityMin || header.capacity > NSUIntegerMax || header.count > NSUIntegerMax) return nil;
+    if ((uint64_t)header.capacity * kYYCacheKeyFilterBitsPerKey > header.bitCount) return nil;
+    if (data.length != sizeof(header) + header.bitCount / 8) return nil;
+
+    YYCacheKeyFilter *filter = [[self alloc] initWithCapacity:(NSUInteger)header.capacity];
+    if (!filter || filter->_bitCount != header.bitCount) return nil;
+    filter->_hashCount = header.hashCount;
+    filter->_count = (NSUInteger)header.count;
+    memcpy(filter->_bits, (const uint8_t *)data.bytes + sizeof(header), (size_t)(header.bitCount / 8));
+    return filter;
+}
+
+- (void)dealloc {
+    free(_bits);
+}
+
+- (BOOL)writeToFile:(NSString *)path {
+    _YYCacheKeyFilterHeader header = {{0}};
+    memcpy(header.magic, kYYCacheKeyFilterMagic, sizeof(kYYCacheKeyFilterMagic));
+    header.hashCount = _hashCount;
+    header.capacity = _capacity;
+    header.count = _count;
+    header.bitCount = _bitCount;
+    NSMutableData *data = [NSMutableData dataWithCapacity:sizeof(header) + (NSUInteger)(_bitCount / 8)];
+    [data appendBytes:&header length:sizeof(header)];
+    [data appendBytes:_bits length:(NSUInteger)(_bitCount / 8)];
+    return [data writeToFile:path atomically:YES];
+}
+
+- (BOOL)isSaturated {
+    return _count > _capacity;
+}
+
+- (void)addKey:(NSString *)key {
+    uint64_t h1, h2;
+    _YYCacheKeyFilterHash(key, &h1, &h2);
+    for (uint32_t i = 0; i < _hashCount; i++) {
+        uint64_t bit = (h1 + i * h2) % _bitCount;
+        __atomic_fetch_or(&_bits[bit >> 3], (uint8_t)(1 << (bit & 7)), __ATOMIC_RELAXED);
+    }
+    _count++;
+}
+
+- (BOOL)mayContainKey:(NSString *)key {
+    uint64_t h1, h2;
+    _YYCacheKeyFilterHash(key, &h1, &h2);
+    for (uint32_t i = 0; i < _hashCount; i++) {
+        uint64_t bit = (h1 + i * h2) % _bitCount;
+        if ((__atomic_load_n(&_bits[bit >> 3], __ATOMIC_RELAXED) & (1 << (bit & 7))) == 0) return NO;
+    }
+    return YES;
+}
+
+- (void)removeAllKeys {
+    memset(_bits, 0, (size_t)(_bitCount / 8));
+    _count = 0;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p> count:%lu capacity:%lu", self.class, self,
+            (unsigned long)_count, (unsigned long)_capacity];
+}
+
+@end
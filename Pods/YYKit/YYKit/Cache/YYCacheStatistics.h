@@ -0,0 +1,128 @@
+//
+//  YYCacheStatistics.h
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by agent on 26/10/17.
+//  Copyright (c) 2026 agent.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ The reason why objects are evicted from a cache.
+ */
+typedef NS_ENUM(NSUInteger, YYCacheEvictionReason) {
+    YYCacheEvictionReasonCost = 0,      ///< The cache is over its cost limit.
+    YYCacheEvictionReasonCount,         ///< The cache is over its count limit.
+    YYCacheEvictionReasonAge,           ///< The object is older than the age limit.
+    YYCacheEvictionReasonFreeDiskSpace, ///< The free disk space is below the limit.
+};
+
+
+/**
+ A log-linear histogram of latencies (each power of 2 is split into 4 linear
+ buckets, so the relative error is under 25%).
+ */
+@interface YYCacheLatencyHistogram : NSObject
+
+/** The number of recorded operations. */
+@property (readonly) uint64_t count;
+
+/** The total latency of recorded operations in nanoseconds. */
+@property (readonly) uint64_t totalNanoseconds;
+
+/** The average latency in nanoseconds, 0 if no operation is recorded. */
+@property (readonly) uint64_t averageNanoseconds;
+
+/**
+ Get the latency at a specified percentile.
+
+ @param percentile The percentile, from 0 to 100 (e.g. 99.9).
+ @return The upper bound of the bucket which holds the percentile in nanoseconds,
+    0 if no operation is recorded.
+ */
+- (uint64_t)nanosecondsAtPercentile:(double)percentile;
+
+@end
+
+
+/**
+ A snapshot of a cache's statistics.
+
+ @discussion The counters are updated with relaxed atomic operations, so a snapshot
+ taken while the cache is in use may be slightly inconsistent between counters.
+ */
+@interface YYCacheStatistics : NSObject
+
+@property (readonly) uint64_t hitCount;     ///< The number of lookups which found the object.
+@property (readonly) uint64_t missCount;    ///< The number of lookups which did not find the object.
+@property (readonly) double hitRatio;       ///< hitCount / (hitCount + missCount), 0 if no lookup.
+@property (readonly) uint64_t bytesRead;    ///< The bytes (or cost for memory cache) of hit objects.
+@property (readonly) uint64_t bytesWritten; ///< The bytes (or cost for memory cache) of set objects.
+@property (readonly) uint64_t evictionCount;///< The number of evicted objects of all reasons.
+
+@property (readonly) YYCacheLatencyHistogram *getLatency; ///< Latency of lookups.
+@property (readonly) YYCacheLatencyHistogram *setLatency; ///< Latency of writes.
+
+/**
+ The number of objects evicted for a specified reason.
+ */
+- (uint64_t)evictionCountForReason:(YYCacheEvictionReason)reason;
+
+@end
+
+
+/**
+ YYCacheStatisticsRecorder collects the statistics of a cache.
+ All methods are thread-safe. Typically, you should not use this class directly.
+
+ @discussion The counters are split into cache-line aligned stripes, and updated
+ with relaxed atomic operations, so it's cheap enough to be always enabled.
+ Threads which access different stripes (e.g. the shards of a memory cache) don't
+ contend on the same cache line.
+ */
+@interface YYCacheStatisticsRecorder : NSObject
+
+/** Create a recorder with one stripe. */
+- (instancetype)init;
+
+/**
+ The designated initializer.
+
+ @param stripeCount The number of stripes, it will be rounded up to power of 2
+    (maximum 8).
+ */
+- (instancetype)initWithStripeCount:(NSUInteger)stripeCount NS_DESIGNATED_INITIALIZER;
+
+/** Record a lookup. The stripe is masked by the stripe count. */
+- (void)recordGetWithHit:(BOOL)hit bytes:(uint64_t)bytes latency:(uint64_t)nanoseconds stripe:(NSUInteger)stripe;
+
+/** Record a write. The stripe is masked by the stripe count. */
+- (void)recordSetWithBytes:(uint64_t)bytes latency:(uint64_t)nanoseconds stripe:(NSUInteger)stripe;
+
+/** Record a batch of lookups, each with the average latency of the batch. */
+- (void)recordGetsWithHitCount:(uint64_t)hitCount missCount:(uint64_t)missCount bytes:(uint64_t)bytes latency:(uint64_t)nanoseconds stripe:(NSUInteger)stripe;
+
+/** Record a batch of writes, each with the average latency of the batch. */
+- (void)recordSetsWithCount:(uint64_t)count bytes:(uint64_t)bytes latency:(uint64_t)nanoseconds stripe:(NSUInteger)stripe;
+
+/** Record evicted objects. The stripe is masked by the stripe count. */
+- (void)recordEvictions:(uint64_t)count reason:(YYCacheEvictionReason)reason stripe:(NSUInteger)stripe;
+
+/** Sum all stripes to a snapshot. */
+- (YYCacheStatistics *)snapshot;
+
+/** Reset all counters to zero. */
+- (void)reset;
+
+@end
+
+/// A monotonic timestamp in nanoseconds, used to measure latency.
+FOUNDATION_EXTERN uint64_t YYCacheStatisticsTime(void);
+
+NS_ASSUME_NONNULL_END
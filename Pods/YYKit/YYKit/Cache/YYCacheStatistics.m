@@ -0,0 +1,267 @@
+//
+//  YYCacheStatistics.m
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by agent on 26/10/17.
+//  Copyright (c) 2026 agent.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#import "YYCacheStatistics.h"
+#import <mach/mach_time.h>
+
+/// Number of eviction reasons.
+#define kYYCacheEvictionReasonCount 4
+
+/// Number of latency buckets: 4 buckets for each power of 2, up to about 8 seconds.
+#define kYYCacheLatencyBucketCount 128
+
+/// The maximum number of stripes in a recorder.
+#define kYYCacheStatisticsStripeMax 8
+
+uint64_t YYCacheStatisticsTime(void) {
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info(&timebase);
+    });
+    uint64_t time = mach_absolute_time();
+    if (timebase.numer == timebase.denom) return time;
+    return time * timebase.numer / timebase.denom;
+}
+
+/// Get the bucket index of a latency: [0, 3] are exact, then 4 buckets per power of 2.
+static inline NSUInteger _YYCacheLatencyBucket(uint64_t nanoseconds) {
+    if (nanoseconds < 4) return (NSUInteger)nanoseconds;
+    int exponent = 63 - __builtin_clzll(nanoseconds); // >= 2
+    NSUInteger index = (exponent - 1) * 4 + ((nanoseconds >> (exponent - 2)) & 3);
+    return MIN(index, kYYCacheLatencyBucketCount - 1);
+}
+
+/// Get the upper bound (inclusive) of a bucket.
+static inline uint64_t _YYCacheLatencyBucketUpperBound(NSUInteger index) {
+    if (index < 4) return index;
+    NSUInteger exponent = index / 4 + 1;
+    uint64_t lower = (uint64_t)(4 + index % 4) << (exponent - 2);
+    return lower + ((uint64_t)1 << (exponent - 2)) - 1;
+}
+
+typedef struct {
+    uint64_t count;
+    uint64_t total;
+    uint64_t buckets[kYYCacheLatencyBucketCount];
+} _YYCacheLatencyCounters;
+
+/// A stripe of counters, aligned to cache line size to avoid false sharing.
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    uint64_t evictions[kYYCacheEvictionReasonCount];
+    _YYCacheLatencyCounters get;
+    _YYCacheLatencyCounters set;
+} __attribute__((aligned(64))) _YYCacheStatisticsStripe;
+
+static inline void _YYCacheCounterAdd(uint64_t *counter, uint64_t value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t _YYCacheCounterGet(uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/// Record `count` operations which take `nanoseconds` in total.
+static inline void _YYCacheLatencyRecord(_YYCacheLatencyCounters *counters, uint64_t count, uint64_t nanoseconds) {
+    if (count == 0) return;
+    _YYCacheCounterAdd(&counters->count, count);
+    _YYCacheCounterAdd(&counters->total, nanoseconds);
+    _YYCacheCounterAdd(&counters->buckets[_YYCacheLatencyBucket(nanoseconds / count)], count);
+}
+
+
+@interface YYCacheLatencyHistogram ()
+- (void)_addCounters:(_YYCacheLatencyCounters *)counters;
+@end
+
+@interface YYCacheStatistics ()
+- (void)_addStripe:(_YYCacheStatisticsStripe *)stripe;
+@end
+
+
+@implementation YYCacheLatencyHistogram {
+    @package
+    uint64_t _buckets[kYYCacheLatencyBucketCount];
+}
+
+- (uint64_t)averageNanoseconds {
+    return _count ? _totalNanoseconds / _count : 0;
+}
+
+- (uint64_t)nanosecondsAtPercentile:(double)percentile {
+    if (_count == 0) return 0;
+    if (percentile < 0) percentile = 0;
+    if (percentile > 100) percentile = 100;
+    uint64_t rank = (uint64_t)ceil(_count * percentile / 100.0);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (NSUInteger i = 0; i < kYYCacheLatencyBucketCount; i++) {
+        seen += _buckets[i];
+        if (seen >= rank) return _YYCacheLatencyBucketUpperBound(i);
+    }
+    return _YYCacheLatencyBucketUpperBound(kYYCacheLatencyBucketCount - 1);
+}
+
+- (void)_addCounters:(_YYCacheLatencyCounters *)counters {
+    _count += _YYCacheCounterGet(&counters->count);
+    _totalNanoseconds += _YYCacheCounterGet(&counters->total);
+    for (NSUInteger i = 0; i < kYYCacheLatencyBucketCount; i++) {
+        _buckets[i] += _YYCacheCounterGet(&counters->buckets[i]);
+    }
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p> count:%llu avg:%lluns p50:%lluns p99:%lluns", self.class, self,
+            _count, self.averageNanoseconds, [self nanosecondsAtPercentile:50], [self nanosecondsAtPercentile:99]];
+}
+
+@end
+
+
+
+@implementation YYCacheStatistics {
+    @package
+    uint64_t _evictions[kYYCacheEvictionReasonCount];
+}
+
+- (instancetype)init {
+    self = [super init];
+    _getLatency = [YYCacheLatencyHistogram new];
+    _setLatency = [YYCacheLatencyHistogram new];
+    return self;
+}
+
+- (double)hitRatio {
+    uint64_t total = _hitCount + _missCount;
+    return total ? (double)_hitCount / total : 0;
+}
+
+- (uint64_t)evictionCount {
+    uint64_t count = 0;
+    for (NSUInteger i = 0; i < kYYCacheEvictionReasonCount; i++) count += _evictions[i];
+    return count;
+}
+
+- (uint64_t)evictionCountForReason:(YYCacheEvictionReason)reason {
+    if (reason >= kYYCacheEvictionReasonCount) return 0;
+    return _evictions[reason];
+}
+
+- (void)_addStripe:(_YYCacheStatisticsStripe *)stripe {
+    _hitCount += _YYCacheCounterGet(&stripe->hits);
+    _missCount += _YYCacheCounterGet(&stripe->misses);
+    _bytesRead += _YYCacheCounterGet(&stripe->bytesRead);
+    _bytesWritten += _YYCacheCounterGet(&stripe->bytesWritten);
+    for (NSUInteger i = 0; i < kYYCacheEvictionReasonCount; i++) {
+        _evictions[i] += _YYCacheCounterGet(&stripe->evictions[i]);
+    }
+    [_getLatency _addCounters:&stripe->get];
+    [_setLatency _addCounters:&stripe->set];
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p> hit:%llu miss:%llu ratio:%.3f read:%llu written:%llu evicted:%llu (cost:%llu count:%llu age:%llu disk:%llu)",
+            self.class, self, _hitCount, _missCount, self.hitRatio, _bytesRead, _bytesWritten, self.evictionCount,
+            _evictions[YYCacheEvictionReasonCost], _evictions[YYCacheEvictionReasonCount],
+            _evictions[YYCacheEvictionReasonAge], _evictions[YYCacheEvictionReasonFreeDiskSpace]];
+}
+
+@end
+
+
+
+@implementation YYCacheStatisticsRecorder {
+    _YYCacheStatisticsStripe *_stripes;
+    NSUInteger _stripeCount;
+    NSUInteger _stripeMask;
+}
+
+- (instancetype)init {
+    return [self initWithStripeCount:1];
+}
+
+- (instancetype)initWithStripeCount:(NSUInteger)stripeCount {
+    self = [super init];
+    if (stripeCount > kYYCacheStatisticsStripeMax) stripeCount = kYYCacheStatisticsStripeMax;
+    NSUInteger count = 1;
+    while (count < stripeCount) count <<= 1;
+    void *stripes = NULL;
+    if (posix_memalign(&stripes, 64, sizeof(_YYCacheStatisticsStripe) * count) != 0) return nil;
+    memset(stripes, 0, sizeof(_YYCacheStatisticsStripe) * count);
+    _stripes = stripes;
+    _stripeCount = count;
+    _stripeMask = count - 1;
+    return self;
+}
+
+- (void)dealloc {
+    free(_stripes);
+}
+
+- (void)recordGetWithHit:(BOOL)hit bytes:(uint64_t)bytes latency:(uint64_t)nanoseconds stripe:(NSUInteger)stripe {
+    _YYCacheStatisticsStripe *s = &_stripes[stripe & _stripeMask];
+    if (hit) {
+        _YYCacheCounterAdd(&s->hits, 1);
+        if (bytes) _YYCacheCounterAdd(&s->bytesRead, bytes);
+    } else {
+        _YYCacheCounterAdd(&s->misses, 1);
+    }
+    _YYCacheLatencyRecord(&s->get, 1, nanoseconds);
+}
+
+- (void)recordSetWithBytes:(uint64_t)bytes latency:(uint64_t)nanoseconds stripe:(NSUInteger)stripe {
+    _YYCacheStatisticsStripe *s = &_stripes[stripe & _stripeMask];
+    if (bytes) _YYCacheCounterAdd(&s->bytesWritten, bytes);
+    _YYCacheLatencyRecord(&s->set, 1, nanoseconds);
+}
+
+- (void)recordGetsWithHitCount:(uint64_t)hitCount missCount:(uint64_t)missCount bytes:(uint64_t)bytes latency:(uint64_t)nanoseconds stripe:(NSUInteger)stripe {
+    _YYCacheStatisticsStripe *s = &_stripes[stripe & _stripeMask];
+    if (hitCount) _YYCacheCounterAdd(&s->hits, hitCount);
+    if (missCount) _YYCacheCounterAdd(&s->misses, missCount);
+    if (bytes) _YYCacheCounterAdd(&s->bytesRead, bytes);
+    _YYCacheLatencyRecord(&s->get, hitCount + missCount, nanoseconds);
+}
+
+- (void)recordSetsWithCount:(uint64_t)count bytes:(uint64_t)bytes latency:(uint64_t)nanoseconds stripe:(NSUInteger)stripe {
+    _YYCacheStatisticsStripe *s = &_stripes[stripe & _stripeMask];
+    if (bytes) _YYCacheCounterAdd(&s->bytesWritten, bytes);
+    _YYCacheLatencyRecord(&s->set, count, nanoseconds);
+}
+
+- (void)recordEvictions:(uint64_t)count reason:(YYCacheEvictionReason)reason stripe:(NSUInteger)stripe {
+    if (count == 0 || reason >= kYYCacheEvictionReasonCount) return;
+    _YYCacheCounterAdd(&_stripes[stripe & _stripeMask].evictions[reason], count);
+}
+
+- (YYCacheStatistics *)snapshot {
+    YYCacheStatistics *statistics = [YYCacheStatistics new];
+    for (NSUInteger i = 0; i < _stripeCount; i++) {
+        [statistics _addStripe:&_stripes[i]];
+    }
+    return statistics;
+}
+
+- (void)reset {
+    for (NSUInteger i = 0; i < _stripeCount; i++) {
+        uint64_t *counters = (uint64_t *)&_stripes[i];
+        NSUInteger n = sizeof(_YYCacheStatisticsStripe) / sizeof(uint64_t);
+        for (NSUInteger j = 0; j < n; j++) {
+            __atomic_store_n(&counters[j], 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+@end
@@ -11,6 +11,14 @@
 
 #import <Foundation/Foundation.h>
 
+#if __has_include(<YYKit/YYKit.h>)
+#import <YYKit/YYKVStorage.h>
+#else
+#import "YYKVStorage.h"
+#endif
+
+@class YYCacheStatistics;
+
 NS_ASSUME_NONNULL_BEGIN
 
 /**
@@ -70,6 +78,17 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nullable, copy) id (^customUnarchiveBlock)(NSData *data);
 
+/**
+ If `YES` (and `customArchiveBlock` is nil), the objects are archived with 
+ `YYCacheBinaryCodec` instead of NSKeyedArchiver, which is much faster for 
+ property-list-shaped objects and YYModel models. Default is NO.
+ 
+ @discussion The data written by YYCacheBinaryCodec is detected by its header when
+ unarchiving (if `customUnarchiveBlock` is nil), so you can turn this on or off
+ for an existing cache, the objects archived in either way can be read.
+ */
+@property BOOL binaryCodecEnabled;
+
 /**
  When an object needs to be saved as a file, this block will be invoked to generate
  a file name for a specified key. If the block is nil, the cache use md5(key) as 
@@ -79,6 +98,66 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nullable, copy) NSString *(^customFileNameBlock)(NSString *key);
 
+/**
+ If `YES`, the writes are queued and committed to sqlite in batches (within
+ about 50 ms), which reduces the write amplification on flash.
+ The queue is also flushed when the app enters background. Default is NO.
+ 
+ @discussion The queued writes are lost if the app crashes before they are flushed.
+ */
+@property BOOL writeBehindEnabled;
+
+/**
+ If `YES`, the large values stored in files are read with `mmap` instead of being
+ copied to heap, this reduces the memory peak when decoding large objects (e.g.
+ images). Default is NO. See `YYKVStorage.mappedReadsEnabled` for more information.
+ */
+@property BOOL mappedReadsEnabled;
+
+/**
+ If `YES`, the objects stored in files are named by a hash of the archived data
+ instead of the key, so the objects with same data share one file. The file is
+ deleted when the last key using it is removed. Default is NO.
+ 
+ @discussion This is useful when same data is cached with many keys (e.g. same 
+ image with different URLs). The `customFileNameBlock` is ignored in this mode.
+ The `totalCost` and `costLimit` still count the data of each key. You should set
+ this property before using the cache.
+ */
+@property BOOL deduplicationEnabled;
+
+/**
+ The codec used to compress the archived data. Default is YYKVStorageCompressionNone.
+ 
+ @discussion The data smaller than `compressionSizeThreshold` or already compressed 
+ (e.g. image data) is stored as it is. The `totalCost` and `costLimit` count the 
+ compressed size, and the `totalLogicalCost` counts the size before compression.
+ See `YYKVStorage.compression` for more information.
+ */
+@property YYKVStorageCompression compression;
+
+/// The data smaller than this size (in bytes) is not compressed. Default is 1024.
+@property NSUInteger compressionSizeThreshold;
+
+/**
+ The rate limit of removing the deleted files in background. Default is 256 files
+ and 32MB per second, 0 means no limit. The removal is also paused while the reads
+ of this cache are slow. See `YYKVStorage.trashPurgeFilesPerSecond` for more information.
+ */
+@property NSUInteger trashPurgeFilesPerSecond;
+@property NSUInteger trashPurgeBytesPerSecond;
+
+/**
+ The number of sqlite connections for concurrent reads. Default is 0, the maximum is 16.
+ 
+ @discussion When it's 0, all the operations of the cache are serialized. Otherwise
+ `objectForKey:`, `objectsForKeys:` and `containsObjectForKey:` can run at the same
+ time (each of them uses a connection in the pool), only the writes and trims are 
+ serialized. Each connection has its own sqlite page cache. 
+ See `YYKVStorage.readerConnectionCount` for more information.
+ */
+@property NSUInteger readerConnectionCount;
+
 
 
 #pragma mark - Limit
@@ -153,7 +232,7 @@ NS_ASSUME_NONNULL_BEGIN
 - (nullable instancetype)initWithPath:(NSString *)path;
 
 /**
- The designated initializer.
+ Create a new cache based on the specified path and inline threshold.
  
  @param path       Full path of a directory in which the cache will write data.
      Once initialized you should not read and write to this directory.
@@ -171,7 +250,35 @@ NS_ASSUME_NONNULL_BEGIN
      this method will return it directly, instead of creating a new instance.
  */
 - (nullable instancetype)initWithPath:(NSString *)path
-                      inlineThreshold:(NSUInteger)threshold NS_DESIGNATED_INITIALIZER;
+                      inlineThreshold:(NSUInteger)threshold;
+
+/**
+ The designated initializer.
+ 
+ @param path       Full path of a directory in which the cache will write data.
+     Once initialized you should not read and write to this directory.
+ 
+ @param threshold  The data store inline threshold in bytes, see `initWithPath:inlineThreshold:`.
+ 
+ @param lazyOpen   Whether to open the storage lazily. If YES, this method returns
+     immediately, the storage (sqlite and directories) is opened in background by
+     the first operation, and the operations wait until it's opened. Before that,
+     `objectForKey:`, `objectsForKeys:` and `containsObjectForKey:` return the
+     definite misses immediately with a key filter persisted by the last launch.
+     The first operation which is not answered by the filter blocks until the
+     storage is opened (it may take tens of milliseconds for a large cache), so
+     use the block-based methods in main thread.
+     Use it for a large cache which is not needed at app launch.
+ 
+ @return A new cache object, or nil if an error occurs. With lazy open, the error
+     of opening the storage is not reported, all operations fail silently.
+ 
+ @warning If the cache instance for the specified path already exists in memory,
+     this method will return it directly, instead of creating a new instance.
+ */
+- (nullable instancetype)initWithPath:(NSString *)path
+                      inlineThreshold:(NSUInteger)threshold
+                             lazyOpen:(BOOL)lazyOpen NS_DESIGNATED_INITIALIZER;
 
 
 #pragma mark - Access Methods
@@ -236,6 +343,50 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)setObject:(nullable id<NSCoding>)object forKey:(NSString *)key withBlock:(void(^)(void))block;
 
+/**
+ Returns the values associated with the given keys.
+ This method may blocks the calling thread until file read finished.
+ 
+ @discussion The items are read with one sqlite query for each 256 keys, and
+ the access time of the found items is updated once per query.
+ 
+ @param keys An array of keys.
+ @return A dictionary which key is the found key and value is the object, the 
+    missing keys are not included.
+ */
+- (NSDictionary<NSString *, id<NSCoding>> *)objectsForKeys:(NSArray<NSString *> *)keys;
+
+/**
+ Returns the values associated with the given keys.
+ This method returns immediately and invoke the passed block in background queue
+ when the operation finished.
+ 
+ @param keys  An array of keys.
+ @param block A block which will be invoked in background queue when finished.
+ */
+- (void)objectsForKeys:(NSArray<NSString *> *)keys withBlock:(void(^)(NSDictionary<NSString *, id<NSCoding>> *objects))block;
+
+/**
+ Sets the values of the specified keys in the cache, in one transaction.
+ This method may blocks the calling thread until file write finished.
+ 
+ @param objects The objects to be stored in the cache.
+ @param keys    The keys with which to associate the objects, the count should be 
+    same as `objects`.
+ */
+- (void)setObjects:(NSArray<id<NSCoding>> *)objects forKeys:(NSArray<NSString *> *)keys;
+
+/**
+ Sets the values of the specified keys in the cache, in one transaction.
+ This method returns immediately and invoke the passed block in background queue
+ when the operation finished.
+ 
+ @param objects The objects to be stored in the cache.
+ @param keys    The keys with which to associate the objects.
+ @param block   A block which will be invoked in background queue when finished.
+ */
+- (void)setObjects:(NSArray<id<NSCoding>> *)objects forKeys:(NSArray<NSString *> *)keys withBlock:(void(^)(void))block;
+
 /**
  Removes the value of the specified key in the cache.
  This method may blocks the calling thread until file delete finished.
@@ -315,6 +466,23 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)totalCostWithBlock:(void(^)(NSInteger totalCost))block;
 
+/**
+ Returns the total size (in bytes) of objects in this cache before compression.
+ This method may blocks the calling thread until file read finished.
+ 
+ @return The total objects size in bytes.
+ */
+- (NSInteger)totalLogicalCost;
+
+/**
+ Get the total size (in bytes) of objects in this cache before compression.
+ This method returns immediately and invoke the passed block in background queue
+ when the operation finished.
+ 
+ @param block  A block which will be invoked in background queue when finished.
+ */
+- (void)totalLogicalCostWithBlock:(void(^)(NSInteger totalLogicalCost))block;
+
 
 #pragma mark - Trim
 ///=============================================================================
@@ -376,6 +544,31 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)trimToAge:(NSTimeInterval)age withBlock:(void(^)(void))block;
 
 
+#pragma mark - Statistics
+///=============================================================================
+/// @name Statistics
+///=============================================================================
+
+/**
+ A snapshot of the cache's statistics: hits, misses, evictions by reason, the
+ bytes of read and written data, and the latency of `objectForKey:` and 
+ `setObject:forKey:` (including archiving).
+ 
+ @discussion The evictions are counted when the cache is trimmed, objects
+ removed by `removeObjectForKey:` or `removeAllObjects` are not counted.
+ */
+@property (readonly) YYCacheStatistics *statistics;
+
+/** Reset the statistics to zero. */
+- (void)resetStatistics;
+
+/**
+ The latency histogram of the file reads while the deleted files are being 
+ removed in background. Reset by `resetStatistics`.
+ */
+@property (readonly) YYCacheLatencyHistogram *trashPurgeReadLatency;
+
+
 #pragma mark - Extended Data
 ///=============================================================================
 /// @name Extended Data
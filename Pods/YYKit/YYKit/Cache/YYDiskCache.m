@@ -11,16 +11,33 @@
 
 #import "YYDiskCache.h"
 #import "YYKVStorage.h"
+#import "YYCacheStatistics.h"
+#import "YYCacheBinaryCodec.h"
+#import "YYCacheKeyFilter.h"
 #import "NSString+YYAdd.h"
 #import "UIDevice+YYAdd.h"
+#import "UIApplication+YYAdd.h"
 #import <objc/runtime.h>
 #import <time.h>
+#import <pthread.h>
 
-#define Lock() dispatch_semaphore_wait(self->_lock, DISPATCH_TIME_FOREVER)
-#define Unlock() dispatch_semaphore_signal(self->_lock)
+#define Lock() do { [self _waitForOpen]; pthread_rwlock_wrlock(&self->_lock); } while (0)
+#define ReadLock() [self _readLock]
+#define Unlock() pthread_rwlock_unlock(&self->_lock)
 
 static const int extended_data_key;
 
+/// The maximum number of keys in one sqlite query of a batch access
+/// (sqlite limits the number of variables in a statement).
+static const NSUInteger kYYDiskCacheBatchSize = 256;
+
+/// The time of each step of the reconciliation after a crash, the lock is
+/// released for the same time between two steps.
+static const NSTimeInterval kYYDiskCacheReconcileStepTime = 0.005;
+
+/// The key filter file of a lazily opened cache, it exists only if it has all keys.
+static NSString *const kYYDiskCacheKeyFilterFileName = @"manifest.filter";
+
 /// Free disk space in bytes.
 static int64_t _YYDiskSpaceFree() {
     NSError *error = nil;
@@ -31,6 +48,68 @@ static int64_t _YYDiskSpaceFree() {
     return space;
 }
 
+static inline uint64_t _YYRotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t _YYFmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+/// A fast 128-bit content hash (MurmurHash3 x64_128), it's not cryptographic.
+static void _YYDiskCacheContentHash(NSData *data, uint64_t hash[2]) {
+    const uint8_t *bytes = data.bytes;
+    NSUInteger length = data.length;
+    NSUInteger blockCount = length / 16;
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    uint64_t h1 = 0, h2 = 0;
+    
+    for (NSUInteger i = 0; i < blockCount; i++) {
+        uint64_t k1, k2;
+        memcpy(&k1, bytes + i * 16, 8);
+        memcpy(&k2, bytes + i * 16 + 8, 8);
+        k1 *= c1; k1 = _YYRotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = _YYRotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = _YYRotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = _YYRotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+    
+    const uint8_t *tail = bytes + blockCount * 16;
+    uint64_t k1 = 0, k2 = 0;
+    switch (length & 15) {
+        case 15: k2 ^= (uint64_t)tail[14] << 48;
+        case 14: k2 ^= (uint64_t)tail[13] << 40;
+        case 13: k2 ^= (uint64_t)tail[12] << 32;
+        case 12: k2 ^= (uint64_t)tail[11] << 24;
+        case 11: k2 ^= (uint64_t)tail[10] << 16;
+        case 10: k2 ^= (uint64_t)tail[9] << 8;
+        case 9:  k2 ^= (uint64_t)tail[8];
+            k2 *= c2; k2 = _YYRotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        case 8:  k1 ^= (uint64_t)tail[7] << 56;
+        case 7:  k1 ^= (uint64_t)tail[6] << 48;
+        case 6:  k1 ^= (uint64_t)tail[5] << 40;
+        case 5:  k1 ^= (uint64_t)tail[4] << 32;
+        case 4:  k1 ^= (uint64_t)tail[3] << 24;
+        case 3:  k1 ^= (uint64_t)tail[2] << 16;
+        case 2:  k1 ^= (uint64_t)tail[1] << 8;
+        case 1:  k1 ^= (uint64_t)tail[0];
+            k1 *= c1; k1 = _YYRotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+    
+    h1 ^= length; h2 ^= length;
+    h1 += h2; h2 += h1;
+    h1 = _YYFmix64(h1); h2 = _YYFmix64(h2);
+    h1 += h2; h2 += h1;
+    hash[0] = h1;
+    hash[1] = h2;
+}
+
 
 /// weak reference for all instances
 static NSMapTable *_globalInstances;
@@ -65,8 +144,145 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 
 @implementation YYDiskCache {
     YYKVStorage *_kv;
-    dispatch_semaphore_t _lock;
+    pthread_rwlock_t _lock; ///< shared by reads if the storage has reader connections, otherwise exclusive
     dispatch_queue_t _queue;
+    YYCacheStatisticsRecorder *_statistics;
+    BOOL _flushScheduled; ///< a flush of write-behind queue is scheduled, guarded by lock
+    BOOL _deduplicationEnabled;
+    NSUInteger _readerConnectionCount; ///< guarded by lock
+    
+    // lazy open
+    dispatch_group_t _openGroup;       ///< entered until the storage is opened, nil if it's opened in init
+    int _openStarted;                  ///< accessed atomically
+    YYCacheKeyFilter *_keyFilter;      ///< keys of the storage, nil if not lazy open or not built yet
+    NSString *_keyFilterPath;
+    BOOL _keyFilterPersisted;          ///< whether the file is same as _keyFilter, guarded by lock
+}
+
+#pragma mark - lazy open
+
+/// Start opening the storage if it's not opened, and wait until it's opened.
+- (void)_waitForOpen {
+    if (!_openGroup) return;
+    if (__atomic_exchange_n(&_openStarted, 1, __ATOMIC_ACQ_REL) == 0) {
+        dispatch_group_t group = _openGroup;
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [self _open];
+            dispatch_group_leave(group);
+        });
+    }
+    dispatch_group_wait(_openGroup, DISPATCH_TIME_FOREVER);
+}
+
+- (BOOL)_isOpened {
+    return !_openGroup || dispatch_group_wait(_openGroup, DISPATCH_TIME_NOW) == 0;
+}
+
+- (YYKVStorageType)_storageType {
+    if (_inlineThreshold == 0) {
+        return YYKVStorageTypeFile;
+    } else if (_inlineThreshold == NSUIntegerMax) {
+        return YYKVStorageTypeSQLite;
+    } else {
+        return YYKVStorageTypeMixed;
+    }
+}
+
+/// Open the storage, no one accesses `_kv` before it's finished.
+- (void)_open {
+    _kv = [[YYKVStorage alloc] initWithPath:_path type:[self _storageType]];
+    if (!_kv) return;
+    [self _reconcileInBackground];
+    if (!_keyFilter) {
+        __weak typeof(self) _self = self;
+        dispatch_async(_queue, ^{
+            __strong typeof(_self) self = _self;
+            if (!self) return;
+            Lock();
+            [self _keyFilterRebuild];
+            Unlock();
+        });
+    }
+}
+
+/// Whether the key is definitely not in the cache, checked only before the storage is opened.
+/// The filter is read in lock without waiting for the open: once the storage is opened, the
+/// filter may be changed or replaced in lock.
+- (BOOL)_keyFilterRejectsKey:(NSString *)key {
+    if ([self _isOpened]) return NO;
+    pthread_rwlock_rdlock(&_lock);
+    BOOL rejects = _keyFilter && ![_keyFilter mayContainKey:key];
+    pthread_rwlock_unlock(&_lock);
+    return rejects;
+}
+
+/// Remove the file before the filter is changed, the file should never miss a key, should be called in lock.
+- (void)_keyFilterWillChange {
+    if (!_keyFilterPersisted) return;
+    _keyFilterPersisted = NO;
+    [[NSFileManager defaultManager] removeItemAtPath:_keyFilterPath error:NULL];
+}
+
+/// Get the keys which may be in the cache, checked only before the storage is opened.
+- (NSArray *)_keyFilterKeysMayExist:(NSArray *)keys {
+    if ([self _isOpened]) return keys;
+    pthread_rwlock_rdlock(&_lock);
+    NSArray *result = keys;
+    if (_keyFilter) {
+        NSMutableArray *mayExist = [NSMutableArray new];
+        for (NSString *key in keys) {
+            if ([_keyFilter mayContainKey:key]) [mayExist addObject:key];
+        }
+        result = mayExist;
+    }
+    pthread_rwlock_unlock(&_lock);
+    return result;
+}
+
+/// Should be called in lock.
+- (void)_keyFilterAddKey:(NSString *)key {
+    if (!_keyFilter) return;
+    [self _keyFilterWillChange];
+    [_keyFilter addKey:key];
+}
+
+/// Should be called in lock.
+- (void)_keyFilterPersist {
+    if (!_keyFilter || _keyFilterPersisted) return;
+    _keyFilterPersisted = [_keyFilter writeToFile:_keyFilterPath];
+}
+
+/// Should be called in lock.
+- (void)_keyFilterRemoveAllKeys {
+    if (!_keyFilter) return;
+    [self _keyFilterWillChange];
+    [_keyFilter removeAllKeys];
+}
+
+/// Build the filter with all keys in the storage, should be called in lock.
+- (void)_keyFilterRebuild {
+    int count = [_kv getItemsCount];
+    if (count < 0) return;
+    YYCacheKeyFilter *filter = [[YYCacheKeyFilter alloc] initWithCapacity:(NSUInteger)count * 2];
+    if (!filter) return;
+    if (![_kv enumerateKeysUsingBlock:^(NSString *key) { [filter addKey:key]; }]) return;
+    [self _keyFilterWillChange];
+    _keyFilter = filter;
+    [self _keyFilterPersist];
+}
+
+#pragma mark - private
+
+/// Lock for a read, it's shared only if the storage can read concurrently.
+- (void)_readLock {
+    [self _waitForOpen];
+    if (_readerConnectionCount > 0) {
+        pthread_rwlock_rdlock(&_lock);
+        // the storage may lose its readers when it reopens the database (e.g. `removeAllItems`)
+        if (_readerConnectionCount > 0 && _kv.readerConnectionCount > 0) return;
+        pthread_rwlock_unlock(&_lock); // disabled before locked
+    }
+    pthread_rwlock_wrlock(&_lock);
 }
 
 - (void)_trimRecursively {
@@ -84,41 +300,68 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     dispatch_async(_queue, ^{
         __strong typeof(_self) self = _self;
         if (!self) return;
+        if (![self _isOpened]) return; // nothing to trim before the first operation
         Lock();
+        [self->_kv flushAccessTimes];
         [self _trimToCost:self.costLimit];
         [self _trimToCount:self.countLimit];
         [self _trimToAge:self.ageLimit];
         [self _trimToFreeDiskSpace:self.freeDiskSpaceLimit];
+        [self->_kv compactSegments];
+        if (self->_keyFilter.isSaturated) [self _keyFilterRebuild];
         Unlock();
     });
 }
 
+- (void)_reconcileInBackground {
+    __weak typeof(self) _self = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kYYDiskCacheReconcileStepTime * NSEC_PER_SEC)), _queue, ^{
+        __strong typeof(_self) self = _self;
+        if (!self) return;
+        Lock();
+        BOOL finished = [self->_kv reconcileWithTimeLimit:kYYDiskCacheReconcileStepTime];
+        Unlock();
+        if (!finished) [self _reconcileInBackground];
+    });
+}
+
 - (void)_trimToCost:(NSUInteger)costLimit {
-    if (costLimit >= INT_MAX) return;
-    [_kv removeItemsToFitSize:(int)costLimit];
-    
+    [self _trimToCost:costLimit reason:YYCacheEvictionReasonCost];
+}
+
+- (void)_trimToCost:(NSUInteger)costLimit reason:(YYCacheEvictionReason)reason {
+    if (costLimit == NSUIntegerMax || costLimit >= INT64_MAX) return;
+    int count = [_kv getItemsCount];
+    [_kv removeItemsToFitTotalSize:(int64_t)costLimit];
+    [self _recordEvictionsWithCountBefore:count reason:reason];
 }
 
 - (void)_trimToCount:(NSUInteger)countLimit {
     if (countLimit >= INT_MAX) return;
+    int count = [_kv getItemsCount];
     [_kv removeItemsToFitCount:(int)countLimit];
+    [self _recordEvictionsWithCountBefore:count reason:YYCacheEvictionReasonCount];
 }
 
 - (void)_trimToAge:(NSTimeInterval)ageLimit {
     if (ageLimit <= 0) {
+        int count = [_kv getItemsCount];
         [_kv removeAllItems];
+        if (count > 0) [_statistics recordEvictions:count reason:YYCacheEvictionReasonAge stripe:0];
         return;
     }
     long timestamp = time(NULL);
     if (timestamp <= ageLimit) return;
     long age = timestamp - ageLimit;
     if (age >= INT_MAX) return;
+    int count = [_kv getItemsCount];
     [_kv removeItemsEarlierThanTime:(int)age];
+    [self _recordEvictionsWithCountBefore:count reason:YYCacheEvictionReasonAge];
 }
 
 - (void)_trimToFreeDiskSpace:(NSUInteger)targetFreeDiskSpace {
     if (targetFreeDiskSpace == 0) return;
-    int64_t totalBytes = [_kv getItemsSize];
+    int64_t totalBytes = [_kv getItemsTotalSize];
     if (totalBytes <= 0) return;
     int64_t diskFreeBytes = _YYDiskSpaceFree();
     if (diskFreeBytes < 0) return;
@@ -126,7 +369,104 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     if (needTrimBytes <= 0) return;
     int64_t costLimit = totalBytes - needTrimBytes;
     if (costLimit < 0) costLimit = 0;
-    [self _trimToCost:(int)costLimit];
+    [self _trimToCost:(NSUInteger)costLimit reason:YYCacheEvictionReasonFreeDiskSpace];
+}
+
+- (void)_recordEvictionsWithCountBefore:(int)count reason:(YYCacheEvictionReason)reason {
+    if (count <= 0) return;
+    int left = [_kv getItemsCount];
+    if (left >= 0 && left < count) [_statistics recordEvictions:count - left reason:reason stripe:0];
+}
+
+/// Unarchive the object from an item, returns nil if failed.
+- (id)_objectFromItem:(YYKVStorageItem *)item {
+    if (!item.value) return nil;
+    id object = nil;
+    if (_customUnarchiveBlock) {
+        object = _customUnarchiveBlock(item.value);
+    } else if ([YYCacheBinaryCodec isBinaryData:item.value]) {
+        object = [YYCacheBinaryCodec objectWithData:item.value];
+    } else {
+        @try {
+            object = [NSKeyedUnarchiver unarchiveObjectWithData:item.value];
+        }
+        @catch (NSException *exception) {
+            // nothing to do...
+        }
+    }
+    if (object && item.extendedData) {
+        [YYDiskCache setExtendedData:item.extendedData toObject:object];
+    }
+    return object;
+}
+
+/// Archive an object to an item, returns nil if failed.
+- (YYKVStorageItem *)_itemWithObject:(id<NSCoding>)object forKey:(NSString *)key {
+    NSData *value = nil;
+    if (_customArchiveBlock) {
+        value = _customArchiveBlock(object);
+    } else if (_binaryCodecEnabled) {
+        value = [YYCacheBinaryCodec dataWithObject:object];
+    } else {
+        @try {
+            value = [NSKeyedArchiver archivedDataWithRootObject:object];
+        }
+        @catch (NSException *exception) {
+            // nothing to do...
+        }
+    }
+    if (!value) return nil;
+    YYKVStorageItem *item = [YYKVStorageItem new];
+    item.key = key;
+    item.value = value;
+    item.extendedData = [YYDiskCache getExtendedDataFromObject:object];
+    if ([self _storageType] != YYKVStorageTypeSQLite) { // `_kv` may be still opening
+        if (value.length > _inlineThreshold) {
+            item.filename = _deduplicationEnabled ? [self _filenameForContent:value] : [self _filenameForKey:key];
+        }
+    }
+    return item;
+}
+
+/// Schedule a flush of the storage's write-behind queue, should be called in lock.
+- (void)_scheduleFlushIfNeeded {
+    if (_flushScheduled || !_kv.hasPendingWrites) return;
+    _flushScheduled = YES;
+    __weak typeof(self) _self = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_kv.writeBehindInterval * NSEC_PER_SEC)), _queue, ^{
+        __strong typeof(_self) self = _self;
+        if (!self) return;
+        Lock();
+        self->_flushScheduled = NO;
+        [self->_kv flushPendingWrites];
+        Unlock();
+    });
+}
+
+- (void)_appDidEnterBackgroundNotification {
+    if (![self _isOpened]) return;
+    // The app may be killed in background without a notification, so end the session
+    // now. It's done in the queue (the main thread doesn't wait for the lock), in a
+    // background task. The task ID is only accessed in main thread.
+    UIApplication *application = [UIApplication sharedExtensionApplication];
+    __block UIBackgroundTaskIdentifier taskID = UIBackgroundTaskInvalid;
+    void (^endTask)(void) = ^{
+        if (taskID == UIBackgroundTaskInvalid) return;
+        [application endBackgroundTask:taskID];
+        taskID = UIBackgroundTaskInvalid;
+    };
+    taskID = [application beginBackgroundTaskWithName:@"com.ibireme.cache.disk" expirationHandler:endTask];
+    __weak typeof(self) _self = self;
+    dispatch_async(_queue, ^{
+        __strong typeof(_self) self = _self;
+        if (self) {
+            Lock();
+            [self->_kv endSession];
+            [self _keyFilterPersist];
+            Unlock();
+        }
+        dispatch_async(dispatch_get_main_queue(), endTask);
+    });
 }
 
 - (NSString *)_filenameForKey:(NSString *)key {
@@ -136,6 +476,12 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     return filename;
 }
 
+- (NSString *)_filenameForContent:(NSData *)value {
+    uint64_t hash[2];
+    _YYDiskCacheContentHash(value, hash);
+    return [NSString stringWithFormat:@"%016llx%016llx-%lu", hash[0], hash[1], (unsigned long)value.length];
+}
+
 #pragma mark - public
 
 - (instancetype)init {
@@ -149,29 +495,43 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 
 - (instancetype)initWithPath:(NSString *)path
              inlineThreshold:(NSUInteger)threshold {
+    return [self initWithPath:path inlineThreshold:threshold lazyOpen:NO];
+}
+
+- (instancetype)initWithPath:(NSString *)path
+             inlineThreshold:(NSUInteger)threshold
+                    lazyOpen:(BOOL)lazyOpen {
     self = [super init];
     if (!self) return nil;
+    pthread_rwlock_init(&_lock, NULL); // destroyed in dealloc, even if returns early
+    if (path.length == 0) return nil;
     
     YYDiskCache *globalCache = _YYDiskCacheGetGlobal(path);
     if (globalCache) return globalCache;
     
-    YYKVStorageType type;
-    if (threshold == 0) {
-        type = YYKVStorageTypeFile;
-    } else if (threshold == NSUIntegerMax) {
-        type = YYKVStorageTypeSQLite;
+    _path = path;
+    _inlineThreshold = threshold;
+    if (lazyOpen) {
+        _openGroup = dispatch_group_create();
+        dispatch_group_enter(_openGroup); // left by `_waitForOpen` after the storage is opened
+        _keyFilterPath = [path stringByAppendingPathComponent:kYYDiskCacheKeyFilterFileName];
+        _keyFilter = [YYCacheKeyFilter filterWithContentsOfFile:_keyFilterPath];
+        if (_keyFilter.isSaturated) {
+            // rebuilt after opened, it's not replaced while the early reads may use it
+            [[NSFileManager defaultManager] removeItemAtPath:_keyFilterPath error:NULL];
+            _keyFilter = nil;
+        }
+        _keyFilterPersisted = _keyFilter != nil;
     } else {
-        type = YYKVStorageTypeMixed;
+        YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:path type:[self _storageType]];
+        if (!kv) return nil;
+        _kv = kv;
+        // the keys added in this session are not in the filter, a later lazy open must not use it
+        unlink([path stringByAppendingPathComponent:kYYDiskCacheKeyFilterFileName].fileSystemRepresentation);
     }
     
-    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:path type:type];
-    if (!kv) return nil;
-    
-    _kv = kv;
-    _path = path;
-    _lock = dispatch_semaphore_create(1);
     _queue = dispatch_queue_create("com.ibireme.cache.disk", DISPATCH_QUEUE_CONCURRENT);
-    _inlineThreshold = threshold;
+    _statistics = [YYCacheStatisticsRecorder new];
     _countLimit = NSUIntegerMax;
     _costLimit = NSUIntegerMax;
     _ageLimit = DBL_MAX;
@@ -179,13 +539,131 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     _autoTrimInterval = 60;
     
     [self _trimRecursively];
+    if (!lazyOpen) [self _reconcileInBackground];
     _YYDiskCacheSetGlobal(self);
+    
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_appDidEnterBackgroundNotification) name:UIApplicationDidEnterBackgroundNotification object:nil];
     return self;
 }
 
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidEnterBackgroundNotification object:nil];
+    if (_openGroup && __atomic_exchange_n(&_openStarted, 1, __ATOMIC_ACQ_REL) == 0) {
+        dispatch_group_leave(_openGroup); // never opened
+    }
+    pthread_rwlock_destroy(&_lock);
+}
+
+- (BOOL)writeBehindEnabled {
+    Lock();
+    BOOL enabled = _kv.writeBehindEnabled;
+    Unlock();
+    return enabled;
+}
+
+- (void)setWriteBehindEnabled:(BOOL)writeBehindEnabled {
+    Lock();
+    _kv.writeBehindEnabled = writeBehindEnabled;
+    Unlock();
+}
+
+- (BOOL)mappedReadsEnabled {
+    Lock();
+    BOOL enabled = _kv.mappedReadsEnabled;
+    Unlock();
+    return enabled;
+}
+
+- (void)setMappedReadsEnabled:(BOOL)mappedReadsEnabled {
+    Lock();
+    _kv.mappedReadsEnabled = mappedReadsEnabled;
+    Unlock();
+}
+
+- (BOOL)deduplicationEnabled {
+    Lock();
+    BOOL enabled = _deduplicationEnabled;
+    Unlock();
+    return enabled;
+}
+
+- (void)setDeduplicationEnabled:(BOOL)deduplicationEnabled {
+    Lock();
+    _deduplicationEnabled = deduplicationEnabled;
+    _kv.sharedFilesEnabled = deduplicationEnabled;
+    Unlock();
+}
+
+- (YYKVStorageCompression)compression {
+    Lock();
+    YYKVStorageCompression compression = _kv.compression;
+    Unlock();
+    return compression;
+}
+
+- (void)setCompression:(YYKVStorageCompression)compression {
+    Lock();
+    _kv.compression = compression;
+    Unlock();
+}
+
+- (NSUInteger)compressionSizeThreshold {
+    Lock();
+    NSUInteger threshold = _kv.compressionSizeThreshold;
+    Unlock();
+    return threshold;
+}
+
+- (void)setCompressionSizeThreshold:(NSUInteger)compressionSizeThreshold {
+    Lock();
+    _kv.compressionSizeThreshold = compressionSizeThreshold;
+    Unlock();
+}
+
+- (NSUInteger)readerConnectionCount {
+    Lock();
+    NSUInteger count = _readerConnectionCount;
+    Unlock();
+    return count;
+}
+
+- (void)setReaderConnectionCount:(NSUInteger)readerConnectionCount {
+    Lock();
+    _kv.readerConnectionCount = readerConnectionCount;
+    _readerConnectionCount = _kv.readerConnectionCount;
+    Unlock();
+}
+
+- (NSUInteger)trashPurgeFilesPerSecond {
+    Lock();
+    NSUInteger rate = _kv.trashPurgeFilesPerSecond;
+    Unlock();
+    return rate;
+}
+
+- (void)setTrashPurgeFilesPerSecond:(NSUInteger)trashPurgeFilesPerSecond {
+    Lock();
+    _kv.trashPurgeFilesPerSecond = trashPurgeFilesPerSecond;
+    Unlock();
+}
+
+- (NSUInteger)trashPurgeBytesPerSecond {
+    Lock();
+    NSUInteger rate = _kv.trashPurgeBytesPerSecond;
+    Unlock();
+    return rate;
+}
+
+- (void)setTrashPurgeBytesPerSecond:(NSUInteger)trashPurgeBytesPerSecond {
+    Lock();
+    _kv.trashPurgeBytesPerSecond = trashPurgeBytesPerSecond;
+    Unlock();
+}
+
 - (BOOL)containsObjectForKey:(NSString *)key {
     if (!key) return NO;
-    Lock();
+    if ([self _keyFilterRejectsKey:key]) return NO;
+    ReadLock();
     BOOL contains = [_kv itemExistsForKey:key];
     Unlock();
     return contains;
@@ -203,25 +681,16 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 
 - (id<NSCoding>)objectForKey:(NSString *)key {
     if (!key) return nil;
-    Lock();
+    uint64_t begin = YYCacheStatisticsTime();
+    if ([self _keyFilterRejectsKey:key]) {
+        [_statistics recordGetWithHit:NO bytes:0 latency:YYCacheStatisticsTime() - begin stripe:0];
+        return nil;
+    }
+    ReadLock();
     YYKVStorageItem *item = [_kv getItemForKey:key];
     Unlock();
-    if (!item.value) return nil;
-    
-    id object = nil;
-    if (_customUnarchiveBlock) {
-        object = _customUnarchiveBlock(item.value);
-    } else {
-        @try {
-            object = [NSKeyedUnarchiver unarchiveObjectWithData:item.value];
-        }
-        @catch (NSException *exception) {
-            // nothing to do...
-        }
-    }
-    if (object && item.extendedData) {
-        [YYDiskCache setExtendedData:item.extendedData toObject:object];
-    }
+    id object = [self _objectFromItem:item];
+    [_statistics recordGetWithHit:object != nil bytes:item.value.length latency:YYCacheStatisticsTime() - begin stripe:0];
     return object;
 }
 
@@ -242,36 +711,89 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
         return;
     }
     
-    NSData *extendedData = [YYDiskCache getExtendedDataFromObject:object];
-    NSData *value = nil;
-    if (_customArchiveBlock) {
-        value = _customArchiveBlock(object);
-    } else {
-        @try {
-            value = [NSKeyedArchiver archivedDataWithRootObject:object];
-        }
-        @catch (NSException *exception) {
-            // nothing to do...
+    uint64_t begin = YYCacheStatisticsTime();
+    YYKVStorageItem *item = [self _itemWithObject:object forKey:key];
+    if (!item) return;
+    
+    Lock();
+    [self _keyFilterAddKey:key];
+    [_kv saveItem:item];
+    [self _scheduleFlushIfNeeded];
+    Unlock();
+    [_statistics recordSetWithBytes:item.value.length latency:YYCacheStatisticsTime() - begin stripe:0];
+}
+
+- (void)setObject:(id<NSCoding>)object forKey:(NSString *)key withBlock:(void(^)(void))block {
+    __weak typeof(self) _self = self;
+    dispatch_async(_queue, ^{
+        __strong typeof(_self) self = _self;
+        [self setObject:object forKey:key];
+        if (block) block();
+    });
+}
+
+- (NSDictionary *)objectsForKeys:(NSArray *)keys {
+    if (keys.count == 0) return @{};
+    uint64_t begin = YYCacheStatisticsTime();
+    NSMutableDictionary *objects = [NSMutableDictionary new];
+    uint64_t bytes = 0;
+    NSArray *readKeys = [self _keyFilterKeysMayExist:keys];
+    for (NSUInteger location = 0; location < readKeys.count; location += kYYDiskCacheBatchSize) {
+        NSRange range = NSMakeRange(location, MIN(kYYDiskCacheBatchSize, readKeys.count - location));
+        NSArray *batch = [readKeys subarrayWithRange:range];
+        ReadLock();
+        NSArray *items = [_kv getItemForKeys:batch];
+        Unlock();
+        for (YYKVStorageItem *item in items) {
+            id object = [self _objectFromItem:item];
+            if (object && item.key) {
+                objects[item.key] = object;
+                bytes += item.value.length;
+            }
         }
     }
-    if (!value) return;
-    NSString *filename = nil;
-    if (_kv.type != YYKVStorageTypeSQLite) {
-        if (value.length > _inlineThreshold) {
-            filename = [self _filenameForKey:key];
-        }
+    [_statistics recordGetsWithHitCount:objects.count missCount:keys.count - objects.count
+                                  bytes:bytes latency:YYCacheStatisticsTime() - begin stripe:0];
+    return objects;
+}
+
+- (void)objectsForKeys:(NSArray *)keys withBlock:(void(^)(NSDictionary *objects))block {
+    if (!block) return;
+    __weak typeof(self) _self = self;
+    dispatch_async(_queue, ^{
+        __strong typeof(_self) self = _self;
+        NSDictionary *objects = [self objectsForKeys:keys];
+        block(objects ?: @{});
+    });
+}
+
+- (void)setObjects:(NSArray *)objects forKeys:(NSArray *)keys {
+    NSUInteger count = MIN(objects.count, keys.count);
+    if (count == 0) return;
+    uint64_t begin = YYCacheStatisticsTime();
+    NSMutableArray *items = [NSMutableArray arrayWithCapacity:count];
+    uint64_t bytes = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        YYKVStorageItem *item = [self _itemWithObject:objects[i] forKey:keys[i]];
+        if (!item) continue;
+        [items addObject:item];
+        bytes += item.value.length;
     }
+    if (items.count == 0) return;
     
     Lock();
-    [_kv saveItemWithKey:key value:value filename:filename extendedData:extendedData];
+    for (YYKVStorageItem *item in items) [self _keyFilterAddKey:item.key];
+    [_kv saveItems:items];
+    [self _scheduleFlushIfNeeded];
     Unlock();
+    [_statistics recordSetsWithCount:items.count bytes:bytes latency:YYCacheStatisticsTime() - begin stripe:0];
 }
 
-- (void)setObject:(id<NSCoding>)object forKey:(NSString *)key withBlock:(void(^)(void))block {
+- (void)setObjects:(NSArray *)objects forKeys:(NSArray *)keys withBlock:(void(^)(void))block {
     __weak typeof(self) _self = self;
     dispatch_async(_queue, ^{
         __strong typeof(_self) self = _self;
-        [self setObject:object forKey:key];
+        [self setObjects:objects forKeys:keys];
         if (block) block();
     });
 }
@@ -294,7 +816,7 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 
 - (void)removeAllObjects {
     Lock();
-    [_kv removeAllItems];
+    if ([_kv removeAllItems]) [self _keyFilterRemoveAllKeys];
     Unlock();
 }
 
@@ -341,9 +863,9 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
 
 - (NSInteger)totalCost {
     Lock();
-    int count = [_kv getItemsSize];
+    int64_t cost = [_kv getItemsTotalSize];
     Unlock();
-    return count;
+    return (NSInteger)cost;
 }
 
 - (void)totalCostWithBlock:(void(^)(NSInteger totalCost))block {
@@ -356,6 +878,41 @@ static void _YYDiskCacheSetGlobal(YYDiskCache *cache) {
     });
 }
 
+- (NSInteger)totalLogicalCost {
+    Lock();
+    int64_t cost = [_kv getItemsTotalLogicalSize];
+    Unlock();
+    return (NSInteger)cost;
+}
+
+- (void)totalLogicalCostWithBlock:(void(^)(NSInteger totalLogicalCost))block {
+    if (!block) return;
+    __weak typeof(self) _self = self;
+    dispatch_async(_queue, ^{
+        __strong typeof(_self) self = _self;
+        NSInteger totalLogicalCost = [self totalLogicalCost];
+        block(totalLogicalCost);
+    });
+}
+
+- (YYCacheStatistics *)statistics {
+    return [_statistics snapshot];
+}
+
+- (void)resetStatistics {
+    [_statistics reset];
+    Lock();
+    [_kv resetTrashPurgeStatistics];
+    Unlock();
+}
+
+- (YYCacheLatencyHistogram *)trashPurgeReadLatency {
+    Lock();
+    YYCacheLatencyHistogram *latency = _kv.trashPurgeReadLatency;
+    Unlock();
+    return latency;
+}
+
 - (void)trimToCount:(NSUInteger)count {
     Lock();
     [self _trimToCount:count];
@@ -11,6 +11,8 @@
 
 #import <Foundation/Foundation.h>
 
+@class YYCacheLatencyHistogram;
+
 NS_ASSUME_NONNULL_BEGIN
 
 /**
@@ -21,7 +23,7 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, strong) NSString *key;                ///< key
 @property (nonatomic, strong) NSData *value;                ///< value
 @property (nullable, nonatomic, strong) NSString *filename; ///< filename (nil if inline)
-@property (nonatomic) int size;                             ///< value's size in bytes
+@property (nonatomic) int size;                             ///< value's size in bytes (compressed size if compressed)
 @property (nonatomic) int modTime;                          ///< modification unix timestamp
 @property (nonatomic) int accessTime;                       ///< last access unix timestamp
 @property (nullable, nonatomic, strong) NSData *extendedData; ///< extended data (nil if no extended data)
@@ -40,6 +42,8 @@ NS_ASSUME_NONNULL_BEGIN
  * If you want to store large files (such as image cache),
    use YYKVStorageTypeFile to get better performance.
  * You can use YYKVStorageTypeMixed and choice your storage type for each item.
+ * If you want to store large number of medium datas (such as thumbnails), use
+   YYKVStorageTypeSegment to avoid the cost of creating and deleting a file per item.
  
  See <http://www.sqlite.org/intern-v-extern-blob.html> for more information.
  */
@@ -53,6 +57,25 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
     
     /// The `value` is stored in file system or sqlite based on your choice.
     YYKVStorageTypeMixed = 2,
+    
+    /// The `value` is appended to large segment files, sqlite stores its position.
+    YYKVStorageTypeSegment = 3,
+};
+
+/**
+ Compression codec of the stored value. The codec of each item is stored in the
+ manifest, so the items written with different codecs can be read correctly.
+ */
+typedef NS_ENUM(NSUInteger, YYKVStorageCompression) {
+    
+    /// The `value` is stored as it is.
+    YYKVStorageCompressionNone = 0,
+    
+    /// The `value` is compressed with zlib, slower but smaller.
+    YYKVStorageCompressionZlib = 1,
+    
+    /// The `value` is compressed with LZ4, much faster but larger than zlib.
+    YYKVStorageCompressionLZ4 = 2,
 };
 
 
@@ -71,7 +94,8 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
  @warning The instance of this class is *NOT* thread safe, you need to make sure 
  that there's only one thread to access the instance at the same time. If you really 
  need to process large amounts of data in multi-thread, you should split the data
- to multiple KVStorage instance (sharding).
+ to multiple KVStorage instance (sharding). The only exception is the concurrent
+ reads, see `readerConnectionCount`.
  */
 @interface YYKVStorage : NSObject
 
@@ -84,6 +108,118 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
 @property (nonatomic, readonly) YYKVStorageType type;  ///< The type of this storage.
 @property (nonatomic) BOOL errorLogsEnabled;           ///< Set `YES` to enable error logs for debug.
 
+/**
+ If `YES`, the saved items are queued in memory and written to sqlite in one
+ transaction (group commit). Default is NO.
+ 
+ @discussion The queue is flushed when it holds `writeBehindBatchSize` items
+ or 4MB of values, or when an access method is called and the oldest queued 
+ item is older than `writeBehindInterval`. The storage can't flush itself, 
+ the owner should call `flushPendingWrites` when `hasPendingWrites` is YES and the
+ storage becomes idle. Reads see the queued items, the queued items are lost if
+ the app crashes before they are flushed.
+ */
+@property (nonatomic) BOOL writeBehindEnabled;
+@property (nonatomic) NSUInteger writeBehindBatchSize;    ///< Default is 64.
+@property (nonatomic) NSTimeInterval writeBehindInterval; ///< In seconds, default is 0.05.
+@property (nonatomic, readonly) BOOL hasPendingWrites;    ///< Whether there are queued items.
+
+/**
+ If `YES`, the values stored in files (16KB or larger) are read with `mmap`, the
+ returned NSData is read-only and backed by the file, without copying the bytes
+ to heap. Default is NO.
+ 
+ @discussion While a mapped NSData is alive, the storage never truncates or unlinks
+ its file: when the item is updated or removed, the file is moved to the trash 
+ folder, and it's removed after the NSData is released (at next launch or next 
+ `removeAllItems`). Don't write the files in the data directory by other ways.
+ */
+@property (nonatomic) BOOL mappedReadsEnabled;
+
+/**
+ If `YES`, the items saved with the same `filename` share one file, the file is 
+ reference counted, and it's deleted when the last item using it is removed.
+ Default is NO.
+ 
+ @discussion The `filename` should identify the content (e.g. a hash of value), 
+ because the file is not written again if it already exists. The item's `size`
+ is still counted for each item, so `getItemsSize` and `removeItemsToFitSize:`
+ use the logical size, not the disk usage. Files saved when this property is NO
+ are owned by one item, as before.
+ */
+@property (nonatomic) BOOL sharedFilesEnabled;
+
+/**
+ The codec used to compress the saved values. Default is YYKVStorageCompressionNone.
+ 
+ @discussion A value is compressed only if it's not smaller than `compressionSizeThreshold`,
+ it's not in a compressed format (e.g. JPEG, PNG, GIF, WebP, HEIF, gzip, zip),
+ and the compressed data is at least 1/8 smaller, otherwise it's stored as it is.
+ The returned values are always decompressed. A compressed file is named with 
+ an extension of the codec (e.g. "filename.z" or "filename.lz4"). 
+ 
+ The `size` of an item is the compressed size, so `getItemsSize` and
+ `removeItemsToFitSize:` work with the bytes written to disk.
+ */
+@property (nonatomic) YYKVStorageCompression compression;
+
+/// Values smaller than this size (in bytes) are not compressed. Default is 1024.
+@property (nonatomic) NSUInteger compressionSizeThreshold;
+
+/**
+ The rate limit of removing the files in trash folder. Default is 256 files and 
+ 32MB per second, 0 means no limit.
+ 
+ @discussion The files of removed items are moved to trash folder, and removed 
+ one by one on a background queue, so the purge doesn't compete with foreground
+ reads for disk I/O. The files not removed yet (e.g. the app is killed) are 
+ removed after the storage is opened next time.
+ */
+@property (nonatomic) NSUInteger trashPurgeFilesPerSecond;
+@property (nonatomic) NSUInteger trashPurgeBytesPerSecond;
+
+/**
+ The purge of trash folder is paused while the recent file reads of this storage
+ are slower than this time (in seconds). Default is 0.01, 0 means never pause.
+ */
+@property (nonatomic) NSTimeInterval trashPurgePauseLatency;
+
+@property (nonatomic, readonly, getter=isPurgingTrash) BOOL purgingTrash; ///< Whether the trash purge is queued or running.
+@property (nonatomic, readonly) uint64_t trashPurgedFileCount; ///< Files removed from trash folder since the storage is opened.
+@property (nonatomic, readonly) uint64_t trashPurgedBytes;     ///< Bytes removed from trash folder since the storage is opened.
+
+/**
+ The latency histogram of the file reads while the trash folder is being purged.
+ It's a snapshot, the reads of inline values are not counted.
+ */
+@property (nonatomic, readonly) YYCacheLatencyHistogram *trashPurgeReadLatency;
+
+/// Reset `trashPurgedFileCount`, `trashPurgedBytes` and `trashPurgeReadLatency`.
+- (void)resetTrashPurgeStatistics;
+
+/**
+ The number of read-only sqlite connections used by concurrent reads. Default is 0,
+ which means no concurrent reads. The maximum is 16.
+ 
+ @discussion When it's larger than 0, the get methods (`getItemForKey:`, `getItemInfoForKey:`,
+ `getItemValueForKey:`, the versions for multiple keys, and `itemExistsForKey:`) can
+ be called from multiple threads at the same time, each of them reads with a connection
+ in the pool (and waits if all connections are in use). The other methods still
+ need exclusive access, they should not be called while any get method is running
+ (e.g. use a read-write lock). The access times of the concurrent reads are written 
+ by `flushAccessTimes`, and the items found broken are removed by it too.
+ 
+ The value read back is the number of connections actually opened, it's 0 (and the
+ get methods need exclusive access again) if none of them can be opened.
+ */
+@property (nonatomic) NSUInteger readerConnectionCount;
+
+/**
+ A segment is compacted by `compactSegments` when the live bytes in it is less than
+ this ratio of its file size. Only for YYKVStorageTypeSegment. Default is 0.5.
+ */
+@property (nonatomic) double segmentCompactionRatio;
+
 #pragma mark - Initializer
 ///=============================================================================
 /// @name Initializer
@@ -118,7 +254,7 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
  and item.value should not be empty (nil or zero length).
  
  If the `type` is YYKVStorageTypeFile, then the item.filename should not be empty.
- If the `type` is YYKVStorageTypeSQLite, then the item.filename will be ignored.
+ If the `type` is YYKVStorageTypeSQLite or YYKVStorageTypeSegment, then the item.filename will be ignored.
  It the `type` is YYKVStorageTypeMixed, then the item.value will be saved to file 
  system if the item.filename is not empty, otherwise it will be saved to sqlite.
  
@@ -144,7 +280,7 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
  
  @discussion
  If the `type` is YYKVStorageTypeFile, then the `filename` should not be empty.
- If the `type` is YYKVStorageTypeSQLite, then the `filename` will be ignored.
+ If the `type` is YYKVStorageTypeSQLite or YYKVStorageTypeSegment, then the `filename` will be ignored.
  It the `type` is YYKVStorageTypeMixed, then the `value` will be saved to file
  system if the `filename` is not empty, otherwise it will be saved to sqlite.
  
@@ -160,6 +296,80 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
                filename:(nullable NSString *)filename
            extendedData:(nullable NSData *)extendedData;
 
+/**
+ Save items or update the items if they already exist, in one sqlite transaction.
+ 
+ @discussion See `saveItem:` for the requirements of each item. An invalid item
+ is skipped, and does not affect other items.
+ 
+ @param items  An array of items.
+ @return Whether all items are saved.
+ */
+- (BOOL)saveItems:(NSArray<YYKVStorageItem *> *)items;
+
+/**
+ Write the queued items to sqlite in one transaction.
+ 
+ @return Whether succeed.
+ */
+- (BOOL)flushPendingWrites;
+
+/**
+ Write the access times recorded in memory to sqlite in one transaction.
+ 
+ @discussion Reading an item doesn't write to sqlite, the access time (in seconds)
+ is recorded in memory, and written in bulk when trimming by time, size or count
+ (so the LRU order is kept), when there're 4096 dirty keys, or when the storage is 
+ closed. The owner may call this method when the storage becomes idle. The recorded
+ access times are lost if the app crashes before they are written. This method also
+ removes the items which can't be read by concurrent reads (see `readerConnectionCount`).
+ 
+ @return Whether succeed.
+ */
+- (BOOL)flushAccessTimes;
+
+/**
+ Reclaim the disk space of removed values in segment files (YYKVStorageTypeSegment).
+ 
+ @discussion The values are appended to segment files (64MB at most), a removed or 
+ replaced value stays in its segment as dead bytes. This method deletes the 
+ segments without live values, and rewrites one segment whose live ratio is less
+ than `segmentCompactionRatio` (its values are appended to the current segment).
+ The owner may call it periodically (e.g. after trimming). It does nothing for other types.
+ 
+ @return Whether succeed.
+ */
+- (BOOL)compactSegments;
+
+/**
+ Reconcile the manifest and the files after a crash, in small steps.
+ 
+ @discussion Files are written to a temp directory and then renamed into place, so
+ a crash never leaves a half-written file, but it may leave a file without row, or
+ (with old versions) a row whose file is missing or truncated. If the last session
+ was not closed normally, the storage needs a reconciliation: the broken rows are
+ removed and the orphan files are moved to trash. It's not done in `initWithPath:type:`,
+ because it checks every row and file (a stat call for each); the owner
+ should call this method repeatedly in background until it returns YES.
+ 
+ @param timeLimit The time to spend in this call, in seconds (such as 0.005). At least
+ one small batch (64 rows or files) is checked in each call.
+ 
+ @return YES if the reconciliation is finished (or not needed), NO if this method
+ should be called again.
+ */
+- (BOOL)reconcileWithTimeLimit:(NSTimeInterval)timeLimit;
+
+/**
+ Flush the queued writes and access times, and close the session as if the storage 
+ was closed normally, so the next launch doesn't need a reconciliation.
+ 
+ @discussion The app may be killed in background without any notification, the
+ owner should call this method when the app enters background. The session is 
+ opened again before the next change.
+ */
+- (void)endSession;
+
 #pragma mark - Remove Items
 ///=============================================================================
 /// @name Remove Items
@@ -207,6 +417,17 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
  */
 - (BOOL)removeItemsToFitSize:(int)maxSize;
 
+/**
+ Remove items to make the total size not larger than a specified size.
+ The least recently used (LRU) items will be removed first.
+ 
+ @discussion Same as `removeItemsToFitSize:`, but accepts a size larger than 2GB.
+ 
+ @param maxSize The specified size in bytes.
+ @return Whether succeed.
+ */
+- (BOOL)removeItemsToFitTotalSize:(int64_t)maxSize;
+
 /**
  Remove items to make the total count not larger than a specified count.
  The least recently used (LRU) items will be removed first.
@@ -294,6 +515,17 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
  */
 - (nullable NSDictionary<NSString *, NSData *> *)getItemValueForKeys:(NSArray<NSString *> *)keys;
 
+/**
+ Enumerate the keys of all items (in no particular order).
+ 
+ @discussion The queued writes are flushed first. The keys are read in one query,
+ the storage should not be changed in the block.
+ 
+ @param block  A block which is called with each key.
+ @return Whether succeed.
+ */
+- (BOOL)enumerateKeysUsingBlock:(void (^)(NSString *key))block;
+
 #pragma mark - Get Storage Status
 ///=============================================================================
 /// @name Get Storage Status
@@ -316,10 +548,29 @@ typedef NS_ENUM(NSUInteger, YYKVStorageType) {
 
 /**
  Get item value's total size in bytes.
- @return Total size in bytes, -1 when an error occurs.
+ @return Total size in bytes (INT_MAX if it's larger), -1 when an error occurs.
  */
 - (int)getItemsSize;
 
+/**
+ Get item value's total size in bytes, without the 2GB limit of `getItemsSize`.
+ @return Total size in bytes, -1 when an error occurs.
+ */
+- (int64_t)getItemsTotalSize;
+
+/**
+ Get item value's total size in bytes before compression.
+ @return Total size in bytes (INT_MAX if it's larger), -1 when an error occurs.
+ */
+- (int)getItemsLogicalSize;
+
+/**
+ Get item value's total size in bytes before compression, without the 2GB limit
+ of `getItemsLogicalSize`.
+ @return Total size in bytes, -1 when an error occurs.
+ */
+- (int64_t)getItemsTotalLogicalSize;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -11,7 +11,15 @@
 
 #import "YYKVStorage.h"
 #import <UIKit/UIKit.h>
+#import <QuartzCore/QuartzCore.h>
 #import <time.h>
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <dirent.h>
+#import <compression.h>
+#import <pthread.h>
+#import "NSData+YYAdd.h"
+#import "YYCacheStatistics.h"
 
 #if __has_include(<sqlite3.h>)
 #import <sqlite3.h>
@@ -25,6 +33,128 @@ static NSString *const kDBShmFileName = @"manifest.sqlite-shm";
 static NSString *const kDBWalFileName = @"manifest.sqlite-wal";
 static NSString *const kDataDirectoryName = @"data";
 static NSString *const kTrashDirectoryName = @"trash";
+static NSString *const kTempDirectoryName = @"temp";
+static NSString *const kSessionFileName = @"session"; ///< exists while the storage is open, left behind by a crash
+static const NSUInteger kWriteBehindBytesMax = 1024 * 1024 * 4; ///< flush if the queued values are larger than 4MB
+static const NSUInteger kAccessTimesCountMax = 4096; ///< flush the dirty access times when reach this count
+static const off_t kMappedReadSizeMin = 1024 * 16; ///< smaller files are read to heap even if mapped reads is enabled
+static const int kDBSchemaVersion = 3; ///< `pragma user_version` of the current schema
+static const uint64_t kTrashPurgeLatencyWindow = NSEC_PER_SEC; ///< the foreground read latency older than this is ignored
+static const useconds_t kTrashPurgePauseInterval = 1000 * 50; ///< check the foreground read latency every 50ms when paused
+static const off_t kSegmentSizeMax = 1024 * 1024 * 64; ///< start a new segment file if the current one reaches 64MB
+static const int kReconcileBatchSize = 64; ///< rows or files checked between two checks of the time limit
+
+/// The statements cached by `_dbPrepareStmt:`.
+typedef NS_ENUM(NSUInteger, _YYKVStmt) {
+    _YYKVStmtUserVersion,
+    _YYKVStmtSaveItem,
+    _YYKVStmtUpdateAccessTime,
+    _YYKVStmtDeleteItem,
+    _YYKVStmtDeleteItemsLargerThanSize,
+    _YYKVStmtDeleteItemsEarlierThanTime,
+    _YYKVStmtGetItem,
+    _YYKVStmtGetItemInfo,
+    _YYKVStmtGetValue,
+    _YYKVStmtGetFilename,
+    _YYKVStmtGetFilenamesLargerThanSize,
+    _YYKVStmtGetFilenamesEarlierThanTime,
+    _YYKVStmtGetItemSizeInfoOrderByTimeDesc,
+    _YYKVStmtGetLRUItems,
+    _YYKVStmtDeleteLRUItems,
+    _YYKVStmtGetItemCount,
+    _YYKVStmtGetRefCount,
+    _YYKVStmtSetRefCount,
+    _YYKVStmtDeleteRefCount,
+    _YYKVStmtHasSharedFiles,
+    _YYKVStmtGetTotalSize,
+    _YYKVStmtGetTotalLogicalSize,
+    _YYKVStmtGetTotalCount,
+    _YYKVStmtGetLastSegment,
+    _YYKVStmtAddSegment,
+    _YYKVStmtGetSegments,
+    _YYKVStmtDeleteSegment,
+    _YYKVStmtGetSegmentItems,
+    _YYKVStmtMoveSegmentItem,
+    _YYKVStmtHasSegment,
+    _YYKVStmtGetReconcileItems,
+    _YYKVStmtReconcileRefCounts,
+    _YYKVStmtDeleteUnusedRefCounts,
+    _YYKVStmtGetKeys,
+    _YYKVStmtCount
+};
+
+static NSString *const _YYKVStmtSQL[_YYKVStmtCount] = {
+    [_YYKVStmtUserVersion] = @"pragma user_version;",
+    [_YYKVStmtSaveItem] = @"insert or replace into manifest (key, filename, size, inline_data, modification_time, last_access_time, extended_data, codec, logical_size, segment, segment_offset) values (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11);",
+    [_YYKVStmtUpdateAccessTime] = @"update manifest set last_access_time = ?1 where key = ?2;",
+    [_YYKVStmtDeleteItem] = @"delete from manifest where key = ?1;",
+    [_YYKVStmtDeleteItemsLargerThanSize] = @"delete from manifest where size > ?1;",
+    [_YYKVStmtDeleteItemsEarlierThanTime] = @"delete from manifest where last_access_time < ?1;",
+    [_YYKVStmtGetItem] = @"select key, filename, size, inline_data, modification_time, last_access_time, extended_data, codec, segment, segment_offset from manifest where key = ?1;",
+    [_YYKVStmtGetItemInfo] = @"select key, filename, size, modification_time, last_access_time, extended_data, codec, segment, segment_offset from manifest where key = ?1;",
+    [_YYKVStmtGetValue] = @"select inline_data, codec, segment, segment_offset, size, filename from manifest where key = ?1;",
+    [_YYKVStmtGetFilename] = @"select filename from manifest where key = ?1;",
+    [_YYKVStmtGetFilenamesLargerThanSize] = @"select filename from manifest where size > ?1 and filename is not null;",
+    [_YYKVStmtGetFilenamesEarlierThanTime] = @"select filename from manifest where last_access_time < ?1 and filename is not null;",
+    [_YYKVStmtGetItemSizeInfoOrderByTimeDesc] = @"select key, filename, size from manifest order by last_access_time desc limit ?1;",
+    [_YYKVStmtGetLRUItems] = @"select last_access_time, rowid, size, filename from manifest order by last_access_time asc, rowid asc;",
+    [_YYKVStmtDeleteLRUItems] = @"delete from manifest where last_access_time <= ?1 and (last_access_time < ?1 or rowid <= ?2);",
+    [_YYKVStmtGetItemCount] = @"select count(key) from manifest where key = ?1;",
+    [_YYKVStmtGetRefCount] = @"select ref_count from blob where filename = ?1;",
+    [_YYKVStmtSetRefCount] = @"insert or replace into blob (filename, ref_count) values (?1, ?2);",
+    [_YYKVStmtDeleteRefCount] = @"delete from blob where filename = ?1;",
+    [_YYKVStmtHasSharedFiles] = @"select count(*) from (select 1 from blob limit 1);",
+    [_YYKVStmtGetTotalSize] = @"select size from stats where id = 0;",
+    [_YYKVStmtGetTotalLogicalSize] = @"select logical_size from stats where id = 0;",
+    [_YYKVStmtGetTotalCount] = @"select count from stats where id = 0;",
+    [_YYKVStmtGetLastSegment] = @"select max(id) from segment;",
+    [_YYKVStmtAddSegment] = @"insert or ignore into segment (id, live_size) values (?1, 0);",
+    [_YYKVStmtGetSegments] = @"select id, live_size from segment order by id;",
+    [_YYKVStmtDeleteSegment] = @"delete from segment where id = ?1;",
+    [_YYKVStmtGetSegmentItems] = @"select key, segment_offset, size from manifest where segment = ?1;",
+    [_YYKVStmtMoveSegmentItem] = @"update manifest set segment = ?1, segment_offset = ?2 where key = ?3 and segment = ?4;",
+    [_YYKVStmtHasSegment] = @"select count(*) from segment where id = ?1;",
+    [_YYKVStmtGetReconcileItems] = @"select rowid, key, filename, size, segment, segment_offset from manifest where rowid > ?1 and (filename is not null or segment > 0) order by rowid limit ?2;",
+    [_YYKVStmtReconcileRefCounts] = @"insert or replace into blob (filename, ref_count) select filename, count(*) from manifest where filename is not null group by filename having count(*) > 1 or filename in (select filename from blob);",
+    [_YYKVStmtDeleteUnusedRefCounts] = @"delete from blob where filename not in (select filename from manifest where filename is not null);",
+    [_YYKVStmtGetKeys] = @"select key from manifest;",
+};
+
+/// The statements with `key in (...)`, cached for each arity bucket by `_dbPrepareKeysStmt:count:arity:`.
+typedef NS_ENUM(NSUInteger, _YYKVKeysStmt) {
+    _YYKVKeysStmtGetItems,
+    _YYKVKeysStmtGetItemInfos,
+    _YYKVKeysStmtGetFilenames,
+    _YYKVKeysStmtDeleteItems,
+    _YYKVKeysStmtCount
+};
+
+static NSString *const _YYKVKeysStmtSQL[_YYKVKeysStmtCount] = {
+    [_YYKVKeysStmtGetItems] = @"select key, filename, size, inline_data, modification_time, last_access_time, extended_data, codec, segment, segment_offset from manifest where key in (%@);",
+    [_YYKVKeysStmtGetItemInfos] = @"select key, filename, size, modification_time, last_access_time, extended_data, codec, segment, segment_offset from manifest where key in (%@);",
+    [_YYKVKeysStmtGetFilenames] = @"select filename from manifest where key in (%@);",
+    [_YYKVKeysStmtDeleteItems] = @"delete from manifest where key in (%@);",
+};
+
+/// The arity of `key in (...)` is rounded up to power of 2: 1, 2, 4 ... 512.
+#define kDBKeysArityBucketCount 10
+static const NSUInteger kDBKeysBatchMax = 1 << (kDBKeysArityBucketCount - 1); ///< more keys are queried in batches
+
+static const NSUInteger kReaderConnectionCountMax = 16;
+
+/// The stages of the reconciliation after a crash, see `reconcileWithTimeLimit:`.
+typedef NS_ENUM(NSUInteger, _YYKVReconcileStage) {
+    _YYKVReconcileStageFinished = 0,
+    _YYKVReconcileStageRows,  ///< remove the rows whose file is missing or truncated, then rebuild the ref counts
+    _YYKVReconcileStageFiles, ///< move the files which have no row to trash
+};
+
+/// A read-only connection in the reader pool, with its own statement cache.
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *stmts[_YYKVStmtCount];
+    sqlite3_stmt *keysStmts[_YYKVKeysStmtCount][kDBKeysArityBucketCount];
+} _YYKVReader;
 
 /*
  SQL:
@@ -39,13 +169,256 @@ static NSString *const kTrashDirectoryName = @"trash";
     primary key(key)
  ); 
  create index if not exists last_access_time_idx on manifest(last_access_time);
+ 
+ // schema version 1
+ alter table manifest add column codec integer default 0; // YYKVStorageCompression
+ alter table manifest add column logical_size integer;    // value's size before compression
+ 
+ // schema version 2: running totals of manifest, maintained by triggers
+ create table if not exists stats (
+    id                  integer, // always 0
+    count               integer,
+    size                integer,
+    logical_size        integer,
+    primary key(id)
+ );
+ create trigger if not exists manifest_insert after insert on manifest ...
+ create trigger if not exists manifest_delete after delete on manifest ...
+ create trigger if not exists manifest_update after update of size, logical_size on manifest ...
+ 
+ // schema version 3: values appended to segment files (YYKVStorageTypeSegment)
+ alter table manifest add column segment integer;         // segment id, null if not in segment
+ alter table manifest add column segment_offset integer;  // value's offset in the segment file
+ create table if not exists segment (
+    id                  integer, // file name is "segment-<id>" in data directory
+    live_size           integer, // bytes still used by items, maintained by triggers
+    primary key(id)
+ );
+ create trigger if not exists manifest_segment_insert after insert on manifest ...
+ create trigger if not exists manifest_segment_delete after delete on manifest ...
+ create trigger if not exists manifest_segment_update after update of segment, size on manifest ...
+ 
+ create table if not exists blob (
+    filename            text,
+    ref_count           integer,
+    primary key(filename)
+ );
  */
 
+@interface YYKVStorageItem ()
+@property (nonatomic) YYKVStorageCompression codec; ///< how the stored value is compressed
+@property (nonatomic) int segment;                  ///< segment id of the value, 0 if not in segment
+@property (nonatomic) int64_t segmentOffset;        ///< value's offset in the segment file
+@end
+
 @implementation YYKVStorageItem
 @end
 
+
+/// Whether the data is in a compressed format (image, archive), it's not worth compressing again.
+static BOOL _YYKVDataIsCompressed(NSData *data) {
+    if (data.length < 16) return NO;
+    const uint8_t *bytes = data.bytes;
+    if (bytes[0] == 0xFF && bytes[1] == 0xD8 && bytes[2] == 0xFF) return YES; // jpeg
+    if (bytes[0] == 0x89 && bytes[1] == 'P' && bytes[2] == 'N' && bytes[3] == 'G') return YES; // png
+    if (bytes[0] == 'G' && bytes[1] == 'I' && bytes[2] == 'F' && bytes[3] == '8') return YES; // gif
+    if (bytes[0] == 'R' && bytes[1] == 'I' && bytes[2] == 'F' && bytes[3] == 'F' &&
+        bytes[8] == 'W' && bytes[9] == 'E' && bytes[10] == 'B' && bytes[11] == 'P') return YES; // webp
+    if (bytes[4] == 'f' && bytes[5] == 't' && bytes[6] == 'y' && bytes[7] == 'p') return YES; // heif, mp4
+    if (bytes[0] == 0x1F && bytes[1] == 0x8B) return YES; // gzip
+    if (bytes[0] == 'P' && bytes[1] == 'K' && bytes[2] == 0x03 && bytes[3] == 0x04) return YES; // zip
+    return NO;
+}
+
+/// LZ4 data: 4 bytes logical length (little endian) + raw LZ4 block.
+static NSData *_YYKVLZ4Encode(NSData *data) {
+    size_t capacity = data.length; // larger output is not worth it
+    uint8_t *buffer = malloc(capacity + 4);
+    if (!buffer) return nil;
+    uint32_t length = CFSwapInt32HostToLittle((uint32_t)data.length);
+    memcpy(buffer, &length, 4);
+    size_t size = compression_encode_buffer(buffer + 4, capacity, data.bytes, data.length, NULL, COMPRESSION_LZ4_RAW);
+    if (size == 0) {
+        free(buffer);
+        return nil;
+    }
+    return [NSData dataWithBytesNoCopy:buffer length:size + 4 freeWhenDone:YES];
+}
+
+static NSData *_YYKVLZ4Decode(NSData *data) {
+    if (data.length < 4) return nil;
+    uint32_t length;
+    memcpy(&length, data.bytes, 4);
+    length = CFSwapInt32LittleToHost(length);
+    if (length == 0) return nil;
+    uint8_t *buffer = malloc(length);
+    if (!buffer) return nil;
+    size_t size = compression_decode_buffer(buffer, length, (const uint8_t *)data.bytes + 4, data.length - 4, NULL, COMPRESSION_LZ4_RAW);
+    if (size != length) {
+        free(buffer);
+        return nil;
+    }
+    return [NSData dataWithBytesNoCopy:buffer length:length freeWhenDone:YES];
+}
+
+
+/// Split the keys to batches for `_dbPrepareKeysStmt:count:arity:`.
+static NSArray *_YYKVKeysBatches(NSArray *keys) {
+    if (keys.count <= kDBKeysBatchMax) return keys.count ? @[keys] : @[];
+    NSMutableArray *batches = [NSMutableArray new];
+    for (NSUInteger offset = 0; offset < keys.count; offset += kDBKeysBatchMax) {
+        [batches addObject:[keys subarrayWithRange:NSMakeRange(offset, MIN(kDBKeysBatchMax, keys.count - offset))]];
+    }
+    return batches;
+}
+
+/**
+ Removes the files in trash folder on the trash queue, file by file, with a rate limit.
+ The purge is paused while the foreground reads are slow. The purge blocks retain
+ this object instead of the storage, the storage updates the settings and reports
+ the foreground reads to it.
+ */
+@interface _YYKVTrashPurger : NSObject
+@property (atomic) NSUInteger filesPerSecond;
+@property (atomic) NSUInteger bytesPerSecond;
+@property (atomic) uint64_t pauseLatency; ///< in nanoseconds, 0 means never pause
+@property (nonatomic, readonly) YYCacheStatisticsRecorder *readStatistics; ///< foreground reads during purge
+@property (nonatomic, readonly, getter=isPurging) BOOL purging;
+@property (nonatomic, readonly) uint64_t purgedFileCount;
+@property (nonatomic, readonly) uint64_t purgedBytes;
+- (void)resetStatistics;
+- (void)recordReadWithBytes:(uint64_t)bytes latency:(uint64_t)nanoseconds; ///< called by storage for each file read
+- (void)purgeTrashPaths:(NSArray *)paths excludingPaths:(NSSet *)excludedPaths queue:(dispatch_queue_t)queue;
+@end
+
+@implementation _YYKVTrashPurger {
+    int32_t _purgeCount;   ///< count of queued or running purges
+    uint64_t _readLatency; ///< moving average of the foreground read latency
+    uint64_t _readTime;    ///< time of the last foreground read
+    uint64_t _purgedFileCount;
+    uint64_t _purgedBytes;
+}
+
+- (instancetype)init {
+    self = [super init];
+    _readStatistics = [YYCacheStatisticsRecorder new];
+    return self;
+}
+
+- (BOOL)isPurging {
+    return __atomic_load_n(&_purgeCount, __ATOMIC_RELAXED) > 0;
+}
+
+- (uint64_t)purgedFileCount {
+    return __atomic_load_n(&_purgedFileCount, __ATOMIC_RELAXED);
+}
+
+- (uint64_t)purgedBytes {
+    return __atomic_load_n(&_purgedBytes, __ATOMIC_RELAXED);
+}
+
+- (void)resetStatistics {
+    __atomic_store_n(&_purgedFileCount, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&_purgedBytes, 0, __ATOMIC_RELAXED);
+    [_readStatistics reset];
+}
+
+- (void)recordReadWithBytes:(uint64_t)bytes latency:(uint64_t)nanoseconds {
+    uint64_t average = __atomic_load_n(&_readLatency, __ATOMIC_RELAXED);
+    average = average - average / 4 + nanoseconds / 4;
+    __atomic_store_n(&_readLatency, average, __ATOMIC_RELAXED);
+    __atomic_store_n(&_readTime, YYCacheStatisticsTime(), __ATOMIC_RELAXED);
+    if (self.isPurging) [_readStatistics recordGetWithHit:bytes > 0 bytes:bytes latency:nanoseconds stripe:0];
+}
+
+- (void)purgeTrashPaths:(NSArray *)paths excludingPaths:(NSSet *)excludedPaths queue:(dispatch_queue_t)queue {
+    if (paths.count == 0) return;
+    __atomic_fetch_add(&_purgeCount, 1, __ATOMIC_RELAXED);
+    dispatch_async(queue, ^{
+        [self _purgeTrashPaths:paths excludingPaths:excludedPaths];
+        [self _purgeFinished];
+    });
+}
+
+- (void)_purgeFinished {
+    __atomic_fetch_sub(&_purgeCount, 1, __ATOMIC_RELAXED);
+}
+
+/// Wait while the foreground reads are slow, returns the waiting time in nanoseconds.
+- (uint64_t)_waitForForegroundReads {
+    uint64_t begin = YYCacheStatisticsTime();
+    uint64_t now = begin;
+    for (;;) {
+        uint64_t pauseLatency = self.pauseLatency;
+        if (pauseLatency == 0) break;
+        if (now - __atomic_load_n(&_readTime, __ATOMIC_RELAXED) > kTrashPurgeLatencyWindow) break;
+        if (__atomic_load_n(&_readLatency, __ATOMIC_RELAXED) <= pauseLatency) break;
+        usleep(kTrashPurgePauseInterval);
+        now = YYCacheStatisticsTime();
+    }
+    return now - begin;
+}
+
+/// Sleep until the removed files and bytes fit the rate limit.
+- (void)_throttleWithBeginTime:(uint64_t)begin fileCount:(uint64_t)fileCount bytes:(uint64_t)bytes {
+    NSUInteger filesPerSecond = self.filesPerSecond;
+    NSUInteger bytesPerSecond = self.bytesPerSecond;
+    uint64_t deadline = begin;
+    if (filesPerSecond > 0) deadline = MAX(deadline, begin + fileCount * NSEC_PER_SEC / filesPerSecond);
+    if (bytesPerSecond > 0) deadline = MAX(deadline, begin + (uint64_t)((double)bytes * NSEC_PER_SEC / bytesPerSecond));
+    uint64_t now = YYCacheStatisticsTime();
+    if (deadline > now) usleep((useconds_t)MIN((deadline - now) / NSEC_PER_USEC, USEC_PER_SEC));
+}
+
+- (void)_purgeTrashPaths:(NSArray *)paths excludingPaths:(NSSet *)excludedPaths {
+    NSFileManager *manager = [NSFileManager new];
+    __block uint64_t begin = YYCacheStatisticsTime();
+    __block uint64_t fileCount = 0, bytes = 0;
+    void (^removeFile)(NSString *path, uint64_t size) = ^(NSString *path, uint64_t size) {
+        if ([excludedPaths containsObject:path]) return;
+        begin += [self _waitForForegroundReads]; // the paused time is not counted by the rate limit
+        if (unlink(path.fileSystemRepresentation) != 0) return;
+        fileCount++;
+        bytes += size;
+        __atomic_fetch_add(&self->_purgedFileCount, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&self->_purgedBytes, size, __ATOMIC_RELAXED);
+        [self _throttleWithBeginTime:begin fileCount:fileCount bytes:bytes];
+    };
+    
+    for (NSString *trashPath in paths) {
+        NSDictionary *attributes = [manager attributesOfItemAtPath:trashPath error:NULL];
+        if (!attributes) continue;
+        if (![attributes.fileType isEqualToString:NSFileTypeDirectory]) {
+            removeFile(trashPath, attributes.fileSize);
+            continue;
+        }
+        NSMutableArray *directories = [NSMutableArray arrayWithObject:trashPath];
+        NSDirectoryEnumerator *enumerator = [manager enumeratorAtPath:trashPath];
+        NSString *subpath;
+        while ((subpath = [enumerator nextObject])) {
+            @autoreleasepool {
+                NSString *path = [trashPath stringByAppendingPathComponent:subpath];
+                NSDictionary *fileAttributes = enumerator.fileAttributes;
+                if ([fileAttributes.fileType isEqualToString:NSFileTypeDirectory]) {
+                    [directories addObject:path];
+                } else {
+                    removeFile(path, fileAttributes.fileSize);
+                }
+            }
+        }
+        // subdirectories first, the directories which still contain mapped files are kept
+        for (NSString *path in directories.reverseObjectEnumerator) {
+            rmdir(path.fileSystemRepresentation);
+        }
+    }
+}
+
+@end
+
+
 @implementation YYKVStorage {
     dispatch_queue_t _trashQueue;
+    _YYKVTrashPurger *_trashPurger;
     
     NSString *_path;
     NSString *_dbPath;
@@ -53,10 +426,50 @@ static NSString *const kTrashDirectoryName = @"trash";
     NSString *_trashPath;
     
     sqlite3 *_db;
-    CFMutableDictionaryRef _dbStmtCache;
+    sqlite3_stmt *_dbStmts[_YYKVStmtCount]; ///< cached statements, finalized when the db is closed
+    sqlite3_stmt *_dbKeysStmts[_YYKVKeysStmtCount][kDBKeysArityBucketCount];
     
     BOOL _invalidated; ///< If YES, then the db should not open again, all read/write should be ignored.
     BOOL _dbIsClosing; ///< If YES, then the db is during closing.
+    
+    // write-behind queue
+    NSMutableDictionary *_pendingItems;    ///< key -> YYKVStorageItem, saved items not written yet
+    NSUInteger _pendingBytes;              ///< total value size of _pendingItems
+    CFTimeInterval _pendingSince;          ///< time of the oldest queued operation, 0 if the queue is empty
+    
+    // access time
+    NSMutableDictionary *_accessTimes;     ///< key -> last access unix timestamp, not written to sqlite yet
+    
+    // mapped reads
+    NSMapTable *_mappedFiles;              ///< filename -> weak mapped NSData, files in data directory
+    NSMapTable *_mappedTrashFiles;         ///< full path -> weak mapped NSData, files moved to trash
+    
+    // shared files
+    BOOL _hasSharedFiles;                  ///< whether the blob table may have rows
+    
+    // reader pool
+    _YYKVReader *_readers;                 ///< `_readerConnectionCount` readers, NULL if the pool is disabled or failed to open
+    _YYKVReader **_freeReaders;            ///< stack of the readers not in use, guarded by _readLock
+    NSUInteger _freeReaderCount;
+    dispatch_semaphore_t _readerSemaphore; ///< count of the readers not in use
+    pthread_key_t _readerKey;              ///< the reader bound to current thread during a read
+    pthread_mutex_t _readLock;             ///< guards the states changed by concurrent reads
+    NSMutableSet *_brokenKeys;             ///< items can't be read by concurrent reads, removed by `flushAccessTimes`
+    
+    // segment
+    int _segmentFD;                        ///< the segment for appending, -1 if not opened
+    int _segmentID;
+    off_t _segmentSize;
+    NSMutableDictionary *_segmentReadFDs;  ///< segment id -> file descriptor for reading, guarded by _readLock
+    
+    // reconciliation
+    NSString *_tempPath;                   ///< files are written here first, then renamed to data directory
+    NSString *_sessionPath;
+    BOOL _sessionMarked;                   ///< whether the session file exists
+    _YYKVReconcileStage _reconcileStage;
+    sqlite3_int64 _reconcileRowID;         ///< the last row checked
+    NSMutableSet *_reconcileFilenames;     ///< filenames of the rows checked, and the files written since then
+    DIR *_reconcileDir;                    ///< data directory stream of the files stage
 }
 
 
@@ -75,9 +488,7 @@ static NSString *const kTrashDirectoryName = @"trash";
     
     int result = sqlite3_open(_dbPath.UTF8String, &_db);
     if (result == SQLITE_OK) {
-        CFDictionaryKeyCallBacks keyCallbacks = kCFCopyStringDictionaryKeyCallBacks;
-        CFDictionaryValueCallBacks valueCallbacks = {0};
-        _dbStmtCache = CFDictionaryCreateMutable(CFAllocatorGetDefault(), 0, &keyCallbacks, &valueCallbacks);
+        [self _readersOpen];
         return YES;
     } else {
         NSLog(@"%s line:%d sqlite open failed (%d).", __FUNCTION__, __LINE__, result);
@@ -98,12 +509,15 @@ static NSString *const kTrashDirectoryName = @"trash";
     }
     if (!needClose) return YES;
     
+    [self _readersClose];
+    
     int  result = 0;
     BOOL retry = NO;
     BOOL stmtFinalized = NO;
     
-    if (_dbStmtCache) CFRelease(_dbStmtCache);
-    _dbStmtCache = NULL;
+    // the cached statements are finalized below
+    memset(_dbStmts, 0, sizeof(_dbStmts));
+    memset(_dbKeysStmts, 0, sizeof(_dbKeysStmts));
     
     do {
         retry = NO;
@@ -131,8 +545,52 @@ static NSString *const kTrashDirectoryName = @"trash";
 }
 
 - (BOOL)_dbInitialize {
-    NSString *sql = @"pragma journal_mode = wal; pragma synchronous = normal; create table if not exists manifest (key text, filename text, size integer, inline_data blob, modification_time integer, last_access_time integer, extended_data blob, primary key(key)); create index if not exists last_access_time_idx on manifest(last_access_time);";
-    return [self _dbExecute:sql];
+    NSString *sql = @"pragma journal_mode = wal; pragma synchronous = normal; pragma recursive_triggers = on; create table if not exists manifest (key text, filename text, size integer, inline_data blob, modification_time integer, last_access_time integer, extended_data blob, primary key(key)); create index if not exists last_access_time_idx on manifest(last_access_time); create table if not exists blob (filename text, ref_count integer, primary key(filename));";
+    if (![self _dbExecute:sql]) return NO;
+    return [self _dbMigrate];
+}
+
+/// Upgrade the schema created by older version.
+- (BOOL)_dbMigrate {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtUserVersion];
+    if (!stmt) return NO;
+    if (sqlite3_step(stmt) != SQLITE_ROW) return NO;
+    int version = sqlite3_column_int(stmt, 0);
+    sqlite3_reset(stmt);
+    if (version >= kDBSchemaVersion) return YES;
+    
+    NSMutableString *sql = [NSMutableString stringWithString:@"begin immediate transaction; "];
+    if (version < 1) {
+        [sql appendString:@"alter table manifest add column codec integer default 0; alter table manifest add column logical_size integer; "];
+    }
+    if (version < 2) {
+        // `insert or replace` fires the delete trigger only if recursive_triggers is on
+        [sql appendString:@"create table if not exists stats (id integer, count integer, size integer, logical_size integer, primary key(id)); "
+                          @"insert or replace into stats (id, count, size, logical_size) select 0, count(*), coalesce(sum(size), 0), coalesce(sum(coalesce(logical_size, size)), 0) from manifest; "
+                          @"create trigger if not exists manifest_insert after insert on manifest begin "
+                          @"update stats set count = count + 1, size = size + new.size, logical_size = logical_size + coalesce(new.logical_size, new.size) where id = 0; end; "
+                          @"create trigger if not exists manifest_delete after delete on manifest begin "
+                          @"update stats set count = count - 1, size = size - old.size, logical_size = logical_size - coalesce(old.logical_size, old.size) where id = 0; end; "
+                          @"create trigger if not exists manifest_update after update of size, logical_size on manifest begin "
+                          @"update stats set size = size - old.size + new.size, logical_size = logical_size - coalesce(old.logical_size, old.size) + coalesce(new.logical_size, new.size) where id = 0; end; "];
+    }
+    if (version < 3) {
+        [sql appendString:@"alter table manifest add column segment integer; alter table manifest add column segment_offset integer; "
+                          @"create table if not exists segment (id integer, live_size integer, primary key(id)); "
+                          @"create trigger if not exists manifest_segment_insert after insert on manifest when new.segment is not null begin "
+                          @"update segment set live_size = live_size + new.size where id = new.segment; end; "
+                          @"create trigger if not exists manifest_segment_delete after delete on manifest when old.segment is not null begin "
+                          @"update segment set live_size = live_size - old.size where id = old.segment; end; "
+                          @"create trigger if not exists manifest_segment_update after update of segment, size on manifest when old.segment is not null or new.segment is not null begin "
+                          @"update segment set live_size = live_size - old.size where id = old.segment; "
+                          @"update segment set live_size = live_size + new.size where id = new.segment; end; "];
+    }
+    [sql appendFormat:@"pragma user_version = %d; commit transaction;", kDBSchemaVersion];
+    if (![self _dbExecute:sql]) {
+        [self _dbExecute:@"rollback transaction;"];
+        return NO;
+    }
+    return YES;
 }
 
 - (void)_dbCheckpoint {
@@ -144,6 +602,7 @@ static NSString *const kTrashDirectoryName = @"trash";
 - (BOOL)_dbExecute:(NSString *)sql {
     if (sql.length == 0) return NO;
     if (![self _dbIsReady]) return NO;
+    [self _sessionMark];
     
     char *error = NULL;
     int result = sqlite3_exec(_db, sql.UTF8String, NULL, NULL, &error);
@@ -155,50 +614,89 @@ static NSString *const kTrashDirectoryName = @"trash";
     return result == SQLITE_OK;
 }
 
-- (sqlite3_stmt *)_dbPrepareStmt:(NSString *)sql {
-    if (![self _dbIsReady] || sql.length == 0 || !_dbStmtCache) return NULL;
-    sqlite3_stmt *stmt = (sqlite3_stmt *)CFDictionaryGetValue(_dbStmtCache, (__bridge const void *)(sql));
+- (sqlite3_stmt *)_dbPrepareSQL:(NSString *)sql db:(sqlite3 *)db {
+    sqlite3_stmt *stmt = NULL;
+    int result = sqlite3_prepare_v2(db, sql.UTF8String, -1, &stmt, NULL);
+    if (result != SQLITE_OK) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite stmt prepare error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(db));
+        return NULL;
+    }
+    return stmt;
+}
+
+/// The statements are prepared on the reader bound to current thread if there's one.
+- (sqlite3_stmt *)_dbPrepareStmt:(_YYKVStmt)stmtID {
+    if (![self _dbIsReady]) return NULL;
+    _YYKVReader *reader = _readers ? pthread_getspecific(_readerKey) : NULL;
+    sqlite3_stmt **slot = reader ? &reader->stmts[stmtID] : &_dbStmts[stmtID];
+    sqlite3_stmt *stmt = *slot;
     if (!stmt) {
-        int result = sqlite3_prepare_v2(_db, sql.UTF8String, -1, &stmt, NULL);
-        if (result != SQLITE_OK) {
-            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite stmt prepare error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
-            return NULL;
-        }
-        CFDictionarySetValue(_dbStmtCache, (__bridge const void *)(sql), stmt);
+        stmt = [self _dbPrepareSQL:_YYKVStmtSQL[stmtID] db:reader ? reader->db : _db];
+        *slot = stmt;
+    } else {
+        sqlite3_reset(stmt);
+    }
+    if (!_sessionMarked && stmt && !reader && !sqlite3_stmt_readonly(stmt)) [self _sessionMark];
+    return stmt;
+}
+
+/**
+ Get the cached statement for `key in (...)` with at least `count` parameters.
+ 
+ @param stmtID The statement.
+ @param count  The number of keys, should not be larger than kDBKeysBatchMax.
+ @param arity  Output the number of parameters, the unused ones should be bound to null.
+ */
+- (sqlite3_stmt *)_dbPrepareKeysStmt:(_YYKVKeysStmt)stmtID count:(NSUInteger)count arity:(int *)arity {
+    if (![self _dbIsReady] || count == 0 || count > kDBKeysBatchMax) return NULL;
+    int bucket = 0;
+    while ((1UL << bucket) < count) bucket++;
+    *arity = 1 << bucket;
+    _YYKVReader *reader = _readers ? pthread_getspecific(_readerKey) : NULL;
+    sqlite3_stmt **slot = reader ? &reader->keysStmts[stmtID][bucket] : &_dbKeysStmts[stmtID][bucket];
+    sqlite3_stmt *stmt = *slot;
+    if (!stmt) {
+        NSString *sql = [NSString stringWithFormat:_YYKVKeysStmtSQL[stmtID], [self _dbJoinedKeysWithCount:*arity]];
+        stmt = [self _dbPrepareSQL:sql db:reader ? reader->db : _db];
+        *slot = stmt;
     } else {
         sqlite3_reset(stmt);
     }
+    if (!_sessionMarked && stmt && !reader && !sqlite3_stmt_readonly(stmt)) [self _sessionMark];
     return stmt;
 }
 
-- (NSString *)_dbJoinedKeys:(NSArray *)keys {
+- (NSString *)_dbJoinedKeysWithCount:(int)count {
     NSMutableString *string = [NSMutableString new];
-    for (NSUInteger i = 0,max = keys.count; i < max; i++) {
+    for (int i = 0; i < count; i++) {
         [string appendString:@"?"];
-        if (i + 1 != max) {
+        if (i + 1 != count) {
             [string appendString:@","];
         }
     }
     return string;
 }
 
-- (void)_dbBindJoinedKeys:(NSArray *)keys stmt:(sqlite3_stmt *)stmt fromIndex:(int)index{
-    for (int i = 0, max = (int)keys.count; i < max; i++) {
+- (void)_dbBindJoinedKeys:(NSArray *)keys stmt:(sqlite3_stmt *)stmt arity:(int)arity {
+    int count = (int)keys.count;
+    for (int i = 0; i < count; i++) {
         NSString *key = keys[i];
-        sqlite3_bind_text(stmt, index + i, key.UTF8String, -1, NULL);
+        sqlite3_bind_text(stmt, i + 1, key.UTF8String, -1, NULL);
+    }
+    for (int i = count; i < arity; i++) {
+        sqlite3_bind_null(stmt, i + 1);
     }
 }
 
-- (BOOL)_dbSaveWithKey:(NSString *)key value:(NSData *)value fileName:(NSString *)fileName extendedData:(NSData *)extendedData {
-    NSString *sql = @"insert or replace into manifest (key, filename, size, inline_data, modification_time, last_access_time, extended_data) values (?1, ?2, ?3, ?4, ?5, ?6, ?7);";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+- (BOOL)_dbSaveWithKey:(NSString *)key value:(NSData *)value fileName:(NSString *)fileName extendedData:(NSData *)extendedData codec:(YYKVStorageCompression)codec logicalSize:(int)logicalSize segment:(int)segment offset:(int64_t)offset {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtSaveItem];
     if (!stmt) return NO;
     
     int timestamp = (int)time(NULL);
     sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
     sqlite3_bind_text(stmt, 2, fileName.UTF8String, -1, NULL);
     sqlite3_bind_int(stmt, 3, (int)value.length);
-    if (fileName.length == 0) {
+    if (fileName.length == 0 && segment == 0) {
         sqlite3_bind_blob(stmt, 4, value.bytes, (int)value.length, 0);
     } else {
         sqlite3_bind_blob(stmt, 4, NULL, 0, 0);
@@ -206,6 +704,15 @@ static NSString *const kTrashDirectoryName = @"trash";
     sqlite3_bind_int(stmt, 5, timestamp);
     sqlite3_bind_int(stmt, 6, timestamp);
     sqlite3_bind_blob(stmt, 7, extendedData.bytes, (int)extendedData.length, 0);
+    sqlite3_bind_int(stmt, 8, (int)codec);
+    sqlite3_bind_int(stmt, 9, logicalSize);
+    if (segment > 0) {
+        sqlite3_bind_int(stmt, 10, segment);
+        sqlite3_bind_int64(stmt, 11, offset);
+    } else {
+        sqlite3_bind_null(stmt, 10);
+        sqlite3_bind_null(stmt, 11);
+    }
     
     int result = sqlite3_step(stmt);
     if (result != SQLITE_DONE) {
@@ -215,11 +722,10 @@ static NSString *const kTrashDirectoryName = @"trash";
     return YES;
 }
 
-- (BOOL)_dbUpdateAccessTimeWithKey:(NSString *)key {
-    NSString *sql = @"update manifest set last_access_time = ?1 where key = ?2;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+- (BOOL)_dbUpdateAccessTime:(int)accessTime withKey:(NSString *)key {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtUpdateAccessTime];
     if (!stmt) return NO;
-    sqlite3_bind_int(stmt, 1, (int)time(NULL));
+    sqlite3_bind_int(stmt, 1, accessTime);
     sqlite3_bind_text(stmt, 2, key.UTF8String, -1, NULL);
     int result = sqlite3_step(stmt);
     if (result != SQLITE_DONE) {
@@ -229,31 +735,8 @@ static NSString *const kTrashDirectoryName = @"trash";
     return YES;
 }
 
-- (BOOL)_dbUpdateAccessTimeWithKeys:(NSArray *)keys {
-    if (![self _dbIsReady]) return NO;
-    int t = (int)time(NULL);
-     NSString *sql = [NSString stringWithFormat:@"update manifest set last_access_time = %d where key in (%@);", t, [self _dbJoinedKeys:keys]];
-    
-    sqlite3_stmt *stmt = NULL;
-    int result = sqlite3_prepare_v2(_db, sql.UTF8String, -1, &stmt, NULL);
-    if (result != SQLITE_OK) {
-        if (_errorLogsEnabled)  NSLog(@"%s line:%d sqlite stmt prepare error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
-        return NO;
-    }
-    
-    [self _dbBindJoinedKeys:keys stmt:stmt fromIndex:1];
-    result = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    if (result != SQLITE_DONE) {
-        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite update error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
-        return NO;
-    }
-    return YES;
-}
-
 - (BOOL)_dbDeleteItemWithKey:(NSString *)key {
-    NSString *sql = @"delete from manifest where key = ?1;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtDeleteItem];
     if (!stmt) return NO;
     sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
     
@@ -267,27 +750,22 @@ static NSString *const kTrashDirectoryName = @"trash";
 
 - (BOOL)_dbDeleteItemWithKeys:(NSArray *)keys {
     if (![self _dbIsReady]) return NO;
-    NSString *sql =  [NSString stringWithFormat:@"delete from manifest where key in (%@);", [self _dbJoinedKeys:keys]];
-    sqlite3_stmt *stmt = NULL;
-    int result = sqlite3_prepare_v2(_db, sql.UTF8String, -1, &stmt, NULL);
-    if (result != SQLITE_OK) {
-        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite stmt prepare error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
-        return NO;
-    }
-    
-    [self _dbBindJoinedKeys:keys stmt:stmt fromIndex:1];
-    result = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    if (result == SQLITE_ERROR) {
-        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite delete error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
-        return NO;
+    for (NSArray *batch in _YYKVKeysBatches(keys)) {
+        int arity = 0;
+        sqlite3_stmt *stmt = [self _dbPrepareKeysStmt:_YYKVKeysStmtDeleteItems count:batch.count arity:&arity];
+        if (!stmt) return NO;
+        [self _dbBindJoinedKeys:batch stmt:stmt arity:arity];
+        int result = sqlite3_step(stmt);
+        if (result != SQLITE_DONE) {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite delete error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            return NO;
+        }
     }
     return YES;
 }
 
 - (BOOL)_dbDeleteItemsWithSizeLargerThan:(int)size {
-    NSString *sql = @"delete from manifest where size > ?1;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtDeleteItemsLargerThanSize];
     if (!stmt) return NO;
     sqlite3_bind_int(stmt, 1, size);
     int result = sqlite3_step(stmt);
@@ -299,8 +777,7 @@ static NSString *const kTrashDirectoryName = @"trash";
 }
 
 - (BOOL)_dbDeleteItemsWithTimeEarlierThan:(int)time {
-    NSString *sql = @"delete from manifest where last_access_time < ?1;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtDeleteItemsEarlierThanTime];
     if (!stmt) return NO;
     sqlite3_bind_int(stmt, 1, time);
     int result = sqlite3_step(stmt);
@@ -322,6 +799,9 @@ static NSString *const kTrashDirectoryName = @"trash";
     int last_access_time = sqlite3_column_int(stmt, i++);
     const void *extended_data = sqlite3_column_blob(stmt, i);
     int extended_data_bytes = sqlite3_column_bytes(stmt, i++);
+    int codec = sqlite3_column_int(stmt, i++);
+    int segment = sqlite3_column_int(stmt, i++);
+    int64_t segment_offset = sqlite3_column_int64(stmt, i++);
     
     YYKVStorageItem *item = [YYKVStorageItem new];
     if (key) item.key = [NSString stringWithUTF8String:key];
@@ -331,12 +811,14 @@ static NSString *const kTrashDirectoryName = @"trash";
     item.modTime = modification_time;
     item.accessTime = last_access_time;
     if (extended_data_bytes > 0 && extended_data) item.extendedData = [NSData dataWithBytes:extended_data length:extended_data_bytes];
+    item.codec = codec;
+    item.segment = segment;
+    item.segmentOffset = segment_offset;
     return item;
 }
 
 - (YYKVStorageItem *)_dbGetItemWithKey:(NSString *)key excludeInlineData:(BOOL)excludeInlineData {
-    NSString *sql = excludeInlineData ? @"select key, filename, size, modification_time, last_access_time, extended_data from manifest where key = ?1;" : @"select key, filename, size, inline_data, modification_time, last_access_time, extended_data from manifest where key = ?1;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:excludeInlineData ? _YYKVStmtGetItemInfo : _YYKVStmtGetItem];
     if (!stmt) return nil;
     sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
     
@@ -346,7 +828,7 @@ static NSString *const kTrashDirectoryName = @"trash";
         item = [self _dbGetItemFromStmt:stmt excludeInlineData:excludeInlineData];
     } else {
         if (result != SQLITE_DONE) {
-            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(sqlite3_db_handle(stmt)));
         }
     }
     return item;
@@ -354,62 +836,69 @@ static NSString *const kTrashDirectoryName = @"trash";
 
 - (NSMutableArray *)_dbGetItemWithKeys:(NSArray *)keys excludeInlineData:(BOOL)excludeInlineData {
     if (![self _dbIsReady]) return nil;
-    NSString *sql;
-    if (excludeInlineData) {
-        sql = [NSString stringWithFormat:@"select key, filename, size, modification_time, last_access_time, extended_data from manifest where key in (%@);", [self _dbJoinedKeys:keys]];
-    } else {
-        sql = [NSString stringWithFormat:@"select key, filename, size, inline_data, modification_time, last_access_time, extended_data from manifest where key in (%@)", [self _dbJoinedKeys:keys]];
-    }
-    
-    sqlite3_stmt *stmt = NULL;
-    int result = sqlite3_prepare_v2(_db, sql.UTF8String, -1, &stmt, NULL);
-    if (result != SQLITE_OK) {
-        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite stmt prepare error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
-        return nil;
-    }
-    
-    [self _dbBindJoinedKeys:keys stmt:stmt fromIndex:1];
+    _YYKVKeysStmt stmtID = excludeInlineData ? _YYKVKeysStmtGetItemInfos : _YYKVKeysStmtGetItems;
     NSMutableArray *items = [NSMutableArray new];
-    do {
-        result = sqlite3_step(stmt);
-        if (result == SQLITE_ROW) {
-            YYKVStorageItem *item = [self _dbGetItemFromStmt:stmt excludeInlineData:excludeInlineData];
-            if (item) [items addObject:item];
-        } else if (result == SQLITE_DONE) {
-            break;
-        } else {
-            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
-            items = nil;
-            break;
-        }
-    } while (1);
-    sqlite3_finalize(stmt);
+    for (NSArray *batch in _YYKVKeysBatches(keys)) {
+        int arity = 0;
+        sqlite3_stmt *stmt = [self _dbPrepareKeysStmt:stmtID count:batch.count arity:&arity];
+        if (!stmt) return nil;
+        [self _dbBindJoinedKeys:batch stmt:stmt arity:arity];
+        do {
+            int result = sqlite3_step(stmt);
+            if (result == SQLITE_ROW) {
+                YYKVStorageItem *item = [self _dbGetItemFromStmt:stmt excludeInlineData:excludeInlineData];
+                if (item) [items addObject:item];
+            } else if (result == SQLITE_DONE) {
+                break;
+            } else {
+                if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(sqlite3_db_handle(stmt)));
+                sqlite3_reset(stmt);
+                return nil;
+            }
+        } while (1);
+    }
     return items;
 }
 
-- (NSData *)_dbGetValueWithKey:(NSString *)key {
-    NSString *sql = @"select inline_data from manifest where key = ?1;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+/**
+ Get the decoded value of an item, from inline data, segment or file.
+ 
+ @param filename Output, the item's filename if the value is stored in file.
+ */
+- (NSData *)_dbGetValueWithKey:(NSString *)key filename:(NSString **)filename {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetValue];
     if (!stmt) return nil;
     sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
     
     int result = sqlite3_step(stmt);
     if (result == SQLITE_ROW) {
+        int codec = sqlite3_column_int(stmt, 1);
+        char *name = (char *)sqlite3_column_text(stmt, 5);
+        if (name && *name != 0) {
+            NSString *file = [NSString stringWithUTF8String:name];
+            if (filename) *filename = file;
+            return [self _decodeValue:[self _fileReadWithName:file] codec:codec];
+        }
+        int segment = sqlite3_column_int(stmt, 2);
+        if (segment > 0) {
+            NSData *value = [self _segmentReadWithID:segment offset:sqlite3_column_int64(stmt, 3) length:sqlite3_column_int(stmt, 4)];
+            return [self _decodeValue:value codec:codec];
+        }
         const void *inline_data = sqlite3_column_blob(stmt, 0);
         int inline_data_bytes = sqlite3_column_bytes(stmt, 0);
         if (!inline_data || inline_data_bytes <= 0) return nil;
-        return [NSData dataWithBytes:inline_data length:inline_data_bytes];
+        NSData *value = [NSData dataWithBytes:inline_data length:inline_data_bytes];
+        return [self _decodeValue:value codec:codec];
     } else {
         if (result != SQLITE_DONE) {
-            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(sqlite3_db_handle(stmt)));
         }
         return nil;
     }
 }
 
 - (NSString *)_dbGetFilenameWithKey:(NSString *)key {
-    NSString *sql = @"select filename from manifest where key = ?1;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetFilename];
     if (!stmt) return nil;
     sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
     int result = sqlite3_step(stmt);
@@ -420,7 +909,7 @@ static NSString *const kTrashDirectoryName = @"trash";
         }
     } else {
         if (result != SQLITE_DONE) {
-            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(sqlite3_db_handle(stmt)));
         }
     }
     return nil;
@@ -428,39 +917,34 @@ static NSString *const kTrashDirectoryName = @"trash";
 
 - (NSMutableArray *)_dbGetFilenameWithKeys:(NSArray *)keys {
     if (![self _dbIsReady]) return nil;
-    NSString *sql = [NSString stringWithFormat:@"select filename from manifest where key in (%@);", [self _dbJoinedKeys:keys]];
-    sqlite3_stmt *stmt = NULL;
-    int result = sqlite3_prepare_v2(_db, sql.UTF8String, -1, &stmt, NULL);
-    if (result != SQLITE_OK) {
-        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite stmt prepare error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
-        return nil;
-    }
-    
-    [self _dbBindJoinedKeys:keys stmt:stmt fromIndex:1];
     NSMutableArray *filenames = [NSMutableArray new];
-    do {
-        result = sqlite3_step(stmt);
-        if (result == SQLITE_ROW) {
-            char *filename = (char *)sqlite3_column_text(stmt, 0);
-            if (filename && *filename != 0) {
-                NSString *name = [NSString stringWithUTF8String:filename];
-                if (name) [filenames addObject:name];
+    for (NSArray *batch in _YYKVKeysBatches(keys)) {
+        int arity = 0;
+        sqlite3_stmt *stmt = [self _dbPrepareKeysStmt:_YYKVKeysStmtGetFilenames count:batch.count arity:&arity];
+        if (!stmt) return nil;
+        [self _dbBindJoinedKeys:batch stmt:stmt arity:arity];
+        do {
+            int result = sqlite3_step(stmt);
+            if (result == SQLITE_ROW) {
+                char *filename = (char *)sqlite3_column_text(stmt, 0);
+                if (filename && *filename != 0) {
+                    NSString *name = [NSString stringWithUTF8String:filename];
+                    if (name) [filenames addObject:name];
+                }
+            } else if (result == SQLITE_DONE) {
+                break;
+            } else {
+                if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+                sqlite3_reset(stmt);
+                return nil;
             }
-        } else if (result == SQLITE_DONE) {
-            break;
-        } else {
-            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
-            filenames = nil;
-            break;
-        }
-    } while (1);
-    sqlite3_finalize(stmt);
+        } while (1);
+    }
     return filenames;
 }
 
 - (NSMutableArray *)_dbGetFilenamesWithSizeLargerThan:(int)size {
-    NSString *sql = @"select filename from manifest where size > ?1 and filename is not null;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetFilenamesLargerThanSize];
     if (!stmt) return nil;
     sqlite3_bind_int(stmt, 1, size);
     
@@ -485,8 +969,7 @@ static NSString *const kTrashDirectoryName = @"trash";
 }
 
 - (NSMutableArray *)_dbGetFilenamesWithTimeEarlierThan:(int)time {
-    NSString *sql = @"select filename from manifest where last_access_time < ?1 and filename is not null;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetFilenamesEarlierThanTime];
     if (!stmt) return nil;
     sqlite3_bind_int(stmt, 1, time);
     
@@ -511,8 +994,7 @@ static NSString *const kTrashDirectoryName = @"trash";
 }
 
 - (NSMutableArray *)_dbGetItemSizeInfoOrderByTimeDescWithLimit:(int)count {
-    NSString *sql = @"select key, filename, size from manifest order by last_access_time desc limit ?1;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetItemSizeInfoOrderByTimeDesc];
     if (!stmt) return nil;
     sqlite3_bind_int(stmt, 1, count);
     
@@ -539,34 +1021,136 @@ static NSString *const kTrashDirectoryName = @"trash";
     return items;
 }
 
+/**
+ Scan the items in LRU order until `count` items (or `size` bytes of items) are 
+ collected, and get the position of the last collected item in the order.
+ 
+ @param count     The number of items to collect, 0 to ignore.
+ @param size      The bytes of items to collect, 0 to ignore.
+ @param time      Output the last access time of the last collected item.
+ @param rowid     Output the rowid of the last collected item.
+ @param filenames The filenames of the collected items are added to this array.
+ @return Whether any item is collected.
+ */
+- (BOOL)_dbGetLRUCutoffWithCount:(int)count size:(int64_t)size time:(int *)time rowid:(sqlite3_int64 *)rowid filenames:(NSMutableArray *)filenames {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetLRUItems];
+    if (!stmt) return NO;
+    
+    int collectedCount = 0;
+    int64_t collectedSize = 0;
+    BOOL collected = NO;
+    do {
+        int result = sqlite3_step(stmt);
+        if (result == SQLITE_ROW) {
+            *time = sqlite3_column_int(stmt, 0);
+            *rowid = sqlite3_column_int64(stmt, 1);
+            collectedSize += sqlite3_column_int(stmt, 2);
+            collectedCount++;
+            collected = YES;
+            char *filename = (char *)sqlite3_column_text(stmt, 3);
+            if (filename && *filename != 0) [filenames addObject:[NSString stringWithUTF8String:filename]];
+            if (count > 0 && collectedCount >= count) break;
+            if (size > 0 && collectedSize >= size) break;
+        } else if (result == SQLITE_DONE) {
+            break;
+        } else {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            collected = NO;
+            break;
+        }
+    } while (1);
+    sqlite3_reset(stmt);
+    return collected;
+}
+
+/// Delete the items before (and including) a position in LRU order.
+- (BOOL)_dbDeleteItemsWithLRUCutoffTime:(int)time rowid:(sqlite3_int64)rowid {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtDeleteLRUItems];
+    if (!stmt) return NO;
+    sqlite3_bind_int(stmt, 1, time);
+    sqlite3_bind_int64(stmt, 2, rowid);
+    int result = sqlite3_step(stmt);
+    if (result != SQLITE_DONE) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite delete error (%d): %s",__FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return NO;
+    }
+    return YES;
+}
+
 - (int)_dbGetItemCountWithKey:(NSString *)key {
-    NSString *sql = @"select count(key) from manifest where key = ?1;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetItemCount];
     if (!stmt) return -1;
     sqlite3_bind_text(stmt, 1, key.UTF8String, -1, NULL);
     int result = sqlite3_step(stmt);
     if (result != SQLITE_ROW) {
-        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(sqlite3_db_handle(stmt)));
         return -1;
     }
     return sqlite3_column_int(stmt, 0);
 }
 
-- (int)_dbGetTotalItemSize {
-    NSString *sql = @"select sum(size) from manifest;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+- (int)_dbGetRefCountWithFilename:(NSString *)filename {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetRefCount];
+    if (!stmt) return -1;
+    sqlite3_bind_text(stmt, 1, filename.UTF8String, -1, NULL);
+    int result = sqlite3_step(stmt);
+    if (result == SQLITE_ROW) {
+        return sqlite3_column_int(stmt, 0);
+    } else if (result != SQLITE_DONE) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return -1;
+    }
+    return 0;
+}
+
+- (BOOL)_dbSetRefCount:(int)refCount withFilename:(NSString *)filename {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:refCount > 0 ? _YYKVStmtSetRefCount : _YYKVStmtDeleteRefCount];
+    if (!stmt) return NO;
+    sqlite3_bind_text(stmt, 1, filename.UTF8String, -1, NULL);
+    if (refCount > 0) sqlite3_bind_int(stmt, 2, refCount);
+    int result = sqlite3_step(stmt);
+    if (result != SQLITE_DONE) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite update error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL)_dbHasSharedFiles {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtHasSharedFiles];
+    if (!stmt) return NO;
+    int result = sqlite3_step(stmt);
+    if (result != SQLITE_ROW) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return NO;
+    }
+    return sqlite3_column_int(stmt, 0) > 0;
+}
+
+- (int64_t)_dbGetTotalItemSize {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetTotalSize];
     if (!stmt) return -1;
     int result = sqlite3_step(stmt);
     if (result != SQLITE_ROW) {
         if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
         return -1;
     }
-    return sqlite3_column_int(stmt, 0);
+    return sqlite3_column_int64(stmt, 0);
+}
+
+- (int64_t)_dbGetTotalItemLogicalSize {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetTotalLogicalSize];
+    if (!stmt) return -1;
+    int result = sqlite3_step(stmt);
+    if (result != SQLITE_ROW) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return -1;
+    }
+    return sqlite3_column_int64(stmt, 0);
 }
 
 - (int)_dbGetTotalItemCount {
-    NSString *sql = @"select count(*) from manifest;";
-    sqlite3_stmt *stmt = [self _dbPrepareStmt:sql];
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetTotalCount];
     if (!stmt) return -1;
     int result = sqlite3_step(stmt);
     if (result != SQLITE_ROW) {
@@ -577,53 +1161,921 @@ static NSString *const kTrashDirectoryName = @"trash";
 }
 
 
-#pragma mark - file
+#pragma mark - write-behind
 
-- (BOOL)_fileWriteWithName:(NSString *)filename data:(NSData *)data {
-    if (_invalidated) return NO;
-    NSString *path = [_dataPath stringByAppendingPathComponent:filename];
-    return [data writeToFile:path atomically:NO];
+- (void)_pendingQueueTouched {
+    if (_pendingSince == 0) _pendingSince = CACurrentMediaTime();
 }
 
-- (NSData *)_fileReadWithName:(NSString *)filename {
-    if (_invalidated) return nil;
-    NSString *path = [_dataPath stringByAppendingPathComponent:filename];
-    NSData *data = [NSData dataWithContentsOfFile:path];
-    return data;
+- (void)_enqueueItemWithKey:(NSString *)key value:(NSData *)value filename:(NSString *)filename extendedData:(NSData *)extendedData {
+    YYKVStorageItem *old = _pendingItems[key];
+    if (old) _pendingBytes -= old.size;
+    int timestamp = (int)time(NULL);
+    YYKVStorageItem *item = [YYKVStorageItem new];
+    item.key = key;
+    item.value = value;
+    item.filename = filename.length ? filename : nil;
+    item.size = (int)value.length;
+    item.modTime = timestamp;
+    item.accessTime = timestamp;
+    item.extendedData = extendedData;
+    _pendingItems[key] = item;
+    _pendingBytes += item.size;
+    [_accessTimes removeObjectForKey:key]; // the save updates access time
+    [self _pendingQueueTouched];
+    [self _flushPendingWritesIfNeeded];
 }
 
-- (BOOL)_fileDeleteWithName:(NSString *)filename {
-    if (_invalidated) return NO;
-    NSString *path = [_dataPath stringByAppendingPathComponent:filename];
+/// Remove the queued operations of a key (the item is being removed).
+- (void)_dequeueKey:(NSString *)key {
+    YYKVStorageItem *item = _pendingItems[key];
+    if (item) {
+        _pendingBytes -= item.size;
+        [_pendingItems removeObjectForKey:key];
+    }
+    [_accessTimes removeObjectForKey:key];
+}
+
+/// Get the queued items for keys, and remove these keys from the `keys`.
+/// Returns nil if no item is queued.
+- (NSMutableArray *)_pendingItemsForKeys:(NSArray **)keys excludeValue:(BOOL)excludeValue {
+    if (_pendingItems.count == 0) return nil;
+    NSMutableArray *items = [NSMutableArray new];
+    NSMutableArray *missingKeys = [NSMutableArray new];
+    for (NSString *key in *keys) {
+        YYKVStorageItem *item = [self _pendingItemForKey:key excludeValue:excludeValue];
+        if (item) [items addObject:item];
+        else [missingKeys addObject:key];
+    }
+    if (items.count == 0) return nil;
+    *keys = missingKeys;
+    return items;
+}
+
+/// Drop all queued items.
+- (void)_dequeueAll {
+    [_pendingItems removeAllObjects];
+    _pendingBytes = 0;
+    _pendingSince = 0;
+}
+
+/// Get a queued item, the value is excluded if `excludeValue` is YES.
+- (YYKVStorageItem *)_pendingItemForKey:(NSString *)key excludeValue:(BOOL)excludeValue {
+    YYKVStorageItem *pending = _pendingItems[key];
+    if (!pending) return nil;
+    YYKVStorageItem *item = [YYKVStorageItem new];
+    item.key = pending.key;
+    item.value = excludeValue ? nil : pending.value;
+    item.filename = pending.filename;
+    item.size = pending.size;
+    item.modTime = pending.modTime;
+    item.accessTime = pending.accessTime;
+    item.extendedData = pending.extendedData;
+    return item;
+}
+
+- (void)_flushPendingWritesIfNeeded {
+    if (_pendingSince == 0) return;
+    if (_pendingItems.count >= _writeBehindBatchSize ||
+        _pendingBytes >= kWriteBehindBytesMax ||
+        CACurrentMediaTime() - _pendingSince >= _writeBehindInterval) {
+        [self flushPendingWrites];
+    }
+}
+
+
+#pragma mark - access time
+
+/// Record the access time in memory, it's written to sqlite by `flushAccessTimes`.
+- (void)_updateAccessTimeWithKey:(NSString *)key {
+    pthread_mutex_lock(&_readLock);
+    _accessTimes[key] = @((int)time(NULL));
+    BOOL full = _accessTimes.count >= kAccessTimesCountMax;
+    pthread_mutex_unlock(&_readLock);
+    if (full && ![self _readerIsBound]) [self flushAccessTimes];
+}
+
+/// Record the access time in memory, it's written to sqlite by `flushAccessTimes`.
+- (void)_updateAccessTimeWithItems:(NSArray *)items {
+    NSNumber *now = @((int)time(NULL));
+    pthread_mutex_lock(&_readLock);
+    for (YYKVStorageItem *item in items) {
+        if (item.key) _accessTimes[item.key] = now;
+    }
+    BOOL full = _accessTimes.count >= kAccessTimesCountMax;
+    pthread_mutex_unlock(&_readLock);
+    if (full && ![self _readerIsBound]) [self flushAccessTimes];
+}
+
+/// Apply the access time not written to sqlite yet to an item.
+- (void)_applyAccessTimeToItem:(YYKVStorageItem *)item {
+    if (!item.key) return;
+    pthread_mutex_lock(&_readLock);
+    NSNumber *accessTime = _accessTimes[item.key];
+    pthread_mutex_unlock(&_readLock);
+    if (accessTime) item.accessTime = accessTime.intValue;
+}
+
+
+#pragma mark - reader pool
+
+- (void)_readersOpen {
+    if (_readerConnectionCount == 0 || _readers || !_db) return;
+    _readers = calloc(_readerConnectionCount, sizeof(_YYKVReader));
+    _freeReaders = calloc(_readerConnectionCount, sizeof(_YYKVReader *));
+    _freeReaderCount = 0;
+    for (NSUInteger i = 0; i < _readerConnectionCount; i++) {
+        sqlite3 *db = NULL;
+        int result = sqlite3_open_v2(_dbPath.UTF8String, &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL);
+        if (result != SQLITE_OK) {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite open reader failed (%d).", __FUNCTION__, __LINE__, result);
+            if (db) sqlite3_close(db);
+            continue;
+        }
+        _readers[_freeReaderCount].db = db;
+        _freeReaders[_freeReaderCount] = &_readers[_freeReaderCount];
+        _freeReaderCount++;
+    }
+    // only the opened readers are counted, the callers rely on it to decide whether to read concurrently
+    _readerConnectionCount = _freeReaderCount;
+    if (_freeReaderCount == 0) {
+        free(_readers);
+        free(_freeReaders);
+        _readers = NULL;
+        _freeReaders = NULL;
+        return;
+    }
+    _readerSemaphore = dispatch_semaphore_create(_freeReaderCount);
+}
+
+/// Should not be called during a read.
+- (void)_readersClose {
+    if (!_readers) return;
+    for (NSUInteger i = 0; i < _readerConnectionCount; i++) {
+        sqlite3 *db = _readers[i].db;
+        if (!db) continue;
+        sqlite3_stmt *stmt;
+        while ((stmt = sqlite3_next_stmt(db, nil)) != 0) {
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_close(db);
+    }
+    free(_readers);
+    free(_freeReaders);
+    _readers = NULL;
+    _freeReaders = NULL;
+    _freeReaderCount = 0;
+    _readerSemaphore = nil;
+}
+
+/// Bind a reader to current thread, returns NULL if the pool is disabled or a reader is bound already.
+- (_YYKVReader *)_readerBegin {
+    if (!_readers || pthread_getspecific(_readerKey)) return NULL;
+    dispatch_semaphore_wait(_readerSemaphore, DISPATCH_TIME_FOREVER);
+    pthread_mutex_lock(&_readLock);
+    _YYKVReader *reader = _freeReaders[--_freeReaderCount];
+    pthread_mutex_unlock(&_readLock);
+    pthread_setspecific(_readerKey, reader);
+    return reader;
+}
+
+- (void)_readerEnd:(_YYKVReader *)reader {
+    if (!reader) return;
+    pthread_setspecific(_readerKey, NULL);
+    // end the read transaction, otherwise it blocks the wal checkpoint
+    sqlite3_stmt *stmt = NULL;
+    while ((stmt = sqlite3_next_stmt(reader->db, stmt)) != 0) {
+        if (sqlite3_stmt_busy(stmt)) sqlite3_reset(stmt);
+    }
+    pthread_mutex_lock(&_readLock);
+    _freeReaders[_freeReaderCount++] = reader;
+    pthread_mutex_unlock(&_readLock);
+    dispatch_semaphore_signal(_readerSemaphore);
+}
+
+/// Whether current thread is reading with a reader, the storage should not be written.
+- (BOOL)_readerIsBound {
+    return _readers && pthread_getspecific(_readerKey);
+}
+
+/// Remove an item whose value can't be read, it's deferred to `flushAccessTimes` in a concurrent read.
+- (void)_removeBrokenItemWithKey:(NSString *)key filename:(NSString *)filename {
+    if ([self _readerIsBound]) {
+        pthread_mutex_lock(&_readLock);
+        [_brokenKeys addObject:key];
+        pthread_mutex_unlock(&_readLock);
+        return;
+    }
+    [self _removeRowsReleasingFiles:filename ? @[filename] : nil usingBlock:^BOOL{
+        return [self _dbDeleteItemWithKey:key];
+    }];
+}
+
+/// Check the items found broken by concurrent reads again, and remove them if they're still broken.
+- (void)_removeBrokenItems {
+    if (_brokenKeys.count == 0) return;
+    NSArray *keys = _brokenKeys.allObjects;
+    [_brokenKeys removeAllObjects];
+    for (NSString *key in keys) {
+        if (_pendingItems[key]) continue;
+        YYKVStorageItem *item = [self _dbGetItemWithKey:key excludeInlineData:NO];
+        if (item) [self _loadValueForItem:item];
+    }
+}
+
+
+#pragma mark - file
+
+/// Whether a file in data directory is still mapped by a returned NSData.
+- (BOOL)_fileIsMappedWithName:(NSString *)filename {
+    return _mappedFiles.count && [_mappedFiles objectForKey:filename] != nil;
+}
+
+/**
+ Move a mapped file to trash, so that it will not be truncated or unlinked
+ while the mapped NSData is alive (touching a truncated page raises SIGBUS).
+ */
+- (BOOL)_fileMoveMappedToTrashWithName:(NSString *)filename {
+    NSData *data = [_mappedFiles objectForKey:filename];
+    if (!data) return NO;
+    [_mappedFiles removeObjectForKey:filename];
+    CFUUIDRef uuidRef = CFUUIDCreate(NULL);
+    CFStringRef uuid = CFUUIDCreateString(NULL, uuidRef);
+    CFRelease(uuidRef);
+    NSString *path = [_dataPath stringByAppendingPathComponent:filename];
+    NSString *tmpPath = [_trashPath stringByAppendingPathComponent:(__bridge NSString *)(uuid)];
+    CFRelease(uuid);
+    BOOL suc = [[NSFileManager defaultManager] moveItemAtPath:path toPath:tmpPath error:NULL];
+    if (suc) [_mappedTrashFiles setObject:data forKey:tmpPath];
+    return suc;
+}
+
+- (BOOL)_fileWriteWithName:(NSString *)filename data:(NSData *)data {
+    if (_invalidated) return NO;
+    [self _sessionMark];
+    if ([self _fileIsMappedWithName:filename]) {
+        [self _fileMoveMappedToTrashWithName:filename]; // write to a new file instead of overwriting the mapped one
+    }
+    // a crash never leaves a half-written file in data directory, only in temp directory
+    NSString *path = [_dataPath stringByAppendingPathComponent:filename];
+    NSString *tempPath = [_tempPath stringByAppendingPathComponent:filename];
+    if (![data writeToFile:tempPath atomically:NO]) return NO;
+    if (rename(tempPath.fileSystemRepresentation, path.fileSystemRepresentation) != 0) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d rename error (%d).", __FUNCTION__, __LINE__, errno);
+        unlink(tempPath.fileSystemRepresentation);
+        return NO;
+    }
+    [_reconcileFilenames addObject:filename];
+    return YES;
+}
+
+- (NSData *)_fileReadWithName:(NSString *)filename {
+    if (_invalidated) return nil;
+    uint64_t begin = YYCacheStatisticsTime();
+    NSData *data = [self _fileReadDataWithName:filename];
+    [_trashPurger recordReadWithBytes:data.length latency:YYCacheStatisticsTime() - begin];
+    return data;
+}
+
+- (NSData *)_fileReadDataWithName:(NSString *)filename {
+    NSString *path = [_dataPath stringByAppendingPathComponent:filename];
+    if (_mappedReadsEnabled) {
+        pthread_mutex_lock(&_readLock);
+        NSData *data = [_mappedFiles objectForKey:filename];
+        pthread_mutex_unlock(&_readLock);
+        if (data) return data;
+        struct stat st;
+        if (stat(path.fileSystemRepresentation, &st) != 0) return nil;
+        if (st.st_size >= kMappedReadSizeMin) {
+            data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedAlways error:NULL];
+            if (data) {
+                pthread_mutex_lock(&_readLock);
+                [_mappedFiles setObject:data forKey:filename];
+                pthread_mutex_unlock(&_readLock);
+            }
+            return data;
+        }
+    }
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    return data;
+}
+
+- (BOOL)_fileDeleteWithName:(NSString *)filename {
+    if (_invalidated) return NO;
+    if ([self _fileIsMappedWithName:filename]) {
+        return [self _fileMoveMappedToTrashWithName:filename];
+    }
+    NSString *path = [_dataPath stringByAppendingPathComponent:filename];
     return [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
 }
 
 - (BOOL)_fileMoveAllToTrash {
     if (_invalidated) return NO;
+    [self _segmentCloseAll];
     CFUUIDRef uuidRef = CFUUIDCreate(NULL);
     CFStringRef uuid = CFUUIDCreateString(NULL, uuidRef);
     CFRelease(uuidRef);
     NSString *tmpPath = [_trashPath stringByAppendingPathComponent:(__bridge NSString *)(uuid)];
     BOOL suc = [[NSFileManager defaultManager] moveItemAtPath:_dataPath toPath:tmpPath error:nil];
     if (suc) {
+        for (NSString *filename in _mappedFiles.keyEnumerator.allObjects) {
+            NSData *data = [_mappedFiles objectForKey:filename];
+            if (data) [_mappedTrashFiles setObject:data forKey:[tmpPath stringByAppendingPathComponent:filename]];
+        }
+        [_mappedFiles removeAllObjects];
         suc = [[NSFileManager defaultManager] createDirectoryAtPath:_dataPath withIntermediateDirectories:YES attributes:nil error:NULL];
     }
     CFRelease(uuid);
     return suc;
 }
 
+/**
+ Move files to a new folder in trash with `rename`, and empty the trash in background.
+ It's much faster than deleting the files one by one in the calling thread.
+ */
+- (void)_fileMoveToTrashWithNames:(NSArray *)filenames {
+    if (_invalidated || filenames.count == 0) return;
+    CFUUIDRef uuidRef = CFUUIDCreate(NULL);
+    CFStringRef uuid = CFUUIDCreateString(NULL, uuidRef);
+    CFRelease(uuidRef);
+    NSString *tmpPath = [_trashPath stringByAppendingPathComponent:(__bridge NSString *)(uuid)];
+    CFRelease(uuid);
+    if (![[NSFileManager defaultManager] createDirectoryAtPath:tmpPath withIntermediateDirectories:YES attributes:nil error:NULL]) {
+        for (NSString *filename in filenames) [self _fileDeleteWithName:filename];
+        return;
+    }
+    for (NSString *filename in filenames) {
+        NSString *path = [_dataPath stringByAppendingPathComponent:filename];
+        NSString *trashPath = [tmpPath stringByAppendingPathComponent:filename];
+        if (rename(path.fileSystemRepresentation, trashPath.fileSystemRepresentation) != 0) continue;
+        NSData *mapped = _mappedFiles.count ? [_mappedFiles objectForKey:filename] : nil;
+        if (mapped) {
+            [_mappedFiles removeObjectForKey:filename];
+            [_mappedTrashFiles setObject:mapped forKey:trashPath];
+        }
+    }
+    [self _fileEmptyTrashInBackground];
+}
+
 - (void)_fileEmptyTrashInBackground {
     if (_invalidated) return;
     NSString *trashPath = _trashPath;
     dispatch_queue_t queue = _trashQueue;
-    dispatch_async(queue, ^{
-        NSFileManager *manager = [NSFileManager new];
-        NSArray *directoryContents = [manager contentsOfDirectoryAtPath:trashPath error:NULL];
-        for (NSString *path in directoryContents) {
-            NSString *fullPath = [trashPath stringByAppendingPathComponent:path];
-            [manager removeItemAtPath:fullPath error:NULL];
+    
+    // the files still mapped are kept, they'll be removed next time
+    NSMutableSet *mappedPaths = [NSMutableSet new];
+    for (NSString *path in _mappedTrashFiles.keyEnumerator.allObjects) {
+        if ([_mappedTrashFiles objectForKey:path]) [mappedPaths addObject:path];
+        else [_mappedTrashFiles removeObjectForKey:path];
+    }
+    
+    // only the files in trash now are purged, the files moved to trash later are purged by next call
+    NSMutableArray *paths = [NSMutableArray new];
+    for (NSString *path in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:trashPath error:NULL]) {
+        [paths addObject:[trashPath stringByAppendingPathComponent:path]];
+    }
+    [_trashPurger purgeTrashPaths:paths excludingPaths:mappedPaths queue:queue];
+}
+
+
+#pragma mark - segment
+
+- (NSString *)_segmentNameWithID:(int)segmentID {
+    return [NSString stringWithFormat:@"segment-%d", segmentID];
+}
+
+- (int)_dbGetLastSegmentID {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetLastSegment];
+    if (!stmt) return -1;
+    int result = sqlite3_step(stmt);
+    if (result != SQLITE_ROW) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return -1;
+    }
+    return sqlite3_column_int(stmt, 0); // 0 if null
+}
+
+- (BOOL)_dbAddSegmentWithID:(int)segmentID {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtAddSegment];
+    if (!stmt) return NO;
+    sqlite3_bind_int(stmt, 1, segmentID);
+    int result = sqlite3_step(stmt);
+    if (result != SQLITE_DONE) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite insert error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL)_dbDeleteSegmentWithID:(int)segmentID {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtDeleteSegment];
+    if (!stmt) return NO;
+    sqlite3_bind_int(stmt, 1, segmentID);
+    int result = sqlite3_step(stmt);
+    if (result != SQLITE_DONE) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite delete error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL)_dbMoveSegmentItemWithKey:(NSString *)key fromSegment:(int)fromSegment toSegment:(int)toSegment offset:(int64_t)offset {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtMoveSegmentItem];
+    if (!stmt) return NO;
+    sqlite3_bind_int(stmt, 1, toSegment);
+    sqlite3_bind_int64(stmt, 2, offset);
+    sqlite3_bind_text(stmt, 3, key.UTF8String, -1, NULL);
+    sqlite3_bind_int(stmt, 4, fromSegment);
+    int result = sqlite3_step(stmt);
+    if (result != SQLITE_DONE) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite update error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return NO;
+    }
+    return YES;
+}
+
+/// Open the segment for appending `length` bytes, a new segment is started if the current one is full.
+- (BOOL)_segmentOpenForLength:(NSUInteger)length {
+    if (_segmentFD >= 0) {
+        if (_segmentSize == 0 || _segmentSize + (off_t)length <= kSegmentSizeMax) return YES;
+        close(_segmentFD);
+        _segmentFD = -1;
+        _segmentID++;
+    } else {
+        int segmentID = [self _dbGetLastSegmentID];
+        if (segmentID < 0) return NO;
+        _segmentID = MAX(segmentID, 1);
+    }
+    
+    for (;;) {
+        if (![self _dbAddSegmentWithID:_segmentID]) return NO;
+        NSString *path = [_dataPath stringByAppendingPathComponent:[self _segmentNameWithID:_segmentID]];
+        int fd = open(path.fileSystemRepresentation, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d open segment error (%d).", __FUNCTION__, __LINE__, errno);
+            return NO;
         }
-    });
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return NO;
+        }
+        if (st.st_size == 0 || st.st_size + (off_t)length <= kSegmentSizeMax) {
+            _segmentFD = fd;
+            _segmentSize = st.st_size; // the bytes written before a crash are appended after, they're never read
+            return YES;
+        }
+        close(fd);
+        _segmentID++;
+    }
+}
+
+/// Append a value to the segment, and get its position.
+- (BOOL)_segmentAppendData:(NSData *)data segment:(int *)segmentID offset:(int64_t *)offset {
+    if (![self _segmentOpenForLength:data.length]) return NO;
+    [self _sessionMark];
+    ssize_t written = pwrite(_segmentFD, data.bytes, data.length, _segmentSize);
+    if (written != (ssize_t)data.length) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d write segment error (%d).", __FUNCTION__, __LINE__, errno);
+        return NO;
+    }
+    *segmentID = _segmentID;
+    *offset = _segmentSize;
+    _segmentSize += data.length;
+    return YES;
+}
+
+- (int)_segmentReadFDWithID:(int)segmentID {
+    pthread_mutex_lock(&_readLock);
+    NSNumber *fd = _segmentReadFDs[@(segmentID)];
+    if (!fd) {
+        NSString *path = [_dataPath stringByAppendingPathComponent:[self _segmentNameWithID:segmentID]];
+        int newFD = open(path.fileSystemRepresentation, O_RDONLY);
+        if (newFD >= 0) {
+            fd = @(newFD);
+            _segmentReadFDs[@(segmentID)] = fd;
+        }
+    }
+    pthread_mutex_unlock(&_readLock);
+    return fd ? fd.intValue : -1;
+}
+
+- (NSData *)_segmentReadWithID:(int)segmentID offset:(int64_t)offset length:(int)length {
+    if (_invalidated || length <= 0) return nil;
+    int fd = [self _segmentReadFDWithID:segmentID];
+    if (fd < 0) return nil;
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    uint64_t begin = YYCacheStatisticsTime();
+    ssize_t count = pread(fd, data.mutableBytes, length, offset);
+    [_trashPurger recordReadWithBytes:count > 0 ? count : 0 latency:YYCacheStatisticsTime() - begin];
+    return count == length ? data : nil;
+}
+
+- (void)_segmentCloseReadFDWithID:(int)segmentID {
+    NSNumber *fd = _segmentReadFDs[@(segmentID)];
+    if (!fd) return;
+    close(fd.intValue);
+    [_segmentReadFDs removeObjectForKey:@(segmentID)];
+}
+
+/// Close all segment files, should be called before the data directory is moved.
+- (void)_segmentCloseAll {
+    if (_segmentFD >= 0) close(_segmentFD);
+    _segmentFD = -1;
+    _segmentID = 0;
+    _segmentSize = 0;
+    for (NSNumber *fd in _segmentReadFDs.allValues) close(fd.intValue);
+    [_segmentReadFDs removeAllObjects];
+}
+
+/// Move the live items of a segment to the current segment, and delete it.
+- (BOOL)_segmentCompactWithID:(int)segmentID {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetSegmentItems];
+    if (!stmt) return NO;
+    sqlite3_bind_int(stmt, 1, segmentID);
+    NSMutableArray *keys = [NSMutableArray new];
+    NSMutableArray *offsets = [NSMutableArray new];
+    NSMutableArray *sizes = [NSMutableArray new];
+    do {
+        int result = sqlite3_step(stmt);
+        if (result == SQLITE_ROW) {
+            char *key = (char *)sqlite3_column_text(stmt, 0);
+            if (!key) continue;
+            [keys addObject:[NSString stringWithUTF8String:key]];
+            [offsets addObject:@(sqlite3_column_int64(stmt, 1))];
+            [sizes addObject:@(sqlite3_column_int(stmt, 2))];
+        } else if (result == SQLITE_DONE) {
+            break;
+        } else {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            return NO;
+        }
+    } while (1);
+    sqlite3_reset(stmt);
+    
+    BOOL transaction = [self _dbExecute:@"begin immediate transaction;"];
+    BOOL succeed = YES;
+    for (NSUInteger i = 0; i < keys.count && succeed; i++) {
+        @autoreleasepool {
+            NSData *data = [self _segmentReadWithID:segmentID offset:[offsets[i] longLongValue] length:[sizes[i] intValue]];
+            if (!data) {
+                [self _dbDeleteItemWithKey:keys[i]]; // broken
+                continue;
+            }
+            int newSegmentID = 0;
+            int64_t offset = 0;
+            succeed = [self _segmentAppendData:data segment:&newSegmentID offset:&offset] &&
+                      [self _dbMoveSegmentItemWithKey:keys[i] fromSegment:segmentID toSegment:newSegmentID offset:offset];
+        }
+    }
+    if (succeed) succeed = [self _dbDeleteSegmentWithID:segmentID];
+    if (transaction) {
+        if (!succeed || ![self _dbExecute:@"commit transaction;"]) {
+            [self _dbExecute:@"rollback transaction;"]; // the appended data become dead bytes
+            return NO;
+        }
+    }
+    if (!succeed) return NO;
+    [self _segmentCloseReadFDWithID:segmentID];
+    [self _fileMoveToTrashWithNames:@[[self _segmentNameWithID:segmentID]]];
+    return YES;
+}
+
+
+#pragma mark - reconciliation
+
+/**
+ Begin the session, the session file is left behind if the app crashed (or was
+ killed) before `_sessionEnd`, then the next session starts a reconciliation.
+ */
+- (void)_sessionBegin {
+    _sessionPath = [_path stringByAppendingPathComponent:kSessionFileName];
+    if ([[NSFileManager defaultManager] fileExistsAtPath:_sessionPath]) {
+        _sessionMarked = YES;
+        [self _reconcileBegin];
+    } else {
+        [self _sessionMark];
+    }
+}
+
+/// Write the session file again before the first change after `_sessionEnd`.
+- (void)_sessionMark {
+    if (_sessionMarked || !_sessionPath) return;
+    _sessionMarked = [[NSData data] writeToFile:_sessionPath atomically:NO];
+}
+
+- (void)_sessionEnd {
+    if (_reconcileStage != _YYKVReconcileStageFinished) return; // continue next time
+    if (!_sessionMarked) return;
+    unlink(_sessionPath.fileSystemRepresentation);
+    _sessionMarked = NO;
+}
+
+/// Move the files left in temp directory by a crash to trash.
+- (BOOL)_tempMoveAllToTrash {
+    CFUUIDRef uuidRef = CFUUIDCreate(NULL);
+    CFStringRef uuid = CFUUIDCreateString(NULL, uuidRef);
+    CFRelease(uuidRef);
+    NSString *tmpPath = [_trashPath stringByAppendingPathComponent:(__bridge NSString *)(uuid)];
+    CFRelease(uuid);
+    if (rename(_tempPath.fileSystemRepresentation, tmpPath.fileSystemRepresentation) != 0 && errno != ENOENT) return NO;
+    return [[NSFileManager defaultManager] createDirectoryAtPath:_tempPath withIntermediateDirectories:YES attributes:nil error:NULL];
+}
+
+- (void)_reconcileBegin {
+    [self _reconcileEnd];
+    _reconcileStage = _YYKVReconcileStageRows;
+    _reconcileRowID = 0;
+    _reconcileFilenames = [NSMutableSet new];
+}
+
+- (void)_reconcileEnd {
+    if (_reconcileDir) closedir(_reconcileDir);
+    _reconcileDir = NULL;
+    _reconcileFilenames = nil;
+    _reconcileStage = _YYKVReconcileStageFinished;
+}
+
+/// Get the file size of a segment, 0 if the file is missing.
+- (off_t)_reconcileSizeOfSegmentWithID:(int)segmentID cache:(NSMutableDictionary *)cache {
+    NSNumber *size = cache[@(segmentID)];
+    if (!size) {
+        NSString *path = [_dataPath stringByAppendingPathComponent:[self _segmentNameWithID:segmentID]];
+        struct stat st;
+        size = @(stat(path.fileSystemRepresentation, &st) == 0 ? st.st_size : 0);
+        cache[@(segmentID)] = size;
+    }
+    return size.longLongValue;
+}
+
+/**
+ Check a batch of rows, remove the rows whose file is missing or has a wrong size
+ (written by an old version without the temp file, or truncated by a crash).
+ 
+ @return Whether there may be more rows to check. If failed, the reconciliation
+ is ended, the files stage needs the filenames of all rows.
+ */
+- (BOOL)_reconcileRows {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetReconcileItems];
+    if (!stmt) {
+        [self _reconcileEnd];
+        return NO;
+    }
+    sqlite3_bind_int64(stmt, 1, _reconcileRowID);
+    sqlite3_bind_int(stmt, 2, kReconcileBatchSize);
+    
+    NSMutableArray *brokenKeys = [NSMutableArray new];
+    NSMutableArray *brokenFilenames = [NSMutableArray new];
+    NSMutableDictionary *segmentSizes = [NSMutableDictionary new];
+    int count = 0;
+    do {
+        int result = sqlite3_step(stmt);
+        if (result == SQLITE_ROW) {
+            count++;
+            _reconcileRowID = sqlite3_column_int64(stmt, 0);
+            char *key = (char *)sqlite3_column_text(stmt, 1);
+            char *filename = (char *)sqlite3_column_text(stmt, 2);
+            sqlite3_int64 size = sqlite3_column_int64(stmt, 3);
+            int segment = sqlite3_column_int(stmt, 4);
+            sqlite3_int64 offset = sqlite3_column_int64(stmt, 5);
+            if (!key) continue;
+            BOOL broken;
+            NSString *name = nil;
+            if (segment > 0) {
+                broken = offset + size > [self _reconcileSizeOfSegmentWithID:segment cache:segmentSizes];
+            } else {
+                if (!filename || *filename == 0) continue;
+                name = [NSString stringWithUTF8String:filename];
+                [_reconcileFilenames addObject:name];
+                NSString *path = [_dataPath stringByAppendingPathComponent:name];
+                struct stat st;
+                broken = stat(path.fileSystemRepresentation, &st) != 0 || st.st_size != size;
+            }
+            if (broken) {
+                [brokenKeys addObject:[NSString stringWithUTF8String:key]];
+                [brokenFilenames addObject:name ? name : (id)[NSNull null]];
+            }
+        } else if (result == SQLITE_DONE) {
+            break;
+        } else {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            sqlite3_reset(stmt);
+            [self _reconcileEnd];
+            return NO;
+        }
+    } while (count < kReconcileBatchSize);
+    sqlite3_reset(stmt);
+    
+    for (NSUInteger i = 0; i < brokenKeys.count; i++) {
+        id filename = brokenFilenames[i];
+        [self _removeBrokenItemWithKey:brokenKeys[i] filename:filename == [NSNull null] ? nil : filename];
+    }
+    return count == kReconcileBatchSize;
+}
+
+/**
+ Rebuild the ref counts of shared files from the rows, after the broken rows are
+ removed. A file referenced by multiple rows is always counted, so it's not deleted
+ with the first row.
+ */
+- (BOOL)_reconcileRefCounts {
+    BOOL transaction = [self _dbExecute:@"begin immediate transaction;"];
+    BOOL suc = YES;
+    for (_YYKVStmt stmtID = _YYKVStmtReconcileRefCounts; stmtID <= _YYKVStmtDeleteUnusedRefCounts && suc; stmtID++) {
+        sqlite3_stmt *stmt = [self _dbPrepareStmt:stmtID];
+        int result = stmt ? sqlite3_step(stmt) : SQLITE_ERROR;
+        if (result != SQLITE_DONE) {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite update error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            suc = NO;
+        }
+    }
+    if (transaction) {
+        if (!suc || ![self _dbExecute:@"commit transaction;"]) {
+            [self _dbExecute:@"rollback transaction;"];
+            return NO;
+        }
+    }
+    _hasSharedFiles = [self _dbHasSharedFiles];
+    return suc;
+}
+
+- (BOOL)_dbHasSegmentWithID:(int)segmentID {
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtHasSegment];
+    if (!stmt) return YES; // keep the file if not sure
+    sqlite3_bind_int(stmt, 1, segmentID);
+    int result = sqlite3_step(stmt);
+    if (result != SQLITE_ROW) {
+        if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+        return YES;
+    }
+    return sqlite3_column_int(stmt, 0) > 0;
+}
+
+/**
+ Check a batch of files in data directory, move the files which are not
+ referenced by any row (written before a crash, but the row is not) to trash.
+ 
+ @return Whether there may be more files to check.
+ */
+- (BOOL)_reconcileFiles {
+    if (!_reconcileDir) {
+        _reconcileDir = opendir(_dataPath.fileSystemRepresentation);
+        if (!_reconcileDir) return NO;
+    }
+    NSMutableArray *orphans = [NSMutableArray new];
+    struct dirent *entry = NULL;
+    int count = 0;
+    while (count < kReconcileBatchSize && (entry = readdir(_reconcileDir))) {
+        if (entry->d_name[0] == '.') continue; // ".", ".." and hidden files
+        count++;
+        NSString *filename = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:entry->d_name length:strlen(entry->d_name)];
+        if (!filename || [_reconcileFilenames containsObject:filename]) continue;
+        int segmentID = 0;
+        if ([filename hasPrefix:@"segment-"]) {
+            segmentID = [filename substringFromIndex:@"segment-".length].intValue;
+            if (segmentID > 0 && [filename isEqualToString:[self _segmentNameWithID:segmentID]] &&
+                [self _dbHasSegmentWithID:segmentID]) continue;
+        }
+        [orphans addObject:filename];
+    }
+    if (orphans.count) [self _fileMoveToTrashWithNames:orphans];
+    return entry != NULL;
+}
+
+#pragma mark - compression
+
+/// The file extension of a compressed value, so that the files with different codec don't conflict.
+static NSString *_YYKVFilenameSuffix(YYKVStorageCompression codec) {
+    switch (codec) {
+        case YYKVStorageCompressionZlib: return @".z";
+        case YYKVStorageCompressionLZ4: return @".lz4";
+        default: return nil;
+    }
+}
+
+/**
+ Compress a value if it's worth it (large enough, not compressed yet, and at least
+ 1/8 smaller after compression).
+ */
+- (NSData *)_encodeValue:(NSData *)value codec:(YYKVStorageCompression *)codec {
+    *codec = YYKVStorageCompressionNone;
+    if (_compression == YYKVStorageCompressionNone) return value;
+    if (value.length < _compressionSizeThreshold || value.length >= INT_MAX) return value;
+    if (_YYKVDataIsCompressed(value)) return value;
+    NSData *encoded = nil;
+    switch (_compression) {
+        case YYKVStorageCompressionZlib: encoded = [value zlibDeflate]; break;
+        case YYKVStorageCompressionLZ4: encoded = _YYKVLZ4Encode(value); break;
+        default: break;
+    }
+    if (!encoded || encoded.length > value.length - value.length / 8) return value;
+    *codec = _compression;
+    return encoded;
+}
+
+- (NSData *)_decodeValue:(NSData *)value codec:(YYKVStorageCompression)codec {
+    if (!value) return nil;
+    switch (codec) {
+        case YYKVStorageCompressionNone: return value;
+        case YYKVStorageCompressionZlib: return [value zlibInflate];
+        case YYKVStorageCompressionLZ4: return _YYKVLZ4Decode(value);
+        default: return nil; // written by newer version
+    }
+}
+
+
+
+#pragma mark - shared file
+
+/**
+ Add a reference to a shared file, the file is written only if it's not referenced
+ yet (the filename identifies the content).
+ */
+- (BOOL)_fileRetainWithName:(NSString *)filename data:(NSData *)data {
+    int refCount = [self _dbGetRefCountWithFilename:filename];
+    if (refCount < 0) return NO;
+    if (refCount == 0 && ![self _fileWriteWithName:filename data:data]) return NO;
+    _hasSharedFiles = YES;
+    return [self _dbSetRefCount:refCount + 1 withFilename:filename];
+}
+
+/**
+ Remove a reference to a file, the file is deleted when the last reference goes.
+ A file not in the blob table is owned by one item, it's deleted directly.
+ */
+- (BOOL)_fileReleaseWithName:(NSString *)filename {
+    if (!_hasSharedFiles) return [self _fileDeleteWithName:filename];
+    int refCount = [self _dbGetRefCountWithFilename:filename];
+    if (refCount < 0) return NO; // keep the file if we don't know who uses it
+    if (refCount > 1) return [self _dbSetRefCount:refCount - 1 withFilename:filename];
+    if (refCount == 1) [self _dbSetRefCount:0 withFilename:filename];
+    return [self _fileDeleteWithName:filename];
+}
+
+/**
+ Remove a reference for each filename (the same filename may appear multiple times),
+ and returns the filenames which are no longer referenced and should be deleted.
+ */
+- (NSArray *)_fileReleaseWithNames:(NSArray *)filenames {
+    if (!_hasSharedFiles) return filenames;
+    NSCountedSet *set = [[NSCountedSet alloc] initWithArray:filenames];
+    NSMutableArray *unreferenced = [NSMutableArray new];
+    for (NSString *filename in set) {
+        int refCount = [self _dbGetRefCountWithFilename:filename];
+        if (refCount < 0) continue; // keep the file if we don't know who uses it
+        int newRefCount = refCount - (int)[set countForObject:filename];
+        if (refCount > 0 && newRefCount > 0) {
+            [self _dbSetRefCount:newRefCount withFilename:filename];
+        } else {
+            if (refCount > 0) [self _dbSetRefCount:0 withFilename:filename];
+            [unreferenced addObject:filename];
+        }
+    }
+    return unreferenced;
+}
+
+/**
+ Delete rows and release their files in one transaction, so a crash can't leave
+ the ref counts out of sync with the rows. The files no longer referenced are
+ deleted after the commit.
+ 
+ @param filenames  The files of the rows (the same filename may appear multiple times).
+ @param deleteRows Delete the rows, returns whether succeed.
+ */
+- (BOOL)_removeRowsReleasingFiles:(NSArray *)filenames usingBlock:(BOOL (^)(void))deleteRows {
+    if (filenames.count == 0) return deleteRows();
+    BOOL transaction = [self _dbExecute:@"begin immediate transaction;"];
+    NSArray *unreferenced = [self _fileReleaseWithNames:filenames];
+    BOOL suc = deleteRows();
+    if (transaction) {
+        if (!suc || ![self _dbExecute:@"commit transaction;"]) {
+            [self _dbExecute:@"rollback transaction;"];
+            return NO;
+        }
+    }
+    if (!suc) return NO;
+    if (unreferenced.count == 1) {
+        [self _fileDeleteWithName:unreferenced.firstObject];
+    } else {
+        [self _fileMoveToTrashWithNames:unreferenced];
+    }
+    return YES;
+}
+
+- (BOOL)_saveSharedItemWithKey:(NSString *)key value:(NSData *)value filename:(NSString *)filename extendedData:(NSData *)extendedData codec:(YYKVStorageCompression)codec logicalSize:(int)logicalSize {
+    NSString *oldFilename = [self _dbGetFilenameWithKey:key];
+    if ([oldFilename isEqualToString:filename]) {
+        return [self _dbSaveWithKey:key value:value fileName:filename extendedData:extendedData codec:codec logicalSize:logicalSize segment:0 offset:0];
+    }
+    if (![self _fileRetainWithName:filename data:value]) {
+        return NO;
+    }
+    if (![self _dbSaveWithKey:key value:value fileName:filename extendedData:extendedData codec:codec logicalSize:logicalSize segment:0 offset:0]) {
+        [self _fileReleaseWithName:filename];
+        return NO;
+    }
+    if (oldFilename) [self _fileReleaseWithName:oldFilename];
+    return YES;
 }
 
 
@@ -637,11 +2089,13 @@ static NSString *const kTrashDirectoryName = @"trash";
     [[NSFileManager defaultManager] removeItemAtPath:[_path stringByAppendingPathComponent:kDBFileName] error:nil];
     [[NSFileManager defaultManager] removeItemAtPath:[_path stringByAppendingPathComponent:kDBShmFileName] error:nil];
     [[NSFileManager defaultManager] removeItemAtPath:[_path stringByAppendingPathComponent:kDBWalFileName] error:nil];
+    [self _reconcileEnd]; // nothing left to reconcile
     [self _fileMoveAllToTrash];
     [self _fileEmptyTrashInBackground];
 }
 
 - (void)_appWillBeTerminated {
+    [self endSession];
     _invalidated = YES;
 }
 
@@ -657,7 +2111,7 @@ static NSString *const kTrashDirectoryName = @"trash";
         NSLog(@"YYKVStorage init error: invalid path: [%@].", path);
         return nil;
     }
-    if (type > YYKVStorageTypeMixed) {
+    if (type > YYKVStorageTypeSegment) {
         NSLog(@"YYKVStorage init error: invalid type: %lu.", (unsigned long)type);
         return nil;
     }
@@ -667,9 +2121,27 @@ static NSString *const kTrashDirectoryName = @"trash";
     _type = type;
     _dataPath = [path stringByAppendingPathComponent:kDataDirectoryName];
     _trashPath = [path stringByAppendingPathComponent:kTrashDirectoryName];
+    _tempPath = [path stringByAppendingPathComponent:kTempDirectoryName];
     _trashQueue = dispatch_queue_create("com.ibireme.cache.disk.trash", DISPATCH_QUEUE_SERIAL);
     _dbPath = [path stringByAppendingPathComponent:kDBFileName];
     _errorLogsEnabled = YES;
+    _pendingItems = [NSMutableDictionary new];
+    _accessTimes = [NSMutableDictionary new];
+    _mappedFiles = [NSMapTable strongToWeakObjectsMapTable];
+    _mappedTrashFiles = [NSMapTable strongToWeakObjectsMapTable];
+    _compressionSizeThreshold = 1024;
+    _segmentCompactionRatio = 0.5;
+    _trashPurger = [_YYKVTrashPurger new];
+    _brokenKeys = [NSMutableSet new];
+    _segmentFD = -1;
+    _segmentReadFDs = [NSMutableDictionary new];
+    pthread_mutex_init(&_readLock, NULL);
+    pthread_key_create(&_readerKey, NULL);
+    _trashPurger.filesPerSecond = 256;
+    _trashPurger.bytesPerSecond = 1024 * 1024 * 32;
+    _trashPurger.pauseLatency = NSEC_PER_MSEC * 10;
+    _writeBehindBatchSize = 64;
+    _writeBehindInterval = 0.05;
     NSError *error = nil;
     if (![[NSFileManager defaultManager] createDirectoryAtPath:path
                                    withIntermediateDirectories:YES
@@ -680,6 +2152,10 @@ static NSString *const kTrashDirectoryName = @"trash";
                                                     attributes:nil
                                                          error:&error] ||
         ![[NSFileManager defaultManager] createDirectoryAtPath:[path stringByAppendingPathComponent:kTrashDirectoryName]
+                                   withIntermediateDirectories:YES
+                                                    attributes:nil
+                                                         error:&error] ||
+        ![[NSFileManager defaultManager] createDirectoryAtPath:[path stringByAppendingPathComponent:kTempDirectoryName]
                                    withIntermediateDirectories:YES
                                                     attributes:nil
                                                          error:&error]) {
@@ -694,9 +2170,12 @@ static NSString *const kTrashDirectoryName = @"trash";
         if (![self _dbOpen] || ![self _dbInitialize]) {
             [self _dbClose];
             NSLog(@"YYKVStorage init error: fail to open sqlite db.");
+            return nil;
         }
-        return nil;
     }
+    _hasSharedFiles = [self _dbHasSharedFiles];
+    [self _tempMoveAllToTrash];
+    [self _sessionBegin];
     [self _fileEmptyTrashInBackground]; // empty the trash if failed at last time
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_appWillBeTerminated) name:UIApplicationWillTerminateNotification object:nil];
     return self;
@@ -704,7 +2183,181 @@ static NSString *const kTrashDirectoryName = @"trash";
 
 - (void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationWillTerminateNotification object:nil];
+    [self flushPendingWrites];
+    [self flushAccessTimes];
+    [self _sessionEnd];
+    [self _reconcileEnd];
     [self _dbClose];
+    [self _segmentCloseAll];
+    pthread_key_delete(_readerKey);
+    pthread_mutex_destroy(&_readLock);
+}
+
+- (void)setWriteBehindEnabled:(BOOL)writeBehindEnabled {
+    if (_writeBehindEnabled == writeBehindEnabled) return;
+    if (!writeBehindEnabled) [self flushPendingWrites];
+    _writeBehindEnabled = writeBehindEnabled;
+}
+
+- (BOOL)hasPendingWrites {
+    return _pendingSince != 0;
+}
+
+- (void)endSession {
+    [self flushPendingWrites];
+    [self flushAccessTimes];
+    [self _sessionEnd];
+}
+
+- (BOOL)reconcileWithTimeLimit:(NSTimeInterval)timeLimit {
+    if (_reconcileStage == _YYKVReconcileStageFinished) return YES;
+    if (_invalidated) return YES;
+    CFTimeInterval deadline = CACurrentMediaTime() + timeLimit;
+    do {
+        if (_reconcileStage == _YYKVReconcileStageRows) {
+            if (![self _reconcileRows] && _reconcileStage == _YYKVReconcileStageRows) {
+                [self _reconcileRefCounts];
+                _reconcileStage = _YYKVReconcileStageFiles;
+            }
+        } else {
+            if (![self _reconcileFiles]) [self _reconcileEnd];
+        }
+    } while (_reconcileStage != _YYKVReconcileStageFinished && CACurrentMediaTime() < deadline);
+    return _reconcileStage == _YYKVReconcileStageFinished;
+}
+
+- (BOOL)compactSegments {
+    if (_type != YYKVStorageTypeSegment) return YES;
+    [self flushPendingWrites];
+    if (![self _segmentOpenForLength:0]) return NO; // the segment for appending is never compacted
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetSegments];
+    if (!stmt) return NO;
+    NSMutableArray *deadSegments = [NSMutableArray new];
+    int compactSegment = 0;
+    do {
+        int result = sqlite3_step(stmt);
+        if (result == SQLITE_ROW) {
+            int segmentID = sqlite3_column_int(stmt, 0);
+            int64_t liveSize = sqlite3_column_int64(stmt, 1);
+            if (segmentID == _segmentID) continue;
+            if (liveSize <= 0) {
+                [deadSegments addObject:@(segmentID)];
+                continue;
+            }
+            if (compactSegment) continue;
+            struct stat st;
+            NSString *path = [_dataPath stringByAppendingPathComponent:[self _segmentNameWithID:segmentID]];
+            if (stat(path.fileSystemRepresentation, &st) != 0 || st.st_size <= 0) continue;
+            if ((double)liveSize / st.st_size < _segmentCompactionRatio) compactSegment = segmentID;
+        } else if (result == SQLITE_DONE) {
+            break;
+        } else {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            return NO;
+        }
+    } while (1);
+    sqlite3_reset(stmt);
+    
+    NSMutableArray *names = [NSMutableArray new];
+    for (NSNumber *segmentID in deadSegments) {
+        if (![self _dbDeleteSegmentWithID:segmentID.intValue]) continue;
+        [self _segmentCloseReadFDWithID:segmentID.intValue];
+        [names addObject:[self _segmentNameWithID:segmentID.intValue]];
+    }
+    [self _fileMoveToTrashWithNames:names];
+    if (compactSegment) return [self _segmentCompactWithID:compactSegment];
+    return YES;
+}
+
+- (NSUInteger)readerConnectionCount {
+    return _readers ? _readerConnectionCount : 0;
+}
+
+- (void)setReaderConnectionCount:(NSUInteger)readerConnectionCount {
+    if (readerConnectionCount > kReaderConnectionCountMax) readerConnectionCount = kReaderConnectionCountMax;
+    if (readerConnectionCount == _readerConnectionCount) return;
+    [self _readersClose];
+    _readerConnectionCount = readerConnectionCount;
+    if ([self _dbIsReady]) [self _readersOpen];
+}
+
+- (NSUInteger)trashPurgeFilesPerSecond {
+    return _trashPurger.filesPerSecond;
+}
+
+- (void)setTrashPurgeFilesPerSecond:(NSUInteger)trashPurgeFilesPerSecond {
+    _trashPurger.filesPerSecond = trashPurgeFilesPerSecond;
+}
+
+- (NSUInteger)trashPurgeBytesPerSecond {
+    return _trashPurger.bytesPerSecond;
+}
+
+- (void)setTrashPurgeBytesPerSecond:(NSUInteger)trashPurgeBytesPerSecond {
+    _trashPurger.bytesPerSecond = trashPurgeBytesPerSecond;
+}
+
+- (NSTimeInterval)trashPurgePauseLatency {
+    return (double)_trashPurger.pauseLatency / NSEC_PER_SEC;
+}
+
+- (void)setTrashPurgePauseLatency:(NSTimeInterval)trashPurgePauseLatency {
+    _trashPurger.pauseLatency = trashPurgePauseLatency > 0 ? (uint64_t)(trashPurgePauseLatency * NSEC_PER_SEC) : 0;
+}
+
+- (BOOL)isPurgingTrash {
+    return _trashPurger.isPurging;
+}
+
+- (uint64_t)trashPurgedFileCount {
+    return _trashPurger.purgedFileCount;
+}
+
+- (uint64_t)trashPurgedBytes {
+    return _trashPurger.purgedBytes;
+}
+
+- (YYCacheLatencyHistogram *)trashPurgeReadLatency {
+    return [_trashPurger.readStatistics snapshot].getLatency;
+}
+
+- (void)resetTrashPurgeStatistics {
+    [_trashPurger resetStatistics];
+}
+
+- (BOOL)flushPendingWrites {
+    if (_pendingSince == 0) return YES;
+    NSArray *items = _pendingItems.allValues;
+    [self _dequeueAll];
+    
+    BOOL transaction = [self _dbExecute:@"begin immediate transaction;"];
+    BOOL succeed = YES;
+    for (YYKVStorageItem *item in items) {
+        if (![self _saveItemWithKey:item.key value:item.value filename:item.filename extendedData:item.extendedData]) succeed = NO;
+    }
+    if (transaction && ![self _dbExecute:@"commit transaction;"]) {
+        [self _dbExecute:@"rollback transaction;"];
+        succeed = NO;
+    }
+    return succeed;
+}
+
+- (BOOL)flushAccessTimes {
+    [self _removeBrokenItems];
+    if (_accessTimes.count == 0) return YES;
+    NSDictionary *accessTimes = _accessTimes.copy;
+    [_accessTimes removeAllObjects];
+    
+    BOOL transaction = [self _dbExecute:@"begin immediate transaction;"];
+    __block BOOL succeed = YES;
+    [accessTimes enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSNumber *accessTime, BOOL *stop) {
+        if (![self _dbUpdateAccessTime:accessTime.intValue withKey:key]) succeed = NO;
+    }];
+    if (transaction && ![self _dbExecute:@"commit transaction;"]) {
+        [self _dbExecute:@"rollback transaction;"];
+        succeed = NO;
+    }
+    return succeed;
 }
 
 - (BOOL)saveItem:(YYKVStorageItem *)item {
@@ -720,40 +2373,99 @@ static NSString *const kTrashDirectoryName = @"trash";
     if (_type == YYKVStorageTypeFile && filename.length == 0) {
         return NO;
     }
-    
+    if (_writeBehindEnabled) {
+        if (_type == YYKVStorageTypeSQLite || _type == YYKVStorageTypeSegment) filename = nil;
+        [self _enqueueItemWithKey:key value:value filename:filename extendedData:extendedData];
+        return YES;
+    }
+    return [self _saveItemWithKey:key value:value filename:filename extendedData:extendedData];
+}
+
+- (BOOL)_saveItemWithKey:(NSString *)key value:(NSData *)value filename:(NSString *)filename extendedData:(NSData *)extendedData {
+    [_accessTimes removeObjectForKey:key]; // the save updates access time
+    int logicalSize = (int)value.length;
+    YYKVStorageCompression codec;
+    value = [self _encodeValue:value codec:&codec];
+    if (_type == YYKVStorageTypeSegment) filename = nil;
     if (filename.length) {
+        NSString *suffix = _YYKVFilenameSuffix(codec);
+        if (suffix) filename = [filename stringByAppendingString:suffix];
+        if (_sharedFilesEnabled) {
+            return [self _saveSharedItemWithKey:key value:value filename:filename extendedData:extendedData codec:codec logicalSize:logicalSize];
+        }
+        NSString *oldFilename = [self _dbGetFilenameWithKey:key]; // the name may change with codec
         if (![self _fileWriteWithName:filename data:value]) {
             return NO;
         }
-        if (![self _dbSaveWithKey:key value:value fileName:filename extendedData:extendedData]) {
+        if (![self _dbSaveWithKey:key value:value fileName:filename extendedData:extendedData codec:codec logicalSize:logicalSize segment:0 offset:0]) {
             [self _fileDeleteWithName:filename];
             return NO;
         }
+        if (oldFilename && ![oldFilename isEqualToString:filename]) {
+            [self _fileReleaseWithName:oldFilename];
+        }
         return YES;
+    } else if (_type == YYKVStorageTypeSegment) {
+        int segment = 0;
+        int64_t offset = 0;
+        if (![self _segmentAppendData:value segment:&segment offset:&offset]) return NO;
+        return [self _dbSaveWithKey:key value:value fileName:nil extendedData:extendedData codec:codec logicalSize:logicalSize segment:segment offset:offset];
     } else {
         if (_type != YYKVStorageTypeSQLite) {
             NSString *filename = [self _dbGetFilenameWithKey:key];
             if (filename) {
+                [self _fileReleaseWithName:filename];
+            }
+        }
+        return [self _dbSaveWithKey:key value:value fileName:nil extendedData:extendedData codec:codec logicalSize:logicalSize segment:0 offset:0];
+    }
+}
+
+- (BOOL)saveItems:(NSArray *)items {
+    if (items.count == 0) return NO;
+    if (_writeBehindEnabled) {
+        BOOL succeed = YES;
+        for (YYKVStorageItem *item in items) {
+            if (![self saveItem:item]) succeed = NO;
+        }
+        return succeed;
+    }
+    BOOL transaction = [self _dbExecute:@"begin immediate transaction;"];
+    BOOL succeed = YES;
+    for (YYKVStorageItem *item in items) {
+        if (![self saveItem:item]) succeed = NO;
+    }
+    if (transaction && ![self _dbExecute:@"commit transaction;"]) {
+        [self _dbExecute:@"rollback transaction;"];
+        for (YYKVStorageItem *item in items) {
+            if (item.filename.length == 0 || _type == YYKVStorageTypeSegment) continue;
+            // the file may be saved with a codec extension
+            for (NSString *filename in @[item.filename,
+                                         [item.filename stringByAppendingString:_YYKVFilenameSuffix(YYKVStorageCompressionZlib)],
+                                         [item.filename stringByAppendingString:_YYKVFilenameSuffix(YYKVStorageCompressionLZ4)]]) {
+                if (_hasSharedFiles && [self _dbGetRefCountWithFilename:filename] != 0) continue; // still used by other items
                 [self _fileDeleteWithName:filename];
             }
         }
-        return [self _dbSaveWithKey:key value:value fileName:nil extendedData:extendedData];
+        succeed = NO;
     }
+    return succeed;
 }
 
 - (BOOL)removeItemForKey:(NSString *)key {
     if (key.length == 0) return NO;
+    [self _dequeueKey:key];
     switch (_type) {
-        case YYKVStorageTypeSQLite: {
+        case YYKVStorageTypeSQLite:
+        case YYKVStorageTypeSegment: {
             return [self _dbDeleteItemWithKey:key];
         } break;
         case YYKVStorageTypeFile:
         case YYKVStorageTypeMixed: {
             NSString *filename = [self _dbGetFilenameWithKey:key];
-            if (filename) {
-                [self _fileDeleteWithName:filename];
-            }
-            return [self _dbDeleteItemWithKey:key];
+            return [self _removeRowsReleasingFiles:filename ? @[filename] : nil usingBlock:^BOOL{
+                return [self _dbDeleteItemWithKey:key];
+            }];
         } break;
         default: return NO;
     }
@@ -761,17 +2473,18 @@ static NSString *const kTrashDirectoryName = @"trash";
 
 - (BOOL)removeItemForKeys:(NSArray *)keys {
     if (keys.count == 0) return NO;
+    for (NSString *key in keys) [self _dequeueKey:key];
     switch (_type) {
-        case YYKVStorageTypeSQLite: {
+        case YYKVStorageTypeSQLite:
+        case YYKVStorageTypeSegment: {
             return [self _dbDeleteItemWithKeys:keys];
         } break;
         case YYKVStorageTypeFile:
         case YYKVStorageTypeMixed: {
             NSArray *filenames = [self _dbGetFilenameWithKeys:keys];
-            for (NSString *filename in filenames) {
-                [self _fileDeleteWithName:filename];
-            }
-            return [self _dbDeleteItemWithKeys:keys];
+            return [self _removeRowsReleasingFiles:filenames usingBlock:^BOOL{
+                return [self _dbDeleteItemWithKeys:keys];
+            }];
         } break;
         default: return NO;
     }
@@ -780,9 +2493,11 @@ static NSString *const kTrashDirectoryName = @"trash";
 - (BOOL)removeItemsLargerThanSize:(int)size {
     if (size == INT_MAX) return YES;
     if (size <= 0) return [self removeAllItems];
+    [self flushPendingWrites];
     
     switch (_type) {
-        case YYKVStorageTypeSQLite: {
+        case YYKVStorageTypeSQLite:
+        case YYKVStorageTypeSegment: {
             if ([self _dbDeleteItemsWithSizeLargerThan:size]) {
                 [self _dbCheckpoint];
                 return YES;
@@ -791,10 +2506,9 @@ static NSString *const kTrashDirectoryName = @"trash";
         case YYKVStorageTypeFile:
         case YYKVStorageTypeMixed: {
             NSArray *filenames = [self _dbGetFilenamesWithSizeLargerThan:size];
-            for (NSString *name in filenames) {
-                [self _fileDeleteWithName:name];
-            }
-            if ([self _dbDeleteItemsWithSizeLargerThan:size]) {
+            if ([self _removeRowsReleasingFiles:filenames usingBlock:^BOOL{
+                return [self _dbDeleteItemsWithSizeLargerThan:size];
+            }]) {
                 [self _dbCheckpoint];
                 return YES;
             }
@@ -806,9 +2520,12 @@ static NSString *const kTrashDirectoryName = @"trash";
 - (BOOL)removeItemsEarlierThanTime:(int)time {
     if (time <= 0) return YES;
     if (time == INT_MAX) return [self removeAllItems];
+    [self flushPendingWrites];
+    [self flushAccessTimes]; // the LRU order needs the latest access times
     
     switch (_type) {
-        case YYKVStorageTypeSQLite: {
+        case YYKVStorageTypeSQLite:
+        case YYKVStorageTypeSegment: {
             if ([self _dbDeleteItemsWithTimeEarlierThan:time]) {
                 [self _dbCheckpoint];
                 return YES;
@@ -817,12 +2534,11 @@ static NSString *const kTrashDirectoryName = @"trash";
         case YYKVStorageTypeFile:
         case YYKVStorageTypeMixed: {
             NSArray *filenames = [self _dbGetFilenamesWithTimeEarlierThan:time];
-            for (NSString *name in filenames) {
-                [self _fileDeleteWithName:name];
-            }
-            if ([self _dbDeleteItemsWithTimeEarlierThan:time]) {
+            if ([self _removeRowsReleasingFiles:filenames usingBlock:^BOOL{
+                return [self _dbDeleteItemsWithTimeEarlierThan:time];
+            }]) {
                 [self _dbCheckpoint];
-                return NO;
+                return YES;
             }
         } break;
     }
@@ -831,67 +2547,65 @@ static NSString *const kTrashDirectoryName = @"trash";
 
 - (BOOL)removeItemsToFitSize:(int)maxSize {
     if (maxSize == INT_MAX) return YES;
+    return [self removeItemsToFitTotalSize:maxSize];
+}
+
+- (BOOL)removeItemsToFitTotalSize:(int64_t)maxSize {
+    if (maxSize == INT64_MAX) return YES;
     if (maxSize <= 0) return [self removeAllItems];
+    [self flushPendingWrites];
+    [self flushAccessTimes]; // the LRU order needs the latest access times
     
-    int total = [self _dbGetTotalItemSize];
+    int64_t total = [self _dbGetTotalItemSize];
     if (total < 0) return NO;
     if (total <= maxSize) return YES;
-    
-    NSArray *items = nil;
-    BOOL suc = NO;
-    do {
-        int perCount = 16;
-        items = [self _dbGetItemSizeInfoOrderByTimeDescWithLimit:perCount];
-        for (YYKVStorageItem *item in items) {
-            if (total > maxSize) {
-                if (item.filename) {
-                    [self _fileDeleteWithName:item.filename];
-                }
-                suc = [self _dbDeleteItemWithKey:item.key];
-                total -= item.size;
-            } else {
-                break;
-            }
-            if (!suc) break;
-        }
-    } while (total > maxSize && items.count > 0 && suc);
-    if (suc) [self _dbCheckpoint];
-    return suc;
+    return [self _removeLRUItemsWithCount:0 size:total - maxSize];
 }
 
 - (BOOL)removeItemsToFitCount:(int)maxCount {
     if (maxCount == INT_MAX) return YES;
     if (maxCount <= 0) return [self removeAllItems];
+    [self flushPendingWrites];
+    [self flushAccessTimes]; // the LRU order needs the latest access times
     
     int total = [self _dbGetTotalItemCount];
     if (total < 0) return NO;
     if (total <= maxCount) return YES;
+    return [self _removeLRUItemsWithCount:total - maxCount size:0];
+}
+
+/**
+ Remove the least recently used items in one transaction: scan the LRU order to
+ find where to stop, delete the items before it with one statement, and move the
+ files to trash.
+ */
+- (BOOL)_removeLRUItemsWithCount:(int)count size:(int64_t)size {
+    NSMutableArray *filenames = [NSMutableArray new];
+    int time = 0;
+    sqlite3_int64 rowid = 0;
     
-    NSArray *items = nil;
-    BOOL suc = NO;
-    do {
-        int perCount = 16;
-        items = [self _dbGetItemSizeInfoOrderByTimeDescWithLimit:perCount];
-        for (YYKVStorageItem *item in items) {
-            if (total > maxCount) {
-                if (item.filename) {
-                    [self _fileDeleteWithName:item.filename];
-                }
-                suc = [self _dbDeleteItemWithKey:item.key];
-                total--;
-            } else {
-                break;
-            }
-            if (!suc) break;
+    BOOL transaction = [self _dbExecute:@"begin immediate transaction;"];
+    BOOL suc = [self _dbGetLRUCutoffWithCount:count size:size time:&time rowid:&rowid filenames:filenames];
+    if (suc) suc = [self _dbDeleteItemsWithLRUCutoffTime:time rowid:rowid];
+    NSArray *unreferenced = suc ? [self _fileReleaseWithNames:filenames] : nil;
+    if (transaction) {
+        if (!suc || ![self _dbExecute:@"commit transaction;"]) {
+            [self _dbExecute:@"rollback transaction;"];
+            return NO;
         }
-    } while (total > maxCount && items.count > 0 && suc);
-    if (suc) [self _dbCheckpoint];
-    return suc;
+    }
+    if (!suc) return NO;
+    [self _fileMoveToTrashWithNames:unreferenced];
+    [self _dbCheckpoint];
+    return YES;
 }
 
 - (BOOL)removeAllItems {
+    [self _dequeueAll];
+    [_accessTimes removeAllObjects];
     if (![self _dbClose]) return NO;
     [self _reset];
+    _hasSharedFiles = NO;
     if (![self _dbOpen]) return NO;
     if (![self _dbInitialize]) return NO;
     return YES;
@@ -899,7 +2613,8 @@ static NSString *const kTrashDirectoryName = @"trash";
 
 - (void)removeAllItemsWithProgressBlock:(void(^)(int removedCount, int totalCount))progress
                                endBlock:(void(^)(BOOL error))end {
-    
+    [self _dequeueAll];
+    [_accessTimes removeAllObjects];
     int total = [self _dbGetTotalItemCount];
     if (total <= 0) {
         if (end) end(total < 0);
@@ -909,19 +2624,18 @@ static NSString *const kTrashDirectoryName = @"trash";
         NSArray *items = nil;
         BOOL suc = NO;
         do {
-            items = [self _dbGetItemSizeInfoOrderByTimeDescWithLimit:perCount];
+            items = [self _dbGetItemSizeInfoOrderByTimeDescWithLimit:MIN(perCount, left)];
+            NSMutableArray *keys = [NSMutableArray new];
+            NSMutableArray *filenames = [NSMutableArray new];
             for (YYKVStorageItem *item in items) {
-                if (left > 0) {
-                    if (item.filename) {
-                        [self _fileDeleteWithName:item.filename];
-                    }
-                    suc = [self _dbDeleteItemWithKey:item.key];
-                    left--;
-                } else {
-                    break;
-                }
-                if (!suc) break;
+                if (!item.key) continue;
+                [keys addObject:item.key];
+                if (item.filename) [filenames addObject:item.filename];
             }
+            suc = keys.count > 0 && [self _removeRowsReleasingFiles:filenames usingBlock:^BOOL{
+                return [self _dbDeleteItemWithKeys:keys];
+            }];
+            if (suc) left -= (int)keys.count;
             if (progress) progress(total - left, total);
         } while (left > 0 && items.count > 0 && suc);
         if (suc) [self _dbCheckpoint];
@@ -929,90 +2643,99 @@ static NSString *const kTrashDirectoryName = @"trash";
     }
 }
 
+/**
+ Read the value of an item from file if needed, and decompress it.
+ The item is removed if the file is missing or broken.
+ */
+- (BOOL)_loadValueForItem:(YYKVStorageItem *)item {
+    if (item.filename) item.value = [self _fileReadWithName:item.filename];
+    else if (item.segment) item.value = [self _segmentReadWithID:item.segment offset:item.segmentOffset length:item.size];
+    if (item.codec != YYKVStorageCompressionNone) item.value = [self _decodeValue:item.value codec:item.codec];
+    if (item.value || (!item.filename && !item.segment && item.codec == YYKVStorageCompressionNone)) return YES;
+    if (item.key) [self _removeBrokenItemWithKey:item.key filename:item.filename];
+    return NO;
+}
+
 - (YYKVStorageItem *)getItemForKey:(NSString *)key {
     if (key.length == 0) return nil;
+    YYKVStorageItem *pending = [self _pendingItemForKey:key excludeValue:NO];
+    if (pending) return pending;
+    _YYKVReader *reader = [self _readerBegin];
     YYKVStorageItem *item = [self _dbGetItemWithKey:key excludeInlineData:NO];
     if (item) {
-        [self _dbUpdateAccessTimeWithKey:key];
-        if (item.filename) {
-            item.value = [self _fileReadWithName:item.filename];
-            if (!item.value) {
-                [self _dbDeleteItemWithKey:key];
-                item = nil;
-            }
-        }
+        [self _updateAccessTimeWithKey:key];
+        if (![self _loadValueForItem:item]) item = nil;
     }
+    [self _readerEnd:reader];
     return item;
 }
 
 - (YYKVStorageItem *)getItemInfoForKey:(NSString *)key {
     if (key.length == 0) return nil;
+    YYKVStorageItem *pending = [self _pendingItemForKey:key excludeValue:YES];
+    if (pending) return pending;
+    _YYKVReader *reader = [self _readerBegin];
     YYKVStorageItem *item = [self _dbGetItemWithKey:key excludeInlineData:YES];
+    [self _readerEnd:reader];
+    if (item) [self _applyAccessTimeToItem:item];
     return item;
 }
 
 - (NSData *)getItemValueForKey:(NSString *)key {
     if (key.length == 0) return nil;
-    NSData *value = nil;
-    switch (_type) {
-        case YYKVStorageTypeFile: {
-            NSString *filename = [self _dbGetFilenameWithKey:key];
-            if (filename) {
-                value = [self _fileReadWithName:filename];
-                if (!value) {
-                    [self _dbDeleteItemWithKey:key];
-                    value = nil;
-                }
-            }
-        } break;
-        case YYKVStorageTypeSQLite: {
-            value = [self _dbGetValueWithKey:key];
-        } break;
-        case YYKVStorageTypeMixed: {
-            NSString *filename = [self _dbGetFilenameWithKey:key];
-            if (filename) {
-                value = [self _fileReadWithName:filename];
-                if (!value) {
-                    [self _dbDeleteItemWithKey:key];
-                    value = nil;
-                }
-            } else {
-                value = [self _dbGetValueWithKey:key];
-            }
-        } break;
+    NSData *value = ((YYKVStorageItem *)_pendingItems[key]).value;
+    if (value) return value;
+    _YYKVReader *reader = [self _readerBegin];
+    NSString *filename = nil;
+    value = [self _dbGetValueWithKey:key filename:&filename]; // the codec is read from manifest
+    if (!value && filename) {
+        [self _removeBrokenItemWithKey:key filename:filename];
     }
     if (value) {
-        [self _dbUpdateAccessTimeWithKey:key];
+        [self _updateAccessTimeWithKey:key];
     }
+    [self _readerEnd:reader];
     return value;
 }
 
 - (NSArray *)getItemForKeys:(NSArray *)keys {
     if (keys.count == 0) return nil;
+    NSMutableArray *pendingItems = [self _pendingItemsForKeys:&keys excludeValue:NO];
+    if (keys.count == 0) return pendingItems;
+    _YYKVReader *reader = [self _readerBegin];
     NSMutableArray *items = [self _dbGetItemWithKeys:keys excludeInlineData:NO];
-    if (_type != YYKVStorageTypeSQLite) {
-        for (NSInteger i = 0, max = items.count; i < max; i++) {
-            YYKVStorageItem *item = items[i];
-            if (item.filename) {
-                item.value = [self _fileReadWithName:item.filename];
-                if (!item.value) {
-                    if (item.key) [self _dbDeleteItemWithKey:item.key];
-                    [items removeObjectAtIndex:i];
-                    i--;
-                    max--;
-                }
-            }
+    for (NSInteger i = 0, max = items.count; i < max; i++) {
+        YYKVStorageItem *item = items[i];
+        if (![self _loadValueForItem:item]) {
+            [items removeObjectAtIndex:i];
+            i--;
+            max--;
         }
     }
     if (items.count > 0) {
-        [self _dbUpdateAccessTimeWithKeys:keys];
+        [self _updateAccessTimeWithItems:items];
+    }
+    [self _readerEnd:reader];
+    if (pendingItems) {
+        if (items) [pendingItems addObjectsFromArray:items];
+        items = pendingItems;
     }
     return items.count ? items : nil;
 }
 
 - (NSArray *)getItemInfoForKeys:(NSArray *)keys {
     if (keys.count == 0) return nil;
-    return [self _dbGetItemWithKeys:keys excludeInlineData:YES];
+    NSMutableArray *pendingItems = [self _pendingItemsForKeys:&keys excludeValue:YES];
+    if (keys.count == 0) return pendingItems;
+    _YYKVReader *reader = [self _readerBegin];
+    NSMutableArray *items = [self _dbGetItemWithKeys:keys excludeInlineData:YES];
+    [self _readerEnd:reader];
+    for (YYKVStorageItem *item in items) [self _applyAccessTimeToItem:item];
+    if (pendingItems) {
+        if (items) [pendingItems addObjectsFromArray:items];
+        items = pendingItems;
+    }
+    return items.count ? items : nil;
 }
 
 - (NSDictionary *)getItemValueForKeys:(NSArray *)keys {
@@ -1026,17 +2749,60 @@ static NSString *const kTrashDirectoryName = @"trash";
     return kv.count ? kv : nil;
 }
 
+- (BOOL)enumerateKeysUsingBlock:(void (^)(NSString *key))block {
+    if (!block) return NO;
+    [self flushPendingWrites];
+    sqlite3_stmt *stmt = [self _dbPrepareStmt:_YYKVStmtGetKeys];
+    if (!stmt) return NO;
+    for (;;) {
+        int result = sqlite3_step(stmt);
+        if (result == SQLITE_ROW) {
+            char *key = (char *)sqlite3_column_text(stmt, 0);
+            if (key && *key != 0) block([NSString stringWithUTF8String:key]);
+        } else if (result == SQLITE_DONE) {
+            break;
+        } else {
+            if (_errorLogsEnabled) NSLog(@"%s line:%d sqlite query error (%d): %s", __FUNCTION__, __LINE__, result, sqlite3_errmsg(_db));
+            sqlite3_reset(stmt);
+            return NO;
+        }
+    }
+    sqlite3_reset(stmt);
+    return YES;
+}
+
 - (BOOL)itemExistsForKey:(NSString *)key {
     if (key.length == 0) return NO;
-    return [self _dbGetItemCountWithKey:key] > 0;
+    if (_pendingItems[key]) return YES;
+    _YYKVReader *reader = [self _readerBegin];
+    BOOL exists = [self _dbGetItemCountWithKey:key] > 0;
+    [self _readerEnd:reader];
+    return exists;
 }
 
 - (int)getItemsCount {
+    [self flushPendingWrites];
     return [self _dbGetTotalItemCount];
 }
 
 - (int)getItemsSize {
+    int64_t size = [self getItemsTotalSize];
+    return size > INT_MAX ? INT_MAX : (int)size;
+}
+
+- (int64_t)getItemsTotalSize {
+    [self flushPendingWrites];
     return [self _dbGetTotalItemSize];
 }
 
+- (int)getItemsLogicalSize {
+    int64_t size = [self getItemsTotalLogicalSize];
+    return size > INT_MAX ? INT_MAX : (int)size;
+}
+
+- (int64_t)getItemsTotalLogicalSize {
+    [self flushPendingWrites];
+    return [self _dbGetTotalItemLogicalSize];
+}
+
 @end
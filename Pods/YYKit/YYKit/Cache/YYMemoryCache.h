@@ -11,8 +11,26 @@
 
 #import <Foundation/Foundation.h>
 
+@class YYCacheStatistics;
+
 NS_ASSUME_NONNULL_BEGIN
 
+/**
+ The eviction policy of YYMemoryCache.
+ */
+typedef NS_ENUM(NSUInteger, YYMemoryCacheEvictionPolicy) {
+    
+    /// Least-recently-used. Each hit moves the object to the head of the LRU list,
+    /// so the read path needs an exclusive lock.
+    YYMemoryCacheEvictionPolicyLRU = 0,
+    
+    /// CLOCK (second chance). A hit only sets a reference bit of the object under
+    /// a shared (read) lock, so readers don't block each other. When trimming, the
+    /// referenced objects at the LRU end get a second chance instead of being
+    /// evicted. It is an approximation of LRU.
+    YYMemoryCacheEvictionPolicyCLOCK = 1,
+};
+
 /**
  YYMemoryCache is a fast in-memory cache that stores key-value pairs.
  In contrast to NSDictionary, keys are retained and not copied.
@@ -20,11 +38,13 @@ NS_ASSUME_NONNULL_BEGIN
  
  YYMemoryCache objects differ from NSCache in a few ways:
  
- * It uses LRU (least-recently-used) to remove objects; NSCache's eviction method
-   is non-deterministic.
+ * It uses LRU (least-recently-used) or CLOCK to remove objects; NSCache's eviction
+   method is non-deterministic.
  * It can be controlled by cost, count and age; NSCache's limits are imprecise.
  * It can be configured to automatically evict objects when receive memory 
    warning or app enter background.
+ * It can split the key space into multiple independently locked shards to reduce
+   lock contention when accessed from many threads.
  
  The time of `Access Methods` in YYMemoryCache is typically in constant time (O(1)).
  */
@@ -44,6 +64,31 @@ NS_ASSUME_NONNULL_BEGIN
 /** The total cost of objects in the cache (read-only). */
 @property (readonly) NSUInteger totalCost;
 
+/** The number of shards in the cache (read-only). Default is 1. */
+@property (readonly) NSUInteger shardCount;
+
+/** The total time in nanoseconds the cache has spent on trimming (read-only). */
+@property (readonly) uint64_t trimNanoseconds;
+
+/**
+ The cost which is currently over the `costLimit` and waiting to be trimmed (read-only).
+ 
+ @discussion A write which makes the cache go over its limits evicts a small batch
+ of objects by itself, and the rest is evicted in background thread, in short 
+ passes which hold the lock for about 1 ms each.
+ */
+@property (readonly) NSUInteger costOverLimit;
+
+/**
+ A snapshot of the cache's statistics: hits, misses, evictions by reason, the
+ cost of read and written objects, and the latency of `objectForKey:` and
+ `setObject:forKey:withCost:` (read-only).
+ */
+@property (readonly) YYCacheStatistics *statistics;
+
+/** Reset the statistics to zero. */
+- (void)resetStatistics;
+
 
 #pragma mark - Limit
 ///=============================================================================
@@ -77,6 +122,26 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property NSTimeInterval ageLimit;
 
+/**
+ The eviction policy. Default is YYMemoryCacheEvictionPolicyLRU.
+ 
+ @discussion Use YYMemoryCacheEvictionPolicyCLOCK if the cache is read much more 
+ often than written from multiple threads. With this policy, an object's age is
+ refreshed when the clock hand passes it instead of on each access.
+ */
+@property YYMemoryCacheEvictionPolicy evictionPolicy;
+
+/**
+ If `YES`, the cache uses a W-TinyLFU admission filter to protect the frequently
+ used objects from being flushed by a scan of one-hit objects. Default is NO.
+ 
+ @discussion The cache estimates the access frequency of keys with a count-min 
+ sketch. New objects are put into a small LRU window (about 1% of the objects),
+ and an object leaving the window can only displace the LRU victim of the cache
+ if it is accessed more frequently than the victim, otherwise it is evicted.
+ */
+@property BOOL admissionFilterEnabled;
+
 /**
  The auto trim check time interval in seconds. Default is 5.0.
  
@@ -122,10 +187,44 @@ NS_ASSUME_NONNULL_BEGIN
  If `YES`, the key-value pair will be released asynchronously to avoid blocking 
  the access methods, otherwise it will be released in the access method  
  (such as removeObjectForKey:). Default is YES.
+ 
+ @discussion The removed objects are released in batches, a partially filled
+ batch is released by the next trim (see `autoTrimInterval`). The batch buffers
+ are reused, so evictions don't allocate memory.
  */
 @property BOOL releaseAsynchronously;
 
 
+#pragma mark - Initializer
+///=============================================================================
+/// @name Initializer
+///=============================================================================
+
+/**
+ Creates a cache with a single shard, same as `initWithShardCount:1`.
+ */
+- (instancetype)init;
+
+/**
+ The designated initializer.
+ 
+ @param shardCount The number of shards, it will be rounded up to a power of 2 
+     and clamped to range [1, 64]. Each shard holds its own lock and LRU list,
+     and a key is always stored in the shard chosen by the key's hash.
+ 
+ @discussion A single shard gives an exact global LRU order. Use more shards 
+ (typically the number of CPU cores) if the cache is heavily accessed from many 
+ threads. The `costLimit` and `countLimit` are divided evenly among the shards, 
+ so the LRU order and the limits are enforced per shard. A limit which is too 
+ small to divide (less than 16 objects or 1 MB cost per shard) is enforced on the
+ whole cache instead: a write which makes the cache go over it only schedules a
+ background trim, which evicts the least recently used objects of all shards
+ first. So the cache may be over such a limit for a short time, and a write never
+ locks other shards.
+ */
+- (instancetype)initWithShardCount:(NSUInteger)shardCount NS_DESIGNATED_INITIALIZER;
+
+
 #pragma mark - Access Methods
 ///=============================================================================
 /// @name Access Methods
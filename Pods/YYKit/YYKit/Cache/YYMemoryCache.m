@@ -10,6 +10,7 @@
 //
 
 #import "YYMemoryCache.h"
+#import "YYCacheStatistics.h"
 #import <UIKit/UIKit.h>
 #import <CoreFoundation/CoreFoundation.h>
 #import <QuartzCore/QuartzCore.h>
@@ -29,58 +30,260 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
 }
 #endif
 
+
+/**
+ A count-min sketch which estimates the access frequency of keys (TinyLFU).
+ Each counter is saturated at 15, and all counters are halved after `sampleSize`
+ additions, so that the old history decays.
+ 
+ The counters are updated with relaxed atomic operations, so a sketch can be 
+ incremented by multiple readers concurrently (some increments may be lost, it's
+ acceptable for an estimation). Other functions need exclusive access.
+ */
+typedef struct {
+    uint8_t *table;        ///< depth * width counters
+    NSUInteger mask;       ///< width - 1, width is power of 2
+    NSUInteger additions;  ///< increments since last reset
+    NSUInteger sampleSize; ///< reset when additions reach this value
+} _YYFrequencySketch;
+
+#define kYYFrequencySketchDepth 4
+#define kYYFrequencySketchWidthMin 64
+#define kYYFrequencySketchWidthMax (1 << 20)
+
+static inline NSUInteger _YYFrequencySketchIndex(_YYFrequencySketch *sketch, NSUInteger hash, int row) {
+    static const uint64_t seeds[kYYFrequencySketchDepth] = {
+        0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL
+    };
+    uint64_t h = ((uint64_t)hash + seeds[row]) * seeds[row];
+    h += h >> 32;
+    return (NSUInteger)row * (sketch->mask + 1) + ((NSUInteger)h & sketch->mask);
+}
+
+static void _YYFrequencySketchSetWidth(_YYFrequencySketch *sketch, NSUInteger width) {
+    uint8_t *table = calloc(width * kYYFrequencySketchDepth, sizeof(uint8_t));
+    if (!table) return;
+    if (sketch->table) free(sketch->table);
+    sketch->table = table;
+    sketch->mask = width - 1;
+    sketch->additions = 0;
+    sketch->sampleSize = width * 10;
+}
+
+static _YYFrequencySketch *_YYFrequencySketchCreate() {
+    _YYFrequencySketch *sketch = calloc(1, sizeof(_YYFrequencySketch));
+    if (!sketch) return NULL;
+    _YYFrequencySketchSetWidth(sketch, kYYFrequencySketchWidthMin);
+    if (!sketch->table) {
+        free(sketch);
+        return NULL;
+    }
+    return sketch;
+}
+
+static void _YYFrequencySketchFree(_YYFrequencySketch *sketch) {
+    if (!sketch) return;
+    if (sketch->table) free(sketch->table);
+    free(sketch);
+}
+
+/// Grow the sketch (and forget the history) if it's too small for the item count.
+static void _YYFrequencySketchEnsureCapacity(_YYFrequencySketch *sketch, NSUInteger count) {
+    NSUInteger width = sketch->mask + 1;
+    if (count <= width || width >= kYYFrequencySketchWidthMax) return;
+    while (width < count && width < kYYFrequencySketchWidthMax) width <<= 1;
+    _YYFrequencySketchSetWidth(sketch, width);
+}
+
+static inline void _YYFrequencySketchIncrement(_YYFrequencySketch *sketch, NSUInteger hash) {
+    for (int i = 0; i < kYYFrequencySketchDepth; i++) {
+        uint8_t *counter = sketch->table + _YYFrequencySketchIndex(sketch, hash, i);
+        uint8_t value = __atomic_load_n(counter, __ATOMIC_RELAXED);
+        if (value < 15) __atomic_store_n(counter, value + 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&sketch->additions, 1, __ATOMIC_RELAXED);
+}
+
+static inline uint8_t _YYFrequencySketchFrequency(_YYFrequencySketch *sketch, NSUInteger hash) {
+    uint8_t frequency = 15;
+    for (int i = 0; i < kYYFrequencySketchDepth; i++) {
+        uint8_t value = sketch->table[_YYFrequencySketchIndex(sketch, hash, i)];
+        if (value < frequency) frequency = value;
+    }
+    return frequency;
+}
+
+/// Halve all counters if the sample size is reached.
+static void _YYFrequencySketchAgeIfNeeded(_YYFrequencySketch *sketch) {
+    if (sketch->additions < sketch->sampleSize) return;
+    NSUInteger length = (sketch->mask + 1) * kYYFrequencySketchDepth;
+    for (NSUInteger i = 0; i < length; i++) {
+        sketch->table[i] >>= 1;
+    }
+    sketch->additions /= 2;
+}
+
+
+/// The index of null node in linked map.
+#define kYYLinkedMapNull UINT32_MAX
+
+/// The removed objects are released in batches of this size (asynchronously).
+#define kYYLinkedMapReleaseBatch 32
+
+/// The capacity of a release pool, pools of this capacity are recycled.
+#define kYYLinkedMapReleasePoolCapacity (kYYLinkedMapReleaseBatch * 2)
+
+/// The number of drained release pools kept for reuse.
+#define kYYLinkedMapReleasePoolSpareCount 16
+
 /**
  A node in linked map.
- Typically, you should not use this class directly.
+ Nodes are stored in a contiguous slab and linked by index, a free node is
+ linked in the free list by `next`. The key and value are retained manually.
  */
-@interface _YYLinkedMapNode : NSObject {
-    @package
-    __unsafe_unretained _YYLinkedMapNode *_prev; // retained by dic
-    __unsafe_unretained _YYLinkedMapNode *_next; // retained by dic
-    id _key;
-    id _value;
-    NSUInteger _cost;
-    NSTimeInterval _time;
+typedef struct {
+    const void *key;     // retained, NULL if the node is free
+    const void *value;   // retained
+    NSUInteger hash;     // mixed hash of key
+    NSUInteger cost;
+    NSTimeInterval time;
+    uint32_t prev;
+    uint32_t next;
+    BOOL referenced;     // reference bit for CLOCK policy, set with relaxed atomic store
+    BOOL inWindow;       // whether the node is in the admission window list
+} _YYLinkedMapNode;
+
+/**
+ A batch of removed objects (keys and values) waiting to be released.
+ */
+typedef struct {
+    NSUInteger count;
+    NSUInteger capacity;
+    const void *objects[];
+} _YYLinkedMapReleasePool;
+
+/// Drained pools of the standard capacity, shared by all maps. A slot is taken
+/// and filled with atomic exchange, so a pool can be recycled in any queue.
+static _YYLinkedMapReleasePool *_YYLinkedMapSpareReleasePools[kYYLinkedMapReleasePoolSpareCount];
+
+/// Get an empty pool of the standard capacity, a recycled one if possible.
+static _YYLinkedMapReleasePool *_YYLinkedMapReleasePoolCreate() {
+    for (int i = 0; i < kYYLinkedMapReleasePoolSpareCount; i++) {
+        if (!__atomic_load_n(&_YYLinkedMapSpareReleasePools[i], __ATOMIC_RELAXED)) continue;
+        _YYLinkedMapReleasePool *pool = __atomic_exchange_n(&_YYLinkedMapSpareReleasePools[i], NULL, __ATOMIC_ACQUIRE);
+        if (pool) return pool;
+    }
+    _YYLinkedMapReleasePool *pool = malloc(sizeof(_YYLinkedMapReleasePool) + sizeof(void *) * kYYLinkedMapReleasePoolCapacity);
+    if (!pool) return NULL;
+    pool->count = 0;
+    pool->capacity = kYYLinkedMapReleasePoolCapacity;
+    return pool;
 }
-@end
 
-@implementation _YYLinkedMapNode
-@end
+/// Release the objects in a pool, then recycle or free the pool.
+static void _YYLinkedMapReleasePoolDrain(void *context) {
+    _YYLinkedMapReleasePool *pool = context;
+    for (NSUInteger i = 0; i < pool->count; i++) {
+        CFRelease(pool->objects[i]);
+    }
+    pool->count = 0;
+    if (pool->capacity == kYYLinkedMapReleasePoolCapacity) {
+        for (int i = 0; i < kYYLinkedMapReleasePoolSpareCount; i++) {
+            _YYLinkedMapReleasePool *empty = NULL;
+            if (__atomic_compare_exchange_n(&_YYLinkedMapSpareReleasePools[i], &empty, pool, NO, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) return;
+        }
+    }
+    free(pool);
+}
 
 
 /**
  A linked map used by YYMemoryCache.
  It's not thread-safe and does not validate the parameters.
  
+ The map doesn't allocate memory for each node: nodes live in a slab which grows
+ by doubling, and the keys are indexed by an open-addressing hash table (linear
+ probing) of node indexes. The removed objects are released in batches, and the
+ batch buffers are recycled. So the steady-state insertion and eviction are free
+ of heap allocation.
+ 
+ A node's address may change when a node is inserted, use the index instead.
+ 
  Typically, you should not use this class directly.
  */
 @interface _YYLinkedMap : NSObject {
     @package
-    CFMutableDictionaryRef _dic; // do not set object directly
+    _YYLinkedMapNode *_nodes; // slab, do not change it directly
+    uint32_t _nodeCapacity;
+    uint32_t _freeNode;       // head of the free list
+    uint32_t *_slots;         // hash table of node index, kYYLinkedMapNull if empty
+    NSUInteger _slotMask;     // slot count - 1, slot count is power of 2
     NSUInteger _totalCost;
     NSUInteger _totalCount;
-    _YYLinkedMapNode *_head; // MRU, do not change it directly
-    _YYLinkedMapNode *_tail; // LRU, do not change it directly
+    uint32_t _head; // MRU, do not change it directly
+    uint32_t _tail; // LRU, do not change it directly
     BOOL _releaseOnMainThread;
     BOOL _releaseAsynchronously;
+    _YYLinkedMapReleasePool *_releasePool;
+    
+    // W-TinyLFU admission, the sketch is NULL if it's disabled
+    _YYFrequencySketch *_sketch;
+    uint32_t _windowHead; // new nodes are inserted here
+    uint32_t _windowTail;
+    NSUInteger _windowCount;
 }
 
+/// Enable or disable the W-TinyLFU admission filter.
+/// When enabled, new nodes are inserted into a small window list (1% of the
+/// total count), and a node which overflows the window must be used more often
+/// than the LRU node of the main list to be admitted into the main list.
+- (void)setAdmissionEnabled:(BOOL)enabled;
+
+/// Find the node for a key, returns kYYLinkedMapNull if not found.
+/// The hash should be computed with `_YYMemoryCacheHash()`.
+- (uint32_t)indexForKey:(id)key hash:(NSUInteger)hash;
+
 /// Insert a node at head and update the total cost.
-/// Node and node.key should not be nil.
-- (void)insertNodeAtHead:(_YYLinkedMapNode *)node;
+/// Key should not be in the map. Returns kYYLinkedMapNull if no memory.
+- (uint32_t)insertNodeWithKey:(id)key hash:(NSUInteger)hash value:(id)value cost:(NSUInteger)cost time:(NSTimeInterval)time;
+
+/// Replace the value of a inner node, update the total cost and bring it to head.
+- (void)setValue:(id)value cost:(NSUInteger)cost time:(NSTimeInterval)time forNode:(uint32_t)index;
 
 /// Bring a inner node to header.
-/// Node should already inside the dic.
-- (void)bringNodeToHead:(_YYLinkedMapNode *)node;
+- (void)bringNodeToHead:(uint32_t)index;
 
 /// Remove a inner node and update the total cost.
-/// Node should already inside the dic.
-- (void)removeNode:(_YYLinkedMapNode *)node;
+/// The key and value are added to the release pool.
+- (void)removeNode:(uint32_t)index;
+
+/// Remove tail node if exist, returns whether a node is removed.
+/// If admission is enabled, remove the loser of the window's LRU node and the
+/// main list's LRU node.
+- (BOOL)removeTailNode;
+
+/// The node with the earliest time (the LRU node of window or main list).
+- (uint32_t)oldestNode;
+
+/// Move the nodes which overflow the window to main list, without admission check.
+/// Call it when the map is not over its limits.
+- (void)trimWindow;
 
-/// Remove tail node if exist.
-- (_YYLinkedMapNode *)removeTailNode;
+/// Move the referenced nodes at tail to head, clear the reference bit and set
+/// the time, until the tail node is not referenced (CLOCK policy, the tail is
+/// the clock hand).
+- (void)advanceClockHandWithTime:(NSTimeInterval)time;
+
+/**
+ Hand off the removed objects for release. If they are released asynchronously
+ or on main thread, they are dispatched to the queue (if `force` is NO, only when
+ a batch is full) and NULL is returned. Otherwise the pool is detached and 
+ returned, the caller should unlock the map, then release the objects with
+ `_YYLinkedMapReleasePoolDrain()`, so an object's dealloc never runs in the lock.
+ */
+- (_YYLinkedMapReleasePool *)flushReleasePool:(BOOL)force __attribute__((warn_unused_result));
 
-/// Remove all node in background queue.
+/// Remove all nodes, the objects are added to the release pool.
 - (void)removeAll;
 
 @end
@@ -89,102 +292,433 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
 
 - (instancetype)init {
     self = [super init];
-    _dic = CFDictionaryCreateMutable(CFAllocatorGetDefault(), 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    _head = _tail = kYYLinkedMapNull;
+    _windowHead = _windowTail = kYYLinkedMapNull;
+    _freeNode = kYYLinkedMapNull;
     _releaseOnMainThread = NO;
     _releaseAsynchronously = YES;
     return self;
 }
 
 - (void)dealloc {
-    CFRelease(_dic);
+    [self removeAll];
+    _YYLinkedMapReleasePool *pool = [self flushReleasePool:YES];
+    if (pool) _YYLinkedMapReleasePoolDrain(pool);
+    if (_releasePool) _YYLinkedMapReleasePoolDrain(_releasePool);
+    _YYFrequencySketchFree(_sketch);
 }
 
-- (void)insertNodeAtHead:(_YYLinkedMapNode *)node {
-    CFDictionarySetValue(_dic, (__bridge const void *)(node->_key), (__bridge const void *)(node));
-    _totalCost += node->_cost;
-    _totalCount++;
-    if (_head) {
-        node->_next = _head;
-        _head->_prev = node;
-        _head = node;
+#pragma mark list
+
+static inline void _YYLinkedMapListUnlink(_YYLinkedMapNode *nodes, uint32_t index, uint32_t *head, uint32_t *tail) {
+    _YYLinkedMapNode *node = &nodes[index];
+    if (node->next != kYYLinkedMapNull) nodes[node->next].prev = node->prev;
+    if (node->prev != kYYLinkedMapNull) nodes[node->prev].next = node->next;
+    if (*head == index) *head = node->next;
+    if (*tail == index) *tail = node->prev;
+    node->prev = node->next = kYYLinkedMapNull;
+}
+
+static inline void _YYLinkedMapListInsertAtHead(_YYLinkedMapNode *nodes, uint32_t index, uint32_t *head, uint32_t *tail) {
+    _YYLinkedMapNode *node = &nodes[index];
+    node->prev = kYYLinkedMapNull;
+    node->next = *head;
+    if (*head != kYYLinkedMapNull) nodes[*head].prev = index;
+    else *tail = index;
+    *head = index;
+}
+
+- (void)_moveWindowTailToMain {
+    uint32_t index = _windowTail;
+    _YYLinkedMapListUnlink(_nodes, index, &_windowHead, &_windowTail);
+    _windowCount--;
+    _nodes[index].inWindow = NO;
+    _YYLinkedMapListInsertAtHead(_nodes, index, &_head, &_tail);
+}
+
+#pragma mark storage
+
+/// Make sure there's a free node, returns NO if no memory.
+- (BOOL)_reserveNode {
+    if (_freeNode != kYYLinkedMapNull) return YES;
+    if (_nodeCapacity >= kYYLinkedMapNull / 2) return NO;
+    uint32_t capacity = _nodeCapacity ? _nodeCapacity * 2 : 16;
+    _YYLinkedMapNode *nodes = realloc(_nodes, sizeof(_YYLinkedMapNode) * capacity);
+    if (!nodes) return NO;
+    memset(nodes + _nodeCapacity, 0, sizeof(_YYLinkedMapNode) * (capacity - _nodeCapacity));
+    for (uint32_t i = capacity; i > _nodeCapacity; i--) {
+        nodes[i - 1].next = _freeNode;
+        _freeNode = i - 1;
+    }
+    _nodes = nodes;
+    _nodeCapacity = capacity;
+    return YES;
+}
+
+/// Make sure the hash table can hold one more node (load factor <= 0.75),
+/// returns NO if no memory.
+- (BOOL)_reserveSlot {
+    NSUInteger slotCount = _slots ? _slotMask + 1 : 0;
+    if ((_totalCount + 1) * 4 <= slotCount * 3) return YES;
+    NSUInteger newCount = slotCount ? slotCount * 2 : 16;
+    uint32_t *slots = malloc(sizeof(uint32_t) * newCount);
+    if (!slots) return NO;
+    memset(slots, 0xFF, sizeof(uint32_t) * newCount); // kYYLinkedMapNull
+    NSUInteger mask = newCount - 1;
+    for (NSUInteger i = 0; i < slotCount; i++) {
+        uint32_t index = _slots[i];
+        if (index == kYYLinkedMapNull) continue;
+        NSUInteger slot = _nodes[index].hash & mask;
+        while (slots[slot] != kYYLinkedMapNull) slot = (slot + 1) & mask;
+        slots[slot] = index;
+    }
+    if (_slots) free(_slots);
+    _slots = slots;
+    _slotMask = mask;
+    return YES;
+}
+
+/// Remove a node index from hash table with backward shift deletion (no tombstone).
+- (void)_removeSlotForNode:(uint32_t)index {
+    NSUInteger i = _nodes[index].hash & _slotMask;
+    while (_slots[i] != index) i = (i + 1) & _slotMask;
+    NSUInteger j = i;
+    while (1) {
+        j = (j + 1) & _slotMask;
+        uint32_t other = _slots[j];
+        if (other == kYYLinkedMapNull) break;
+        NSUInteger k = _nodes[other].hash & _slotMask; // the ideal slot of the other node
+        // move the other node to the hole if its ideal slot is not in (i, j] cyclically
+        BOOL move = (i <= j) ? (k <= i || k > j) : (k <= i && k > j);
+        if (move) {
+            _slots[i] = other;
+            i = j;
+        }
+    }
+    _slots[i] = kYYLinkedMapNull;
+}
+
+/// Make room for `count` more objects in the release pool.
+- (BOOL)_reserveReleasePool:(NSUInteger)count {
+    if (!_releasePool) _releasePool = _YYLinkedMapReleasePoolCreate();
+    if (!_releasePool) return NO;
+    if (_releasePool->capacity - _releasePool->count >= count) return YES;
+    NSUInteger used = _releasePool->count;
+    NSUInteger capacity = _releasePool->capacity * 2;
+    if (capacity < used + count) capacity = used + count;
+    _YYLinkedMapReleasePool *pool = realloc(_releasePool, sizeof(_YYLinkedMapReleasePool) + sizeof(void *) * capacity);
+    if (!pool) return NO;
+    pool->count = used;
+    pool->capacity = capacity;
+    _releasePool = pool;
+    return YES;
+}
+
+- (void)_releaseLater:(const void *)object {
+    if (_releasePool && _releasePool->count == _releasePool->capacity) {
+        // a full batch goes to the release queue, a synchronous pool grows until it's detached
+        _YYLinkedMapReleasePool *pool = [self flushReleasePool:NO];
+        if (pool) _releasePool = pool; // not detached here, keep it
+    }
+    if (![self _reserveReleasePool:1]) {
+        // no memory, release it in background to keep it out of the lock
+        dispatch_async_f(YYMemoryCacheGetReleaseQueue(), (void *)object, (dispatch_function_t)CFRelease);
+        return;
+    }
+    _releasePool->objects[_releasePool->count++] = object;
+}
+
+- (_YYLinkedMapReleasePool *)flushReleasePool:(BOOL)force {
+    _YYLinkedMapReleasePool *pool = _releasePool;
+    if (!pool || pool->count == 0) return NULL;
+    if (_releaseAsynchronously) {
+        if (!force && pool->count < kYYLinkedMapReleaseBatch) return NULL;
+        _releasePool = NULL;
+        dispatch_queue_t queue = _releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
+        dispatch_async_f(queue, pool, _YYLinkedMapReleasePoolDrain); // hold and release in specified queue
+        return NULL;
+    } else if (_releaseOnMainThread && !pthread_main_np()) {
+        _releasePool = NULL;
+        dispatch_async_f(dispatch_get_main_queue(), pool, _YYLinkedMapReleasePoolDrain);
+        return NULL;
     } else {
-        _head = _tail = node;
+        _releasePool = NULL;
+        return pool; // released by caller after unlock
     }
 }
 
-- (void)bringNodeToHead:(_YYLinkedMapNode *)node {
-    if (_head == node) return;
+#pragma mark public
+
+- (void)setAdmissionEnabled:(BOOL)enabled {
+    if (enabled == (_sketch != NULL)) return;
+    if (enabled) {
+        _sketch = _YYFrequencySketchCreate();
+        if (_sketch) _YYFrequencySketchEnsureCapacity(_sketch, _totalCount);
+    } else {
+        while (_windowTail != kYYLinkedMapNull) [self _moveWindowTailToMain];
+        _YYFrequencySketchFree(_sketch);
+        _sketch = NULL;
+    }
+}
+
+- (uint32_t)indexForKey:(id)key hash:(NSUInteger)hash {
+    if (!_slots) return kYYLinkedMapNull;
+    const void *keyRef = (__bridge const void *)(key);
+    NSUInteger slot = hash & _slotMask;
+    while (1) {
+        uint32_t index = _slots[slot];
+        if (index == kYYLinkedMapNull) return kYYLinkedMapNull;
+        _YYLinkedMapNode *node = &_nodes[index];
+        if (node->hash == hash && (node->key == keyRef || CFEqual(node->key, keyRef))) return index;
+        slot = (slot + 1) & _slotMask;
+    }
+}
+
+- (uint32_t)insertNodeWithKey:(id)key hash:(NSUInteger)hash value:(id)value cost:(NSUInteger)cost time:(NSTimeInterval)time {
+    if (![self _reserveNode] || ![self _reserveSlot]) return kYYLinkedMapNull;
+    uint32_t index = _freeNode;
+    _YYLinkedMapNode *node = &_nodes[index];
+    _freeNode = node->next;
+    node->key = CFRetain((__bridge CFTypeRef)(key));
+    node->value = CFRetain((__bridge CFTypeRef)(value));
+    node->hash = hash;
+    node->cost = cost;
+    node->time = time;
+    node->referenced = NO;
+    node->inWindow = NO;
+    
+    NSUInteger slot = hash & _slotMask;
+    while (_slots[slot] != kYYLinkedMapNull) slot = (slot + 1) & _slotMask;
+    _slots[slot] = index;
     
-    if (_tail == node) {
-        _tail = node->_prev;
-        _tail->_next = nil;
+    _totalCost += cost;
+    _totalCount++;
+    if (_sketch) {
+        node->inWindow = YES;
+        _windowCount++;
+        _YYLinkedMapListInsertAtHead(_nodes, index, &_windowHead, &_windowTail);
     } else {
-        node->_next->_prev = node->_prev;
-        node->_prev->_next = node->_next;
+        _YYLinkedMapListInsertAtHead(_nodes, index, &_head, &_tail);
     }
-    node->_next = _head;
-    node->_prev = nil;
-    _head->_prev = node;
-    _head = node;
+    return index;
 }
 
-- (void)removeNode:(_YYLinkedMapNode *)node {
-    CFDictionaryRemoveValue(_dic, (__bridge const void *)(node->_key));
-    _totalCost -= node->_cost;
-    _totalCount--;
-    if (node->_next) node->_next->_prev = node->_prev;
-    if (node->_prev) node->_prev->_next = node->_next;
-    if (_head == node) _head = node->_next;
-    if (_tail == node) _tail = node->_prev;
+- (void)setValue:(id)value cost:(NSUInteger)cost time:(NSTimeInterval)time forNode:(uint32_t)index {
+    _YYLinkedMapNode *node = &_nodes[index];
+    const void *oldValue = node->value;
+    node->value = CFRetain((__bridge CFTypeRef)(value));
+    _totalCost -= node->cost;
+    _totalCost += cost;
+    node->cost = cost;
+    node->time = time;
+    node->referenced = NO;
+    [self bringNodeToHead:index];
+    [self _releaseLater:oldValue];
 }
 
-- (_YYLinkedMapNode *)removeTailNode {
-    if (!_tail) return nil;
-    _YYLinkedMapNode *tail = _tail;
-    CFDictionaryRemoveValue(_dic, (__bridge const void *)(_tail->_key));
-    _totalCost -= _tail->_cost;
+- (void)bringNodeToHead:(uint32_t)index {
+    if (_nodes[index].inWindow) {
+        if (_windowHead == index) return;
+        _YYLinkedMapListUnlink(_nodes, index, &_windowHead, &_windowTail);
+        _YYLinkedMapListInsertAtHead(_nodes, index, &_windowHead, &_windowTail);
+    } else {
+        if (_head == index) return;
+        _YYLinkedMapListUnlink(_nodes, index, &_head, &_tail);
+        _YYLinkedMapListInsertAtHead(_nodes, index, &_head, &_tail);
+    }
+}
+
+- (void)removeNode:(uint32_t)index {
+    _YYLinkedMapNode *node = &_nodes[index];
+    [self _removeSlotForNode:index];
+    _totalCost -= node->cost;
     _totalCount--;
-    if (_head == _tail) {
-        _head = _tail = nil;
+    if (node->inWindow) {
+        _YYLinkedMapListUnlink(_nodes, index, &_windowHead, &_windowTail);
+        node->inWindow = NO;
+        _windowCount--;
     } else {
-        _tail = _tail->_prev;
-        _tail->_next = nil;
+        _YYLinkedMapListUnlink(_nodes, index, &_head, &_tail);
+    }
+    const void *key = node->key;
+    const void *value = node->value;
+    node->key = NULL;
+    node->value = NULL;
+    node->next = _freeNode;
+    _freeNode = index;
+    [self _releaseLater:key];
+    [self _releaseLater:value];
+}
+
+- (BOOL)removeTailNode {
+    uint32_t index = _sketch ? [self _admissionVictim] : _tail;
+    if (index == kYYLinkedMapNull) return NO;
+    [self removeNode:index];
+    return YES;
+}
+
+/// The candidate (window's LRU) competes with the victim (main list's LRU),
+/// the one with lower frequency is returned, and the candidate is moved to the
+/// main list if it wins.
+- (uint32_t)_admissionVictim {
+    if (_windowTail == kYYLinkedMapNull) return _tail;
+    if (_tail == kYYLinkedMapNull) return _windowTail;
+    if (_windowCount <= MAX(_totalCount / 100, 1)) return _tail;
+    
+    uint32_t candidate = _windowTail;
+    uint32_t victim = _tail;
+    uint8_t candidateFrequency = _YYFrequencySketchFrequency(_sketch, _nodes[candidate].hash);
+    uint8_t victimFrequency = _YYFrequencySketchFrequency(_sketch, _nodes[victim].hash);
+    if (candidateFrequency > victimFrequency) {
+        [self _moveWindowTailToMain];
+        return victim;
+    }
+    return candidate;
+}
+
+- (uint32_t)oldestNode {
+    if (_windowTail == kYYLinkedMapNull) return _tail;
+    if (_tail == kYYLinkedMapNull) return _windowTail;
+    return _nodes[_windowTail].time < _nodes[_tail].time ? _windowTail : _tail;
+}
+
+- (void)trimWindow {
+    NSUInteger windowLimit = MAX(_totalCount / 100, 1);
+    while (_windowCount > windowLimit) [self _moveWindowTailToMain];
+}
+
+- (void)advanceClockHandWithTime:(NSTimeInterval)time {
+    NSUInteger count = _totalCount;
+    while (_tail != kYYLinkedMapNull && _nodes[_tail].referenced && count--) {
+        uint32_t index = _tail;
+        _nodes[index].referenced = NO;
+        _nodes[index].time = time;
+        [self bringNodeToHead:index];
     }
-    return tail;
 }
 
 - (void)removeAll {
-    _totalCost = 0;
-    _totalCount = 0;
-    _head = nil;
-    _tail = nil;
-    if (CFDictionaryGetCount(_dic) > 0) {
-        CFMutableDictionaryRef holder = _dic;
-        _dic = CFDictionaryCreateMutable(CFAllocatorGetDefault(), 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-        
-        if (_releaseAsynchronously) {
-            dispatch_queue_t queue = _releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-            dispatch_async(queue, ^{
-                CFRelease(holder); // hold and release in specified queue
-            });
-        } else if (_releaseOnMainThread && !pthread_main_np()) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                CFRelease(holder); // hold and release in specified queue
-            });
-        } else {
-            CFRelease(holder);
+    if (_totalCount > 0) {
+        // release all objects in one batch
+        [self _reserveReleasePool:_totalCount * 2];
+        for (uint32_t i = 0; i < _nodeCapacity; i++) {
+            _YYLinkedMapNode *node = &_nodes[i];
+            if (!node->key) continue;
+            [self _releaseLater:node->key];
+            [self _releaseLater:node->value];
         }
     }
+    
+    // free the storage, it will grow again on demand
+    if (_nodes) free(_nodes);
+    if (_slots) free(_slots);
+    _nodes = NULL;
+    _slots = NULL;
+    _nodeCapacity = 0;
+    _slotMask = 0;
+    _freeNode = kYYLinkedMapNull;
+    _totalCost = 0;
+    _totalCount = 0;
+    _head = _tail = kYYLinkedMapNull;
+    _windowHead = _windowTail = kYYLinkedMapNull;
+    _windowCount = 0;
 }
 
 @end
 
 
 
+
+
+
+/// The maximum number of shards in a memory cache.
+static const NSUInteger kYYMemoryCacheShardCountMax = 64;
+
+/// The number of nodes evicted between two deadline checks, and the most nodes
+/// a writer evicts inline before it leaves the rest to the trimmer.
+static const NSUInteger kYYMemoryCacheTrimBatch = 16;
+
+/// The longest time (in seconds) a trim pass holds a shard's write lock.
+static const NSTimeInterval kYYMemoryCacheTrimPassBudget = 0.001;
+
+/// The minimum part of the count limit and cost limit assigned to a shard. A
+/// smaller limit is not divided among shards but enforced on the whole cache
+/// by the trimmer.
+static const NSUInteger kYYMemoryCacheShardCountLimitMin = 16;
+static const NSUInteger kYYMemoryCacheShardCostLimitMin = 1024 * 1024;
+
+/**
+ A shard of YYMemoryCache: a linked map and the lock which guards it.
+ It's aligned to cache line size to avoid false sharing between shards.
+ */
+typedef struct {
+    pthread_rwlock_t lock;
+    __unsafe_unretained _YYLinkedMap *lru; // retained by cache's _shardMaps
+    BOOL trimScheduled; // a trim of this shard is queued, guarded by lock
+} __attribute__((aligned(64))) _YYMemoryCacheShard;
+
+/// Get the mixed hash of a key, used by both the shard and the linked map.
+static inline NSUInteger _YYMemoryCacheHash(id key) {
+    uint64_t hash = (uint64_t)CFHash((__bridge CFTypeRef)(key));
+    // mix the bits, many hash functions leave the low bits poorly distributed
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return (NSUInteger)hash;
+}
+
+/// Get the shard index for a hash. The mask should be (shardCount - 1).
+/// The high bits are used, the low bits are used by the linked map's hash table.
+static inline NSUInteger _YYMemoryCacheShardIndex(NSUInteger hash, NSUInteger mask) {
+    return (hash >> (sizeof(NSUInteger) * 4)) & mask;
+}
+
+/// Whether a limit is too small to be divided among the shards.
+static inline BOOL _YYMemoryCacheLimitIsGlobal(NSUInteger limit, NSUInteger shardCount, NSUInteger shardLimitMin) {
+    return shardCount > 1 && limit != NSUIntegerMax && limit / shardCount < shardLimitMin;
+}
+
+/// Get the part of a limit (cost or count) assigned to a shard, NSUIntegerMax if
+/// the limit is enforced on the whole cache.
+static inline NSUInteger _YYMemoryCacheShardLimit(NSUInteger limit, NSUInteger shardCount, NSUInteger index, NSUInteger shardLimitMin) {
+    if (shardCount == 1 || limit == NSUIntegerMax) return limit;
+    if (_YYMemoryCacheLimitIsGlobal(limit, shardCount, shardLimitMin)) return NSUIntegerMax;
+    return limit / shardCount + (index < limit % shardCount ? 1 : 0);
+}
+
+/// Get the limit (cost or count) enforced on the whole cache, NSUIntegerMax if
+/// the limit is divided among the shards.
+static inline NSUInteger _YYMemoryCacheGlobalLimit(NSUInteger limit, NSUInteger shardCount, NSUInteger shardLimitMin) {
+    return _YYMemoryCacheLimitIsGlobal(limit, shardCount, shardLimitMin) ? limit : NSUIntegerMax;
+}
+
+static inline NSUInteger _YYMemoryCacheShardCostLimit(NSUInteger limit, NSUInteger shardCount, NSUInteger index) {
+    return _YYMemoryCacheShardLimit(limit, shardCount, index, kYYMemoryCacheShardCostLimitMin);
+}
+
+static inline NSUInteger _YYMemoryCacheShardCountLimit(NSUInteger limit, NSUInteger shardCount, NSUInteger index) {
+    return _YYMemoryCacheShardLimit(limit, shardCount, index, kYYMemoryCacheShardCountLimitMin);
+}
+
+static inline NSUInteger _YYMemoryCacheGlobalCostLimit(NSUInteger limit, NSUInteger shardCount) {
+    return _YYMemoryCacheGlobalLimit(limit, shardCount, kYYMemoryCacheShardCostLimitMin);
+}
+
+static inline NSUInteger _YYMemoryCacheGlobalCountLimit(NSUInteger limit, NSUInteger shardCount) {
+    return _YYMemoryCacheGlobalLimit(limit, shardCount, kYYMemoryCacheShardCountLimitMin);
+}
+
+
 @implementation YYMemoryCache {
-    pthread_mutex_t _lock;
-    _YYLinkedMap *_lru;
+    _YYMemoryCacheShard *_shards;
+    NSUInteger _shardMask;
+    NSArray *_shardMaps;
     dispatch_queue_t _queue;
+    NSUInteger _totalCost;  // sum of all shards, relaxed atomic
+    NSUInteger _totalCount; // sum of all shards, relaxed atomic
+    BOOL _globalTrimScheduled; // relaxed atomic
+    uint64_t _trimNanoseconds; // relaxed atomic
+    YYCacheStatisticsRecorder *_statistics; // striped by shard index
 }
 
 - (void)_trimRecursively {
@@ -199,113 +733,203 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
 
 - (void)_trimInBackground {
     dispatch_async(_queue, ^{
-        [self _trimToCost:self->_costLimit];
-        [self _trimToCount:self->_countLimit];
-        [self _trimToAge:self->_ageLimit];
+        NSUInteger shardCount = self->_shardCount;
+        NSUInteger costLimit = self->_costLimit;
+        NSUInteger countLimit = self->_countLimit;
+        for (NSUInteger i = 0; i < shardCount; i++) {
+            [self _trimShard:&self->_shards[i]
+                      toCost:_YYMemoryCacheShardCostLimit(costLimit, shardCount, i)
+                       count:_YYMemoryCacheShardCountLimit(countLimit, shardCount, i)
+                         age:self->_ageLimit];
+        }
+        [self _trimGlobalToCost:_YYMemoryCacheGlobalCostLimit(costLimit, shardCount)
+                          count:_YYMemoryCacheGlobalCountLimit(countLimit, shardCount)];
     });
 }
 
 - (void)_trimToCost:(NSUInteger)costLimit {
-    BOOL finish = NO;
-    pthread_mutex_lock(&_lock);
-    if (costLimit == 0) {
-        [_lru removeAll];
-        finish = YES;
-    } else if (_lru->_totalCost <= costLimit) {
-        finish = YES;
-    }
-    pthread_mutex_unlock(&_lock);
-    if (finish) return;
-    
-    NSMutableArray *holder = [NSMutableArray new];
-    while (!finish) {
-        if (pthread_mutex_trylock(&_lock) == 0) {
-            if (_lru->_totalCost > costLimit) {
-                _YYLinkedMapNode *node = [_lru removeTailNode];
-                if (node) [holder addObject:node];
-            } else {
-                finish = YES;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        [self _trimShard:&_shards[i] toCost:_YYMemoryCacheShardCostLimit(costLimit, _shardCount, i) count:NSUIntegerMax age:DBL_MAX];
+    }
+    [self _trimGlobalToCost:_YYMemoryCacheGlobalCostLimit(costLimit, _shardCount) count:NSUIntegerMax];
+}
+
+- (void)_trimToCount:(NSUInteger)countLimit {
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        [self _trimShard:&_shards[i] toCost:NSUIntegerMax count:_YYMemoryCacheShardCountLimit(countLimit, _shardCount, i) age:DBL_MAX];
+    }
+    [self _trimGlobalToCost:NSUIntegerMax count:_YYMemoryCacheGlobalCountLimit(countLimit, _shardCount)];
+}
+
+/**
+ Trim the whole cache to the limits which are not divided among the shards.
+ The shard which holds the least recently used object is found with read locks,
+ then a batch of its old objects is evicted with its write lock. Only one shard
+ is locked at a time, the access methods of other shards are never blocked.
+ */
+- (void)_trimGlobalToCost:(NSUInteger)costLimit count:(NSUInteger)countLimit {
+    if (costLimit == NSUIntegerMax && countLimit == NSUIntegerMax) return;
+    BOOL clock = _evictionPolicy == YYMemoryCacheEvictionPolicyCLOCK;
+    while (__atomic_load_n(&_totalCost, __ATOMIC_RELAXED) > costLimit ||
+           __atomic_load_n(&_totalCount, __ATOMIC_RELAXED) > countLimit) {
+        NSTimeInterval begin = CACurrentMediaTime();
+        NSUInteger victim = NSNotFound;
+        NSTimeInterval oldest = DBL_MAX, runnerUp = DBL_MAX; // the oldest time of the victim and of other shards
+        for (NSUInteger i = 0; i < _shardCount; i++) {
+            pthread_rwlock_rdlock(&_shards[i].lock);
+            _YYLinkedMap *lru = _shards[i].lru;
+            uint32_t index = [lru oldestNode];
+            NSTimeInterval time = index != kYYLinkedMapNull ? lru->_nodes[index].time : DBL_MAX;
+            pthread_rwlock_unlock(&_shards[i].lock);
+            if (index == kYYLinkedMapNull) continue;
+            if (victim == NSNotFound || time < oldest) {
+                runnerUp = oldest;
+                oldest = time;
+                victim = i;
+            } else if (time < runnerUp) {
+                runnerUp = time;
             }
-            pthread_mutex_unlock(&_lock);
-        } else {
-            usleep(10 * 1000); //10 ms
         }
+        if (victim == NSNotFound) break;
+        
+        _YYMemoryCacheShard *shard = &_shards[victim];
+        _YYLinkedMap *lru = shard->lru;
+        pthread_rwlock_wrlock(&shard->lock);
+        NSUInteger oldCost = lru->_totalCost, oldCount = lru->_totalCount;
+        // the totals include this shard's latest change, it's added before unlocking
+        NSUInteger totalCost = __atomic_load_n(&_totalCost, __ATOMIC_RELAXED);
+        NSUInteger totalCount = __atomic_load_n(&_totalCount, __ATOMIC_RELAXED);
+        NSUInteger evictedByReason[2] = {0}; // cost, count
+        for (NSUInteger evicted = 0; evicted < kYYMemoryCacheTrimBatch; evicted++) {
+            BOOL overCost = totalCost - (oldCost - lru->_totalCost) > costLimit;
+            BOOL overCount = totalCount - (oldCount - lru->_totalCount) > countLimit;
+            if (!overCost && !overCount) break;
+            if (clock) [lru advanceClockHandWithTime:begin];
+            uint32_t index = [lru oldestNode];
+            if (index == kYYLinkedMapNull) break;
+            if (evicted > 0 && lru->_nodes[index].time > runnerUp) break; // another shard holds older objects
+            if (![lru removeTailNode]) break;
+            evictedByReason[overCost ? YYCacheEvictionReasonCost : YYCacheEvictionReasonCount]++;
+        }
+        [self _addCost:lru->_totalCost - oldCost count:lru->_totalCount - oldCount];
+        _YYLinkedMapReleasePool *pool = [lru flushReleasePool:NO];
+        pthread_rwlock_unlock(&shard->lock);
+        [self _addTrimTime:CACurrentMediaTime() - begin];
+        if (pool) _YYLinkedMapReleasePoolDrain(pool);
+        
+        [_statistics recordEvictions:evictedByReason[YYCacheEvictionReasonCost] reason:YYCacheEvictionReasonCost stripe:victim];
+        [_statistics recordEvictions:evictedByReason[YYCacheEvictionReasonCount] reason:YYCacheEvictionReasonCount stripe:victim];
+        if (evictedByReason[YYCacheEvictionReasonCost] + evictedByReason[YYCacheEvictionReasonCount] == 0) break;
     }
-    if (holder.count) {
-        dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-        dispatch_async(queue, ^{
-            [holder count]; // release in queue
-        });
+}
+
+/// Schedule a trim of the whole cache if it's over a limit which is not divided
+/// among the shards. A writer never locks other shards.
+- (void)_trimGlobalIfNeeded {
+    NSUInteger costLimit = _YYMemoryCacheGlobalCostLimit(_costLimit, _shardCount);
+    NSUInteger countLimit = _YYMemoryCacheGlobalCountLimit(_countLimit, _shardCount);
+    if (__atomic_load_n(&_totalCost, __ATOMIC_RELAXED) <= costLimit &&
+        __atomic_load_n(&_totalCount, __ATOMIC_RELAXED) <= countLimit) return;
+    if (__atomic_exchange_n(&_globalTrimScheduled, YES, __ATOMIC_RELAXED)) return;
+    dispatch_async(_queue, ^{
+        __atomic_store_n(&self->_globalTrimScheduled, NO, __ATOMIC_RELAXED);
+        [self _trimGlobalToCost:_YYMemoryCacheGlobalCostLimit(self->_costLimit, self->_shardCount)
+                          count:_YYMemoryCacheGlobalCountLimit(self->_countLimit, self->_shardCount)];
+    });
+}
+
+/// Add the change of a shard's totals to the cache's totals, the arguments wrap
+/// around for a decrease. Call it before unlocking the shard.
+- (void)_addCost:(NSUInteger)cost count:(NSUInteger)count {
+    if (cost) __atomic_fetch_add(&_totalCost, cost, __ATOMIC_RELAXED);
+    if (count) __atomic_fetch_add(&_totalCount, count, __ATOMIC_RELAXED);
+}
+
+- (void)_trimToAge:(NSTimeInterval)ageLimit {
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        [self _trimShard:&_shards[i] toCost:NSUIntegerMax count:NSUIntegerMax age:ageLimit];
     }
 }
 
-- (void)_trimToCount:(NSUInteger)countLimit {
+/**
+ Trim a shard in passes. Each pass holds the write lock for at most 
+ kYYMemoryCacheTrimPassBudget, so the access methods wait for one pass at most
+ instead of the whole trim.
+ */
+- (void)_trimShard:(_YYMemoryCacheShard *)shard toCost:(NSUInteger)costLimit count:(NSUInteger)countLimit age:(NSTimeInterval)ageLimit {
+    _YYLinkedMap *lru = shard->lru;
     BOOL finish = NO;
-    pthread_mutex_lock(&_lock);
-    if (countLimit == 0) {
-        [_lru removeAll];
-        finish = YES;
-    } else if (_lru->_totalCount <= countLimit) {
-        finish = YES;
-    }
-    pthread_mutex_unlock(&_lock);
-    if (finish) return;
-    
-    NSMutableArray *holder = [NSMutableArray new];
     while (!finish) {
-        if (pthread_mutex_trylock(&_lock) == 0) {
-            if (_lru->_totalCount > countLimit) {
-                _YYLinkedMapNode *node = [_lru removeTailNode];
-                if (node) [holder addObject:node];
-            } else {
-                finish = YES;
-            }
-            pthread_mutex_unlock(&_lock);
+        NSTimeInterval begin = CACurrentMediaTime();
+        pthread_rwlock_wrlock(&shard->lock);
+        shard->trimScheduled = NO;
+        NSUInteger oldCost = lru->_totalCost, oldCount = lru->_totalCount;
+        if (costLimit == 0 || countLimit == 0 || ageLimit <= 0) {
+            YYCacheEvictionReason reason = costLimit == 0 ? YYCacheEvictionReasonCost :
+                (countLimit == 0 ? YYCacheEvictionReasonCount : YYCacheEvictionReasonAge);
+            [_statistics recordEvictions:lru->_totalCount reason:reason stripe:shard - _shards];
+            [lru removeAll];
+            finish = YES;
         } else {
-            usleep(10 * 1000); //10 ms
+            finish = [self _evictNodesInShard:shard toCost:costLimit count:countLimit age:ageLimit
+                                          now:begin deadline:begin + kYYMemoryCacheTrimPassBudget];
         }
-    }
-    if (holder.count) {
-        dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-        dispatch_async(queue, ^{
-            [holder count]; // release in queue
-        });
+        [self _addCost:lru->_totalCost - oldCost count:lru->_totalCount - oldCount];
+        _YYLinkedMapReleasePool *pool = [lru flushReleasePool:finish];
+        pthread_rwlock_unlock(&shard->lock);
+        [self _addTrimTime:CACurrentMediaTime() - begin];
+        if (pool) _YYLinkedMapReleasePoolDrain(pool);
     }
 }
 
-- (void)_trimToAge:(NSTimeInterval)ageLimit {
+/**
+ Evict nodes from a locked shard until it's within the limits. The deadline is
+ checked every kYYMemoryCacheTrimBatch nodes, pass 0 to evict one batch at most.
+ 
+ @return YES if the shard is within the limits, NO if the deadline is reached.
+ */
+- (BOOL)_evictNodesInShard:(_YYMemoryCacheShard *)shard
+                    toCost:(NSUInteger)costLimit
+                     count:(NSUInteger)countLimit
+                       age:(NSTimeInterval)ageLimit
+                       now:(NSTimeInterval)now
+                  deadline:(NSTimeInterval)deadline {
+    _YYLinkedMap *lru = shard->lru;
+    BOOL clock = _evictionPolicy == YYMemoryCacheEvictionPolicyCLOCK;
+    NSUInteger evicted = 0;
+    NSUInteger evictedByReason[3] = {0}; // cost, count, age
     BOOL finish = NO;
-    NSTimeInterval now = CACurrentMediaTime();
-    pthread_mutex_lock(&_lock);
-    if (ageLimit <= 0) {
-        [_lru removeAll];
-        finish = YES;
-    } else if (!_lru->_tail || (now - _lru->_tail->_time) <= ageLimit) {
-        finish = YES;
-    }
-    pthread_mutex_unlock(&_lock);
-    if (finish) return;
-    
-    NSMutableArray *holder = [NSMutableArray new];
     while (!finish) {
-        if (pthread_mutex_trylock(&_lock) == 0) {
-            if (_lru->_tail && (now - _lru->_tail->_time) > ageLimit) {
-                _YYLinkedMapNode *node = [_lru removeTailNode];
-                if (node) [holder addObject:node];
-            } else {
+        // referenced nodes get a second chance, and the list is still ordered by time
+        if (clock) [lru advanceClockHandWithTime:now];
+        if (lru->_totalCost > costLimit || lru->_totalCount > countLimit) {
+            YYCacheEvictionReason reason = lru->_totalCost > costLimit ? YYCacheEvictionReasonCost : YYCacheEvictionReasonCount;
+            if (![lru removeTailNode]) {
                 finish = YES;
+                break;
             }
-            pthread_mutex_unlock(&_lock);
+            evictedByReason[reason]++;
         } else {
-            usleep(10 * 1000); //10 ms
+            uint32_t index = [lru oldestNode];
+            if (index == kYYLinkedMapNull || (now - lru->_nodes[index].time) <= ageLimit) {
+                finish = YES;
+                break;
+            }
+            [lru removeNode:index];
+            evictedByReason[YYCacheEvictionReasonAge]++;
         }
+        if (++evicted % kYYMemoryCacheTrimBatch == 0 && CACurrentMediaTime() >= deadline) break;
     }
-    if (holder.count) {
-        dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-        dispatch_async(queue, ^{
-            [holder count]; // release in queue
-        });
-    }
+    NSUInteger stripe = shard - _shards;
+    [_statistics recordEvictions:evictedByReason[YYCacheEvictionReasonCost] reason:YYCacheEvictionReasonCost stripe:stripe];
+    [_statistics recordEvictions:evictedByReason[YYCacheEvictionReasonCount] reason:YYCacheEvictionReasonCount stripe:stripe];
+    [_statistics recordEvictions:evictedByReason[YYCacheEvictionReasonAge] reason:YYCacheEvictionReasonAge stripe:stripe];
+    return finish;
+}
+
+- (void)_addTrimTime:(NSTimeInterval)time {
+    if (time <= 0) return;
+    __atomic_fetch_add(&_trimNanoseconds, (uint64_t)(time * NSEC_PER_SEC), __ATOMIC_RELAXED);
 }
 
 - (void)_appDidReceiveMemoryWarningNotification {
@@ -329,10 +953,32 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
 #pragma mark - public
 
 - (instancetype)init {
+    return [self initWithShardCount:1];
+}
+
+- (instancetype)initWithShardCount:(NSUInteger)shardCount {
     self = super.init;
-    pthread_mutex_init(&_lock, NULL);
-    _lru = [_YYLinkedMap new];
+    if (shardCount < 1) shardCount = 1;
+    if (shardCount > kYYMemoryCacheShardCountMax) shardCount = kYYMemoryCacheShardCountMax;
+    NSUInteger count = 1;
+    while (count < shardCount) count <<= 1;
+    
+    void *shards = NULL;
+    if (posix_memalign(&shards, 64, sizeof(_YYMemoryCacheShard) * count) != 0) return nil;
+    memset(shards, 0, sizeof(_YYMemoryCacheShard) * count);
+    _shards = shards;
+    _shardCount = count;
+    _shardMask = count - 1;
+    NSMutableArray *maps = [NSMutableArray new];
+    for (NSUInteger i = 0; i < count; i++) {
+        _YYLinkedMap *lru = [_YYLinkedMap new];
+        [maps addObject:lru];
+        pthread_rwlock_init(&_shards[i].lock, NULL);
+        _shards[i].lru = lru;
+    }
+    _shardMaps = maps;
     _queue = dispatch_queue_create("com.ibireme.cache.memory", DISPATCH_QUEUE_SERIAL);
+    _statistics = [[YYCacheStatisticsRecorder alloc] initWithStripeCount:count];
     
     _countLimit = NSUIntegerMax;
     _costLimit = NSUIntegerMax;
@@ -351,68 +997,148 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
 - (void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
     [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidEnterBackgroundNotification object:nil];
-    [_lru removeAll];
-    pthread_mutex_destroy(&_lock);
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        [_shards[i].lru removeAll];
+        pthread_rwlock_destroy(&_shards[i].lock);
+    }
+    free(_shards);
 }
 
 - (NSUInteger)totalCount {
-    pthread_mutex_lock(&_lock);
-    NSUInteger count = _lru->_totalCount;
-    pthread_mutex_unlock(&_lock);
-    return count;
+    return __atomic_load_n(&_totalCount, __ATOMIC_RELAXED);
 }
 
 - (NSUInteger)totalCost {
-    pthread_mutex_lock(&_lock);
-    NSUInteger totalCost = _lru->_totalCost;
-    pthread_mutex_unlock(&_lock);
-    return totalCost;
+    return __atomic_load_n(&_totalCost, __ATOMIC_RELAXED);
+}
+
+- (YYCacheStatistics *)statistics {
+    return [_statistics snapshot];
+}
+
+- (void)resetStatistics {
+    [_statistics reset];
+}
+
+- (uint64_t)trimNanoseconds {
+    return __atomic_load_n(&_trimNanoseconds, __ATOMIC_RELAXED);
+}
+
+- (NSUInteger)costOverLimit {
+    NSUInteger globalCostLimit = _YYMemoryCacheGlobalCostLimit(_costLimit, _shardCount);
+    if (globalCostLimit != NSUIntegerMax) {
+        NSUInteger totalCost = __atomic_load_n(&_totalCost, __ATOMIC_RELAXED);
+        return totalCost > globalCostLimit ? totalCost - globalCostLimit : 0;
+    }
+    NSUInteger over = 0;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        NSUInteger costLimit = _YYMemoryCacheShardCostLimit(_costLimit, _shardCount, i);
+        pthread_rwlock_rdlock(&_shards[i].lock);
+        NSUInteger cost = _shards[i].lru->_totalCost;
+        pthread_rwlock_unlock(&_shards[i].lock);
+        if (cost > costLimit) over += cost - costLimit;
+    }
+    return over;
 }
 
 - (BOOL)releaseInMainThread {
-    pthread_mutex_lock(&_lock);
-    BOOL releaseInMainThread = _lru->_releaseOnMainThread;
-    pthread_mutex_unlock(&_lock);
+    pthread_rwlock_rdlock(&_shards[0].lock);
+    BOOL releaseInMainThread = _shards[0].lru->_releaseOnMainThread;
+    pthread_rwlock_unlock(&_shards[0].lock);
     return releaseInMainThread;
 }
 
 - (void)setReleaseInMainThread:(BOOL)releaseInMainThread {
-    pthread_mutex_lock(&_lock);
-    _lru->_releaseOnMainThread = releaseInMainThread;
-    pthread_mutex_unlock(&_lock);
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        pthread_rwlock_wrlock(&_shards[i].lock);
+        _YYLinkedMapReleasePool *pool = [_shards[i].lru flushReleasePool:YES];
+        _shards[i].lru->_releaseOnMainThread = releaseInMainThread;
+        pthread_rwlock_unlock(&_shards[i].lock);
+        if (pool) _YYLinkedMapReleasePoolDrain(pool);
+    }
 }
 
 - (BOOL)releaseAsynchronously {
-    pthread_mutex_lock(&_lock);
-    BOOL releaseAsynchronously = _lru->_releaseAsynchronously;
-    pthread_mutex_unlock(&_lock);
+    pthread_rwlock_rdlock(&_shards[0].lock);
+    BOOL releaseAsynchronously = _shards[0].lru->_releaseAsynchronously;
+    pthread_rwlock_unlock(&_shards[0].lock);
     return releaseAsynchronously;
 }
 
 - (void)setReleaseAsynchronously:(BOOL)releaseAsynchronously {
-    pthread_mutex_lock(&_lock);
-    _lru->_releaseAsynchronously = releaseAsynchronously;
-    pthread_mutex_unlock(&_lock);
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        pthread_rwlock_wrlock(&_shards[i].lock);
+        _YYLinkedMapReleasePool *pool = [_shards[i].lru flushReleasePool:YES];
+        _shards[i].lru->_releaseAsynchronously = releaseAsynchronously;
+        pthread_rwlock_unlock(&_shards[i].lock);
+        if (pool) _YYLinkedMapReleasePoolDrain(pool);
+    }
+}
+
+- (BOOL)admissionFilterEnabled {
+    pthread_rwlock_rdlock(&_shards[0].lock);
+    BOOL enabled = _shards[0].lru->_sketch != NULL;
+    pthread_rwlock_unlock(&_shards[0].lock);
+    return enabled;
+}
+
+- (void)setAdmissionFilterEnabled:(BOOL)admissionFilterEnabled {
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        pthread_rwlock_wrlock(&_shards[i].lock);
+        [_shards[i].lru setAdmissionEnabled:admissionFilterEnabled];
+        pthread_rwlock_unlock(&_shards[i].lock);
+    }
 }
 
 - (BOOL)containsObjectForKey:(id)key {
     if (!key) return NO;
-    pthread_mutex_lock(&_lock);
-    BOOL contains = CFDictionaryContainsKey(_lru->_dic, (__bridge const void *)(key));
-    pthread_mutex_unlock(&_lock);
+    NSUInteger hash = _YYMemoryCacheHash(key);
+    _YYMemoryCacheShard *shard = &_shards[_YYMemoryCacheShardIndex(hash, _shardMask)];
+    pthread_rwlock_rdlock(&shard->lock);
+    BOOL contains = [shard->lru indexForKey:key hash:hash] != kYYLinkedMapNull;
+    pthread_rwlock_unlock(&shard->lock);
     return contains;
 }
 
 - (id)objectForKey:(id)key {
     if (!key) return nil;
-    pthread_mutex_lock(&_lock);
-    _YYLinkedMapNode *node = CFDictionaryGetValue(_lru->_dic, (__bridge const void *)(key));
-    if (node) {
-        node->_time = CACurrentMediaTime();
-        [_lru bringNodeToHead:node];
+    uint64_t begin = YYCacheStatisticsTime();
+    NSUInteger hash = _YYMemoryCacheHash(key);
+    NSUInteger shardIndex = _YYMemoryCacheShardIndex(hash, _shardMask);
+    _YYMemoryCacheShard *shard = &_shards[shardIndex];
+    _YYLinkedMap *lru = shard->lru;
+    id value = nil;
+    NSUInteger cost = 0;
+    if (_evictionPolicy == YYMemoryCacheEvictionPolicyCLOCK) {
+        // read lock only: a hit sets the reference bit and never touches the list
+        pthread_rwlock_rdlock(&shard->lock);
+        if (lru->_sketch) _YYFrequencySketchIncrement(lru->_sketch, hash);
+        uint32_t index = [lru indexForKey:key hash:hash];
+        if (index != kYYLinkedMapNull) {
+            _YYLinkedMapNode *node = &lru->_nodes[index];
+            if (!__atomic_load_n(&node->referenced, __ATOMIC_RELAXED)) {
+                __atomic_store_n(&node->referenced, YES, __ATOMIC_RELAXED);
+            }
+            value = (__bridge id)(node->value);
+            cost = node->cost;
+        }
+        pthread_rwlock_unlock(&shard->lock);
+        [_statistics recordGetWithHit:value != nil bytes:cost latency:YYCacheStatisticsTime() - begin stripe:shardIndex];
+        return value;
     }
-    pthread_mutex_unlock(&_lock);
-    return node ? node->_value : nil;
+    
+    pthread_rwlock_wrlock(&shard->lock);
+    if (lru->_sketch) _YYFrequencySketchIncrement(lru->_sketch, hash);
+    uint32_t index = [lru indexForKey:key hash:hash];
+    if (index != kYYLinkedMapNull) {
+        lru->_nodes[index].time = CACurrentMediaTime();
+        [lru bringNodeToHead:index];
+        value = (__bridge id)(lru->_nodes[index].value);
+        cost = lru->_nodes[index].cost;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    [_statistics recordGetWithHit:value != nil bytes:cost latency:YYCacheStatisticsTime() - begin stripe:shardIndex];
+    return value;
 }
 
 - (void)setObject:(id)object forKey:(id)key {
@@ -425,69 +1151,76 @@ static inline dispatch_queue_t YYMemoryCacheGetReleaseQueue() {
         [self removeObjectForKey:key];
         return;
     }
-    pthread_mutex_lock(&_lock);
-    _YYLinkedMapNode *node = CFDictionaryGetValue(_lru->_dic, (__bridge const void *)(key));
+    uint64_t begin = YYCacheStatisticsTime();
+    NSUInteger hash = _YYMemoryCacheHash(key);
+    NSUInteger index = _YYMemoryCacheShardIndex(hash, _shardMask);
+    _YYMemoryCacheShard *shard = &_shards[index];
+    _YYLinkedMap *lru = shard->lru;
+    pthread_rwlock_wrlock(&shard->lock);
+    NSUInteger oldCost = lru->_totalCost, oldCount = lru->_totalCount;
+    if (lru->_sketch) {
+        _YYFrequencySketchEnsureCapacity(lru->_sketch, lru->_totalCount + 1);
+        _YYFrequencySketchIncrement(lru->_sketch, hash);
+        _YYFrequencySketchAgeIfNeeded(lru->_sketch);
+    }
+    uint32_t node = [lru indexForKey:key hash:hash];
     NSTimeInterval now = CACurrentMediaTime();
-    if (node) {
-        _lru->_totalCost -= node->_cost;
-        _lru->_totalCost += cost;
-        node->_cost = cost;
-        node->_time = now;
-        node->_value = object;
-        [_lru bringNodeToHead:node];
-    } else {
-        node = [_YYLinkedMapNode new];
-        node->_cost = cost;
-        node->_time = now;
-        node->_key = key;
-        node->_value = object;
-        [_lru insertNodeAtHead:node];
-    }
-    if (_lru->_totalCost > _costLimit) {
-        dispatch_async(_queue, ^{
-            [self trimToCost:_costLimit];
-        });
-    }
-    if (_lru->_totalCount > _countLimit) {
-        _YYLinkedMapNode *node = [_lru removeTailNode];
-        if (_lru->_releaseAsynchronously) {
-            dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-            dispatch_async(queue, ^{
-                [node class]; //hold and release in queue
-            });
-        } else if (_lru->_releaseOnMainThread && !pthread_main_np()) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                [node class]; //hold and release in queue
+    if (node != kYYLinkedMapNull) {
+        [lru setValue:object cost:cost time:now forNode:node];
+    } else if ([lru insertNodeWithKey:key hash:hash value:object cost:cost time:now] == kYYLinkedMapNull) {
+        pthread_rwlock_unlock(&shard->lock);
+        return; // no memory
+    }
+    NSUInteger costLimit = _YYMemoryCacheShardCostLimit(_costLimit, _shardCount, index);
+    NSUInteger countLimit = _YYMemoryCacheShardCountLimit(_countLimit, _shardCount, index);
+    if (lru->_totalCost > costLimit || lru->_totalCount > countLimit) {
+        // the writer which crosses the limit evicts one batch, the rest is left to the trimmer
+        BOOL finish = [self _evictNodesInShard:shard toCost:costLimit count:countLimit age:DBL_MAX now:now deadline:0];
+        if (!finish && !shard->trimScheduled) {
+            shard->trimScheduled = YES;
+            dispatch_async(_queue, ^{
+                [self _trimShard:shard toCost:costLimit count:countLimit age:DBL_MAX];
             });
         }
+        [self _addTrimTime:CACurrentMediaTime() - now];
+    } else if (lru->_sketch) {
+        [lru trimWindow]; // no eviction needed, the window overflow goes to main list directly
     }
-    pthread_mutex_unlock(&_lock);
+    [self _addCost:lru->_totalCost - oldCost count:lru->_totalCount - oldCount];
+    _YYLinkedMapReleasePool *pool = [lru flushReleasePool:NO];
+    pthread_rwlock_unlock(&shard->lock);
+    if (pool) _YYLinkedMapReleasePoolDrain(pool);
+    [self _trimGlobalIfNeeded];
+    [_statistics recordSetWithBytes:cost latency:YYCacheStatisticsTime() - begin stripe:index];
 }
 
 - (void)removeObjectForKey:(id)key {
     if (!key) return;
-    pthread_mutex_lock(&_lock);
-    _YYLinkedMapNode *node = CFDictionaryGetValue(_lru->_dic, (__bridge const void *)(key));
-    if (node) {
-        [_lru removeNode:node];
-        if (_lru->_releaseAsynchronously) {
-            dispatch_queue_t queue = _lru->_releaseOnMainThread ? dispatch_get_main_queue() : YYMemoryCacheGetReleaseQueue();
-            dispatch_async(queue, ^{
-                [node class]; //hold and release in queue
-            });
-        } else if (_lru->_releaseOnMainThread && !pthread_main_np()) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                [node class]; //hold and release in queue
-            });
-        }
+    NSUInteger hash = _YYMemoryCacheHash(key);
+    _YYMemoryCacheShard *shard = &_shards[_YYMemoryCacheShardIndex(hash, _shardMask)];
+    _YYLinkedMap *lru = shard->lru;
+    pthread_rwlock_wrlock(&shard->lock);
+    uint32_t index = [lru indexForKey:key hash:hash];
+    _YYLinkedMapReleasePool *pool = NULL;
+    if (index != kYYLinkedMapNull) {
+        NSUInteger cost = lru->_nodes[index].cost;
+        [lru removeNode:index];
+        [self _addCost:-cost count:-1];
+        pool = [lru flushReleasePool:NO];
     }
-    pthread_mutex_unlock(&_lock);
+    pthread_rwlock_unlock(&shard->lock);
+    if (pool) _YYLinkedMapReleasePoolDrain(pool);
 }
 
 - (void)removeAllObjects {
-    pthread_mutex_lock(&_lock);
-    [_lru removeAll];
-    pthread_mutex_unlock(&_lock);
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        pthread_rwlock_wrlock(&_shards[i].lock);
+        [self _addCost:-_shards[i].lru->_totalCost count:-_shards[i].lru->_totalCount];
+        [_shards[i].lru removeAll];
+        _YYLinkedMapReleasePool *pool = [_shards[i].lru flushReleasePool:YES];
+        pthread_rwlock_unlock(&_shards[i].lock);
+        if (pool) _YYLinkedMapReleasePoolDrain(pool);
+    }
 }
 
 - (void)trimToCount:(NSUInteger)count {
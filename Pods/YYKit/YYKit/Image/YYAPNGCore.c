@@ -0,0 +1,1124 @@
+//
+//  YYAPNGCore.c
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by agent on 26/10/17.
+//  Copyright (c) 2026 agent.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#include "YYAPNGCore.h"
+#include "YYImagePixel.h"
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+/*
+ PNG  spec: http://www.libpng.org/pub/png/spec/1.2/PNG-Structure.html
+ APNG spec: https://wiki.mozilla.org/APNG_Specification
+
+ ===============================================================================
+ PNG format:
+ header (8): 89 50 4e 47 0d 0a 1a 0a
+ chunk, chunk, chunk, ...
+
+ ===============================================================================
+ chunk format:
+ length (4): uint32_t big endian
+ fourcc (4): chunk type code
+ data   (length): data
+ crc32  (4): uint32_t big endian crc32(fourcc + data)
+
+ ===============================================================================
+ PNG chunk define:
+
+ IHDR (Image Header) required, must appear first, 13 bytes
+ width              (4) pixel count, should not be zero
+ height             (4) pixel count, should not be zero
+ bit depth          (1) expected: 1, 2, 4, 8, 16
+ color type         (1) 1<<0 (palette used), 1<<1 (color used), 1<<2 (alpha channel used)
+ compression method (1) 0 (deflate/inflate)
+ filter method      (1) 0 (adaptive filtering with five basic filter types)
+ interlace method   (1) 0 (no interlace) or 1 (Adam7 interlace)
+
+ PLTE (Palette) required for color type 3, must appear before 'IDAT', 3 bytes (RGB) per entry
+
+ tRNS (Transparency) optional, must appear after 'PLTE' and before 'IDAT'
+ color type 0: gray  (2)
+ color type 2: red, green, blue (2 each)
+ color type 3: alpha (1) for each palette entry, the missing entries are opaque
+
+ IDAT (Image Data) required, must appear consecutively if there's multiple 'IDAT' chunk
+
+ IEND (End) required, must appear last, 0 bytes
+
+ ===============================================================================
+ APNG chunk define:
+
+ acTL (Animation Control) required, must appear before 'IDAT', 8 bytes
+ num frames     (4) number of frames
+ num plays      (4) number of times to loop, 0 indicates infinite looping
+
+ fcTL (Frame Control) required, must appear before the 'IDAT' or 'fdAT' chunks of the frame to which it applies, 26 bytes
+ sequence number   (4) sequence number of the animation chunk, starting from 0
+ width             (4) width of the following frame
+ height            (4) height of the following frame
+ x offset          (4) x position at which to render the following frame
+ y offset          (4) y position at which to render the following frame
+ delay num         (2) frame delay fraction numerator
+ delay den         (2) frame delay fraction denominator
+ dispose op        (1) type of frame area disposal to be done after rendering this frame (0:none, 1:background 2:previous)
+ blend op          (1) type of frame area rendering for this frame (0:source, 1:over)
+
+ fdAT (Frame Data) required
+ sequence number   (4) sequence number of the animation chunk
+ frame data        (x) frame data for this frame (same as 'IDAT')
+
+ ===============================================================================
+ `dispose_op` specifies how the output buffer should be changed at the end of the delay
+ (before rendering the next frame).
+
+ * NONE: no disposal is done on this frame before rendering the next; the contents
+    of the output buffer are left as is.
+ * BACKGROUND: the frame's region of the output buffer is to be cleared to fully
+    transparent black before rendering the next frame.
+ * PREVIOUS: the frame's region of the output buffer is to be reverted to the previous
+    contents before rendering the next frame.
+
+ `blend_op` specifies whether the frame is to be alpha blended into the current output buffer
+ content, or whether it should completely replace its region in the output buffer.
+
+ * SOURCE: all color components of the frame, including alpha, overwrite the current contents
+    of the frame's output buffer region.
+ * OVER: the frame should be composited onto the output buffer based on its alpha,
+    using a simple OVER operation as described in the "Alpha Channel Processing" section
+    of the PNG specification
+ */
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Utility (any byte order)
+
+static inline uint32_t yy_png_read_uint32(const uint8_t *data) {
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+}
+
+static inline uint16_t yy_png_read_uint16(const uint8_t *data) {
+    return (uint16_t)(((uint16_t)data[0] << 8) | (uint16_t)data[1]);
+}
+
+static inline void yy_png_write_uint32(uint8_t *data, uint32_t value) {
+    data[0] = (uint8_t)(value >> 24);
+    data[1] = (uint8_t)(value >> 16);
+    data[2] = (uint8_t)(value >> 8);
+    data[3] = (uint8_t)value;
+}
+
+static inline void yy_png_write_uint16(uint8_t *data, uint16_t value) {
+    data[0] = (uint8_t)(value >> 8);
+    data[1] = (uint8_t)value;
+}
+
+static inline uint32_t yy_png_read_fourcc(const uint8_t *data) {
+    return YY_PNG_FOURCC(data[0], data[1], data[2], data[3]);
+}
+
+static inline void yy_png_write_fourcc(uint8_t *data, uint32_t fourcc) {
+    data[0] = (uint8_t)fourcc;
+    data[1] = (uint8_t)(fourcc >> 8);
+    data[2] = (uint8_t)(fourcc >> 16);
+    data[3] = (uint8_t)(fourcc >> 24);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Chunk
+
+void yy_png_chunk_IHDR_read(yy_png_chunk_IHDR *IHDR, const uint8_t *data) {
+    IHDR->width = yy_png_read_uint32(data);
+    IHDR->height = yy_png_read_uint32(data + 4);
+    IHDR->bit_depth = data[8];
+    IHDR->color_type = data[9];
+    IHDR->compression_method = data[10];
+    IHDR->filter_method = data[11];
+    IHDR->interlace_method = data[12];
+}
+
+void yy_png_chunk_IHDR_write(yy_png_chunk_IHDR *IHDR, uint8_t *data) {
+    yy_png_write_uint32(data, IHDR->width);
+    yy_png_write_uint32(data + 4, IHDR->height);
+    data[8] = IHDR->bit_depth;
+    data[9] = IHDR->color_type;
+    data[10] = IHDR->compression_method;
+    data[11] = IHDR->filter_method;
+    data[12] = IHDR->interlace_method;
+}
+
+void yy_png_chunk_fcTL_read(yy_png_chunk_fcTL *fcTL, const uint8_t *data) {
+    fcTL->sequence_number = yy_png_read_uint32(data);
+    fcTL->width = yy_png_read_uint32(data + 4);
+    fcTL->height = yy_png_read_uint32(data + 8);
+    fcTL->x_offset = yy_png_read_uint32(data + 12);
+    fcTL->y_offset = yy_png_read_uint32(data + 16);
+    fcTL->delay_num = yy_png_read_uint16(data + 20);
+    fcTL->delay_den = yy_png_read_uint16(data + 22);
+    fcTL->dispose_op = data[24];
+    fcTL->blend_op = data[25];
+}
+
+void yy_png_chunk_fcTL_write(yy_png_chunk_fcTL *fcTL, uint8_t *data) {
+    yy_png_write_uint32(data, fcTL->sequence_number);
+    yy_png_write_uint32(data + 4, fcTL->width);
+    yy_png_write_uint32(data + 8, fcTL->height);
+    yy_png_write_uint32(data + 12, fcTL->x_offset);
+    yy_png_write_uint32(data + 16, fcTL->y_offset);
+    yy_png_write_uint16(data + 20, fcTL->delay_num);
+    yy_png_write_uint16(data + 22, fcTL->delay_den);
+    data[24] = fcTL->dispose_op;
+    data[25] = fcTL->blend_op;
+}
+
+// convert double value to fraction
+void yy_png_delay_to_fraction(double duration, uint16_t *num, uint16_t *den) {
+    if (duration >= 0xFF) {
+        *num = 0xFF;
+        *den = 1;
+    } else if (duration <= 1.0 / (double)0xFF) {
+        *num = 1;
+        *den = 0xFF;
+    } else {
+        // Use continued fraction to calculate the num and den.
+        long MAX = 10;
+        double eps = (0.5 / (double)0xFF);
+        long p[MAX], q[MAX], a[MAX], i, numl = 0, denl = 0;
+        // The first two convergents are 0/1 and 1/0
+        p[0] = 0; q[0] = 1;
+        p[1] = 1; q[1] = 0;
+        // The rest of the convergents (and continued fraction)
+        for (i = 2; i < MAX; i++) {
+            a[i] = lrint(floor(duration));
+            p[i] = a[i] * p[i - 1] + p[i - 2];
+            q[i] = a[i] * q[i - 1] + q[i - 2];
+            if (p[i] <= 0xFF && q[i] <= 0xFF) { // uint16_t
+                numl = p[i];
+                denl = q[i];
+            } else break;
+            if (fabs(duration - a[i]) < eps) break;
+            duration = 1.0 / (duration - a[i]);
+        }
+
+        if (numl != 0 && denl != 0) {
+            *num = numl;
+            *den = denl;
+        } else {
+            *num = 1;
+            *den = 100;
+        }
+    }
+}
+
+// convert fraction to double value
+double yy_png_delay_to_seconds(uint16_t num, uint16_t den) {
+    if (den == 0) {
+        return num / 100.0;
+    } else {
+        return (double)num / (double)den;
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Info
+
+struct yy_png_parser {
+    yy_png_info *info;           ///< the info parsed so far, apng_frame_num is the complete frame count
+    yy_png_parser_status status; ///< parse status
+    uint32_t offset;             ///< offset of the next chunk in data, 0 if the file header is not read
+    uint32_t chunk_capacity;     ///< capacity of info->chunks and info->apng_shared_chunk_indexs
+    uint32_t frame_capacity;     ///< capacity of info->apng_frames
+    uint32_t frame_num;          ///< count of `fcTL`, the last frame may be incomplete
+    bool frame_open;             ///< the last frame may receive more data chunks
+    bool IEND_found;             ///< `IEND` found, the rest of data is ignored
+    bool apng_error;             ///< the apng chunks are broken, no more frames are added
+    uint32_t prev_fourcc;        ///< fourcc of the last chunk
+    uint32_t IDAT_num;           ///< count of `IDAT`
+    uint32_t acTL_num;           ///< count of `acTL`
+    uint32_t acTL_frame_num;     ///< frame count declared in `acTL`
+    int64_t sequence_index;      ///< sequence number of the last `fcTL` or `fdAT`
+    uint32_t last_blend_index;   ///< the first frame to render for the next frame if it's not full size
+};
+
+static bool yy_png_parser_reserve_chunks(yy_png_parser *parser, uint32_t count) {
+    if (count <= parser->chunk_capacity) return true;
+    yy_png_info *info = parser->info;
+    uint32_t capacity = parser->chunk_capacity ? parser->chunk_capacity * 2 : 16;
+    if (capacity < count) capacity = count;
+    yy_png_chunk_info *chunks = realloc(info->chunks, sizeof(yy_png_chunk_info) * capacity);
+    if (!chunks) return false;
+    info->chunks = chunks;
+    uint32_t *indexs = realloc(info->apng_shared_chunk_indexs, sizeof(uint32_t) * capacity);
+    if (!indexs) return false;
+    info->apng_shared_chunk_indexs = indexs;
+    parser->chunk_capacity = capacity;
+    return true;
+}
+
+static bool yy_png_parser_reserve_frames(yy_png_parser *parser, uint32_t count) {
+    if (count <= parser->frame_capacity) return true;
+    yy_png_info *info = parser->info;
+    uint32_t capacity = parser->frame_capacity ? parser->frame_capacity * 2 : 8;
+    if (capacity < count) capacity = count;
+    yy_png_frame_info *frames = realloc(info->apng_frames, sizeof(yy_png_frame_info) * capacity);
+    if (!frames) return false;
+    info->apng_frames = frames;
+    parser->frame_capacity = capacity;
+    return true;
+}
+
+/// Set the first frame to render on a cleared canvas for the frame which is just read.
+static void yy_png_parser_update_blend_from_index(yy_png_parser *parser, yy_png_frame_info *frame, uint32_t index) {
+    const yy_png_chunk_IHDR *header = &parser->info->header;
+    const yy_png_chunk_fcTL *fcTL = &frame->frame_control;
+    bool is_full_size = (fcTL->width == header->width && fcTL->height == header->height &&
+                         fcTL->x_offset == 0 && fcTL->y_offset == 0);
+    if (fcTL->blend_op != YY_PNG_BLEND_OP_OVER && is_full_size) {
+        frame->blend_from_index = index;
+        if (fcTL->dispose_op != YY_PNG_DISPOSE_OP_PREVIOUS) parser->last_blend_index = index;
+    } else if (fcTL->dispose_op == YY_PNG_DISPOSE_OP_BACKGROUND && is_full_size) {
+        frame->blend_from_index = parser->last_blend_index;
+        parser->last_blend_index = index + 1;
+    } else {
+        frame->blend_from_index = parser->last_blend_index;
+    }
+}
+
+static void yy_png_parser_check_sequence(yy_png_parser *parser, const yy_png_chunk_info *chunk, const uint8_t *chunk_data) {
+    if (chunk->length > 4 && yy_png_read_uint32(chunk_data + 8) == parser->sequence_index + 1) {
+        parser->sequence_index++;
+    } else {
+        parser->apng_error = true;
+    }
+}
+
+/**
+ Read a complete chunk, check the chunk order incrementally.
+ 
+ PNG at least contains 3 chunks: IHDR, IDAT, IEND.
+ `IHDR` must appear first.
+ `IDAT` must appear consecutively.
+ `IEND` must appear end.
+ 
+ APNG must contains one `acTL` and at least one 'fcTL' and `fdAT`.
+ `fdAT` must appear consecutively.
+ `fcTL` must appear before `IDAT` or `fdAT`.
+ */
+static bool yy_png_parser_read_chunk(yy_png_parser *parser, const uint8_t *data) {
+    yy_png_info *info = parser->info;
+    uint32_t index = info->chunk_num - 1;
+    yy_png_chunk_info *chunk = info->chunks + index;
+    const uint8_t *chunk_data = data + chunk->offset;
+    uint32_t prev_fourcc = parser->prev_fourcc;
+    parser->prev_fourcc = chunk->fourcc;
+    
+    if (index == 0) {
+        if (chunk->fourcc != YY_PNG_FOURCC('I', 'H', 'D', 'R') || chunk->length != 13) return false;
+        yy_png_chunk_IHDR_read(&info->header, chunk_data + 8);
+    }
+    
+    // the data chunks of a frame follow its `fcTL` consecutively
+    bool is_frame_data = false;
+    if (chunk->fourcc == YY_PNG_FOURCC('I', 'D', 'A', 'T') || chunk->fourcc == YY_PNG_FOURCC('f', 'd', 'A', 'T')) {
+        is_frame_data = (prev_fourcc == YY_PNG_FOURCC('f', 'c', 'T', 'L') ||
+                         (prev_fourcc == chunk->fourcc && parser->frame_open));
+    }
+    if (prev_fourcc == YY_PNG_FOURCC('f', 'c', 'T', 'L') && !is_frame_data) parser->apng_error = true;
+    if (parser->frame_open && !is_frame_data) parser->frame_open = false; // the frame is complete
+    
+    switch (chunk->fourcc) {
+        case YY_PNG_FOURCC('I', 'D', 'A', 'T'): {  // png data
+            if (prev_fourcc != YY_PNG_FOURCC('I', 'D', 'A', 'T')) {
+                if (parser->IDAT_num == 0) {
+                    info->apng_shared_insert_index = index;
+                } else {
+                    parser->apng_error = true;
+                }
+            }
+            parser->IDAT_num++;
+            if (is_frame_data) {
+                if (parser->frame_num == 1) {
+                    info->apng_first_frame_is_cover = true;
+                } else {
+                    parser->apng_error = true; // only the first frame can use `IDAT`
+                }
+            }
+        } break;
+        case YY_PNG_FOURCC('a', 'c', 'T', 'L'): {  // apng control
+            if (parser->acTL_num > 0 || chunk->length != 8) {
+                parser->apng_error = true;
+            } else {
+                parser->acTL_frame_num = yy_png_read_uint32(chunk_data + 8);
+                info->apng_loop_num = yy_png_read_uint32(chunk_data + 12);
+            }
+            parser->acTL_num++;
+        } break;
+        case YY_PNG_FOURCC('f', 'c', 'T', 'L'): {  // apng frame control
+            if (chunk->length != 26) parser->apng_error = true;
+            yy_png_parser_check_sequence(parser, chunk, chunk_data);
+            if (parser->acTL_num > 0 && parser->frame_num >= parser->acTL_frame_num) parser->apng_error = true;
+            if (parser->apng_error) break;
+            if (!yy_png_parser_reserve_frames(parser, parser->frame_num + 1)) return false;
+            yy_png_frame_info *frame = info->apng_frames + parser->frame_num;
+            memset(frame, 0, sizeof(yy_png_frame_info));
+            frame->chunk_index = index + 1;
+            yy_png_chunk_fcTL_read(&frame->frame_control, chunk_data + 8);
+            yy_png_parser_update_blend_from_index(parser, frame, parser->frame_num);
+            parser->frame_num++;
+            parser->frame_open = true;
+        } break;
+        case YY_PNG_FOURCC('f', 'd', 'A', 'T'): {  // apng data
+            if (prev_fourcc != YY_PNG_FOURCC('f', 'd', 'A', 'T') && prev_fourcc != YY_PNG_FOURCC('f', 'c', 'T', 'L')) {
+                parser->apng_error = true;
+            }
+            yy_png_parser_check_sequence(parser, chunk, chunk_data);
+        } break;
+        default: {
+            if (chunk->fourcc == YY_PNG_FOURCC('I', 'H', 'D', 'R') && index != 0) parser->apng_error = true;
+            if (chunk->fourcc == YY_PNG_FOURCC('I', 'E', 'N', 'D')) parser->IEND_found = true;
+            info->apng_shared_chunk_indexs[info->apng_shared_chunk_num] = index;
+            info->apng_shared_chunk_num++;
+            info->apng_shared_chunk_size += chunk->length + 12;
+        } break;
+    }
+    
+    if (parser->apng_error) {
+        parser->frame_open = false;
+        return true; // keep the complete frames
+    }
+    if (is_frame_data && parser->frame_open) {
+        yy_png_frame_info *frame = info->apng_frames + parser->frame_num - 1;
+        frame->chunk_num++;
+        frame->chunk_size += chunk->length + 12;
+    }
+    // the frames are available after `acTL` and `IDAT`
+    if (parser->acTL_num == 1 && parser->IDAT_num > 0) {
+        info->apng_frame_num = parser->frame_num - (parser->frame_open ? 1 : 0);
+    }
+    return true;
+}
+
+/// All data is received, validate the animation.
+static void yy_png_parser_finish(yy_png_parser *parser) {
+    yy_png_info *info = parser->info;
+    if (info->chunk_num < 3) {
+        parser->status = YY_PNG_PARSER_STATUS_ERROR;
+        return;
+    }
+    parser->status = YY_PNG_PARSER_STATUS_FINISHED;
+    if (!parser->IEND_found || parser->frame_open ||
+        parser->IDAT_num == 0 || parser->acTL_num != 1 ||
+        parser->frame_num == 0 || parser->frame_num != parser->acTL_frame_num) {
+        parser->apng_error = true;
+    }
+}
+
+yy_png_parser *yy_png_parser_create(void) {
+    yy_png_parser *parser = calloc(1, sizeof(yy_png_parser));
+    if (!parser) return NULL;
+    parser->info = calloc(1, sizeof(yy_png_info));
+    if (!parser->info) {
+        free(parser);
+        return NULL;
+    }
+    parser->sequence_index = -1;
+    return parser;
+}
+
+void yy_png_parser_release(yy_png_parser *parser) {
+    if (parser) {
+        yy_png_info_release(parser->info);
+        free(parser);
+    }
+}
+
+yy_png_parser_status yy_png_parser_update(yy_png_parser *parser, const uint8_t *data, uint32_t length, bool final) {
+    if (!parser) return YY_PNG_PARSER_STATUS_ERROR;
+    if (parser->status != YY_PNG_PARSER_STATUS_NEED_MORE_DATA) return parser->status;
+    if (!data) length = 0;
+    
+    if (parser->offset == 0) { // png file header
+        if (length < 32) {
+            if (final) parser->status = YY_PNG_PARSER_STATUS_ERROR;
+            return parser->status;
+        }
+        if (yy_png_read_fourcc(data) != YY_PNG_FOURCC(0x89, 0x50, 0x4E, 0x47) ||
+            yy_png_read_fourcc(data + 4) != YY_PNG_FOURCC(0x0D, 0x0A, 0x1A, 0x0A)) {
+            parser->status = YY_PNG_PARSER_STATUS_ERROR;
+            return parser->status;
+        }
+        parser->offset = 8;
+    }
+    
+    // parse the complete chunks after the offset
+    yy_png_info *info = parser->info;
+    while ((uint64_t)parser->offset + 12 <= length) {
+        const uint8_t *chunk_data = data + parser->offset;
+        uint32_t chunk_length = yy_png_read_uint32(chunk_data);
+        if ((uint64_t)parser->offset + chunk_length + 12 > length) {
+            if (final) { // truncated
+                parser->status = YY_PNG_PARSER_STATUS_ERROR;
+                return parser->status;
+            }
+            break; // wait for more data
+        }
+        if (!yy_png_parser_reserve_chunks(parser, info->chunk_num + 1)) {
+            parser->status = YY_PNG_PARSER_STATUS_ERROR;
+            return parser->status;
+        }
+        yy_png_chunk_info *chunk = info->chunks + info->chunk_num;
+        chunk->offset = parser->offset;
+        chunk->length = chunk_length;
+        chunk->fourcc = yy_png_read_fourcc(chunk_data + 4);
+        chunk->crc32 = yy_png_read_uint32(chunk_data + 8 + chunk_length);
+        info->chunk_num++;
+        parser->offset += 12 + chunk_length;
+        if (!yy_png_parser_read_chunk(parser, data)) {
+            parser->status = YY_PNG_PARSER_STATUS_ERROR;
+            return parser->status;
+        }
+        if (parser->IEND_found) break; // end, ignore the rest data
+    }
+    
+    if (parser->IEND_found || final) yy_png_parser_finish(parser);
+    return parser->status;
+}
+
+const yy_png_info *yy_png_parser_get_info(const yy_png_parser *parser) {
+    if (!parser || parser->info->chunk_num == 0) return NULL;
+    return parser->info;
+}
+
+bool yy_png_parser_is_apng(const yy_png_parser *parser) {
+    return parser && !parser->apng_error && parser->acTL_num == 1;
+}
+
+void yy_png_info_release(yy_png_info *info) {
+    if (info) {
+        if (info->chunks) free(info->chunks);
+        if (info->apng_frames) free(info->apng_frames);
+        if (info->apng_shared_chunk_indexs) free(info->apng_shared_chunk_indexs);
+        free(info);
+    }
+}
+
+yy_png_info *yy_png_info_create(const uint8_t *data, uint32_t length) {
+    yy_png_parser *parser = yy_png_parser_create();
+    if (!parser) return NULL;
+    if (yy_png_parser_update(parser, data, length, true) != YY_PNG_PARSER_STATUS_FINISHED) {
+        yy_png_parser_release(parser);
+        return NULL;
+    }
+    yy_png_info *info = parser->info;
+    if (!yy_png_parser_is_apng(parser)) { // ignore apng chunk
+        if (info->apng_frames) free(info->apng_frames);
+        if (info->apng_shared_chunk_indexs) free(info->apng_shared_chunk_indexs);
+        yy_png_chunk_info *chunks = info->chunks;
+        uint32_t chunk_num = info->chunk_num;
+        yy_png_chunk_IHDR header = info->header;
+        memset(info, 0, sizeof(yy_png_info));
+        info->chunks = chunks;
+        info->chunk_num = chunk_num;
+        info->header = header;
+    }
+    parser->info = NULL;
+    free(parser);
+    return info;
+}
+
+uint8_t *yy_png_copy_frame_data_at_index(const uint8_t *data,
+                                         const yy_png_info *info,
+                                         const uint32_t index,
+                                         uint32_t *size) {
+    if (index >= info->apng_frame_num) return NULL;
+
+    yy_png_frame_info *frame_info = info->apng_frames + index;
+    uint32_t frame_remux_size = 8 /* PNG Header */ + info->apng_shared_chunk_size + frame_info->chunk_size;
+    if (!(info->apng_first_frame_is_cover && index == 0)) {
+        frame_remux_size -= frame_info->chunk_num * 4; // remove fdAT sequence number
+    }
+    uint8_t *frame_data = malloc(frame_remux_size);
+    if (!frame_data) return NULL;
+    *size = frame_remux_size;
+
+    uint32_t data_offset = 0;
+    bool inserted = false;
+    memcpy(frame_data, data, 8); // PNG File Header
+    data_offset += 8;
+    for (uint32_t i = 0; i < info->apng_shared_chunk_num; i++) {
+        uint32_t shared_chunk_index = info->apng_shared_chunk_indexs[i];
+        yy_png_chunk_info *shared_chunk_info = info->chunks + shared_chunk_index;
+
+        if (shared_chunk_index >= info->apng_shared_insert_index && !inserted) { // replace IDAT with fdAT
+            inserted = true;
+            for (uint32_t c = 0; c < frame_info->chunk_num; c++) {
+                yy_png_chunk_info *insert_chunk_info = info->chunks + frame_info->chunk_index + c;
+                if (insert_chunk_info->fourcc == YY_PNG_FOURCC('f', 'd', 'A', 'T')) {
+                    yy_png_write_uint32(frame_data + data_offset, insert_chunk_info->length - 4);
+                    yy_png_write_fourcc(frame_data + data_offset + 4, YY_PNG_FOURCC('I', 'D', 'A', 'T'));
+                    memcpy(frame_data + data_offset + 8, data + insert_chunk_info->offset + 12, insert_chunk_info->length - 4);
+                    uint32_t crc = (uint32_t)crc32(0, frame_data + data_offset + 4, insert_chunk_info->length);
+                    yy_png_write_uint32(frame_data + data_offset + insert_chunk_info->length + 4, crc);
+                    data_offset += insert_chunk_info->length + 8;
+                } else { // IDAT
+                    memcpy(frame_data + data_offset, data + insert_chunk_info->offset, insert_chunk_info->length + 12);
+                    data_offset += insert_chunk_info->length + 12;
+                }
+            }
+        }
+
+        if (shared_chunk_info->fourcc == YY_PNG_FOURCC('I', 'H', 'D', 'R')) {
+            uint8_t tmp[25] = {0};
+            memcpy(tmp, data + shared_chunk_info->offset, 25);
+            yy_png_chunk_IHDR IHDR = info->header;
+            IHDR.width = frame_info->frame_control.width;
+            IHDR.height = frame_info->frame_control.height;
+            yy_png_chunk_IHDR_write(&IHDR, tmp + 8);
+            yy_png_write_uint32(tmp + 21, (uint32_t)crc32(0, tmp + 4, 17));
+            memcpy(frame_data + data_offset, tmp, 25);
+            data_offset += 25;
+        } else {
+            memcpy(frame_data + data_offset, data + shared_chunk_info->offset, shared_chunk_info->length + 12);
+            data_offset += shared_chunk_info->length + 12;
+        }
+    }
+    return frame_data;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Decode
+
+typedef struct {
+    uint32_t x, y;   ///< first pixel of the pass
+    uint32_t dx, dy; ///< pixel step of the pass
+} yy_png_pass;
+
+/// Adam7 passes, or the whole image (the first) if not interlaced.
+static const yy_png_pass yy_png_adam7_passes[7] = {
+    {0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8}, {2, 0, 4, 4}, {0, 2, 2, 4}, {1, 0, 2, 2}, {0, 1, 1, 2},
+};
+
+typedef struct {
+    const uint8_t *palette; ///< PLTE entries (RGB)
+    uint32_t palette_num;   ///< PLTE entry count
+    const uint8_t *trns;    ///< tRNS data
+    uint32_t trns_length;   ///< tRNS data length
+} yy_png_color_table;
+
+/// Returns the sample count of a pixel, or 0 if the header is not supported.
+static uint32_t yy_png_header_channels(const yy_png_chunk_IHDR *header) {
+    if (header->compression_method != 0 || header->filter_method != 0 || header->interlace_method > 1) return 0;
+    uint8_t depth = header->bit_depth;
+    bool depth_8_16 = (depth == 8 || depth == 16);
+    switch (header->color_type) {
+        case 0: return (depth == 1 || depth == 2 || depth == 4 || depth_8_16) ? 1 : 0; // gray
+        case 2: return depth_8_16 ? 3 : 0; // rgb
+        case 3: return (depth == 1 || depth == 2 || depth == 4 || depth == 8) ? 1 : 0; // palette
+        case 4: return depth_8_16 ? 2 : 0; // gray alpha
+        case 6: return depth_8_16 ? 4 : 0; // rgb alpha
+        default: return 0;
+    }
+}
+
+static bool yy_png_color_table_read(const uint8_t *data, const yy_png_info *info, yy_png_color_table *table) {
+    memset(table, 0, sizeof(yy_png_color_table));
+    for (uint32_t i = 0; i < info->chunk_num; i++) {
+        const yy_png_chunk_info *chunk = info->chunks + i;
+        if (chunk->fourcc == YY_PNG_FOURCC('P', 'L', 'T', 'E')) {
+            table->palette = data + chunk->offset + 8;
+            table->palette_num = chunk->length / 3;
+        } else if (chunk->fourcc == YY_PNG_FOURCC('t', 'R', 'N', 'S')) {
+            table->trns = data + chunk->offset + 8;
+            table->trns_length = chunk->length;
+        } else if (chunk->fourcc == YY_PNG_FOURCC('I', 'D', 'A', 'T') ||
+                   chunk->fourcc == YY_PNG_FOURCC('f', 'd', 'A', 'T')) {
+            break; // these chunks must appear before the image data
+        }
+    }
+    if (info->header.color_type == 3 && table->palette_num == 0) return false;
+    return true;
+}
+
+bool yy_png_has_color_space(const yy_png_info *info) {
+    if (!info) return false;
+    for (uint32_t i = 0; i < info->chunk_num; i++) {
+        switch (info->chunks[i].fourcc) {
+            case YY_PNG_FOURCC('g', 'A', 'M', 'A'):
+            case YY_PNG_FOURCC('c', 'H', 'R', 'M'):
+            case YY_PNG_FOURCC('i', 'C', 'C', 'P'):
+            case YY_PNG_FOURCC('s', 'R', 'G', 'B'):
+                return true;
+            case YY_PNG_FOURCC('I', 'D', 'A', 'T'):
+            case YY_PNG_FOURCC('f', 'd', 'A', 'T'):
+                return false; // these chunks must appear before the image data
+            default: break;
+        }
+    }
+    return false;
+}
+
+/// Inflate the `IDAT` or `fdAT` chunks of a frame, returns NULL if the data is broken or too short.
+static uint8_t *yy_png_inflate_frame(const uint8_t *data, const yy_png_info *info, const yy_png_frame_info *frame, size_t size) {
+    if (size == 0 || size > UINT_MAX) return NULL;
+    uint8_t *raw = malloc(size);
+    if (!raw) return NULL;
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(z_stream));
+    if (inflateInit(&stream) != Z_OK) {
+        free(raw);
+        return NULL;
+    }
+    stream.next_out = raw;
+    stream.avail_out = (uInt)size;
+    for (uint32_t c = 0; c < frame->chunk_num && stream.avail_out > 0; c++) {
+        const yy_png_chunk_info *chunk = info->chunks + frame->chunk_index + c;
+        const uint8_t *bytes = data + chunk->offset + 8;
+        uint32_t length = chunk->length;
+        if (chunk->fourcc == YY_PNG_FOURCC('f', 'd', 'A', 'T')) { // skip sequence number
+            bytes += 4;
+            length -= 4;
+        }
+        stream.next_in = (Bytef *)bytes;
+        stream.avail_in = length;
+        int result = inflate(&stream, Z_NO_FLUSH);
+        if (result == Z_STREAM_END) break;
+        if (result != Z_OK && result != Z_BUF_ERROR) break;
+    }
+    bool finished = (stream.avail_out == 0);
+    inflateEnd(&stream);
+    if (!finished) {
+        free(raw);
+        return NULL;
+    }
+    return raw;
+}
+
+static inline uint8_t yy_png_paeth(uint8_t a, uint8_t b, uint8_t c) {
+    int p = (int)a + (int)b - (int)c;
+    int pa = abs(p - (int)a);
+    int pb = abs(p - (int)b);
+    int pc = abs(p - (int)c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+/// Reverse the filter of a row in place, `prev` is NULL for the first row of a pass.
+static bool yy_png_unfilter_row(uint8_t filter, uint8_t *row, const uint8_t *prev, size_t length, size_t bpp) {
+    switch (filter) {
+        case 0: { // none
+        } break;
+        case 1: { // sub
+            for (size_t i = bpp; i < length; i++) row[i] += row[i - bpp];
+        } break;
+        case 2: { // up
+            if (prev) for (size_t i = 0; i < length; i++) row[i] += prev[i];
+        } break;
+        case 3: { // average
+            for (size_t i = 0; i < length; i++) {
+                uint32_t left = i >= bpp ? row[i - bpp] : 0;
+                uint32_t up = prev ? prev[i] : 0;
+                row[i] += (uint8_t)((left + up) >> 1);
+            }
+        } break;
+        case 4: { // paeth
+            for (size_t i = 0; i < length; i++) {
+                uint8_t left = i >= bpp ? row[i - bpp] : 0;
+                uint8_t up = prev ? prev[i] : 0;
+                uint8_t up_left = (prev && i >= bpp) ? prev[i - bpp] : 0;
+                row[i] += yy_png_paeth(left, up, up_left);
+            }
+        } break;
+        default: return false;
+    }
+    return true;
+}
+
+/// Read the sample at index of a row, the value is not scaled.
+static inline uint32_t yy_png_row_sample(const uint8_t *row, uint32_t index, uint8_t bit_depth) {
+    switch (bit_depth) {
+        case 8: return row[index];
+        case 16: return yy_png_read_uint16(row + index * 2);
+        default: {
+            uint32_t bit = index * bit_depth;
+            return (row[bit >> 3] >> (8 - bit_depth - (bit & 7))) & ((1U << bit_depth) - 1);
+        }
+    }
+}
+
+/// Scale a sample to 8 bits.
+static inline uint8_t yy_png_sample_to_8(uint32_t value, uint8_t bit_depth) {
+    switch (bit_depth) {
+        case 1: return value ? 0xFF : 0;
+        case 2: return (uint8_t)(value * 0x55);
+        case 4: return (uint8_t)(value * 0x11);
+        case 16: return (uint8_t)(value >> 8);
+        default: return (uint8_t)value;
+    }
+}
+
+static inline void yy_png_store_pixel(uint8_t *dst, uint8_t r, uint8_t g, uint8_t b, uint8_t a, yy_png_pixel_format format) {
+    if (a == 0) {
+        r = g = b = 0;
+    } else if (a != 0xFF) {
+        r = (uint8_t)((r * a + 127) / 255);
+        g = (uint8_t)((g * a + 127) / 255);
+        b = (uint8_t)((b * a + 127) / 255);
+    }
+    if (format == YY_PNG_PIXEL_FORMAT_BGRA) {
+        dst[0] = b; dst[1] = g; dst[2] = r; dst[3] = a;
+    } else {
+        dst[0] = r; dst[1] = g; dst[2] = b; dst[3] = a;
+    }
+}
+
+/// Convert an unfiltered row to premultiplied pixels, `step` is the bytes between two output pixels.
+static void yy_png_expand_row(const uint8_t *row, uint32_t count, const yy_png_chunk_IHDR *header,
+                              const yy_png_color_table *table, yy_png_pixel_format format,
+                              uint8_t *dst, size_t step) {
+    uint8_t depth = header->bit_depth;
+    switch (header->color_type) {
+        case 0: { // gray
+            bool has_key = table->trns_length >= 2;
+            uint32_t key = has_key ? yy_png_read_uint16(table->trns) : 0;
+            for (uint32_t i = 0; i < count; i++, dst += step) {
+                uint32_t v = yy_png_row_sample(row, i, depth);
+                uint8_t c = yy_png_sample_to_8(v, depth);
+                yy_png_store_pixel(dst, c, c, c, (has_key && v == key) ? 0 : 0xFF, format);
+            }
+        } break;
+        case 2: { // rgb
+            bool has_key = table->trns_length >= 6;
+            uint32_t kr = has_key ? yy_png_read_uint16(table->trns) : 0;
+            uint32_t kg = has_key ? yy_png_read_uint16(table->trns + 2) : 0;
+            uint32_t kb = has_key ? yy_png_read_uint16(table->trns + 4) : 0;
+            for (uint32_t i = 0; i < count; i++, dst += step) {
+                uint32_t r = yy_png_row_sample(row, i * 3, depth);
+                uint32_t g = yy_png_row_sample(row, i * 3 + 1, depth);
+                uint32_t b = yy_png_row_sample(row, i * 3 + 2, depth);
+                uint8_t a = (has_key && r == kr && g == kg && b == kb) ? 0 : 0xFF;
+                yy_png_store_pixel(dst, yy_png_sample_to_8(r, depth), yy_png_sample_to_8(g, depth), yy_png_sample_to_8(b, depth), a, format);
+            }
+        } break;
+        case 3: { // palette
+            for (uint32_t i = 0; i < count; i++, dst += step) {
+                uint32_t index = yy_png_row_sample(row, i, depth);
+                if (index < table->palette_num) {
+                    const uint8_t *entry = table->palette + index * 3;
+                    uint8_t a = index < table->trns_length ? table->trns[index] : 0xFF;
+                    yy_png_store_pixel(dst, entry[0], entry[1], entry[2], a, format);
+                } else {
+                    yy_png_store_pixel(dst, 0, 0, 0, 0, format); // out of palette
+                }
+            }
+        } break;
+        case 4: { // gray alpha
+            for (uint32_t i = 0; i < count; i++, dst += step) {
+                uint8_t c = yy_png_sample_to_8(yy_png_row_sample(row, i * 2, depth), depth);
+                uint8_t a = yy_png_sample_to_8(yy_png_row_sample(row, i * 2 + 1, depth), depth);
+                yy_png_store_pixel(dst, c, c, c, a, format);
+            }
+        } break;
+        case 6: { // rgb alpha
+            if (depth == 8 && step == 4) { // most common, swizzle then premultiply the row
+                if (format == YY_PNG_PIXEL_FORMAT_BGRA) {
+                    for (uint32_t i = 0; i < count; i++) {
+                        dst[i * 4] = row[i * 4 + 2];
+                        dst[i * 4 + 1] = row[i * 4 + 1];
+                        dst[i * 4 + 2] = row[i * 4];
+                        dst[i * 4 + 3] = row[i * 4 + 3];
+                    }
+                } else {
+                    memcpy(dst, row, (size_t)count * 4);
+                }
+                yy_pixel_premultiply(dst, (size_t)count * 4, count, 1);
+                break;
+            }
+            for (uint32_t i = 0; i < count; i++, dst += step) {
+                uint8_t r = yy_png_sample_to_8(yy_png_row_sample(row, i * 4, depth), depth);
+                uint8_t g = yy_png_sample_to_8(yy_png_row_sample(row, i * 4 + 1, depth), depth);
+                uint8_t b = yy_png_sample_to_8(yy_png_row_sample(row, i * 4 + 2, depth), depth);
+                uint8_t a = yy_png_sample_to_8(yy_png_row_sample(row, i * 4 + 3, depth), depth);
+                yy_png_store_pixel(dst, r, g, b, a, format);
+            }
+        } break;
+    }
+}
+
+/// Returns the pixel count of a pass in one dimension.
+static inline uint32_t yy_png_pass_size(uint32_t size, uint32_t start, uint32_t step) {
+    return size > start ? (size - start + step - 1) / step : 0;
+}
+
+bool yy_png_decode_frame(const uint8_t *data,
+                         const yy_png_info *info,
+                         uint32_t index,
+                         yy_png_pixel_format format,
+                         uint8_t *pixels,
+                         size_t stride) {
+    if (!data || !info || !pixels || index >= info->apng_frame_num) return false;
+    const yy_png_chunk_IHDR *header = &info->header;
+    const yy_png_frame_info *frame = info->apng_frames + index;
+    uint32_t width = frame->frame_control.width;
+    uint32_t height = frame->frame_control.height;
+    if (width == 0 || height == 0 || frame->chunk_num == 0) return false;
+    if ((uint64_t)width * 4 > stride) return false;
+
+    uint32_t channels = yy_png_header_channels(header);
+    if (channels == 0) return false;
+    yy_png_color_table table;
+    if (!yy_png_color_table_read(data, info, &table)) return false;
+
+    uint64_t bits_per_pixel = (uint64_t)channels * header->bit_depth;
+    size_t bpp = bits_per_pixel >= 8 ? (size_t)(bits_per_pixel / 8) : 1; // filter unit
+    const yy_png_pass *passes = yy_png_adam7_passes;
+    uint32_t pass_num = header->interlace_method ? 7 : 1;
+    yy_png_pass whole = {0, 0, 1, 1};
+    if (pass_num == 1) passes = &whole;
+
+    uint64_t raw_size = 0;
+    for (uint32_t p = 0; p < pass_num; p++) {
+        uint64_t pass_width = yy_png_pass_size(width, passes[p].x, passes[p].dx);
+        uint64_t pass_height = yy_png_pass_size(height, passes[p].y, passes[p].dy);
+        if (pass_width == 0 || pass_height == 0) continue;
+        raw_size += pass_height * (1 + (pass_width * bits_per_pixel + 7) / 8);
+        if (raw_size > UINT_MAX) return false;
+    }
+
+    uint8_t *raw = yy_png_inflate_frame(data, info, frame, (size_t)raw_size);
+    if (!raw) return false;
+
+    uint8_t *cur = raw;
+    for (uint32_t p = 0; p < pass_num; p++) {
+        const yy_png_pass *pass = passes + p;
+        uint32_t pass_width = yy_png_pass_size(width, pass->x, pass->dx);
+        uint32_t pass_height = yy_png_pass_size(height, pass->y, pass->dy);
+        if (pass_width == 0 || pass_height == 0) continue;
+        size_t row_length = (size_t)(((uint64_t)pass_width * bits_per_pixel + 7) / 8);
+        const uint8_t *prev = NULL;
+        for (uint32_t y = 0; y < pass_height; y++) {
+            uint8_t *row = cur + 1;
+            if (!yy_png_unfilter_row(cur[0], row, prev, row_length, bpp)) {
+                free(raw);
+                return false;
+            }
+            uint8_t *dst = pixels + (size_t)(pass->y + y * pass->dy) * stride + (size_t)pass->x * 4;
+            yy_png_expand_row(row, pass_width, header, &table, format, dst, (size_t)pass->dx * 4);
+            prev = row;
+            cur += 1 + row_length;
+        }
+    }
+    free(raw);
+    return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Composite
+
+struct yy_png_compositor {
+    const yy_png_info *info;
+    yy_png_pixel_format format;
+    uint8_t *frame_pixels;     ///< decoded pixels of a frame
+    size_t frame_capacity;     ///< bytes of frame_pixels
+    uint8_t *previous_pixels;  ///< canvas region saved for YY_PNG_DISPOSE_OP_PREVIOUS
+    size_t previous_capacity;  ///< bytes of previous_pixels
+    int64_t canvas_index;      ///< the frame on the canvas, -1 if unknown
+    uint32_t pending_dispose;  ///< dispose op of the frame on the canvas
+    uint32_t pending_x, pending_y, pending_width, pending_height; ///< clipped region of the frame on the canvas
+};
+
+/// A region of the canvas, clipped to the canvas bounds.
+typedef struct {
+    uint32_t x, y, width, height;
+} yy_png_rect;
+
+static yy_png_rect yy_png_frame_rect_clipped(const yy_png_info *info, const yy_png_chunk_fcTL *fcTL) {
+    yy_png_rect rect = {0, 0, 0, 0};
+    uint32_t canvas_width = info->header.width, canvas_height = info->header.height;
+    if (fcTL->x_offset >= canvas_width || fcTL->y_offset >= canvas_height) return rect;
+    rect.x = fcTL->x_offset;
+    rect.y = fcTL->y_offset;
+    rect.width = fcTL->width < canvas_width - rect.x ? fcTL->width : canvas_width - rect.x;
+    rect.height = fcTL->height < canvas_height - rect.y ? fcTL->height : canvas_height - rect.y;
+    return rect;
+}
+
+static bool yy_png_buffer_reserve(uint8_t **buffer, size_t *capacity, size_t size) {
+    if (size <= *capacity) return true;
+    uint8_t *new_buffer = realloc(*buffer, size);
+    if (!new_buffer) return false;
+    *buffer = new_buffer;
+    *capacity = size;
+    return true;
+}
+
+yy_png_compositor *yy_png_compositor_create(const yy_png_info *info, yy_png_pixel_format format) {
+    if (!info || info->apng_frame_num == 0) return NULL;
+    if (info->header.width == 0 || info->header.height == 0) return NULL;
+    if ((uint64_t)info->header.width * info->header.height * 4 > SIZE_MAX) return NULL;
+    yy_png_compositor *compositor = calloc(1, sizeof(yy_png_compositor));
+    if (!compositor) return NULL;
+    compositor->info = info;
+    compositor->format = format;
+    compositor->canvas_index = -1;
+    return compositor;
+}
+
+void yy_png_compositor_release(yy_png_compositor *compositor) {
+    if (compositor) {
+        if (compositor->frame_pixels) free(compositor->frame_pixels);
+        if (compositor->previous_pixels) free(compositor->previous_pixels);
+        free(compositor);
+    }
+}
+
+void yy_png_compositor_reset(yy_png_compositor *compositor) {
+    if (compositor) {
+        compositor->canvas_index = -1;
+        compositor->pending_dispose = YY_PNG_DISPOSE_OP_NONE;
+    }
+}
+
+/**
+ Dispose the frame on the canvas, then draw the frame at index with its decoded
+ pixels (clipped to the canvas). The frame is not drawn if the pixels is NULL.
+ */
+static bool yy_png_compositor_draw_frame(yy_png_compositor *compositor,
+                                         uint32_t index,
+                                         const uint8_t *pixels,
+                                         size_t pixels_stride,
+                                         uint8_t *canvas,
+                                         size_t stride) {
+    const yy_png_info *info = compositor->info;
+    const yy_png_chunk_fcTL *fcTL = &info->apng_frames[index].frame_control;
+    if (fcTL->width > info->header.width || fcTL->height > info->header.height) return false;
+
+    // dispose previous frame
+    uint8_t *pending = canvas + (size_t)compositor->pending_y * stride + (size_t)compositor->pending_x * 4;
+    if (compositor->pending_dispose == YY_PNG_DISPOSE_OP_BACKGROUND) {
+        yy_pixel_clear(pending, stride, compositor->pending_width, compositor->pending_height);
+    } else if (compositor->pending_dispose == YY_PNG_DISPOSE_OP_PREVIOUS) {
+        yy_pixel_copy(pending, stride, compositor->previous_pixels, (size_t)compositor->pending_width * 4,
+                      compositor->pending_width, compositor->pending_height);
+    }
+    compositor->pending_dispose = YY_PNG_DISPOSE_OP_NONE;
+
+    yy_png_rect rect = yy_png_frame_rect_clipped(info, fcTL);
+    uint8_t *region = canvas + (size_t)rect.y * stride + (size_t)rect.x * 4;
+
+    // save the region to restore
+    if (fcTL->dispose_op == YY_PNG_DISPOSE_OP_PREVIOUS) {
+        if (!yy_png_buffer_reserve(&compositor->previous_pixels, &compositor->previous_capacity,
+                                   (size_t)rect.width * rect.height * 4)) return false;
+        yy_pixel_copy(compositor->previous_pixels, (size_t)rect.width * 4, region, stride, rect.width, rect.height);
+    }
+
+    // blend
+    if (pixels && rect.width > 0 && rect.height > 0) {
+        if (fcTL->blend_op == YY_PNG_BLEND_OP_OVER) {
+            yy_pixel_blend_over(region, stride, pixels, pixels_stride, rect.width, rect.height);
+        } else {
+            yy_pixel_copy(region, stride, pixels, pixels_stride, rect.width, rect.height);
+        }
+    }
+
+    compositor->pending_dispose = fcTL->dispose_op;
+    compositor->pending_x = rect.x;
+    compositor->pending_y = rect.y;
+    compositor->pending_width = rect.width;
+    compositor->pending_height = rect.height;
+    return true;
+}
+
+/// Dispose the frame on the canvas, then decode and render the frame at index.
+static bool yy_png_compositor_render_frame(yy_png_compositor *compositor,
+                                           const uint8_t *data,
+                                           uint32_t index,
+                                           uint8_t *canvas,
+                                           size_t stride) {
+    const yy_png_info *info = compositor->info;
+    const yy_png_chunk_fcTL *fcTL = &info->apng_frames[index].frame_control;
+    if (fcTL->width > info->header.width || fcTL->height > info->header.height) return false;
+    
+    yy_png_rect rect = yy_png_frame_rect_clipped(info, fcTL);
+    if (rect.width == 0 || rect.height == 0) { // nothing to draw
+        return yy_png_compositor_draw_frame(compositor, index, NULL, 0, canvas, stride);
+    }
+    uint64_t frame_size = (uint64_t)fcTL->width * fcTL->height * 4;
+    if (frame_size > SIZE_MAX) return false;
+    if (!yy_png_buffer_reserve(&compositor->frame_pixels, &compositor->frame_capacity, (size_t)frame_size)) return false;
+    size_t frame_stride = (size_t)fcTL->width * 4;
+    if (!yy_png_decode_frame(data, info, index, compositor->format, compositor->frame_pixels, frame_stride)) return false;
+    return yy_png_compositor_draw_frame(compositor, index, compositor->frame_pixels, frame_stride, canvas, stride);
+}
+
+bool yy_png_compositor_render_pixels(yy_png_compositor *compositor,
+                                     uint32_t index,
+                                     const uint8_t *pixels,
+                                     size_t pixels_stride,
+                                     uint8_t *canvas,
+                                     size_t stride) {
+    if (!compositor || !canvas) return false;
+    const yy_png_info *info = compositor->info;
+    if (index >= info->apng_frame_num) return false;
+    if ((uint64_t)info->header.width * 4 > stride) return false;
+    if (pixels && (uint64_t)info->apng_frames[index].frame_control.width * 4 > pixels_stride) return false;
+    compositor->canvas_index = -1;
+    if (!yy_png_compositor_draw_frame(compositor, index, pixels, pixels_stride, canvas, stride)) {
+        compositor->pending_dispose = YY_PNG_DISPOSE_OP_NONE;
+        return false;
+    }
+    compositor->canvas_index = index;
+    return true;
+}
+
+bool yy_png_compositor_render(yy_png_compositor *compositor,
+                              const uint8_t *data,
+                              uint32_t index,
+                              uint8_t *canvas,
+                              size_t stride) {
+    if (!compositor || !data || !canvas) return false;
+    const yy_png_info *info = compositor->info;
+    if (index >= info->apng_frame_num) return false;
+    if ((uint64_t)info->header.width * 4 > stride) return false;
+
+    uint32_t begin = index;
+    bool restart = false;
+    if (compositor->canvas_index < 0 || compositor->canvas_index + 1 != index) {
+        // canvas is not ready, draw from a cleared canvas
+        begin = info->apng_frames[index].blend_from_index;
+        yy_pixel_clear(canvas, stride, info->header.width, info->header.height);
+        compositor->pending_dispose = YY_PNG_DISPOSE_OP_NONE;
+        restart = true;
+    }
+    compositor->canvas_index = -1;
+    for (uint32_t i = begin; i <= index; i++) {
+        if (!yy_png_compositor_render_frame(compositor, data, i, canvas, stride)) {
+            compositor->pending_dispose = YY_PNG_DISPOSE_OP_NONE;
+            return false;
+        }
+    }
+    if (restart && begin == index && index > 0 &&
+        info->apng_frames[index].frame_control.dispose_op == YY_PNG_DISPOSE_OP_PREVIOUS) {
+        // The frame covers the canvas, but the content it reverts to is not on the
+        // canvas, so the next frame should be rendered from its `blend_from_index`.
+        return true;
+    }
+    compositor->canvas_index = index;
+    return true;
+}
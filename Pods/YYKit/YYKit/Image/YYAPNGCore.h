@@ -0,0 +1,306 @@
+//
+//  YYAPNGCore.h
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by agent on 26/10/17.
+//  Copyright (c) 2026 agent.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+/*
+ A platform independent APNG decoder written in C (depends on zlib only).
+
+ It parses the PNG/APNG chunks, decodes a frame's pixels, and composites the
+ frames into a caller-supplied buffer with the frame's dispose_op and blend_op.
+ YYImageDecoder wraps it with CGImage, and it can also be built and tested
+ without ImageIO/CoreGraphics.
+
+ The functions are not thread safe for the same compositor, but different
+ compositors can use the same png info and data at the same time.
+ */
+
+#ifndef YYAPNGCore_h
+#define YYAPNGCore_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// The chunk fourcc as it is in memory on a little endian platform.
+#define YY_PNG_FOURCC(c1,c2,c3,c4) ((uint32_t)(((uint32_t)(c4) << 24) | ((uint32_t)(c3) << 16) | ((uint32_t)(c2) << 8) | (uint32_t)(c1)))
+
+typedef enum {
+    YY_PNG_ALPHA_TYPE_PALEETE = 1 << 0,
+    YY_PNG_ALPHA_TYPE_COLOR = 1 << 1,
+    YY_PNG_ALPHA_TYPE_ALPHA = 1 << 2,
+} yy_png_alpha_type;
+
+typedef enum {
+    YY_PNG_DISPOSE_OP_NONE = 0,
+    YY_PNG_DISPOSE_OP_BACKGROUND = 1,
+    YY_PNG_DISPOSE_OP_PREVIOUS = 2,
+} yy_png_dispose_op;
+
+typedef enum {
+    YY_PNG_BLEND_OP_SOURCE = 0,
+    YY_PNG_BLEND_OP_OVER = 1,
+} yy_png_blend_op;
+
+/// The pixel format of the decoded pixels, 8 bits per component, premultiplied alpha.
+typedef enum {
+    YY_PNG_PIXEL_FORMAT_RGBA = 0, ///< byte order R, G, B, A
+    YY_PNG_PIXEL_FORMAT_BGRA = 1, ///< byte order B, G, R, A (kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst)
+} yy_png_pixel_format;
+
+typedef struct {
+    uint32_t width;             ///< pixel count, should not be zero
+    uint32_t height;            ///< pixel count, should not be zero
+    uint8_t bit_depth;          ///< expected: 1, 2, 4, 8, 16
+    uint8_t color_type;         ///< see yy_png_alpha_type
+    uint8_t compression_method; ///< 0 (deflate/inflate)
+    uint8_t filter_method;      ///< 0 (adaptive filtering with five basic filter types)
+    uint8_t interlace_method;   ///< 0 (no interlace) or 1 (Adam7 interlace)
+} yy_png_chunk_IHDR;
+
+typedef struct {
+    uint32_t sequence_number;  ///< sequence number of the animation chunk, starting from 0
+    uint32_t width;            ///< width of the following frame
+    uint32_t height;           ///< height of the following frame
+    uint32_t x_offset;         ///< x position at which to render the following frame
+    uint32_t y_offset;         ///< y position at which to render the following frame
+    uint16_t delay_num;        ///< frame delay fraction numerator
+    uint16_t delay_den;        ///< frame delay fraction denominator
+    uint8_t dispose_op;        ///< see yy_png_dispose_op
+    uint8_t blend_op;          ///< see yy_png_blend_op
+} yy_png_chunk_fcTL;
+
+typedef struct {
+    uint32_t offset; ///< chunk offset in PNG data
+    uint32_t fourcc; ///< chunk fourcc
+    uint32_t length; ///< chunk data length
+    uint32_t crc32;  ///< chunk crc32
+} yy_png_chunk_info;
+
+typedef struct {
+    uint32_t chunk_index; ///< the first `fdAT`/`IDAT` chunk index
+    uint32_t chunk_num;   ///< the `fdAT`/`IDAT` chunk count
+    uint32_t chunk_size;  ///< the `fdAT`/`IDAT` chunk bytes
+    uint32_t blend_from_index; ///< the first frame to render for this frame on a cleared canvas
+    yy_png_chunk_fcTL frame_control;
+} yy_png_frame_info;
+
+typedef struct {
+    yy_png_chunk_IHDR header;   ///< png header
+    yy_png_chunk_info *chunks;      ///< chunks
+    uint32_t chunk_num;          ///< count of chunks
+
+    yy_png_frame_info *apng_frames; ///< frame info, NULL if not apng
+    uint32_t apng_frame_num;     ///< 0 if not apng
+    uint32_t apng_loop_num;      ///< 0 indicates infinite looping
+
+    uint32_t *apng_shared_chunk_indexs; ///< shared chunk index
+    uint32_t apng_shared_chunk_num;     ///< shared chunk count
+    uint32_t apng_shared_chunk_size;    ///< shared chunk bytes
+    uint32_t apng_shared_insert_index;  ///< shared chunk insert index
+    bool apng_first_frame_is_cover;     ///< the first frame is same as png (cover)
+} yy_png_info;
+
+/// Parses a png file incrementally as the data arrives, see yy_png_parser_update().
+typedef struct yy_png_parser yy_png_parser;
+
+typedef enum {
+    YY_PNG_PARSER_STATUS_NEED_MORE_DATA = 0, ///< waiting for more data
+    YY_PNG_PARSER_STATUS_FINISHED = 1,       ///< `IEND` is found, or all data is parsed
+    YY_PNG_PARSER_STATUS_ERROR = 2,          ///< not a png file, or the data is broken
+} yy_png_parser_status;
+
+/// Composites the frames of an apng, see yy_png_compositor_create().
+typedef struct yy_png_compositor yy_png_compositor;
+
+
+void yy_png_chunk_IHDR_read(yy_png_chunk_IHDR *IHDR, const uint8_t *data);
+void yy_png_chunk_IHDR_write(yy_png_chunk_IHDR *IHDR, uint8_t *data);
+void yy_png_chunk_fcTL_read(yy_png_chunk_fcTL *fcTL, const uint8_t *data);
+void yy_png_chunk_fcTL_write(yy_png_chunk_fcTL *fcTL, uint8_t *data);
+
+/// Convert a duration in seconds to the fcTL delay fraction.
+void yy_png_delay_to_fraction(double duration, uint16_t *num, uint16_t *den);
+
+/// Convert the fcTL delay fraction to a duration in seconds.
+double yy_png_delay_to_seconds(uint16_t num, uint16_t den);
+
+/**
+ Create a png info from a png file. See struct png_info for more information.
+
+ @param data   png/apng file data.
+ @param length the data's length in bytes.
+ @return A png info object, you may call yy_png_info_release() to release it.
+ Returns NULL if an error occurs.
+ */
+yy_png_info *yy_png_info_create(const uint8_t *data, uint32_t length);
+
+void yy_png_info_release(yy_png_info *info);
+
+/// Create a parser, you may call yy_png_parser_release() to release it.
+yy_png_parser *yy_png_parser_create(void);
+
+void yy_png_parser_release(yy_png_parser *parser);
+
+/**
+ Parse the data received since the last call.
+ 
+ @discussion The parser keeps its state between calls and only reads the new bytes:
+ a chunk is read once all its bytes are received, and an apng frame is added to the
+ info once all its data chunks are received (the next chunk is not its data).
+ So a file received in pieces is parsed in linear time in total.
+ 
+ @param parser parser
+ @param data   png/apng file data received so far. It should begin with the data
+               of the previous call (bytes are only appended). It's not retained.
+ @param length the data's length in bytes.
+ @param final  whether all the data is received.
+ @return The parse status. Once it's finished or failed, the parser ignores new data.
+ */
+yy_png_parser_status yy_png_parser_update(yy_png_parser *parser, const uint8_t *data, uint32_t length, bool final);
+
+/**
+ Get the png info parsed so far (`apng_frame_num` is the complete frame count).
+ 
+ @return The info owned by the parser, NULL if the `IHDR` is not received yet.
+ The info's arrays may be reallocated by yy_png_parser_update(), don't keep
+ pointers to them.
+ */
+const yy_png_info *yy_png_parser_get_info(const yy_png_parser *parser);
+
+/**
+ Whether the data is an apng so far (`acTL` is found and no broken apng chunk).
+ If the apng chunks are broken after some frames, the parsed frames are kept in
+ the info but no more frame is added. When the status is finished, it also means
+ all frames declared in `acTL` are found.
+ */
+bool yy_png_parser_is_apng(const yy_png_parser *parser);
+
+/**
+ Copy a png frame data from an apng file.
+
+ @param data  apng file data
+ @param info  png info
+ @param index frame index (zero-based)
+ @param size  output, the size of the frame data
+ @return A frame data (single-frame png file), call free() to release the data.
+ Returns NULL if an error occurs.
+ */
+uint8_t *yy_png_copy_frame_data_at_index(const uint8_t *data,
+                                         const yy_png_info *info,
+                                         const uint32_t index,
+                                         uint32_t *size);
+
+/**
+ Decode the pixels of an apng frame (not blended with other frames).
+
+ @discussion All color types and bit depths (16 bits are truncated to 8 bits),
+ `tRNS` and Adam7 interlace are supported. The color space chunks (gAMA, iCCP,
+ sRGB...) are ignored, the pixels are treated as device RGB. Use
+ yy_png_has_color_space() to check whether the pixels should be tagged with another
+ color space.
+
+ @param data   apng file data
+ @param info   png info with apng frames
+ @param index  frame index (zero-based)
+ @param format pixel format of the output
+ @param pixels output, at least `stride * frame_control.height` bytes
+ @param stride bytes per row of the output, at least `4 * frame_control.width`
+ @return Whether succeed.
+ */
+bool yy_png_decode_frame(const uint8_t *data,
+                         const yy_png_info *info,
+                         uint32_t index,
+                         yy_png_pixel_format format,
+                         uint8_t *pixels,
+                         size_t stride);
+
+/**
+ Whether the png declares its color space with `gAMA`, `cHRM`, `iCCP` or `sRGB`
+ (before the image data), which is ignored by yy_png_decode_frame().
+
+ @param info png info
+ @return Whether any of these chunks is found.
+ */
+bool yy_png_has_color_space(const yy_png_info *info);
+
+/**
+ Create a compositor which renders the apng frames to a canvas.
+
+ @param info   png info with apng frames, it should be alive while the compositor is in use.
+ @param format pixel format of the canvas
+ @return A compositor, you may call yy_png_compositor_release() to release it.
+ Returns NULL if an error occurs.
+ */
+yy_png_compositor *yy_png_compositor_create(const yy_png_info *info, yy_png_pixel_format format);
+
+void yy_png_compositor_release(yy_png_compositor *compositor);
+
+/**
+ Render a frame to the canvas, as it should be displayed.
+
+ @discussion The canvas is `header.width * header.height` and is owned by the caller.
+ If the canvas holds the previous frame (rendered by the last call with the same
+ canvas), only this frame is rendered; otherwise the canvas is cleared and the frames
+ are rendered from `blend_from_index`. The caller should not change the canvas
+ between calls, or call yy_png_compositor_reset() after it's changed.
+
+ @param compositor compositor
+ @param data       apng file data
+ @param index      frame index (zero-based)
+ @param canvas     the canvas
+ @param stride     bytes per row of the canvas
+ @return Whether succeed. The canvas is undefined if failed.
+ */
+bool yy_png_compositor_render(yy_png_compositor *compositor,
+                              const uint8_t *data,
+                              uint32_t index,
+                              uint8_t *canvas,
+                              size_t stride);
+
+/**
+ Render a frame to the canvas with its decoded pixels, after disposing the frame
+ rendered by the last call. The frame is clipped to the canvas and blended in the
+ same way as yy_png_compositor_render().
+
+ @discussion Unlike yy_png_compositor_render(), it doesn't decode the frame, so the
+ caller can decode the frames concurrently with yy_png_decode_frame(). It doesn't 
+ prepare the canvas either: the caller should render the frames in order, starting
+ from a frame's `blend_from_index` on a cleared canvas (after yy_png_compositor_reset()
+ if the compositor was used).
+
+ @param compositor    compositor
+ @param index         frame index (zero-based)
+ @param pixels        the frame's pixels decoded by yy_png_decode_frame() in the
+                      compositor's format, or NULL to skip drawing the frame (e.g.
+                      it's disposed before it's displayed). Only its dispose_op is applied.
+ @param pixels_stride bytes per row of the pixels
+ @param canvas        the canvas
+ @param stride        bytes per row of the canvas
+ @return Whether succeed.
+ */
+bool yy_png_compositor_render_pixels(yy_png_compositor *compositor,
+                                     uint32_t index,
+                                     const uint8_t *pixels,
+                                     size_t pixels_stride,
+                                     uint8_t *canvas,
+                                     size_t stride);
+
+/// Forget the canvas content, the next render starts from a cleared canvas.
+void yy_png_compositor_reset(yy_png_compositor *compositor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* YYAPNGCore_h */
@@ -46,11 +46,26 @@ NS_ASSUME_NONNULL_BEGIN
 + (nullable YYImage *)imageWithData:(NSData *)data;
 + (nullable YYImage *)imageWithData:(NSData *)data scale:(CGFloat)scale;
 
+/**
+ Creates an image which is downsampled to the target size when decoding.
+ 
+ @param data            Image data.
+ @param scale           Image's scale.
+ @param targetPixelSize The target size (in pixels), CGSizeZero means no limit.
+    See `targetPixelSize` in YYImageDecoder.
+ */
++ (nullable YYImage *)imageWithData:(NSData *)data scale:(CGFloat)scale targetPixelSize:(CGSize)targetPixelSize;
+
 /**
  If the image is created from data or file, then the value indicates the data type.
  */
 @property (nonatomic, readonly) YYImageType animatedImageType;
 
+/**
+ The target size (in pixels) which the image is downsampled to, CGSizeZero means no limit.
+ */
+@property (nonatomic, readonly) CGSize targetPixelSize;
+
 /**
  If the image is created from animated image data (multi-frame GIF/APNG/WebP),
  this property stores the original image data.
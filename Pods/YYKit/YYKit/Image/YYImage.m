@@ -61,6 +61,10 @@
     return [[self alloc] initWithData:data scale:scale];
 }
 
++ (YYImage *)imageWithData:(NSData *)data scale:(CGFloat)scale targetPixelSize:(CGSize)targetPixelSize {
+    return [[self alloc] initWithData:data scale:scale targetPixelSize:targetPixelSize];
+}
+
 - (instancetype)initWithContentsOfFile:(NSString *)path {
     NSData *data = [NSData dataWithContentsOfFile:path];
     return [self initWithData:data scale:path.pathScale];
@@ -71,17 +75,22 @@
 }
 
 - (instancetype)initWithData:(NSData *)data scale:(CGFloat)scale {
+    return [self initWithData:data scale:scale targetPixelSize:CGSizeZero];
+}
+
+- (instancetype)initWithData:(NSData *)data scale:(CGFloat)scale targetPixelSize:(CGSize)targetPixelSize {
     if (data.length == 0) return nil;
     if (scale <= 0) scale = [UIScreen mainScreen].scale;
     _preloadedLock = dispatch_semaphore_create(1);
     @autoreleasepool {
-        YYImageDecoder *decoder = [YYImageDecoder decoderWithData:data scale:scale];
+        YYImageDecoder *decoder = [YYImageDecoder decoderWithData:data scale:scale targetPixelSize:targetPixelSize];
         YYImageFrame *frame = [decoder frameAtIndex:0 decodeForDisplay:YES];
         UIImage *image = frame.image;
         if (!image) return nil;
         self = [self initWithCGImage:image.CGImage scale:decoder.scale orientation:image.imageOrientation];
         if (!self) return nil;
         _animatedImageType = decoder.type;
+        _targetPixelSize = decoder.targetPixelSize;
         if (decoder.frameCount > 1) {
             _decoder = decoder;
             _bytesPerFrame = CGImageGetBytesPerRow(image.CGImage) * CGImageGetHeight(image.CGImage);
@@ -125,7 +134,8 @@
     NSNumber *scale = [aDecoder decodeObjectForKey:@"YYImageScale"];
     NSData *data = [aDecoder decodeObjectForKey:@"YYImageData"];
     if (data.length) {
-        self = [self initWithData:data scale:scale.doubleValue];
+        CGSize targetPixelSize = [aDecoder decodeCGSizeForKey:@"YYImageTargetPixelSize"];
+        self = [self initWithData:data scale:scale.doubleValue targetPixelSize:targetPixelSize];
     } else {
         self = [super initWithCoder:aDecoder];
     }
@@ -136,6 +146,7 @@
     if (_decoder.data.length) {
         [aCoder encodeObject:@(self.scale) forKey:@"YYImageScale"];
         [aCoder encodeObject:_decoder.data forKey:@"YYImageData"];
+        [aCoder encodeCGSize:_targetPixelSize forKey:@"YYImageTargetPixelSize"];
     } else {
         [super encodeWithCoder:aCoder]; // Apple use UIImagePNGRepresentation() to encode UIImage.
     }
@@ -56,7 +56,12 @@ typedef NS_OPTIONS(NSUInteger, YYImageCacheType) {
 /** The name of the cache. Default is nil. */
 @property (nullable, copy) NSString *name;
 
-/** The underlying memory cache. see `YYMemoryCache` for more information.*/
+/** 
+ The underlying memory cache. see `YYMemoryCache` for more information.
+ 
+ @discussion Enable its `admissionFilterEnabled` to keep the frequently used 
+ images (such as avatars and emoticons) when a long list is scrolled through once.
+ */
 @property (strong, readonly) YYMemoryCache *memoryCache;
 
 /** The underlying disk cache. see `YYDiskCache` for more information.*/
@@ -205,6 +210,41 @@ typedef NS_OPTIONS(NSUInteger, YYImageCacheType) {
               withType:(YYImageCacheType)type
              withBlock:(void(^)(UIImage * _Nullable image, YYImageCacheType type))block;
 
+/**
+ Returns the image associated with a given key, downsampled to the target size.
+ 
+ @discussion The downsampled image is decoded from the image data in disk cache
+ (see `targetPixelSize` in YYImageDecoder), and stored in memory cache for the
+ key and size. The downsampled images of a key are removed from memory cache when
+ the key's image is set or removed, and a downsampled image decoded before that is
+ not stored. If the image is not in memory and the `type`
+ contains `YYImageCacheTypeDisk`, this method may blocks the calling thread until
+ file read finished.
+ 
+ @param key             A string identifying the image. If nil, just return nil.
+ @param targetPixelSize The target size (in pixels, rounded up to whole pixels), CGSizeZero
+                        means the original size.
+ @param type            The cache type.
+ @return The downsampled image associated with key, or nil if no image is associated with key.
+ */
+- (nullable UIImage *)getImageForKey:(NSString *)key
+                     targetPixelSize:(CGSize)targetPixelSize
+                            withType:(YYImageCacheType)type;
+
+/**
+ Asynchronously get the image associated with a given key, downsampled to the target size.
+ 
+ @param key             A string identifying the image. If nil, just return nil.
+ @param targetPixelSize The target size (in pixels, rounded up to whole pixels), CGSizeZero
+                        means the original size.
+ @param type            The cache type.
+ @param block           A completion block which will be called on main thread.
+ */
+- (void)getImageForKey:(NSString *)key
+       targetPixelSize:(CGSize)targetPixelSize
+              withType:(YYImageCacheType)type
+             withBlock:(void(^)(UIImage * _Nullable image, YYImageCacheType type))block;
+
 /**
  Returns the image data associated with a given key.
  This method may blocks the calling thread until file read finished.
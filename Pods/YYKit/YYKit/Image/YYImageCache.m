@@ -37,14 +37,91 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
 #endif
 }
 
+/// Round a target size up to whole pixels, so the sizes which give the same
+/// downsampled image share one variant.
+static inline CGSize YYImageCacheVariantPixelSize(CGSize targetPixelSize) {
+    return CGSizeMake(targetPixelSize.width > 0 ? ceil(targetPixelSize.width) : 0,
+                      targetPixelSize.height > 0 ? ceil(targetPixelSize.height) : 0);
+}
+
+
+/**
+ The memory cache key of a downsampled image. It's only equal to another variant
+ key, so it never collides with the string key of an original image.
+ */
+@interface _YYImageCacheVariantKey : NSObject <NSCopying>
+@property (nonatomic, readonly) NSString *key;
+@property (nonatomic, readonly) NSUInteger width;  ///< target width in whole pixels
+@property (nonatomic, readonly) NSUInteger height; ///< target height in whole pixels
+- (instancetype)initWithKey:(NSString *)key targetPixelSize:(CGSize)targetPixelSize;
+@end
+
+@implementation _YYImageCacheVariantKey {
+    NSUInteger _hash;
+}
+
+- (instancetype)initWithKey:(NSString *)key targetPixelSize:(CGSize)targetPixelSize {
+    self = [super init];
+    CGSize size = YYImageCacheVariantPixelSize(targetPixelSize);
+    _key = key.copy;
+    _width = (NSUInteger)size.width;
+    _height = (NSUInteger)size.height;
+    _hash = _key.hash ^ (_width * 31 + _height) * 0x9E3779B97F4A7C15ULL;
+    return self;
+}
+
+- (NSUInteger)hash {
+    return _hash;
+}
+
+- (BOOL)isEqual:(id)object {
+    if (object == self) return YES;
+    if (![object isKindOfClass:[_YYImageCacheVariantKey class]]) return NO;
+    _YYImageCacheVariantKey *other = object;
+    return _width == other->_width && _height == other->_height && [_key isEqualToString:other->_key];
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    return self; // immutable
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %@ %lux%lu>", self.class, _key, (unsigned long)_width, (unsigned long)_height];
+}
+
+@end
+
+
+/**
+ The downsampled images of a key in memory cache. It's removed when it has no
+ variant and no decoding in progress.
+ */
+@interface _YYImageCacheVariants : NSObject
+@property (nonatomic, readonly) NSMutableSet *keys; ///< memory cache keys (_YYImageCacheVariantKey) of the downsampled images
+@property (nonatomic) NSUInteger generation;        ///< increased when the key's image is changed or removed
+@property (nonatomic) NSUInteger decodingCount;     ///< downsampled images being decoded
+@end
+
+@implementation _YYImageCacheVariants
+- (instancetype)init {
+    self = [super init];
+    _keys = [NSMutableSet new];
+    return self;
+}
+@end
+
 
 @interface YYImageCache ()
 - (NSUInteger)imageCost:(UIImage *)image;
 - (UIImage *)imageFromData:(NSData *)data;
+- (UIImage *)imageFromData:(NSData *)data targetPixelSize:(CGSize)targetPixelSize;
 @end
 
 
-@implementation YYImageCache
+@implementation YYImageCache {
+    NSMutableDictionary *_variants; ///< key -> _YYImageCacheVariants
+    dispatch_semaphore_t _variantLock;
+}
 
 - (NSUInteger)imageCost:(UIImage *)image {
     CGImageRef cgImage = image.CGImage;
@@ -57,6 +134,10 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
 }
 
 - (UIImage *)imageFromData:(NSData *)data {
+    return [self imageFromData:data targetPixelSize:CGSizeZero];
+}
+
+- (UIImage *)imageFromData:(NSData *)data targetPixelSize:(CGSize)targetPixelSize {
     NSData *scaleData = [YYDiskCache getExtendedDataFromObject:data];
     CGFloat scale = 0;
     if (scaleData) {
@@ -65,15 +146,101 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
     if (scale <= 0) scale = [UIScreen mainScreen].scale;
     UIImage *image;
     if (_allowAnimatedImage) {
-        image = [[YYImage alloc] initWithData:data scale:scale];
+        image = [YYImage imageWithData:data scale:scale targetPixelSize:targetPixelSize];
         if (_decodeForDisplay) image = [image imageByDecoded];
     } else {
-        YYImageDecoder *decoder = [YYImageDecoder decoderWithData:data scale:scale];
+        YYImageDecoder *decoder = [YYImageDecoder decoderWithData:data scale:scale targetPixelSize:targetPixelSize];
         image = [decoder frameAtIndex:0 decodeForDisplay:_decodeForDisplay].image;
     }
     return image;
 }
 
+/// Remove the variants if it has no variant and no decoding, should be called in lock.
+- (void)_pruneVariants:(_YYImageCacheVariants *)variants forKey:(NSString *)key {
+    if (variants.keys.count == 0 && variants.decodingCount == 0) [_variants removeObjectForKey:key];
+}
+
+/**
+ Called before decoding a downsampled image which is not in memory cache (it may be
+ evicted, so its variant key is removed).
+ 
+ @return The generation of the key, pass it to `_endDecodingVariant:...`.
+ */
+- (NSUInteger)_beginDecodingVariant:(_YYImageCacheVariantKey *)variantKey forKey:(NSString *)key {
+    dispatch_semaphore_wait(_variantLock, DISPATCH_TIME_FOREVER);
+    _YYImageCacheVariants *variants = _variants[key];
+    if (!variants) {
+        variants = [_YYImageCacheVariants new];
+        _variants[key] = variants;
+    }
+    [variants.keys removeObject:variantKey];
+    variants.decodingCount++;
+    NSUInteger generation = variants.generation;
+    dispatch_semaphore_signal(_variantLock);
+    return generation;
+}
+
+/**
+ Called after decoding a downsampled image, the image is added to memory cache only
+ if the key's image is not changed or removed since the decoding began.
+ */
+- (void)_endDecodingVariant:(_YYImageCacheVariantKey *)variantKey forKey:(NSString *)key generation:(NSUInteger)generation image:(UIImage *)image {
+    dispatch_semaphore_wait(_variantLock, DISPATCH_TIME_FOREVER);
+    _YYImageCacheVariants *variants = _variants[key];
+    variants.decodingCount--;
+    if (image && variants.generation == generation) {
+        // in lock, so `_removeVariantsForKey:` can't miss it
+        [_memoryCache setObject:image forKey:variantKey withCost:[self imageCost:image]];
+        [variants.keys addObject:variantKey];
+    }
+    [self _pruneVariants:variants forKey:key];
+    dispatch_semaphore_signal(_variantLock);
+}
+
+/// The downsampled image is not in memory cache (it may be evicted), forget its key.
+- (void)_removeVariantKey:(_YYImageCacheVariantKey *)variantKey forKey:(NSString *)key {
+    dispatch_semaphore_wait(_variantLock, DISPATCH_TIME_FOREVER);
+    _YYImageCacheVariants *variants = _variants[key];
+    if (variants) {
+        [variants.keys removeObject:variantKey];
+        [self _pruneVariants:variants forKey:key];
+    }
+    dispatch_semaphore_signal(_variantLock);
+}
+
+- (void)_removeVariantsForKey:(NSString *)key {
+    if (!key) return;
+    dispatch_semaphore_wait(_variantLock, DISPATCH_TIME_FOREVER);
+    _YYImageCacheVariants *variants = _variants[key];
+    NSArray *variantKeys = variants.keys.allObjects;
+    variants.generation++;
+    [variants.keys removeAllObjects];
+    [self _pruneVariants:variants forKey:key];
+    dispatch_semaphore_signal(_variantLock);
+    for (_YYImageCacheVariantKey *variantKey in variantKeys) {
+        [_memoryCache removeObjectForKey:variantKey];
+    }
+}
+
+/// The memory cache removes all objects, forget the variant keys.
+- (void)_removeAllVariants {
+    dispatch_semaphore_wait(_variantLock, DISPATCH_TIME_FOREVER);
+    for (NSString *key in _variants.allKeys) {
+        _YYImageCacheVariants *variants = _variants[key];
+        [variants.keys removeAllObjects];
+        [self _pruneVariants:variants forKey:key];
+    }
+    dispatch_semaphore_signal(_variantLock);
+}
+
+- (void)_appDidReceiveMemoryWarningNotification {
+    if (_memoryCache.shouldRemoveAllObjectsOnMemoryWarning) [self _removeAllVariants];
+}
+
+- (void)_appDidEnterBackgroundNotification {
+    if (_memoryCache.shouldRemoveAllObjectsWhenEnteringBackground) [self _removeAllVariants];
+}
+
 #pragma mark Public
 
 + (instancetype)sharedCache {
@@ -112,15 +279,25 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
     _diskCache = diskCache;
     _allowAnimatedImage = YES;
     _decodeForDisplay = YES;
+    _variants = [NSMutableDictionary new];
+    _variantLock = dispatch_semaphore_create(1);
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_appDidReceiveMemoryWarningNotification) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_appDidEnterBackgroundNotification) name:UIApplicationDidEnterBackgroundNotification object:nil];
     return self;
 }
 
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidEnterBackgroundNotification object:nil];
+}
+
 - (void)setImage:(UIImage *)image forKey:(NSString *)key {
     [self setImage:image imageData:nil forKey:key withType:YYImageCacheTypeAll];
 }
 
 - (void)setImage:(UIImage *)image imageData:(NSData *)imageData forKey:(NSString *)key withType:(YYImageCacheType)type {
     if (!key || (image == nil && imageData.length == 0)) return;
+    [self _removeVariantsForKey:key];
     
     __weak typeof(self) _self = self;
     if (type & YYImageCacheTypeMemory) { // add to memory cache
@@ -166,6 +343,7 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
 }
 
 - (void)removeImageForKey:(NSString *)key withType:(YYImageCacheType)type {
+    [self _removeVariantsForKey:key];
     if (type & YYImageCacheTypeMemory) [_memoryCache removeObjectForKey:key];
     if (type & YYImageCacheTypeDisk) [_diskCache removeObjectForKey:key];
 }
@@ -238,6 +416,68 @@ static inline dispatch_queue_t YYImageCacheDecodeQueue() {
     });
 }
 
+- (UIImage *)getImageForKey:(NSString *)key targetPixelSize:(CGSize)targetPixelSize withType:(YYImageCacheType)type {
+    if (!key) return nil;
+    if (targetPixelSize.width <= 0 && targetPixelSize.height <= 0) return [self getImageForKey:key withType:type];
+    targetPixelSize = YYImageCacheVariantPixelSize(targetPixelSize);
+    _YYImageCacheVariantKey *variantKey = [[_YYImageCacheVariantKey alloc] initWithKey:key targetPixelSize:targetPixelSize];
+    if (type & YYImageCacheTypeMemory) {
+        UIImage *image = [_memoryCache objectForKey:variantKey];
+        if (image) return image;
+        if (!(type & YYImageCacheTypeDisk)) [self _removeVariantKey:variantKey forKey:key];
+    }
+    if (type & YYImageCacheTypeDisk) {
+        BOOL cacheable = (type & YYImageCacheTypeMemory) != 0;
+        NSUInteger generation = cacheable ? [self _beginDecodingVariant:variantKey forKey:key] : 0;
+        NSData *data = (id)[_diskCache objectForKey:key];
+        UIImage *image = [self imageFromData:data targetPixelSize:targetPixelSize];
+        if (cacheable) [self _endDecodingVariant:variantKey forKey:key generation:generation image:image];
+        return image;
+    }
+    return nil;
+}
+
+- (void)getImageForKey:(NSString *)key targetPixelSize:(CGSize)targetPixelSize withType:(YYImageCacheType)type withBlock:(void (^)(UIImage *image, YYImageCacheType type))block {
+    if (!block) return;
+    if (targetPixelSize.width <= 0 && targetPixelSize.height <= 0) {
+        [self getImageForKey:key withType:type withBlock:block];
+        return;
+    }
+    CGSize pixelSize = YYImageCacheVariantPixelSize(targetPixelSize);
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        UIImage *image = nil;
+        _YYImageCacheVariantKey *variantKey = key ? [[_YYImageCacheVariantKey alloc] initWithKey:key targetPixelSize:pixelSize] : nil;
+        
+        if (variantKey && (type & YYImageCacheTypeMemory)) {
+            image = [_memoryCache objectForKey:variantKey];
+            if (image) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    block(image, YYImageCacheTypeMemory);
+                });
+                return;
+            }
+            if (!(type & YYImageCacheTypeDisk)) [self _removeVariantKey:variantKey forKey:key];
+        }
+        
+        if (variantKey && (type & YYImageCacheTypeDisk)) {
+            NSUInteger generation = [self _beginDecodingVariant:variantKey forKey:key];
+            NSData *data = (id)[_diskCache objectForKey:key];
+            image = [self imageFromData:data targetPixelSize:pixelSize];
+            [self _endDecodingVariant:variantKey forKey:key generation:generation image:image];
+            if (image) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    block(image, YYImageCacheTypeDisk);
+                });
+                return;
+            }
+        }
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            block(nil, YYImageCacheTypeNone);
+        });
+    });
+}
+
 - (NSData *)getImageDataForKey:(NSString *)key {
     return (id)[_diskCache objectForKey:key];
 }
@@ -135,13 +135,35 @@ typedef NS_ENUM(NSUInteger, YYImageBlendOperation) {
 @property (nonatomic, readonly) NSUInteger height;         ///< Image canvas height.
 @property (nonatomic, readonly, getter=isFinalized) BOOL finalized;
 
+/**
+ The target size (in pixels) of the decoded frame images, CGSizeZero means no limit.
+ 
+ @discussion The frame images are downsampled to about the smallest size which
+ covers the target size, the aspect ratio is kept and the images are never upsampled.
+ ImageIO decodes the downsampled image directly (JPEG is scaled when decoding),
+ WebP is scaled by the WebP decoder, and other frames (APNG, blended frames) are
+ reduced with a box filter. ICO is not downsampled.
+ 
+ The `width`, `height` and the frame properties are still in the original size.
+ */
+@property (nonatomic, readonly) CGSize targetPixelSize;
+
 /**
  Creates an image decoder.
  
  @param scale  Image's scale.
  @return An image decoder.
  */
-- (instancetype)initWithScale:(CGFloat)scale NS_DESIGNATED_INITIALIZER;
+- (instancetype)initWithScale:(CGFloat)scale;
+
+/**
+ Creates an image decoder which downsamples the frame images.
+ 
+ @param scale           Image's scale.
+ @param targetPixelSize The target size of the decoded images (in pixels), see `targetPixelSize`.
+ @return An image decoder.
+ */
+- (instancetype)initWithScale:(CGFloat)scale targetPixelSize:(CGSize)targetPixelSize NS_DESIGNATED_INITIALIZER;
 
 /**
  Updates the incremental image with new data.
@@ -150,6 +172,9 @@ typedef NS_ENUM(NSUInteger, YYImageBlendOperation) {
  image when you do not have the complete image data. The `data` was retained by
  decoder, you should not modify the data in other thread during decoding.
  
+ For APNG and WebP, the frames are available (frameCount increases) as soon as
+ they are complete, and the frames parsed by previous calls are not parsed again.
+ 
  @param data  The data to add to the image decoder. Each time you call this 
  function, the 'data' parameter must contain all of the image file data 
  accumulated so far.
@@ -170,6 +195,15 @@ typedef NS_ENUM(NSUInteger, YYImageBlendOperation) {
  */
 + (nullable instancetype)decoderWithData:(NSData *)data scale:(CGFloat)scale;
 
+/**
+ Convenience method to create a decoder with specified data, which downsamples the frame images.
+ @param data            Image data.
+ @param scale           Image's scale.
+ @param targetPixelSize The target size of the decoded images (in pixels), see `targetPixelSize`.
+ @return A new decoder, or nil if an error occurs.
+ */
++ (nullable instancetype)decoderWithData:(NSData *)data scale:(CGFloat)scale targetPixelSize:(CGSize)targetPixelSize;
+
 /**
  Decodes and returns a frame from a specified index.
  @param index  Frame image index (zero-based).
@@ -179,6 +213,25 @@ typedef NS_ENUM(NSUInteger, YYImageBlendOperation) {
  */
 - (nullable YYImageFrame *)frameAtIndex:(NSUInteger)index decodeForDisplay:(BOOL)decodeForDisplay;
 
+/**
+ Decodes and returns the frames in a specified range, the frame images are decoded
+ concurrently.
+
+ @discussion If the frames don't need blend, each frame is decoded in parallel.
+ Otherwise (APNG, WebP), the frame pixels are decoded in parallel, then blended
+ in order on a private canvas from the `blendFromIndex` of the first frame in range.
+ It's faster than calling `frameAtIndex:decodeForDisplay:` for each frame on a
+ multi-core device, and doesn't affect the following `frameAtIndex:decodeForDisplay:`
+ calls.
+
+ @param range  Frame index range (zero-based).
+ @param decodeForDisplay Whether decode the images to memory bitmap for display.
+    If NO, it will try to returns the original frame data without blend.
+ @return The new frames in range, the image of a frame is nil if an error occurs
+    when decoding it. Returns nil if the range is out of bounds or an error occurs.
+ */
+- (nullable NSArray<YYImageFrame *> *)framesInRange:(NSRange)range decodeForDisplay:(BOOL)decodeForDisplay;
+
 /**
  Returns the frame duration from a specified index.
  @param index  Frame image (zero-based).
@@ -20,6 +20,8 @@
 #import <pthread.h>
 #import <zlib.h>
 #import "YYImage.h"
+#import "YYAPNGCore.h"
+#import "YYImagePixel.h"
 #import "YYKitMacro.h"
 
 #ifndef YYIMAGE_WEBP_ENABLED
@@ -66,567 +68,6 @@ static inline uint32_t yy_swap_endian_uint32(uint32_t value) {
     (uint32_t)((value & 0xFF000000U) >> 24) ;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-#pragma mark - APNG
-
-/*
- PNG  spec: http://www.libpng.org/pub/png/spec/1.2/PNG-Structure.html
- APNG spec: https://wiki.mozilla.org/APNG_Specification
- 
- ===============================================================================
- PNG format:
- header (8): 89 50 4e 47 0d 0a 1a 0a
- chunk, chunk, chunk, ...
- 
- ===============================================================================
- chunk format:
- length (4): uint32_t big endian
- fourcc (4): chunk type code
- data   (length): data
- crc32  (4): uint32_t big endian crc32(fourcc + data)
- 
- ===============================================================================
- PNG chunk define:
- 
- IHDR (Image Header) required, must appear first, 13 bytes
- width              (4) pixel count, should not be zero
- height             (4) pixel count, should not be zero
- bit depth          (1) expected: 1, 2, 4, 8, 16
- color type         (1) 1<<0 (palette used), 1<<1 (color used), 1<<2 (alpha channel used)
- compression method (1) 0 (deflate/inflate)
- filter method      (1) 0 (adaptive filtering with five basic filter types)
- interlace method   (1) 0 (no interlace) or 1 (Adam7 interlace)
- 
- IDAT (Image Data) required, must appear consecutively if there's multiple 'IDAT' chunk
- 
- IEND (End) required, must appear last, 0 bytes
- 
- ===============================================================================
- APNG chunk define:
- 
- acTL (Animation Control) required, must appear before 'IDAT', 8 bytes
- num frames     (4) number of frames
- num plays      (4) number of times to loop, 0 indicates infinite looping
- 
- fcTL (Frame Control) required, must appear before the 'IDAT' or 'fdAT' chunks of the frame to which it applies, 26 bytes
- sequence number   (4) sequence number of the animation chunk, starting from 0
- width             (4) width of the following frame
- height            (4) height of the following frame
- x offset          (4) x position at which to render the following frame
- y offset          (4) y position at which to render the following frame
- delay num         (2) frame delay fraction numerator
- delay den         (2) frame delay fraction denominator
- dispose op        (1) type of frame area disposal to be done after rendering this frame (0:none, 1:background 2:previous)
- blend op          (1) type of frame area rendering for this frame (0:source, 1:over)
- 
- fdAT (Frame Data) required
- sequence number   (4) sequence number of the animation chunk
- frame data        (x) frame data for this frame (same as 'IDAT')
- 
- ===============================================================================
- `dispose_op` specifies how the output buffer should be changed at the end of the delay 
- (before rendering the next frame).
- 
- * NONE: no disposal is done on this frame before rendering the next; the contents
-    of the output buffer are left as is.
- * BACKGROUND: the frame's region of the output buffer is to be cleared to fully
-    transparent black before rendering the next frame.
- * PREVIOUS: the frame's region of the output buffer is to be reverted to the previous
-    contents before rendering the next frame.
-
- `blend_op` specifies whether the frame is to be alpha blended into the current output buffer
- content, or whether it should completely replace its region in the output buffer.
- 
- * SOURCE: all color components of the frame, including alpha, overwrite the current contents
-    of the frame's output buffer region. 
- * OVER: the frame should be composited onto the output buffer based on its alpha,
-    using a simple OVER operation as described in the "Alpha Channel Processing" section
-    of the PNG specification
- */
-
-typedef enum {
-    YY_PNG_ALPHA_TYPE_PALEETE = 1 << 0,
-    YY_PNG_ALPHA_TYPE_COLOR = 1 << 1,
-    YY_PNG_ALPHA_TYPE_ALPHA = 1 << 2,
-} yy_png_alpha_type;
-
-typedef enum {
-    YY_PNG_DISPOSE_OP_NONE = 0,
-    YY_PNG_DISPOSE_OP_BACKGROUND = 1,
-    YY_PNG_DISPOSE_OP_PREVIOUS = 2,
-} yy_png_dispose_op;
-
-typedef enum {
-    YY_PNG_BLEND_OP_SOURCE = 0,
-    YY_PNG_BLEND_OP_OVER = 1,
-} yy_png_blend_op;
-
-typedef struct {
-    uint32_t width;             ///< pixel count, should not be zero
-    uint32_t height;            ///< pixel count, should not be zero
-    uint8_t bit_depth;          ///< expected: 1, 2, 4, 8, 16
-    uint8_t color_type;         ///< see yy_png_alpha_type
-    uint8_t compression_method; ///< 0 (deflate/inflate)
-    uint8_t filter_method;      ///< 0 (adaptive filtering with five basic filter types)
-    uint8_t interlace_method;   ///< 0 (no interlace) or 1 (Adam7 interlace)
-} yy_png_chunk_IHDR;
-
-typedef struct {
-    uint32_t sequence_number;  ///< sequence number of the animation chunk, starting from 0
-    uint32_t width;            ///< width of the following frame
-    uint32_t height;           ///< height of the following frame
-    uint32_t x_offset;         ///< x position at which to render the following frame
-    uint32_t y_offset;         ///< y position at which to render the following frame
-    uint16_t delay_num;        ///< frame delay fraction numerator
-    uint16_t delay_den;        ///< frame delay fraction denominator
-    uint8_t dispose_op;        ///< see yy_png_dispose_op
-    uint8_t blend_op;          ///< see yy_png_blend_op
-} yy_png_chunk_fcTL;
-
-typedef struct {
-    uint32_t offset; ///< chunk offset in PNG data
-    uint32_t fourcc; ///< chunk fourcc
-    uint32_t length; ///< chunk data length
-    uint32_t crc32;  ///< chunk crc32
-} yy_png_chunk_info;
-
-typedef struct {
-    uint32_t chunk_index; ///< the first `fdAT`/`IDAT` chunk index
-    uint32_t chunk_num;   ///< the `fdAT`/`IDAT` chunk count
-    uint32_t chunk_size;  ///< the `fdAT`/`IDAT` chunk bytes
-    yy_png_chunk_fcTL frame_control;
-} yy_png_frame_info;
-
-typedef struct {
-    yy_png_chunk_IHDR header;   ///< png header
-    yy_png_chunk_info *chunks;      ///< chunks
-    uint32_t chunk_num;          ///< count of chunks
-    
-    yy_png_frame_info *apng_frames; ///< frame info, NULL if not apng
-    uint32_t apng_frame_num;     ///< 0 if not apng
-    uint32_t apng_loop_num;      ///< 0 indicates infinite looping
-    
-    uint32_t *apng_shared_chunk_indexs; ///< shared chunk index
-    uint32_t apng_shared_chunk_num;     ///< shared chunk count
-    uint32_t apng_shared_chunk_size;    ///< shared chunk bytes
-    uint32_t apng_shared_insert_index;  ///< shared chunk insert index
-    bool apng_first_frame_is_cover;     ///< the first frame is same as png (cover)
-} yy_png_info;
-
-static void yy_png_chunk_IHDR_read(yy_png_chunk_IHDR *IHDR, const uint8_t *data) {
-    IHDR->width = yy_swap_endian_uint32(*((uint32_t *)(data)));
-    IHDR->height = yy_swap_endian_uint32(*((uint32_t *)(data + 4)));
-    IHDR->bit_depth = data[8];
-    IHDR->color_type = data[9];
-    IHDR->compression_method = data[10];
-    IHDR->filter_method = data[11];
-    IHDR->interlace_method = data[12];
-}
-
-static void yy_png_chunk_IHDR_write(yy_png_chunk_IHDR *IHDR, uint8_t *data) {
-    *((uint32_t *)(data)) = yy_swap_endian_uint32(IHDR->width);
-    *((uint32_t *)(data + 4)) = yy_swap_endian_uint32(IHDR->height);
-    data[8] = IHDR->bit_depth;
-    data[9] = IHDR->color_type;
-    data[10] = IHDR->compression_method;
-    data[11] = IHDR->filter_method;
-    data[12] = IHDR->interlace_method;
-}
-
-static void yy_png_chunk_fcTL_read(yy_png_chunk_fcTL *fcTL, const uint8_t *data) {
-    fcTL->sequence_number = yy_swap_endian_uint32(*((uint32_t *)(data)));
-    fcTL->width = yy_swap_endian_uint32(*((uint32_t *)(data + 4)));
-    fcTL->height = yy_swap_endian_uint32(*((uint32_t *)(data + 8)));
-    fcTL->x_offset = yy_swap_endian_uint32(*((uint32_t *)(data + 12)));
-    fcTL->y_offset = yy_swap_endian_uint32(*((uint32_t *)(data + 16)));
-    fcTL->delay_num = yy_swap_endian_uint16(*((uint16_t *)(data + 20)));
-    fcTL->delay_den = yy_swap_endian_uint16(*((uint16_t *)(data + 22)));
-    fcTL->dispose_op = data[24];
-    fcTL->blend_op = data[25];
-}
-
-static void yy_png_chunk_fcTL_write(yy_png_chunk_fcTL *fcTL, uint8_t *data) {
-    *((uint32_t *)(data)) = yy_swap_endian_uint32(fcTL->sequence_number);
-    *((uint32_t *)(data + 4)) = yy_swap_endian_uint32(fcTL->width);
-    *((uint32_t *)(data + 8)) = yy_swap_endian_uint32(fcTL->height);
-    *((uint32_t *)(data + 12)) = yy_swap_endian_uint32(fcTL->x_offset);
-    *((uint32_t *)(data + 16)) = yy_swap_endian_uint32(fcTL->y_offset);
-    *((uint16_t *)(data + 20)) = yy_swap_endian_uint16(fcTL->delay_num);
-    *((uint16_t *)(data + 22)) = yy_swap_endian_uint16(fcTL->delay_den);
-    data[24] = fcTL->dispose_op;
-    data[25] = fcTL->blend_op;
-}
-
-// convert double value to fraction
-static void yy_png_delay_to_fraction(double duration, uint16_t *num, uint16_t *den) {
-    if (duration >= 0xFF) {
-        *num = 0xFF;
-        *den = 1;
-    } else if (duration <= 1.0 / (double)0xFF) {
-        *num = 1;
-        *den = 0xFF;
-    } else {
-        // Use continued fraction to calculate the num and den.
-        long MAX = 10;
-        double eps = (0.5 / (double)0xFF);
-        long p[MAX], q[MAX], a[MAX], i, numl = 0, denl = 0;
-        // The first two convergents are 0/1 and 1/0
-        p[0] = 0; q[0] = 1;
-        p[1] = 1; q[1] = 0;
-        // The rest of the convergents (and continued fraction)
-        for (i = 2; i < MAX; i++) {
-            a[i] = lrint(floor(duration));
-            p[i] = a[i] * p[i - 1] + p[i - 2];
-            q[i] = a[i] * q[i - 1] + q[i - 2];
-            if (p[i] <= 0xFF && q[i] <= 0xFF) { // uint16_t
-                numl = p[i];
-                denl = q[i];
-            } else break;
-            if (fabs(duration - a[i]) < eps) break;
-            duration = 1.0 / (duration - a[i]);
-        }
-        
-        if (numl != 0 && denl != 0) {
-            *num = numl;
-            *den = denl;
-        } else {
-            *num = 1;
-            *den = 100;
-        }
-    }
-}
-
-// convert fraction to double value
-static double yy_png_delay_to_seconds(uint16_t num, uint16_t den) {
-    if (den == 0) {
-        return num / 100.0;
-    } else {
-        return (double)num / (double)den;
-    }
-}
-
-static bool yy_png_validate_animation_chunk_order(yy_png_chunk_info *chunks,  /* input */
-                                                  uint32_t chunk_num,         /* input */
-                                                  uint32_t *first_idat_index, /* output */
-                                                  bool *first_frame_is_cover  /* output */) {
-    /*
-     PNG at least contains 3 chunks: IHDR, IDAT, IEND.
-     `IHDR` must appear first.
-     `IDAT` must appear consecutively.
-     `IEND` must appear end.
-     
-     APNG must contains one `acTL` and at least one 'fcTL' and `fdAT`.
-     `fdAT` must appear consecutively.
-     `fcTL` must appear before `IDAT` or `fdAT`.
-     */
-    if (chunk_num <= 2) return false;
-    if (chunks->fourcc != YY_FOUR_CC('I', 'H', 'D', 'R')) return false;
-    if ((chunks + chunk_num - 1)->fourcc != YY_FOUR_CC('I', 'E', 'N', 'D')) return false;
-    
-    uint32_t prev_fourcc = 0;
-    uint32_t IHDR_num = 0;
-    uint32_t IDAT_num = 0;
-    uint32_t acTL_num = 0;
-    uint32_t fcTL_num = 0;
-    uint32_t first_IDAT = 0;
-    bool first_frame_cover = false;
-    for (uint32_t i = 0; i < chunk_num; i++) {
-        yy_png_chunk_info *chunk = chunks + i;
-        switch (chunk->fourcc) {
-            case YY_FOUR_CC('I', 'H', 'D', 'R'): {  // png header
-                if (i != 0) return false;
-                if (IHDR_num > 0) return false;
-                IHDR_num++;
-            } break;
-            case YY_FOUR_CC('I', 'D', 'A', 'T'): {  // png data
-                if (prev_fourcc != YY_FOUR_CC('I', 'D', 'A', 'T')) {
-                    if (IDAT_num == 0)
-                        first_IDAT = i;
-                    else
-                        return false;
-                }
-                IDAT_num++;
-            } break;
-            case YY_FOUR_CC('a', 'c', 'T', 'L'): {  // apng control
-                if (acTL_num > 0) return false;
-                acTL_num++;
-            } break;
-            case YY_FOUR_CC('f', 'c', 'T', 'L'): {  // apng frame control
-                if (i + 1 == chunk_num) return false;
-                if ((chunk + 1)->fourcc != YY_FOUR_CC('f', 'd', 'A', 'T') &&
-                    (chunk + 1)->fourcc != YY_FOUR_CC('I', 'D', 'A', 'T')) {
-                    return false;
-                }
-                if (fcTL_num == 0) {
-                    if ((chunk + 1)->fourcc == YY_FOUR_CC('I', 'D', 'A', 'T')) {
-                        first_frame_cover = true;
-                    }
-                }
-                fcTL_num++;
-            } break;
-            case YY_FOUR_CC('f', 'd', 'A', 'T'): {  // apng data
-                if (prev_fourcc != YY_FOUR_CC('f', 'd', 'A', 'T') && prev_fourcc != YY_FOUR_CC('f', 'c', 'T', 'L')) {
-                    return false;
-                }
-            } break;
-        }
-        prev_fourcc = chunk->fourcc;
-    }
-    if (IHDR_num != 1) return false;
-    if (IDAT_num == 0) return false;
-    if (acTL_num != 1) return false;
-    if (fcTL_num < acTL_num) return false;
-    *first_idat_index = first_IDAT;
-    *first_frame_is_cover = first_frame_cover;
-    return true;
-}
-
-static void yy_png_info_release(yy_png_info *info) {
-    if (info) {
-        if (info->chunks) free(info->chunks);
-        if (info->apng_frames) free(info->apng_frames);
-        if (info->apng_shared_chunk_indexs) free(info->apng_shared_chunk_indexs);
-        free(info);
-    }
-}
-
-/**
- Create a png info from a png file. See struct png_info for more information.
- 
- @param data   png/apng file data.
- @param length the data's length in bytes.
- @return A png info object, you may call yy_png_info_release() to release it.
- Returns NULL if an error occurs.
- */
-static yy_png_info *yy_png_info_create(const uint8_t *data, uint32_t length) {
-    if (length < 32) return NULL;
-    if (*((uint32_t *)data) != YY_FOUR_CC(0x89, 0x50, 0x4E, 0x47)) return NULL;
-    if (*((uint32_t *)(data + 4)) != YY_FOUR_CC(0x0D, 0x0A, 0x1A, 0x0A)) return NULL;
-    
-    uint32_t chunk_realloc_num = 16;
-    yy_png_chunk_info *chunks = malloc(sizeof(yy_png_chunk_info) * chunk_realloc_num);
-    if (!chunks) return NULL;
-    
-    // parse png chunks
-    uint32_t offset = 8;
-    uint32_t chunk_num = 0;
-    uint32_t chunk_capacity = chunk_realloc_num;
-    uint32_t apng_loop_num = 0;
-    int32_t apng_sequence_index = -1;
-    int32_t apng_frame_index = 0;
-    int32_t apng_frame_number = -1;
-    bool apng_chunk_error = false;
-    do {
-        if (chunk_num >= chunk_capacity) {
-            yy_png_chunk_info *new_chunks = realloc(chunks, sizeof(yy_png_chunk_info) * (chunk_capacity + chunk_realloc_num));
-            if (!new_chunks) {
-                free(chunks);
-                return NULL;
-            }
-            chunks = new_chunks;
-            chunk_capacity += chunk_realloc_num;
-        }
-        yy_png_chunk_info *chunk = chunks + chunk_num;
-        const uint8_t *chunk_data = data + offset;
-        chunk->offset = offset;
-        chunk->length = yy_swap_endian_uint32(*((uint32_t *)chunk_data));
-        if ((uint64_t)chunk->offset + (uint64_t)chunk->length + 12 > length) {
-            free(chunks);
-            return NULL;
-        }
-        
-        chunk->fourcc = *((uint32_t *)(chunk_data + 4));
-        if ((uint64_t)chunk->offset + 4 + chunk->length + 4 > (uint64_t)length) break;
-        chunk->crc32 = yy_swap_endian_uint32(*((uint32_t *)(chunk_data + 8 + chunk->length)));
-        chunk_num++;
-        offset += 12 + chunk->length;
-        
-        switch (chunk->fourcc) {
-            case YY_FOUR_CC('a', 'c', 'T', 'L') : {
-                if (chunk->length == 8) {
-                    apng_frame_number = yy_swap_endian_uint32(*((uint32_t *)(chunk_data + 8)));
-                    apng_loop_num = yy_swap_endian_uint32(*((uint32_t *)(chunk_data + 12)));
-                } else {
-                    apng_chunk_error = true;
-                }
-            } break;
-            case YY_FOUR_CC('f', 'c', 'T', 'L') :
-            case YY_FOUR_CC('f', 'd', 'A', 'T') : {
-                if (chunk->fourcc == YY_FOUR_CC('f', 'c', 'T', 'L')) {
-                    if (chunk->length != 26) {
-                        apng_chunk_error = true;
-                    } else {
-                        apng_frame_index++;
-                    }
-                }
-                if (chunk->length > 4) {
-                    uint32_t sequence = yy_swap_endian_uint32(*((uint32_t *)(chunk_data + 8)));
-                    if (apng_sequence_index + 1 == sequence) {
-                        apng_sequence_index++;
-                    } else {
-                        apng_chunk_error = true;
-                    }
-                } else {
-                    apng_chunk_error = true;
-                }
-            } break;
-            case YY_FOUR_CC('I', 'E', 'N', 'D') : {
-                offset = length; // end, break do-while loop
-            } break;
-        }
-    } while (offset + 12 <= length);
-    
-    if (chunk_num < 3 ||
-        chunks->fourcc != YY_FOUR_CC('I', 'H', 'D', 'R') ||
-        chunks->length != 13) {
-        free(chunks);
-        return NULL;
-    }
-    
-    // png info
-    yy_png_info *info = calloc(1, sizeof(yy_png_info));
-    if (!info) {
-        free(chunks);
-        return NULL;
-    }
-    info->chunks = chunks;
-    info->chunk_num = chunk_num;
-    yy_png_chunk_IHDR_read(&info->header, data + chunks->offset + 8);
-    
-    // apng info
-    if (!apng_chunk_error && apng_frame_number == apng_frame_index && apng_frame_number >= 1) {
-        bool first_frame_is_cover = false;
-        uint32_t first_IDAT_index = 0;
-        if (!yy_png_validate_animation_chunk_order(info->chunks, info->chunk_num, &first_IDAT_index, &first_frame_is_cover)) {
-            return info; // ignore apng chunk
-        }
-        
-        info->apng_loop_num = apng_loop_num;
-        info->apng_frame_num = apng_frame_number;
-        info->apng_first_frame_is_cover = first_frame_is_cover;
-        info->apng_shared_insert_index = first_IDAT_index;
-        info->apng_frames = calloc(apng_frame_number, sizeof(yy_png_frame_info));
-        if (!info->apng_frames) {
-            yy_png_info_release(info);
-            return NULL;
-        }
-        info->apng_shared_chunk_indexs = calloc(info->chunk_num, sizeof(uint32_t));
-        if (!info->apng_shared_chunk_indexs) {
-            yy_png_info_release(info);
-            return NULL;
-        }
-        
-        int32_t frame_index = -1;
-        uint32_t *shared_chunk_index = info->apng_shared_chunk_indexs;
-        for (int32_t i = 0; i < info->chunk_num; i++) {
-            yy_png_chunk_info *chunk = info->chunks + i;
-            switch (chunk->fourcc) {
-                case YY_FOUR_CC('I', 'D', 'A', 'T'): {
-                    if (info->apng_shared_insert_index == 0) {
-                        info->apng_shared_insert_index = i;
-                    }
-                    if (first_frame_is_cover) {
-                        yy_png_frame_info *frame = info->apng_frames + frame_index;
-                        frame->chunk_num++;
-                        frame->chunk_size += chunk->length + 12;
-                    }
-                } break;
-                case YY_FOUR_CC('a', 'c', 'T', 'L'): {
-                } break;
-                case YY_FOUR_CC('f', 'c', 'T', 'L'): {
-                    frame_index++;
-                    yy_png_frame_info *frame = info->apng_frames + frame_index;
-                    frame->chunk_index = i + 1;
-                    yy_png_chunk_fcTL_read(&frame->frame_control, data + chunk->offset + 8);
-                } break;
-                case YY_FOUR_CC('f', 'd', 'A', 'T'): {
-                    yy_png_frame_info *frame = info->apng_frames + frame_index;
-                    frame->chunk_num++;
-                    frame->chunk_size += chunk->length + 12;
-                } break;
-                default: {
-                    *shared_chunk_index = i;
-                    shared_chunk_index++;
-                    info->apng_shared_chunk_size += chunk->length + 12;
-                    info->apng_shared_chunk_num++;
-                } break;
-            }
-        }
-    }
-    return info;
-}
-
-/**
- Copy a png frame data from an apng file.
- 
- @param data  apng file data
- @param info  png info
- @param index frame index (zero-based)
- @param size  output, the size of the frame data
- @return A frame data (single-frame png file), call free() to release the data.
- Returns NULL if an error occurs.
- */
-static uint8_t *yy_png_copy_frame_data_at_index(const uint8_t *data,
-                                                const yy_png_info *info,
-                                                const uint32_t index,
-                                                uint32_t *size) {
-    if (index >= info->apng_frame_num) return NULL;
-    
-    yy_png_frame_info *frame_info = info->apng_frames + index;
-    uint32_t frame_remux_size = 8 /* PNG Header */ + info->apng_shared_chunk_size + frame_info->chunk_size;
-    if (!(info->apng_first_frame_is_cover && index == 0)) {
-        frame_remux_size -= frame_info->chunk_num * 4; // remove fdAT sequence number
-    }
-    uint8_t *frame_data = malloc(frame_remux_size);
-    if (!frame_data) return NULL;
-    *size = frame_remux_size;
-    
-    uint32_t data_offset = 0;
-    bool inserted = false;
-    memcpy(frame_data, data, 8); // PNG File Header
-    data_offset += 8;
-    for (uint32_t i = 0; i < info->apng_shared_chunk_num; i++) {
-        uint32_t shared_chunk_index = info->apng_shared_chunk_indexs[i];
-        yy_png_chunk_info *shared_chunk_info = info->chunks + shared_chunk_index;
-        
-        if (shared_chunk_index >= info->apng_shared_insert_index && !inserted) { // replace IDAT with fdAT
-            inserted = true;
-            for (uint32_t c = 0; c < frame_info->chunk_num; c++) {
-                yy_png_chunk_info *insert_chunk_info = info->chunks + frame_info->chunk_index + c;
-                if (insert_chunk_info->fourcc == YY_FOUR_CC('f', 'd', 'A', 'T')) {
-                    *((uint32_t *)(frame_data + data_offset)) = yy_swap_endian_uint32(insert_chunk_info->length - 4);
-                    *((uint32_t *)(frame_data + data_offset + 4)) = YY_FOUR_CC('I', 'D', 'A', 'T');
-                    memcpy(frame_data + data_offset + 8, data + insert_chunk_info->offset + 12, insert_chunk_info->length - 4);
-                    uint32_t crc = (uint32_t)crc32(0, frame_data + data_offset + 4, insert_chunk_info->length);
-                    *((uint32_t *)(frame_data + data_offset + insert_chunk_info->length + 4)) = yy_swap_endian_uint32(crc);
-                    data_offset += insert_chunk_info->length + 8;
-                } else { // IDAT
-                    memcpy(frame_data + data_offset, data + insert_chunk_info->offset, insert_chunk_info->length + 12);
-                    data_offset += insert_chunk_info->length + 12;
-                }
-            }
-        }
-        
-        if (shared_chunk_info->fourcc == YY_FOUR_CC('I', 'H', 'D', 'R')) {
-            uint8_t tmp[25] = {0};
-            memcpy(tmp, data + shared_chunk_info->offset, 25);
-            yy_png_chunk_IHDR IHDR = info->header;
-            IHDR.width = frame_info->frame_control.width;
-            IHDR.height = frame_info->frame_control.height;
-            yy_png_chunk_IHDR_write(&IHDR, tmp + 8);
-            *((uint32_t *)(tmp + 21)) = yy_swap_endian_uint32((uint32_t)crc32(0, tmp + 4, 17));
-            memcpy(frame_data + data_offset, tmp, 25);
-            data_offset += 25;
-        } else {
-            memcpy(frame_data + data_offset, data + shared_chunk_info->offset, shared_chunk_info->length + 12);
-            data_offset += shared_chunk_info->length + 12;
-        }
-    }
-    return frame_data;
-}
-
-
-
 ////////////////////////////////////////////////////////////////////////////////
 #pragma mark - Helper
 
@@ -678,6 +119,32 @@ static void YYCGDataProviderReleaseDataCallback(void *info, const void *data, si
     if (info) free(info);
 }
 
+/// Returns the length scaled by the downsample factor (at least 1).
+static inline size_t YYImageDownsampledLength(size_t length, CGFloat factor) {
+    if (factor >= 1) return length;
+    return MAX((size_t)1, (size_t)lround(length * factor));
+}
+
+/**
+ Create an image with a premultiplied BGRA bitmap buffer
+ (kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst).
+ 
+ @param pixels A buffer created with malloc(), it's hold by the image, and is
+               released even if this function failed.
+ @param space  The color space of the pixels, NULL means device RGB.
+ */
+static CGImageRef YYCGImageCreateWithBGRABuffer(void *pixels, size_t width, size_t height, size_t bytesPerRow, CGColorSpaceRef space) {
+    CGDataProviderRef provider = CGDataProviderCreateWithData(pixels, pixels, bytesPerRow * height, YYCGDataProviderReleaseDataCallback);
+    if (!provider) {
+        free(pixels);
+        return NULL;
+    }
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst;
+    CGImageRef imageRef = CGImageCreate(width, height, 8, 32, bytesPerRow, space ? space : YYCGColorSpaceGetDeviceRGB(), bitmapInfo, provider, NULL, false, kCGRenderingIntentDefault);
+    CFRelease(provider);
+    return imageRef;
+}
+
 /**
  Decode an image to bitmap buffer with the specified format.
  
@@ -1509,9 +976,13 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     
     BOOL _sourceTypeDetected;
     CGImageSourceRef _source;
-    yy_png_info *_apngSource;
+    yy_png_parser *_apngParser;
+    const yy_png_info *_apngSource; ///< owned by _apngParser, the complete frames so far
+    yy_png_compositor *_apngCompositor;
+    CGColorSpaceRef _apngColorSpace; ///< color space declared by the apng's chunks, NULL means device RGB
 #if YYIMAGE_WEBP_ENABLED
     WebPDemuxer *_webpSource;
+    NSUInteger _webpLastBlendIndex; ///< blendFromIndex of the next webp frame if it's not full size
 #endif
     
     UIImageOrientation _orientation;
@@ -1519,22 +990,28 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     NSArray *_frames; ///< Array<GGImageDecoderFrame>, without image
     BOOL _needBlend;
     NSUInteger _blendFrameIndex;
-    CGContextRef _blendCanvas;
+    uint8_t *_blendCanvas; ///< BGRA premultiplied, _width * _height, bytesPerRow is _width * 4, top row first
 }
 
 - (void)dealloc {
     if (_source) CFRelease(_source);
-    if (_apngSource) yy_png_info_release(_apngSource);
+    if (_apngCompositor) yy_png_compositor_release(_apngCompositor);
+    if (_apngParser) yy_png_parser_release(_apngParser);
+    if (_apngColorSpace) CFRelease(_apngColorSpace);
 #if YYIMAGE_WEBP_ENABLED
     if (_webpSource) WebPDemuxDelete(_webpSource);
 #endif
-    if (_blendCanvas) CFRelease(_blendCanvas);
+    if (_blendCanvas) free(_blendCanvas);
     pthread_mutex_destroy(&_lock);
 }
 
 + (instancetype)decoderWithData:(NSData *)data scale:(CGFloat)scale {
+    return [self decoderWithData:data scale:scale targetPixelSize:CGSizeZero];
+}
+
++ (instancetype)decoderWithData:(NSData *)data scale:(CGFloat)scale targetPixelSize:(CGSize)targetPixelSize {
     if (!data) return nil;
-    YYImageDecoder *decoder = [[YYImageDecoder alloc] initWithScale:scale];
+    YYImageDecoder *decoder = [[YYImageDecoder alloc] initWithScale:scale targetPixelSize:targetPixelSize];
     [decoder updateData:data final:YES];
     if (decoder.frameCount == 0) return nil;
     return decoder;
@@ -1545,9 +1022,14 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
 }
 
 - (instancetype)initWithScale:(CGFloat)scale {
+    return [self initWithScale:scale targetPixelSize:CGSizeZero];
+}
+
+- (instancetype)initWithScale:(CGFloat)scale targetPixelSize:(CGSize)targetPixelSize {
     self = [super init];
     if (scale <= 0) scale = 1;
     _scale = scale;
+    _targetPixelSize = CGSizeMake(MAX(targetPixelSize.width, 0), MAX(targetPixelSize.height, 0));
     _framesLock = dispatch_semaphore_create(1);
     pthread_mutex_init_recursive(&_lock, true);
     return self;
@@ -1569,6 +1051,14 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     return result;
 }
 
+- (NSArray<YYImageFrame *> *)framesInRange:(NSRange)range decodeForDisplay:(BOOL)decodeForDisplay {
+    NSArray *result = nil;
+    pthread_mutex_lock(&_lock);
+    result = [self _framesInRange:range decodeForDisplay:decodeForDisplay];
+    pthread_mutex_unlock(&_lock);
+    return result;
+}
+
 - (NSTimeInterval)frameDurationAtIndex:(NSUInteger)index {
     NSTimeInterval result = 0;
     dispatch_semaphore_wait(_framesLock, DISPATCH_TIME_FOREVER);
@@ -1623,27 +1113,14 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
 - (YYImageFrame *)_frameAtIndex:(NSUInteger)index decodeForDisplay:(BOOL)decodeForDisplay {
     if (index >= _frames.count) return 0;
     _YYImageDecoderFrame *frame = [(_YYImageDecoderFrame *)_frames[index] copy];
-    BOOL decoded = NO;
     BOOL extendToCanvas = NO;
     if (_type != YYImageTypeICO && decodeForDisplay) { // ICO contains multi-size frame and should not extend to canvas.
         extendToCanvas = YES;
     }
     
     if (!_needBlend) {
-        CGImageRef imageRef = [self _newUnblendedImageAtIndex:index extendToCanvas:extendToCanvas decoded:&decoded];
-        if (!imageRef) return nil;
-        if (decodeForDisplay && !decoded) {
-            CGImageRef imageRefDecoded = YYCGImageCreateDecodedCopy(imageRef, YES);
-            if (imageRefDecoded) {
-                CFRelease(imageRef);
-                imageRef = imageRefDecoded;
-                decoded = YES;
-            }
-        }
-        UIImage *image = [UIImage imageWithCGImage:imageRef scale:_scale orientation:_orientation];
-        CFRelease(imageRef);
+        UIImage *image = [self _unblendedImageAtIndex:index extendToCanvas:extendToCanvas decodeForDisplay:decodeForDisplay];
         if (!image) return nil;
-        image.isDecodedForDisplay = decoded;
         frame.image = image;
         return frame;
     }
@@ -1651,35 +1128,19 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     // blend
     if (![self _createBlendContextIfNeeded]) return nil;
     CGImageRef imageRef = NULL;
-    
-    if (_blendFrameIndex + 1 == frame.index) {
+    if (_apngSource) {
+        // the compositor keeps track of the canvas
         imageRef = [self _newBlendedImageWithFrame:frame];
-        _blendFrameIndex = index;
-    } else { // should draw canvas from previous frame
-        _blendFrameIndex = NSNotFound;
-        CGContextClearRect(_blendCanvas, CGRectMake(0, 0, _width, _height));
-        
-        if (frame.blendFromIndex == frame.index) {
-            CGImageRef unblendedImage = [self _newUnblendedImageAtIndex:index extendToCanvas:NO decoded:NULL];
-            if (unblendedImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendedImage);
-                CFRelease(unblendedImage);
-            }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
-            if (frame.dispose == YYImageDisposeBackground) {
-                CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
-            }
-            _blendFrameIndex = index;
-        } else { // canvas is not ready
-            for (uint32_t i = (uint32_t)frame.blendFromIndex; i <= (uint32_t)frame.index; i++) {
-                if (i == frame.index) {
-                    if (!imageRef) imageRef = [self _newBlendedImageWithFrame:frame];
-                } else {
-                    [self _blendImageWithFrame:_frames[i]];
-                }
+    } else {
+        if (_blendFrameIndex + 1 != frame.index) { // should draw canvas from previous frame
+            _blendFrameIndex = NSNotFound;
+            yy_pixel_clear(_blendCanvas, _width * 4, (uint32_t)_width, (uint32_t)_height);
+            for (NSUInteger i = frame.blendFromIndex; i < frame.index; i++) {
+                [self _blendImageWithFrame:_frames[i]];
             }
-            _blendFrameIndex = index;
         }
+        imageRef = [self _newBlendedImageWithFrame:frame];
+        _blendFrameIndex = index;
     }
     
     if (!imageRef) return nil;
@@ -1689,15 +1150,38 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     
     image.isDecodedForDisplay = YES;
     frame.image = image;
+    if (extendToCanvas) [self _extendFrameToCanvas:frame];
+    return frame;
+}
+
+- (NSArray *)_framesInRange:(NSRange)range decodeForDisplay:(BOOL)decodeForDisplay {
+    if (range.length == 0 || NSMaxRange(range) > _frames.count) return nil;
+    BOOL extendToCanvas = NO;
+    if (_type != YYImageTypeICO && decodeForDisplay) { // ICO contains multi-size frame and should not extend to canvas.
+        extendToCanvas = YES;
+    }
+    
+    NSMutableArray *frames = [NSMutableArray arrayWithCapacity:range.length];
+    for (NSUInteger i = range.location; i < NSMaxRange(range); i++) {
+        [frames addObject:[(_YYImageDecoderFrame *)_frames[i] copy]];
+    }
+    
+    if (!_needBlend) {
+        // the frames are independent, decode them concurrently
+        dispatch_apply(range.length, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            _YYImageDecoderFrame *frame = frames[i];
+            frame.image = [self _unblendedImageAtIndex:range.location + i extendToCanvas:extendToCanvas decodeForDisplay:decodeForDisplay];
+        });
+        return frames;
+    }
+    
+    if (![self _blendFrames:frames inRange:range]) return nil;
     if (extendToCanvas) {
-        frame.width = _width;
-        frame.height = _height;
-        frame.offsetX = 0;
-        frame.offsetY = 0;
-        frame.dispose = YYImageDisposeNone;
-        frame.blend = YYImageBlendNone;
+        for (_YYImageDecoderFrame *frame in frames) {
+            [self _extendFrameToCanvas:frame];
+        }
     }
-    return frame;
+    return frames;
 }
 
 - (NSDictionary *)_framePropertiesAtIndex:(NSUInteger)index {
@@ -1735,15 +1219,6 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
 
 - (void)_updateSourceWebP {
 #if YYIMAGE_WEBP_ENABLED
-    _width = 0;
-    _height = 0;
-    _loopCount = 0;
-    if (_webpSource) WebPDemuxDelete(_webpSource);
-    _webpSource = NULL;
-    dispatch_semaphore_wait(_framesLock, DISPATCH_TIME_FOREVER);
-    _frames = nil;
-    dispatch_semaphore_signal(_framesLock);
-    
     /*
      https://developers.google.com/speed/webp/docs/api
      The documentation said we can use WebPIDecoder to decode webp progressively, 
@@ -1752,30 +1227,38 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
      
      When using WebPDecode() to decode multi-frame webp, we will get the error
      "VP8_STATUS_UNSUPPORTED_FEATURE", so we first use WebPDemuxer to unpack it.
+     
+     The demuxer only reads the chunk headers, and it accepts partial data, so the
+     frames are added as soon as they are complete. The frames of the previous
+     update are kept, only the new frames are parsed.
      */
     
     WebPData webPData = {0};
     webPData.bytes = _data.bytes;
     webPData.size = _data.length;
-    WebPDemuxer *demuxer = WebPDemux(&webPData);
-    if (!demuxer) return;
-    
-    uint32_t webpFrameCount = WebPDemuxGetI(demuxer, WEBP_FF_FRAME_COUNT);
-    uint32_t webpLoopCount =  WebPDemuxGetI(demuxer, WEBP_FF_LOOP_COUNT);
-    uint32_t canvasWidth = WebPDemuxGetI(demuxer, WEBP_FF_CANVAS_WIDTH);
-    uint32_t canvasHeight = WebPDemuxGetI(demuxer, WEBP_FF_CANVAS_HEIGHT);
-    if (webpFrameCount == 0 || canvasWidth < 1 || canvasHeight < 1) {
-        WebPDemuxDelete(demuxer);
+    WebPDemuxState state = WEBP_DEMUX_PARSING_HEADER;
+    WebPDemuxer *demuxer = WebPDemuxPartial(&webPData, &state);
+    
+    BOOL headerParsed = (demuxer && state > WEBP_DEMUX_PARSING_HEADER); // the features are valid after header parsed
+    uint32_t canvasWidth = headerParsed ? WebPDemuxGetI(demuxer, WEBP_FF_CANVAS_WIDTH) : 0;
+    uint32_t canvasHeight = headerParsed ? WebPDemuxGetI(demuxer, WEBP_FF_CANVAS_HEIGHT) : 0;
+    BOOL failed = (!demuxer || canvasWidth < 1 || canvasHeight < 1 || (_finalized && state != WEBP_DEMUX_DONE));
+    if (!failed && _webpSource && (canvasWidth != _width || canvasHeight != _height)) failed = YES;
+    if (failed) {
+        if (demuxer) WebPDemuxDelete(demuxer);
+        [self _resetSourceWebP];
         return;
     }
     
-    NSMutableArray *frames = [NSMutableArray new];
-    BOOL needBlend = NO;
-    uint32_t iterIndex = 0;
-    uint32_t lastBlendIndex = 0;
+    NSUInteger parsedCount = _webpSource ? _frames.count : 0;
+    NSMutableArray *frames = parsedCount ? _frames.mutableCopy : [NSMutableArray new];
+    BOOL needBlend = parsedCount ? _needBlend : NO;
+    NSUInteger lastBlendIndex = parsedCount ? _webpLastBlendIndex : 0;
     WebPIterator iter = {0};
-    if (WebPDemuxGetFrame(demuxer, 1, &iter)) { // one-based index...
+    if (WebPDemuxGetFrame(demuxer, (int)parsedCount + 1, &iter)) { // one-based index...
         do {
+            if (!iter.complete) break; // wait for the rest of the frame
+            NSUInteger iterIndex = frames.count;
             _YYImageDecoderFrame *frame = [_YYImageDecoderFrame new];
             [frames addObject:frame];
             if (iter.dispose_method == WEBP_MUX_DISPOSE_BACKGROUND) {
@@ -1785,8 +1268,6 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
                 frame.blend = YYImageBlendOver;
             }
             
-            int canvasWidth = WebPDemuxGetI(demuxer, WEBP_FF_CANVAS_WIDTH);
-            int canvasHeight = WebPDemuxGetI(demuxer, WEBP_FF_CANVAS_HEIGHT);
             frame.index = iterIndex;
             frame.duration = iter.duration / 1000.0;
             frame.width = iter.width;
@@ -1796,7 +1277,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
             frame.offsetX = iter.x_offset;
             frame.offsetY = canvasHeight - iter.y_offset - iter.height;
             
-            BOOL sizeEqualsToCanvas = (iter.width == canvasWidth && iter.height == canvasHeight);
+            BOOL sizeEqualsToCanvas = (iter.width == (int)canvasWidth && iter.height == (int)canvasHeight);
             BOOL offsetIsZero = (iter.x_offset == 0 && iter.y_offset == 0);
             frame.isFullSize = (sizeEqualsToCanvas && offsetIsZero);
             
@@ -1811,27 +1292,52 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
                 }
             }
             if (frame.index != frame.blendFromIndex) needBlend = YES;
-            iterIndex++;
         } while (WebPDemuxNextFrame(&iter));
         WebPDemuxReleaseIterator(&iter);
     }
-    if (frames.count != webpFrameCount) {
+    uint32_t webpFrameCount = WebPDemuxGetI(demuxer, WEBP_FF_FRAME_COUNT);
+    if (_finalized && frames.count != webpFrameCount) {
+        WebPDemuxDelete(demuxer);
+        [self _resetSourceWebP];
+        return;
+    }
+    if (frames.count == 0) { // wait for the first frame
         WebPDemuxDelete(demuxer);
         return;
     }
     
+    if (_webpSource) WebPDemuxDelete(_webpSource); // it refers to the previous data
     _width = canvasWidth;
     _height = canvasHeight;
     _frameCount = frames.count;
-    _loopCount = webpLoopCount;
+    _loopCount = WebPDemuxGetI(demuxer, WEBP_FF_LOOP_COUNT);
     _needBlend = needBlend;
     _webpSource = demuxer;
+    _webpLastBlendIndex = lastBlendIndex;
     dispatch_semaphore_wait(_framesLock, DISPATCH_TIME_FOREVER);
     _frames = frames;
     dispatch_semaphore_signal(_framesLock);
 #endif
 }
 
+#if YYIMAGE_WEBP_ENABLED
+- (void)_resetSourceWebP {
+    _width = 0;
+    _height = 0;
+    _frameCount = 0;
+    _loopCount = 0;
+    _needBlend = NO;
+    if (_webpSource) WebPDemuxDelete(_webpSource);
+    _webpSource = NULL;
+    _webpLastBlendIndex = 0;
+    if (_blendCanvas) free(_blendCanvas); // the canvas size may be changed
+    _blendCanvas = NULL;
+    dispatch_semaphore_wait(_framesLock, DISPATCH_TIME_FOREVER);
+    _frames = nil;
+    dispatch_semaphore_signal(_framesLock);
+}
+#endif
+
 - (void)_updateSourceAPNG {
     /*
      APNG extends PNG format to support animation, it was supported by ImageIO
@@ -1840,37 +1346,66 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
      We use a custom APNG decoder to make APNG available in old system, so we
      ignore the ImageIO's APNG frame info. Typically the custom decoder is a bit
      faster than ImageIO.
+     
+     The parser keeps its state between updates and only reads the new bytes,
+     the frames are added as soon as they are complete. Before the animation is
+     found, the first frame is decoded by ImageIO.
      */
     
-    yy_png_info_release(_apngSource);
-    _apngSource = nil;
-    
-    [self _updateSourceImageIO]; // decode first frame
-    if (_frameCount == 0) return; // png decode failed
-    if (!_finalized) return; // ignore multi-frame before finalized
-    
-    yy_png_info *apng = yy_png_info_create(_data.bytes, (uint32_t)_data.length);
-    if (!apng) return; // apng decode failed
-    if (apng->apng_frame_num == 0 ||
-        (apng->apng_frame_num == 1 && apng->apng_first_frame_is_cover)) {
-        yy_png_info_release(apng);
-        return; // no animation
+    if (!_apngSource) {
+        [self _updateSourceImageIO]; // decode first frame
+        if (!_apngParser) {
+            _apngParser = yy_png_parser_create();
+            if (!_apngParser) return;
+        }
     }
-    if (_source) { // apng decode succeed, no longer need image souce
-        CFRelease(_source);
-        _source = NULL;
+    if (!_apngParser) return; // not apng
+    
+    yy_png_parser_status status = yy_png_parser_update(_apngParser, _data.bytes, (uint32_t)_data.length, _finalized);
+    const yy_png_info *apng = yy_png_parser_get_info(_apngParser);
+    if (_apngSource) {
+        if (apng->apng_frame_num == _frames.count) return; // no new frame
+    } else {
+        BOOL isAPNG = yy_png_parser_is_apng(_apngParser);
+        if (status == YY_PNG_PARSER_STATUS_ERROR || (status == YY_PNG_PARSER_STATUS_FINISHED && !isAPNG)) {
+            yy_png_parser_release(_apngParser); // apng decode failed
+            _apngParser = NULL;
+            return;
+        }
+        if (!isAPNG || _frameCount == 0) return; // wait for more data
+        if (apng->apng_frame_num == 0 ||
+            (apng->apng_frame_num == 1 && apng->apng_first_frame_is_cover)) {
+            if (status == YY_PNG_PARSER_STATUS_FINISHED) { // no animation
+                yy_png_parser_release(_apngParser);
+                _apngParser = NULL;
+            }
+            return;
+        }
+        if (_source) { // apng decode succeed, no longer need image souce
+            if (yy_png_has_color_space(apng)) {
+                // the apng decoder ignores gAMA/iCCP/sRGB, tag the pixels with the color space read by ImageIO
+                CGImageRef imageRef = CGImageSourceCreateImageAtIndex(_source, 0, NULL);
+                CGColorSpaceRef space = imageRef ? CGImageGetColorSpace(imageRef) : NULL;
+                if (space && CGColorSpaceGetModel(space) == kCGColorSpaceModelRGB && !YYCGColorSpaceIsDeviceRGB(space)) {
+                    _apngColorSpace = CGColorSpaceRetain(space);
+                }
+                if (imageRef) CFRelease(imageRef);
+            }
+            CFRelease(_source);
+            _source = NULL;
+        }
     }
     
+    // add the new frames
     uint32_t canvasWidth = apng->header.width;
     uint32_t canvasHeight = apng->header.height;
-    NSMutableArray *frames = [NSMutableArray new];
-    BOOL needBlend = NO;
-    uint32_t lastBlendIndex = 0;
-    for (uint32_t i = 0; i < apng->apng_frame_num; i++) {
+    NSMutableArray *frames = _apngSource ? _frames.mutableCopy : [NSMutableArray new];
+    BOOL needBlend = _apngSource ? _needBlend : NO;
+    for (uint32_t i = (uint32_t)frames.count; i < apng->apng_frame_num; i++) {
         _YYImageDecoderFrame *frame = [_YYImageDecoderFrame new];
         [frames addObject:frame];
         
-        yy_png_frame_info *fi = apng->apng_frames + i;
+        const yy_png_frame_info *fi = apng->apng_frames + i;
         frame.index = i;
         frame.duration = yy_png_delay_to_seconds(fi->frame_control.delay_num, fi->frame_control.delay_den);
         frame.hasAlpha = YES;
@@ -1904,17 +1439,7 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
             } break;
         }
         
-        if (frame.blend == YYImageBlendNone && frame.isFullSize) {
-            frame.blendFromIndex  = i;
-            if (frame.dispose != YYImageDisposePrevious) lastBlendIndex = i;
-        } else {
-            if (frame.dispose == YYImageDisposeBackground && frame.isFullSize) {
-                frame.blendFromIndex = lastBlendIndex;
-                lastBlendIndex = i + 1;
-            } else {
-                frame.blendFromIndex = lastBlendIndex;
-            }
-        }
+        frame.blendFromIndex = fi->blend_from_index;
         if (frame.index != frame.blendFromIndex) needBlend = YES;
     }
     
@@ -2025,15 +1550,96 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     dispatch_semaphore_signal(_framesLock);
 }
 
+/// Returns the scale factor in (0, 1] to downsample the frames to the target size, 1 means no downsampling.
+- (CGFloat)_downsampleFactor {
+    if (_type == YYImageTypeICO || _width == 0 || _height == 0) return 1;
+    CGFloat factor = MAX(_targetPixelSize.width / _width, _targetPixelSize.height / _height);
+    if (factor <= 0 || factor >= 1) return 1;
+    return factor;
+}
+
+/// Create an image with a copy of the BGRA pixels, the image is downsampled if needed.
+- (CGImageRef)_newImageWithCopyOfPixels:(const uint8_t *)pixels
+                                  width:(size_t)width
+                                 height:(size_t)height
+                            bytesPerRow:(size_t)bytesPerRow CF_RETURNS_RETAINED {
+    CGFloat factor = [self _downsampleFactor];
+    size_t dstWidth = YYImageDownsampledLength(width, factor);
+    size_t dstHeight = YYImageDownsampledLength(height, factor);
+    size_t dstBytesPerRow = dstWidth * 4;
+    uint8_t *dst = malloc(dstBytesPerRow * dstHeight);
+    if (!dst) return NULL;
+    if (dstWidth == width && dstHeight == height) {
+        yy_pixel_copy(dst, dstBytesPerRow, pixels, bytesPerRow, (uint32_t)width, (uint32_t)height);
+    } else if (!yy_pixel_downsample(dst, dstBytesPerRow, (uint32_t)dstWidth, (uint32_t)dstHeight,
+                                    pixels, bytesPerRow, (uint32_t)width, (uint32_t)height)) {
+        free(dst);
+        return NULL;
+    }
+    return YYCGImageCreateWithBGRABuffer(dst, dstWidth, dstHeight, dstBytesPerRow, _apngColorSpace);
+}
+
+/// Create an image with the BGRA pixels (the pixels is owned by the image), the image is downsampled if needed.
+- (CGImageRef)_newImageWithPixels:(uint8_t *)pixels
+                            width:(size_t)width
+                           height:(size_t)height
+                      bytesPerRow:(size_t)bytesPerRow CF_RETURNS_RETAINED {
+    if ([self _downsampleFactor] >= 1) return YYCGImageCreateWithBGRABuffer(pixels, width, height, bytesPerRow, _apngColorSpace);
+    CGImageRef imageRef = [self _newImageWithCopyOfPixels:pixels width:width height:height bytesPerRow:bytesPerRow];
+    free(pixels);
+    return imageRef;
+}
+
+/// Decode an unblended frame image. It doesn't change the decoder's state, so it
+/// can be called concurrently while the lock is held by the caller.
+- (UIImage *)_unblendedImageAtIndex:(NSUInteger)index
+                     extendToCanvas:(BOOL)extendToCanvas
+                   decodeForDisplay:(BOOL)decodeForDisplay {
+    BOOL decoded = NO;
+    CGImageRef imageRef = [self _newUnblendedImageAtIndex:index extendToCanvas:extendToCanvas decoded:&decoded];
+    if (!imageRef) return nil;
+    if (decodeForDisplay && !decoded) {
+        CGImageRef imageRefDecoded = YYCGImageCreateDecodedCopy(imageRef, YES);
+        if (imageRefDecoded) {
+            CFRelease(imageRef);
+            imageRef = imageRefDecoded;
+            decoded = YES;
+        }
+    }
+    UIImage *image = [UIImage imageWithCGImage:imageRef scale:_scale orientation:_orientation];
+    CFRelease(imageRef);
+    image.isDecodedForDisplay = decoded;
+    return image;
+}
+
+/// The blended frame image covers the whole canvas.
+- (void)_extendFrameToCanvas:(_YYImageDecoderFrame *)frame {
+    frame.width = _width;
+    frame.height = _height;
+    frame.offsetX = 0;
+    frame.offsetY = 0;
+    frame.dispose = YYImageDisposeNone;
+    frame.blend = YYImageBlendNone;
+}
+
 - (CGImageRef)_newUnblendedImageAtIndex:(NSUInteger)index
                          extendToCanvas:(BOOL)extendToCanvas
                                 decoded:(BOOL *)decoded CF_RETURNS_RETAINED {
     
-    if (!_finalized && index > 0) return NULL;
     if (_frames.count <= index) return NULL;
     _YYImageDecoderFrame *frame = _frames[index];
     
     if (_source) {
+        if (!_finalized && index > 0) return NULL;
+        CGFloat factor = [self _downsampleFactor];
+        if (factor < 1) {
+            // ImageIO decodes the image at the reduced size (JPEG is scaled in DCT domain)
+            size_t maxPixelSize = YYImageDownsampledLength(MAX(frame.width, frame.height), factor);
+            NSDictionary *options = @{(id)kCGImageSourceCreateThumbnailFromImageAlways : @(YES),
+                                      (id)kCGImageSourceThumbnailMaxPixelSize : @(maxPixelSize),
+                                      (id)kCGImageSourceShouldCacheImmediately : @(YES)};
+            return CGImageSourceCreateThumbnailAtIndex(_source, index, (CFDictionaryRef)options);
+        }
         CGImageRef imageRef = CGImageSourceCreateImageAtIndex(_source, index, (CFDictionaryRef)@{(id)kCGImageSourceShouldCache:@(YES)});
         if (imageRef && extendToCanvas) {
             size_t width = CGImageGetWidth(imageRef);
@@ -2063,229 +1669,375 @@ CGImageRef YYCGImageCreateWithWebPData(CFDataRef webpData,
     }
     
     if (_apngSource) {
-        uint32_t size = 0;
-        uint8_t *bytes = yy_png_copy_frame_data_at_index(_data.bytes, _apngSource, (uint32_t)index, &size);
-        if (!bytes) return NULL;
-        CGDataProviderRef provider = CGDataProviderCreateWithData(bytes, bytes, size, YYCGDataProviderReleaseDataCallback);
-        if (!provider) {
-            free(bytes);
-            return NULL;
-        }
-        bytes = NULL; // hold by provider
+        if (frame.width < 1 || frame.height < 1) return NULL;
+        if (frame.offsetX + frame.width > _width || frame.offsetY + frame.height > _height) return NULL;
         
-        CGImageSourceRef source = CGImageSourceCreateWithDataProvider(provider, NULL);
-        if (!source) {
-            CFRelease(provider);
-            return NULL;
-        }
-        CFRelease(provider);
+        size_t width = extendToCanvas ? _width : frame.width;
+        size_t height = extendToCanvas ? _height : frame.height;
+        size_t bytesPerRow = YYImageByteAlign(4 * width, 32);
+        uint8_t *pixels = calloc(1, bytesPerRow * height);
+        if (!pixels) return NULL;
         
-        if(CGImageSourceGetCount(source) < 1) {
-            CFRelease(source);
+        // decode the frame to its rect directly, the frame's offsetY is from bottom
+        size_t offset = 0;
+        if (extendToCanvas) offset = (_height - frame.offsetY - frame.height) * bytesPerRow + frame.offsetX * 4;
+        if (!yy_png_decode_frame(_data.bytes, _apngSource, (uint32_t)index, YY_PNG_PIXEL_FORMAT_BGRA, pixels + offset, bytesPerRow)) {
+            free(pixels);
             return NULL;
         }
-        
-        CGImageRef imageRef = CGImageSourceCreateImageAtIndex(source, 0, (CFDictionaryRef)@{(id)kCGImageSourceShouldCache:@(YES)});
-        CFRelease(source);
+        CGImageRef imageRef = [self _newImageWithPixels:pixels width:width height:height bytesPerRow:bytesPerRow];
         if (!imageRef) return NULL;
-        if (extendToCanvas) {
-            CGContextRef context = CGBitmapContextCreate(NULL, _width, _height, 8, 0, YYCGColorSpaceGetDeviceRGB(), kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst); //bgrA
-            if (context) {
-                CGContextDrawImage(context, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), imageRef);
-                CFRelease(imageRef);
-                imageRef = CGBitmapContextCreateImage(context);
-                CFRelease(context);
-                if (decoded) *decoded = YES;
-            }
-        }
+        if (decoded) *decoded = YES;
         return imageRef;
     }
     
 #if YYIMAGE_WEBP_ENABLED
     if (_webpSource) {
-        WebPIterator iter;
-        if (!WebPDemuxGetFrame(_webpSource, (int)(index + 1), &iter)) return NULL; // demux webp frame data
-        // frame numbers are one-based in webp -----------^
-        
-        int frameWidth = iter.width;
-        int frameHeight = iter.height;
-        if (frameWidth < 1 || frameHeight < 1) return NULL;
+        if (frame.width < 1 || frame.height < 1) return NULL;
+        if (frame.offsetX + frame.width > _width || frame.offsetY + frame.height > _height) return NULL;
         
-        int width = extendToCanvas ? (int)_width : frameWidth;
-        int height = extendToCanvas ? (int)_height : frameHeight;
-        if (width > _width || height > _height) return NULL;
-        
-        const uint8_t *payload = iter.fragment.bytes;
-        size_t payloadSize = iter.fragment.size;
-        
-        WebPDecoderConfig config;
-        if (!WebPInitDecoderConfig(&config)) {
-            WebPDemuxReleaseIterator(&iter);
-            return NULL;
-        }
-        if (WebPGetFeatures(payload , payloadSize, &config.input) != VP8_STATUS_OK) {
-            WebPDemuxReleaseIterator(&iter);
-            return NULL;
+        CGFloat factor = [self _downsampleFactor];
+        BOOL coversCanvas = frame.width == _width && frame.height == _height;
+        if (factor < 1 && (coversCanvas || !extendToCanvas)) {
+            // the webp decoder scales the frame when decoding
+            size_t width = YYImageDownsampledLength(frame.width, factor);
+            size_t height = YYImageDownsampledLength(frame.height, factor);
+            size_t bytesPerRow = YYImageByteAlign(4 * width, 32);
+            size_t length = bytesPerRow * height;
+            uint8_t *pixels = calloc(1, length);
+            if (!pixels) return NULL;
+            if (![self _decodeWebPFrameAtIndex:index scaledWidth:width scaledHeight:height pixels:pixels bytesPerRow:bytesPerRow length:length]) {
+                free(pixels);
+                return NULL;
+            }
+            CGImageRef imageRef = YYCGImageCreateWithBGRABuffer(pixels, width, height, bytesPerRow, NULL);
+            if (!imageRef) return NULL;
+            if (decoded) *decoded = YES;
+            return imageRef;
         }
         
-        size_t bitsPerComponent = 8;
-        size_t bitsPerPixel = 32;
-        size_t bytesPerRow = YYImageByteAlign(bitsPerPixel / 8 * width, 32);
+        size_t width = extendToCanvas ? _width : frame.width;
+        size_t height = extendToCanvas ? _height : frame.height;
+        size_t bytesPerRow = YYImageByteAlign(4 * width, 32);
         size_t length = bytesPerRow * height;
-        CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst; //bgrA
-        
-        void *pixels = calloc(1, length);
-        if (!pixels) {
-            WebPDemuxReleaseIterator(&iter);
-            return NULL;
-        }
-        
-        config.output.colorspace = MODE_bgrA;
-        config.output.is_external_memory = 1;
-        config.output.u.RGBA.rgba = pixels;
-        config.output.u.RGBA.stride = (int)bytesPerRow;
-        config.output.u.RGBA.size = length;
-        VP8StatusCode result = WebPDecode(payload, payloadSize, &config); // decode
-        if ((result != VP8_STATUS_OK) && (result != VP8_STATUS_NOT_ENOUGH_DATA)) {
-            WebPDemuxReleaseIterator(&iter);
-            free(pixels);
-            return NULL;
-        }
-        WebPDemuxReleaseIterator(&iter);
-        
-        if (extendToCanvas && (iter.x_offset != 0 || iter.y_offset != 0)) {
-            void *tmp = calloc(1, length);
-            if (tmp) {
-                vImage_Buffer src = {pixels, height, width, bytesPerRow};
-                vImage_Buffer dest = {tmp, height, width, bytesPerRow};
-                vImage_CGAffineTransform transform = {1, 0, 0, 1, iter.x_offset, -iter.y_offset};
-                uint8_t backColor[4] = {0};
-                vImage_Error error = vImageAffineWarpCG_ARGB8888(&src, &dest, NULL, &transform, backColor, kvImageBackgroundColorFill);
-                if (error == kvImageNoError) {
-                    memcpy(pixels, tmp, length);
-                }
-                free(tmp);
-            }
-        }
+        uint8_t *pixels = calloc(1, length);
+        if (!pixels) return NULL;
         
-        CGDataProviderRef provider = CGDataProviderCreateWithData(pixels, pixels, length, YYCGDataProviderReleaseDataCallback);
-        if (!provider) {
+        // decode the frame to its rect directly, the frame's offsetY is from bottom
+        size_t offset = 0;
+        if (extendToCanvas) offset = (_height - frame.offsetY - frame.height) * bytesPerRow + frame.offsetX * 4;
+        if (![self _decodeWebPFrameAtIndex:index pixels:pixels + offset bytesPerRow:bytesPerRow length:length - offset]) {
             free(pixels);
             return NULL;
         }
-        pixels = NULL; // hold by provider
-        
-        CGImageRef image = CGImageCreate(width, height, bitsPerComponent, bitsPerPixel, bytesPerRow, YYCGColorSpaceGetDeviceRGB(), bitmapInfo, provider, NULL, false, kCGRenderingIntentDefault);
-        CFRelease(provider);
+        CGImageRef imageRef = [self _newImageWithPixels:pixels width:width height:height bytesPerRow:bytesPerRow];
+        if (!imageRef) return NULL;
         if (decoded) *decoded = YES;
-        return image;
+        return imageRef;
     }
 #endif
     
     return NULL;
 }
 
+#if YYIMAGE_WEBP_ENABLED
+/**
+ Decode a webp frame to premultiplied BGRA pixels (without blend).
+ 
+ @param pixels      Output, the frame's top left pixel.
+ @param bytesPerRow Bytes per row of the output.
+ @param length      Bytes of the output from `pixels`, at least bytesPerRow * (height - 1) + width * 4.
+ */
+- (BOOL)_decodeWebPFrameAtIndex:(NSUInteger)index pixels:(uint8_t *)pixels bytesPerRow:(size_t)bytesPerRow length:(size_t)length {
+    return [self _decodeWebPFrameAtIndex:index scaledWidth:0 scaledHeight:0 pixels:pixels bytesPerRow:bytesPerRow length:length];
+}
+
+/// Decode a webp frame scaled to the size by the webp decoder, 0 means the original size.
+- (BOOL)_decodeWebPFrameAtIndex:(NSUInteger)index
+                    scaledWidth:(size_t)scaledWidth
+                   scaledHeight:(size_t)scaledHeight
+                         pixels:(uint8_t *)pixels
+                    bytesPerRow:(size_t)bytesPerRow
+                         length:(size_t)length {
+    WebPIterator iter;
+    if (!WebPDemuxGetFrame(_webpSource, (int)(index + 1), &iter)) return NO; // demux webp frame data
+    // frame numbers are one-based in webp -----------^
+    
+    const uint8_t *payload = iter.fragment.bytes;
+    size_t payloadSize = iter.fragment.size;
+    
+    WebPDecoderConfig config;
+    if (!WebPInitDecoderConfig(&config)) {
+        WebPDemuxReleaseIterator(&iter);
+        return NO;
+    }
+    if (WebPGetFeatures(payload , payloadSize, &config.input) != VP8_STATUS_OK) {
+        WebPDemuxReleaseIterator(&iter);
+        return NO;
+    }
+    
+    if (scaledWidth > 0 && scaledHeight > 0) {
+        config.options.use_scaling = 1;
+        config.options.scaled_width = (int)scaledWidth;
+        config.options.scaled_height = (int)scaledHeight;
+    }
+    config.output.colorspace = MODE_bgrA;
+    config.output.is_external_memory = 1;
+    config.output.u.RGBA.rgba = pixels;
+    config.output.u.RGBA.stride = (int)bytesPerRow;
+    config.output.u.RGBA.size = length;
+    VP8StatusCode result = WebPDecode(payload, payloadSize, &config); // decode
+    WebPDemuxReleaseIterator(&iter);
+    return result == VP8_STATUS_OK || result == VP8_STATUS_NOT_ENOUGH_DATA;
+}
+#endif
+
 - (BOOL)_createBlendContextIfNeeded {
     if (!_blendCanvas) {
         _blendFrameIndex = NSNotFound;
-        _blendCanvas = CGBitmapContextCreate(NULL, _width, _height, 8, 0, YYCGColorSpaceGetDeviceRGB(), kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst);
+        _blendCanvas = calloc(1, _width * 4 * _height);
     }
     BOOL suc = _blendCanvas != NULL;
     return suc;
 }
 
+/// Returns the frame's top left pixel in a canvas, or NULL if the frame is out of the canvas.
+- (uint8_t *)_pixelsForFrame:(_YYImageDecoderFrame *)frame inCanvas:(uint8_t *)canvas {
+    if (frame.width < 1 || frame.height < 1) return NULL;
+    if (frame.offsetX + frame.width > _width || frame.offsetY + frame.height > _height) return NULL;
+    size_t top = _height - frame.offsetY - frame.height; // offsetY is from bottom
+    return canvas + top * _width * 4 + frame.offsetX * 4;
+}
+
+- (uint8_t *)_blendCanvasPixelsForFrame:(_YYImageDecoderFrame *)frame {
+    return [self _pixelsForFrame:frame inCanvas:_blendCanvas];
+}
+
+/// Create an image with a copy of a canvas (downsampled if needed).
+- (CGImageRef)_newImageWithCanvas:(const uint8_t *)canvas CF_RETURNS_RETAINED {
+    return [self _newImageWithCopyOfPixels:canvas width:_width height:_height bytesPerRow:_width * 4];
+}
+
+- (CGImageRef)_newImageWithBlendCanvas CF_RETURNS_RETAINED {
+    return [self _newImageWithCanvas:_blendCanvas];
+}
+
+/**
+ Decode an apng or webp frame to new premultiplied BGRA pixels (without blend),
+ the bytes per row is `frame.width * 4`. It doesn't change the decoder's state, so
+ it can be called concurrently while the lock is held by the caller.
+ 
+ @return The pixels, you should free it with free(). Returns NULL if an error occurs.
+ */
+- (uint8_t *)_newPixelsOfFrame:(_YYImageDecoderFrame *)frame {
+    if (frame.width < 1 || frame.height < 1) return NULL;
+    size_t bytesPerRow = frame.width * 4;
+    uint8_t *pixels = malloc(bytesPerRow * frame.height);
+    if (!pixels) return NULL;
+    BOOL suc = NO;
+    if (_apngSource) {
+        suc = yy_png_decode_frame(_data.bytes, _apngSource, (uint32_t)frame.index, YY_PNG_PIXEL_FORMAT_BGRA, pixels, bytesPerRow);
+    }
+#if YYIMAGE_WEBP_ENABLED
+    else if (_webpSource) {
+        suc = [self _decodeWebPFrameAtIndex:frame.index pixels:pixels bytesPerRow:bytesPerRow length:bytesPerRow * frame.height];
+    }
+#endif
+    if (!suc) {
+        free(pixels);
+        return NULL;
+    }
+    return pixels;
+}
+
+/// Draw the frame to its rect in the blend canvas with the frame's blend operation.
+- (void)_drawFrameToBlendCanvas:(_YYImageDecoderFrame *)frame {
+#if YYIMAGE_WEBP_ENABLED
+    uint8_t *dst = [self _blendCanvasPixelsForFrame:frame];
+    if (!dst) return;
+    size_t bytesPerRow = _width * 4;
+    uint32_t width = (uint32_t)frame.width, height = (uint32_t)frame.height;
+    
+    if (frame.blend != YYImageBlendOver) {
+        // the frame replaces the rect, decode it to the canvas directly
+        size_t length = _blendCanvas + bytesPerRow * _height - dst;
+        if (![self _decodeWebPFrameAtIndex:frame.index pixels:dst bytesPerRow:bytesPerRow length:length]) {
+            yy_pixel_clear(dst, bytesPerRow, width, height);
+        }
+    } else {
+        uint8_t *src = [self _newPixelsOfFrame:frame];
+        if (!src) return;
+        yy_pixel_blend_over(dst, bytesPerRow, src, width * 4, width, height);
+        free(src);
+    }
+#endif
+}
+
 - (void)_blendImageWithFrame:(_YYImageDecoderFrame *)frame {
     if (frame.dispose == YYImageDisposePrevious) {
         // nothing
     } else if (frame.dispose == YYImageDisposeBackground) {
-        CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
+        uint8_t *dst = [self _blendCanvasPixelsForFrame:frame];
+        if (dst) yy_pixel_clear(dst, _width * 4, (uint32_t)frame.width, (uint32_t)frame.height);
     } else { // no dispose
-        if (frame.blend == YYImageBlendOver) {
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
-            }
-        } else {
-            CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
-            }
-        }
+        [self _drawFrameToBlendCanvas:frame];
     }
 }
 
 - (CGImageRef)_newBlendedImageWithFrame:(_YYImageDecoderFrame *)frame CF_RETURNS_RETAINED{
+    if (_apngSource) {
+        if (!_apngCompositor) {
+            _apngCompositor = yy_png_compositor_create(_apngSource, YY_PNG_PIXEL_FORMAT_BGRA);
+            if (!_apngCompositor) return NULL;
+        }
+        if (!yy_png_compositor_render(_apngCompositor, _data.bytes, (uint32_t)frame.index, _blendCanvas, _width * 4)) {
+            yy_png_compositor_reset(_apngCompositor);
+            return NULL;
+        }
+        return [self _newImageWithBlendCanvas];
+    }
+    
+    size_t bytesPerRow = _width * 4;
+    uint8_t *dst = [self _blendCanvasPixelsForFrame:frame];
     CGImageRef imageRef = NULL;
     if (frame.dispose == YYImageDisposePrevious) {
-        if (frame.blend == YYImageBlendOver) {
-            CGImageRef previousImage = CGBitmapContextCreateImage(_blendCanvas);
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
-            }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
-            CGContextClearRect(_blendCanvas, CGRectMake(0, 0, _width, _height));
-            if (previousImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(0, 0, _width, _height), previousImage);
-                CFRelease(previousImage);
-            }
-        } else {
-            CGImageRef previousImage = CGBitmapContextCreateImage(_blendCanvas);
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
-            }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
-            CGContextClearRect(_blendCanvas, CGRectMake(0, 0, _width, _height));
-            if (previousImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(0, 0, _width, _height), previousImage);
-                CFRelease(previousImage);
-            }
+        // keep the rect to restore it after the frame is displayed
+        uint8_t *previous = dst ? malloc(frame.width * 4 * frame.height) : NULL;
+        if (previous) yy_pixel_copy(previous, frame.width * 4, dst, bytesPerRow, (uint32_t)frame.width, (uint32_t)frame.height);
+        [self _drawFrameToBlendCanvas:frame];
+        imageRef = [self _newImageWithBlendCanvas];
+        if (previous) {
+            yy_pixel_copy(dst, bytesPerRow, previous, frame.width * 4, (uint32_t)frame.width, (uint32_t)frame.height);
+            free(previous);
         }
     } else if (frame.dispose == YYImageDisposeBackground) {
-        if (frame.blend == YYImageBlendOver) {
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
+        [self _drawFrameToBlendCanvas:frame];
+        imageRef = [self _newImageWithBlendCanvas];
+        if (dst) yy_pixel_clear(dst, bytesPerRow, (uint32_t)frame.width, (uint32_t)frame.height);
+    } else { // no dispose
+        [self _drawFrameToBlendCanvas:frame];
+        imageRef = [self _newImageWithBlendCanvas];
+    }
+    return imageRef;
+}
+
+/// Draw the decoded frame pixels (NULL if failed to decode) to the frame's rect in canvas.
+static void YYCanvasDrawFramePixels(uint8_t *dst, size_t dstBytesPerRow,
+                                    const uint8_t *src, size_t srcBytesPerRow,
+                                    uint32_t width, uint32_t height, YYImageBlendOperation blend) {
+    if (blend == YYImageBlendOver) {
+        if (src) yy_pixel_blend_over(dst, dstBytesPerRow, src, srcBytesPerRow, width, height);
+    } else {
+        if (src) yy_pixel_copy(dst, dstBytesPerRow, src, srcBytesPerRow, width, height);
+        else yy_pixel_clear(dst, dstBytesPerRow, width, height);
+    }
+}
+
+/// Set an image with a copy of the canvas to the frame.
+- (void)_setImageWithCanvas:(const uint8_t *)canvas toFrame:(_YYImageDecoderFrame *)frame {
+    CGImageRef imageRef = [self _newImageWithCanvas:canvas];
+    if (!imageRef) return;
+    UIImage *image = [UIImage imageWithCGImage:imageRef scale:_scale orientation:_orientation];
+    CFRelease(imageRef);
+    image.isDecodedForDisplay = YES;
+    frame.image = image;
+}
+
+/**
+ Blend the frames in range on a private canvas, the decoder's blend canvas is not changed.
+ 
+ @discussion Blending starts from the `blendFromIndex` of the first frame in range.
+ The frame pixels are decoded concurrently in batches, then each batch is drawn
+ to the canvas in order with the frames' dispose and blend operations. The apng
+ frames are drawn by a private compositor, so they are clipped to the canvas in the
+ same way as `_apngCompositor` does.
+ 
+ @param frames Output, the copies of the frames in range, the images are set to them.
+ @return Whether succeed.
+ */
+- (BOOL)_blendFrames:(NSArray *)frames inRange:(NSRange)range {
+    size_t bytesPerRow = _width * 4;
+    uint8_t *canvas = calloc(1, bytesPerRow * _height);
+    if (!canvas) return NO;
+    
+    NSArray *allFrames = _frames;
+    NSUInteger begin = ((_YYImageDecoderFrame *)allFrames[range.location]).blendFromIndex;
+    NSUInteger end = NSMaxRange(range);
+    if (begin > range.location) begin = range.location;
+    NSUInteger batchCount = MAX([NSProcessInfo processInfo].activeProcessorCount, 1) * 2;
+    uint8_t **batchPixels = calloc(batchCount, sizeof(uint8_t *));
+    yy_png_compositor *compositor = _apngSource ? yy_png_compositor_create(_apngSource, YY_PNG_PIXEL_FORMAT_BGRA) : NULL;
+    if (!batchPixels || (_apngSource && !compositor)) {
+        if (batchPixels) free(batchPixels);
+        if (compositor) yy_png_compositor_release(compositor);
+        free(canvas);
+        return NO;
+    }
+    
+    for (NSUInteger batch = begin; batch < end; batch += batchCount) {
+        NSUInteger count = MIN(batchCount, end - batch);
+        
+        // decode the frame pixels concurrently
+        dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            NSUInteger index = batch + i;
+            _YYImageDecoderFrame *frame = allFrames[index];
+            if (index < range.location && frame.dispose != YYImageDisposeNone) return; // not drawn
+            if (!compositor && ![self _pixelsForFrame:frame inCanvas:canvas]) return; // out of canvas
+            batchPixels[i] = [self _newPixelsOfFrame:frame];
+        });
+        
+        // draw the frames in order
+        for (NSUInteger i = 0; i < count; i++) {
+            NSUInteger index = batch + i;
+            _YYImageDecoderFrame *frame = allFrames[index];
+            uint8_t *src = batchPixels[i];
+            batchPixels[i] = NULL;
+            
+            if (compositor) {
+                // the frame is disposed by the next call
+                yy_png_compositor_render_pixels(compositor, (uint32_t)index, src, frame.width * 4, canvas, bytesPerRow);
+                if (src) free(src);
+                if (index >= range.location) [self _setImageWithCanvas:canvas toFrame:frames[index - range.location]];
+                continue;
             }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
-            CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
-        } else {
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
+            
+            uint8_t *dst = [self _pixelsForFrame:frame inCanvas:canvas];
+            uint32_t width = (uint32_t)frame.width, height = (uint32_t)frame.height;
+            size_t srcBytesPerRow = frame.width * 4;
+            
+            if (index < range.location) { // draw the canvas from previous frame
+                if (dst && frame.dispose == YYImageDisposeBackground) {
+                    yy_pixel_clear(dst, bytesPerRow, width, height);
+                } else if (dst && frame.dispose == YYImageDisposeNone) {
+                    YYCanvasDrawFramePixels(dst, bytesPerRow, src, srcBytesPerRow, width, height, frame.blend);
+                }
+                if (src) free(src);
+                continue;
             }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
-            CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
-        }
-    } else { // no dispose
-        if (frame.blend == YYImageBlendOver) {
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
+            
+            // keep the rect to restore it after the frame is displayed
+            uint8_t *previous = NULL;
+            if (dst && frame.dispose == YYImageDisposePrevious) {
+                previous = malloc(srcBytesPerRow * height);
+                if (previous) yy_pixel_copy(previous, srcBytesPerRow, dst, bytesPerRow, width, height);
             }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
-        } else {
-            CGImageRef unblendImage = [self _newUnblendedImageAtIndex:frame.index extendToCanvas:NO decoded:NULL];
-            if (unblendImage) {
-                CGContextClearRect(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height));
-                CGContextDrawImage(_blendCanvas, CGRectMake(frame.offsetX, frame.offsetY, frame.width, frame.height), unblendImage);
-                CFRelease(unblendImage);
+            if (dst) YYCanvasDrawFramePixels(dst, bytesPerRow, src, srcBytesPerRow, width, height, frame.blend);
+            if (src) free(src);
+            [self _setImageWithCanvas:canvas toFrame:frames[index - range.location]];
+            
+            if (previous) {
+                yy_pixel_copy(dst, bytesPerRow, previous, srcBytesPerRow, width, height);
+                free(previous);
+            } else if (dst && frame.dispose == YYImageDisposeBackground) {
+                yy_pixel_clear(dst, bytesPerRow, width, height);
             }
-            imageRef = CGBitmapContextCreateImage(_blendCanvas);
         }
     }
-    return imageRef;
+    
+    free(batchPixels);
+    if (compositor) yy_png_compositor_release(compositor);
+    free(canvas);
+    return YES;
 }
 
 @end
@@ -0,0 +1,446 @@
+//
+//  YYImagePixel.c
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by agent on 26/10/17.
+//  Copyright (c) 2026 agent.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#include "YYImagePixel.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define YY_PIXEL_NEON 1
+#include <arm_neon.h>
+#else
+#define YY_PIXEL_NEON 0
+#endif
+
+#if !YY_PIXEL_NEON && defined(__SSE2__)
+#define YY_PIXEL_SSE2 1
+#include <emmintrin.h>
+#else
+#define YY_PIXEL_SSE2 0
+#endif
+
+#if YY_PIXEL_SSE2 && defined(__AVX2__)
+#define YY_PIXEL_AVX2 1
+#include <immintrin.h>
+#else
+#define YY_PIXEL_AVX2 0
+#endif
+
+/*
+ All kernels divide by 255 with rounding: (x + 127) / 255, x is in [0, 255 * 255].
+ It equals to (x + 128 + ((x + 128) >> 8)) >> 8, which is used by the vectorized
+ kernels on 16 bits lanes.
+ */
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Scalar
+
+static inline uint32_t yy_pixel_div255(uint32_t x) {
+    return (x + 127) / 255;
+}
+
+static inline void yy_pixel_blend_over_row_scalar(uint8_t *dst, const uint8_t *src, uint32_t count) {
+    for (uint32_t x = 0; x < count; x++, dst += 4, src += 4) {
+        uint32_t sa = src[3];
+        if (sa == 0xFF) { // opaque
+            memcpy(dst, src, 4);
+            continue;
+        }
+        if ((src[0] | src[1] | src[2] | sa) == 0) continue; // transparent
+        uint32_t ia = 0xFF - sa;
+        dst[0] = (uint8_t)(src[0] + yy_pixel_div255(dst[0] * ia));
+        dst[1] = (uint8_t)(src[1] + yy_pixel_div255(dst[1] * ia));
+        dst[2] = (uint8_t)(src[2] + yy_pixel_div255(dst[2] * ia));
+        dst[3] = (uint8_t)(sa + yy_pixel_div255(dst[3] * ia));
+    }
+}
+
+static inline void yy_pixel_premultiply_row_scalar(uint8_t *pixels, uint32_t count) {
+    for (uint32_t x = 0; x < count; x++, pixels += 4) {
+        uint32_t a = pixels[3];
+        if (a == 0xFF) continue;
+        pixels[0] = (uint8_t)yy_pixel_div255(pixels[0] * a);
+        pixels[1] = (uint8_t)yy_pixel_div255(pixels[1] * a);
+        pixels[2] = (uint8_t)yy_pixel_div255(pixels[2] * a);
+    }
+}
+
+static inline void yy_pixel_unpremultiply_row_scalar(uint8_t *pixels, uint32_t count) {
+    for (uint32_t x = 0; x < count; x++, pixels += 4) {
+        uint32_t a = pixels[3];
+        if (a == 0xFF) continue;
+        if (a == 0) {
+            pixels[0] = pixels[1] = pixels[2] = 0;
+            continue;
+        }
+        for (int c = 0; c < 3; c++) {
+            uint32_t value = (pixels[c] * 255 + a / 2) / a;
+            pixels[c] = (uint8_t)(value > 0xFF ? 0xFF : value);
+        }
+    }
+}
+
+void yy_pixel_blend_over_scalar(uint8_t *dst, size_t dst_stride,
+                                const uint8_t *src, size_t src_stride,
+                                uint32_t width, uint32_t height) {
+    for (uint32_t y = 0; y < height; y++) {
+        yy_pixel_blend_over_row_scalar(dst + y * dst_stride, src + y * src_stride, width);
+    }
+}
+
+void yy_pixel_premultiply_scalar(uint8_t *pixels, size_t stride, uint32_t width, uint32_t height) {
+    for (uint32_t y = 0; y < height; y++) {
+        yy_pixel_premultiply_row_scalar(pixels + y * stride, width);
+    }
+}
+
+void yy_pixel_unpremultiply_scalar(uint8_t *pixels, size_t stride, uint32_t width, uint32_t height) {
+    for (uint32_t y = 0; y < height; y++) {
+        yy_pixel_unpremultiply_row_scalar(pixels + y * stride, width);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - NEON (8 pixels, deinterleaved)
+
+#if YY_PIXEL_NEON
+
+static inline uint8x8_t yy_neon_div255(uint16x8_t x) {
+    return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+}
+
+static inline int yy_neon_all_bits(uint8x8_t v) {
+    return vget_lane_u64(vreinterpret_u64_u8(v), 0) == UINT64_MAX;
+}
+
+static inline int yy_neon_all_zero(uint8x8_t v) {
+    return vget_lane_u64(vreinterpret_u64_u8(v), 0) == 0;
+}
+
+static uint32_t yy_pixel_blend_over_row_neon(uint8_t *dst, const uint8_t *src, uint32_t count) {
+    uint32_t x = 0;
+    for (; x + 8 <= count; x += 8) {
+        uint8x8x4_t s = vld4_u8(src + x * 4);
+        if (yy_neon_all_bits(s.val[3])) {
+            vst4_u8(dst + x * 4, s);
+            continue;
+        }
+        if (yy_neon_all_zero(vorr_u8(vorr_u8(s.val[0], s.val[1]), vorr_u8(s.val[2], s.val[3])))) continue;
+        uint8x8x4_t d = vld4_u8(dst + x * 4);
+        uint8x8_t ia = vmvn_u8(s.val[3]);
+        d.val[0] = vadd_u8(s.val[0], yy_neon_div255(vmull_u8(d.val[0], ia)));
+        d.val[1] = vadd_u8(s.val[1], yy_neon_div255(vmull_u8(d.val[1], ia)));
+        d.val[2] = vadd_u8(s.val[2], yy_neon_div255(vmull_u8(d.val[2], ia)));
+        d.val[3] = vadd_u8(s.val[3], yy_neon_div255(vmull_u8(d.val[3], ia)));
+        vst4_u8(dst + x * 4, d);
+    }
+    return x;
+}
+
+static uint32_t yy_pixel_premultiply_row_neon(uint8_t *pixels, uint32_t count) {
+    uint32_t x = 0;
+    for (; x + 8 <= count; x += 8) {
+        uint8x8x4_t p = vld4_u8(pixels + x * 4);
+        if (yy_neon_all_bits(p.val[3])) continue;
+        p.val[0] = yy_neon_div255(vmull_u8(p.val[0], p.val[3]));
+        p.val[1] = yy_neon_div255(vmull_u8(p.val[1], p.val[3]));
+        p.val[2] = yy_neon_div255(vmull_u8(p.val[2], p.val[3]));
+        vst4_u8(pixels + x * 4, p);
+    }
+    return x;
+}
+
+#if defined(__aarch64__)
+static uint32_t yy_pixel_unpremultiply_row_neon(uint8_t *pixels, uint32_t count) {
+    uint32_t x = 0;
+    for (; x + 8 <= count; x += 8) {
+        uint8x8x4_t p = vld4_u8(pixels + x * 4);
+        if (yy_neon_all_bits(p.val[3])) continue;
+        uint16x8_t a = vmovl_u8(p.val[3]);
+        uint16x8_t half = vshrq_n_u16(a, 1);
+        float32x4_t a_lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(a)));
+        float32x4_t a_hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(a)));
+        uint8x8_t nonzero = vtst_u8(p.val[3], p.val[3]);
+        for (int c = 0; c < 3; c++) {
+            // the quotient of two exact floats is exact if it's an integer, so the
+            // truncated value is same as the integer division (the result is clamped)
+            uint16x8_t v = vmovl_u8(p.val[c]);
+            uint32x4_t n_lo = vmlal_u16(vmovl_u16(vget_low_u16(half)), vget_low_u16(v), vdup_n_u16(255));
+            uint32x4_t n_hi = vmlal_u16(vmovl_u16(vget_high_u16(half)), vget_high_u16(v), vdup_n_u16(255));
+            uint32x4_t q_lo = vcvtq_u32_f32(vdivq_f32(vcvtq_f32_u32(n_lo), a_lo));
+            uint32x4_t q_hi = vcvtq_u32_f32(vdivq_f32(vcvtq_f32_u32(n_hi), a_hi));
+            uint8x8_t q = vqmovn_u16(vcombine_u16(vqmovn_u32(q_lo), vqmovn_u32(q_hi)));
+            p.val[c] = vand_u8(q, nonzero);
+        }
+        vst4_u8(pixels + x * 4, p);
+    }
+    return x;
+}
+#endif
+
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - SSE2 (4 pixels) and AVX2 (8 pixels)
+
+#if YY_PIXEL_SSE2
+
+static inline __m128i yy_sse2_div255(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+/// The alpha of each pixel in all 4 bytes of the pixel.
+static inline __m128i yy_sse2_alpha_bytes(__m128i p) {
+    __m128i a = _mm_srli_epi32(p, 24);
+    a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+    return _mm_or_si128(a, _mm_slli_epi32(a, 16));
+}
+
+/// dst * mul / 255 for each byte.
+static inline __m128i yy_sse2_mul_div255(__m128i p, __m128i mul) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = yy_sse2_div255(_mm_mullo_epi16(_mm_unpacklo_epi8(p, zero), _mm_unpacklo_epi8(mul, zero)));
+    __m128i hi = yy_sse2_div255(_mm_mullo_epi16(_mm_unpackhi_epi8(p, zero), _mm_unpackhi_epi8(mul, zero)));
+    return _mm_packus_epi16(lo, hi);
+}
+
+static inline int yy_sse2_all_opaque(__m128i p) {
+    __m128i mask = _mm_set1_epi32((int)0xFF000000);
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(p, mask), mask)) == 0xFFFF;
+}
+
+#if YY_PIXEL_AVX2
+static inline __m256i yy_avx2_div255(__m256i x) {
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+static inline __m256i yy_avx2_alpha_bytes(__m256i p) {
+    __m256i a = _mm256_srli_epi32(p, 24);
+    a = _mm256_or_si256(a, _mm256_slli_epi32(a, 8));
+    return _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+}
+
+/// The unpack and pack instructions work in 128 bits lanes, so the pixel order is kept.
+static inline __m256i yy_avx2_mul_div255(__m256i p, __m256i mul) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i lo = yy_avx2_div255(_mm256_mullo_epi16(_mm256_unpacklo_epi8(p, zero), _mm256_unpacklo_epi8(mul, zero)));
+    __m256i hi = yy_avx2_div255(_mm256_mullo_epi16(_mm256_unpackhi_epi8(p, zero), _mm256_unpackhi_epi8(mul, zero)));
+    return _mm256_packus_epi16(lo, hi);
+}
+
+static inline int yy_avx2_all_opaque(__m256i p) {
+    __m256i mask = _mm256_set1_epi32((int)0xFF000000);
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(p, mask), mask)) == 0xFFFFFFFFU;
+}
+#endif
+
+static uint32_t yy_pixel_blend_over_row_sse2(uint8_t *dst, const uint8_t *src, uint32_t count) {
+    uint32_t x = 0;
+#if YY_PIXEL_AVX2
+    for (; x + 8 <= count; x += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + x * 4));
+        if (yy_avx2_all_opaque(s)) {
+            _mm256_storeu_si256((__m256i *)(dst + x * 4), s);
+            continue;
+        }
+        if (_mm256_testz_si256(s, s)) continue;
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + x * 4));
+        __m256i ia = _mm256_xor_si256(yy_avx2_alpha_bytes(s), _mm256_set1_epi8((char)0xFF));
+        _mm256_storeu_si256((__m256i *)(dst + x * 4), _mm256_add_epi8(s, yy_avx2_mul_div255(d, ia)));
+    }
+#endif
+    for (; x + 4 <= count; x += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + x * 4));
+        if (yy_sse2_all_opaque(s)) {
+            _mm_storeu_si128((__m128i *)(dst + x * 4), s);
+            continue;
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, _mm_setzero_si128())) == 0xFFFF) continue;
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + x * 4));
+        __m128i ia = _mm_xor_si128(yy_sse2_alpha_bytes(s), _mm_set1_epi8((char)0xFF));
+        _mm_storeu_si128((__m128i *)(dst + x * 4), _mm_add_epi8(s, yy_sse2_mul_div255(d, ia)));
+    }
+    return x;
+}
+
+static uint32_t yy_pixel_premultiply_row_sse2(uint8_t *pixels, uint32_t count) {
+    uint32_t x = 0;
+#if YY_PIXEL_AVX2
+    __m256i alpha_mask_256 = _mm256_set1_epi32((int)0xFF000000);
+    for (; x + 8 <= count; x += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(pixels + x * 4));
+        if (yy_avx2_all_opaque(p)) continue;
+        __m256i mul = _mm256_or_si256(yy_avx2_alpha_bytes(p), alpha_mask_256); // keep alpha: a * 255 / 255
+        _mm256_storeu_si256((__m256i *)(pixels + x * 4), yy_avx2_mul_div255(p, mul));
+    }
+#endif
+    __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+    for (; x + 4 <= count; x += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(pixels + x * 4));
+        if (yy_sse2_all_opaque(p)) continue;
+        __m128i mul = _mm_or_si128(yy_sse2_alpha_bytes(p), alpha_mask); // keep alpha: a * 255 / 255
+        _mm_storeu_si128((__m128i *)(pixels + x * 4), yy_sse2_mul_div255(p, mul));
+    }
+    return x;
+}
+
+/// Unpremultiply one pixel (4 int32 lanes).
+static inline __m128i yy_sse2_unpremultiply_pixel(__m128i p) {
+    __m128i a = _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i n = _mm_add_epi32(_mm_sub_epi32(_mm_slli_epi32(p, 8), p), _mm_srli_epi32(a, 1)); // c * 255 + a / 2
+    // the quotient of two exact floats is exact if it's an integer, so the truncated
+    // value is same as the integer division; 0 / 0 and c / 0 become INT_MIN (saturated to 0)
+    return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(n), _mm_cvtepi32_ps(a)));
+}
+
+static uint32_t yy_pixel_unpremultiply_row_sse2(uint8_t *pixels, uint32_t count) {
+    uint32_t x = 0;
+    __m128i zero = _mm_setzero_si128();
+    __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+    for (; x + 4 <= count; x += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(pixels + x * 4));
+        if (yy_sse2_all_opaque(p)) continue;
+        __m128i lo = _mm_unpacklo_epi8(p, zero);
+        __m128i hi = _mm_unpackhi_epi8(p, zero);
+        __m128i q0 = yy_sse2_unpremultiply_pixel(_mm_unpacklo_epi16(lo, zero));
+        __m128i q1 = yy_sse2_unpremultiply_pixel(_mm_unpackhi_epi16(lo, zero));
+        __m128i q2 = yy_sse2_unpremultiply_pixel(_mm_unpacklo_epi16(hi, zero));
+        __m128i q3 = yy_sse2_unpremultiply_pixel(_mm_unpackhi_epi16(hi, zero));
+        __m128i q = _mm_packus_epi16(_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3)); // clamp to [0, 255]
+        q = _mm_or_si128(_mm_andnot_si128(alpha_mask, q), _mm_and_si128(p, alpha_mask));
+        _mm_storeu_si128((__m128i *)(pixels + x * 4), q);
+    }
+    return x;
+}
+
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Public
+
+void yy_pixel_clear(uint8_t *dst, size_t dst_stride, uint32_t width, uint32_t height) {
+    if (width == 0) return;
+    if (dst_stride == (size_t)width * 4) {
+        memset(dst, 0, dst_stride * height);
+        return;
+    }
+    for (uint32_t y = 0; y < height; y++) {
+        memset(dst + y * dst_stride, 0, (size_t)width * 4);
+    }
+}
+
+void yy_pixel_copy(uint8_t *dst, size_t dst_stride,
+                   const uint8_t *src, size_t src_stride,
+                   uint32_t width, uint32_t height) {
+    if (width == 0) return;
+    if (dst_stride == (size_t)width * 4 && src_stride == dst_stride) {
+        memcpy(dst, src, dst_stride * height);
+        return;
+    }
+    for (uint32_t y = 0; y < height; y++) {
+        memcpy(dst + y * dst_stride, src + y * src_stride, (size_t)width * 4);
+    }
+}
+
+void yy_pixel_blend_over(uint8_t *dst, size_t dst_stride,
+                         const uint8_t *src, size_t src_stride,
+                         uint32_t width, uint32_t height) {
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t *d = dst + y * dst_stride;
+        const uint8_t *s = src + y * src_stride;
+        uint32_t x = 0;
+#if YY_PIXEL_NEON
+        x = yy_pixel_blend_over_row_neon(d, s, width);
+#elif YY_PIXEL_SSE2
+        x = yy_pixel_blend_over_row_sse2(d, s, width);
+#endif
+        yy_pixel_blend_over_row_scalar(d + x * 4, s + x * 4, width - x);
+    }
+}
+
+void yy_pixel_premultiply(uint8_t *pixels, size_t stride, uint32_t width, uint32_t height) {
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t *p = pixels + y * stride;
+        uint32_t x = 0;
+#if YY_PIXEL_NEON
+        x = yy_pixel_premultiply_row_neon(p, width);
+#elif YY_PIXEL_SSE2
+        x = yy_pixel_premultiply_row_sse2(p, width);
+#endif
+        yy_pixel_premultiply_row_scalar(p + x * 4, width - x);
+    }
+}
+
+void yy_pixel_unpremultiply(uint8_t *pixels, size_t stride, uint32_t width, uint32_t height) {
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t *p = pixels + y * stride;
+        uint32_t x = 0;
+#if YY_PIXEL_NEON && defined(__aarch64__)
+        x = yy_pixel_unpremultiply_row_neon(p, width);
+#elif YY_PIXEL_SSE2
+        x = yy_pixel_unpremultiply_row_sse2(p, width);
+#endif
+        yy_pixel_unpremultiply_row_scalar(p + x * 4, width - x);
+    }
+}
+
+bool yy_pixel_downsample(uint8_t *dst, size_t dst_stride, uint32_t dst_width, uint32_t dst_height,
+                         const uint8_t *src, size_t src_stride, uint32_t src_width, uint32_t src_height) {
+    if (!dst || !src || dst_width == 0 || dst_height == 0) return false;
+    if (dst_width > src_width || dst_height > src_height) return false;
+    
+    // src column range of dst pixel x: [xs[x], xs[x + 1])
+    uint32_t *xs = malloc((dst_width + 1) * sizeof(uint32_t));
+    uint64_t *sums = malloc(dst_width * 4 * sizeof(uint64_t));
+    if (!xs || !sums) {
+        free(xs);
+        free(sums);
+        return false;
+    }
+    for (uint32_t x = 0; x <= dst_width; x++) {
+        xs[x] = (uint32_t)((uint64_t)x * src_width / dst_width);
+    }
+    
+    for (uint32_t y = 0; y < dst_height; y++) {
+        uint32_t y0 = (uint32_t)((uint64_t)y * src_height / dst_height);
+        uint32_t y1 = (uint32_t)((uint64_t)(y + 1) * src_height / dst_height);
+        memset(sums, 0, dst_width * 4 * sizeof(uint64_t));
+        for (uint32_t sy = y0; sy < y1; sy++) {
+            const uint8_t *s = src + sy * src_stride;
+            for (uint32_t x = 0; x < dst_width; x++) {
+                uint32_t r = 0, g = 0, b = 0, a = 0;
+                for (uint32_t sx = xs[x]; sx < xs[x + 1]; sx++) {
+                    const uint8_t *p = s + sx * 4;
+                    r += p[0]; g += p[1]; b += p[2]; a += p[3];
+                }
+                uint64_t *sum = sums + x * 4;
+                sum[0] += r; sum[1] += g; sum[2] += b; sum[3] += a;
+            }
+        }
+        uint8_t *d = dst + y * dst_stride;
+        for (uint32_t x = 0; x < dst_width; x++) {
+            uint64_t count = (uint64_t)(y1 - y0) * (xs[x + 1] - xs[x]);
+            const uint64_t *sum = sums + x * 4;
+            for (int i = 0; i < 4; i++) {
+                d[x * 4 + i] = (uint8_t)((sum[i] + count / 2) / count);
+            }
+        }
+    }
+    free(xs);
+    free(sums);
+    return true;
+}
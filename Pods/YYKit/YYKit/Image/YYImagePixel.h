@@ -0,0 +1,79 @@
+//
+//  YYImagePixel.h
+//  YYKit <https://github.com/ibireme/YYKit>
+//
+//  Created by agent on 26/10/17.
+//  Copyright (c) 2026 agent.
+//
+//  This source code is licensed under the MIT-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+/*
+ Pixel kernels used to composite and downsample image frames (written in C).
+
+ The pixels are 8 bits per component, 4 components per pixel, and the alpha is
+ the last component (RGBA or BGRA, the color order doesn't matter). The kernels
+ work on a rect of the buffer: `width` pixels per row, `height` rows, and the
+ rows are `stride` bytes apart.
+
+ The kernels use NEON on ARM, and SSE2 (or AVX2 if enabled by the compiler) on
+ x86. The `_scalar` functions are the reference implementations, the vectorized
+ kernels return exactly the same bytes for any input.
+ */
+
+#ifndef YYImagePixel_h
+#define YYImagePixel_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Fill the rect with transparent black (0, 0, 0, 0).
+void yy_pixel_clear(uint8_t *dst, size_t dst_stride, uint32_t width, uint32_t height);
+
+/// Copy the src rect to the dst rect (the rects should not overlap).
+void yy_pixel_copy(uint8_t *dst, size_t dst_stride,
+                   const uint8_t *src, size_t src_stride,
+                   uint32_t width, uint32_t height);
+
+/**
+ Blend the src rect over the dst rect, both are premultiplied:
+ dst = src + dst * (255 - src_alpha) / 255 (rounded).
+ */
+void yy_pixel_blend_over(uint8_t *dst, size_t dst_stride,
+                         const uint8_t *src, size_t src_stride,
+                         uint32_t width, uint32_t height);
+
+/// Premultiply the colors with alpha in place: color = color * alpha / 255 (rounded).
+void yy_pixel_premultiply(uint8_t *pixels, size_t stride, uint32_t width, uint32_t height);
+
+/// Unpremultiply the colors in place: color = min(255, (color * 255 + alpha / 2) / alpha), 0 if alpha is 0.
+void yy_pixel_unpremultiply(uint8_t *pixels, size_t stride, uint32_t width, uint32_t height);
+
+/**
+ Downsample the src rect to the dst rect with a box filter: each dst pixel is the
+ average of the src pixels whose centers are in its area. The pixels should be
+ premultiplied.
+
+ @return Whether succeed. Returns false if the dst size is zero or larger than
+ the src size, or no memory.
+ */
+bool yy_pixel_downsample(uint8_t *dst, size_t dst_stride, uint32_t dst_width, uint32_t dst_height,
+                         const uint8_t *src, size_t src_stride, uint32_t src_width, uint32_t src_height);
+
+void yy_pixel_blend_over_scalar(uint8_t *dst, size_t dst_stride,
+                                const uint8_t *src, size_t src_stride,
+                                uint32_t width, uint32_t height);
+void yy_pixel_premultiply_scalar(uint8_t *pixels, size_t stride, uint32_t width, uint32_t height);
+void yy_pixel_unpremultiply_scalar(uint8_t *pixels, size_t stride, uint32_t width, uint32_t height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* YYImagePixel_h */
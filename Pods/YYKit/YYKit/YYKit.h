@@ -54,6 +54,9 @@ FOUNDATION_EXPORT const unsigned char YYKitVersionString[];
 #import <YYKit/YYClassInfo.h>
 
 #import <YYKit/YYCache.h>
+#import <YYKit/YYCacheStatistics.h>
+#import <YYKit/YYCacheBinaryCodec.h>
+#import <YYKit/YYCacheKeyFilter.h>
 #import <YYKit/YYMemoryCache.h>
 #import <YYKit/YYDiskCache.h>
 #import <YYKit/YYKVStorage.h>
@@ -63,6 +66,8 @@ FOUNDATION_EXPORT const unsigned char YYKitVersionString[];
 #import <YYKit/YYSpriteSheetImage.h>
 #import <YYKit/YYAnimatedImageView.h>
 #import <YYKit/YYImageCoder.h>
+#import <YYKit/YYAPNGCore.h>
+#import <YYKit/YYImagePixel.h>
 #import <YYKit/YYImageCache.h>
 #import <YYKit/YYWebImageOperation.h>
 #import <YYKit/YYWebImageManager.h>
@@ -145,6 +150,9 @@ FOUNDATION_EXPORT const unsigned char YYKitVersionString[];
 #import "YYClassInfo.h"
 
 #import "YYCache.h"
+#import "YYCacheStatistics.h"
+#import "YYCacheBinaryCodec.h"
+#import "YYCacheKeyFilter.h"
 #import "YYMemoryCache.h"
 #import "YYDiskCache.h"
 #import "YYKVStorage.h"
@@ -154,6 +162,8 @@ FOUNDATION_EXPORT const unsigned char YYKitVersionString[];
 #import "YYSpriteSheetImage.h"
 #import "YYAnimatedImageView.h"
 #import "YYImageCoder.h"
+#import "YYAPNGCore.h"
+#import "YYImagePixel.h"
 #import "YYImageCache.h"
 #import "YYWebImageOperation.h"
 #import "YYWebImageManager.h"
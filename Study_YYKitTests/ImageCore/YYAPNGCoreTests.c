@@ -0,0 +1,308 @@
+//
+//  YYAPNGCoreTests.c
+//  Study_YYKitTests
+//
+//  Tests of the portable APNG core (YYAPNGCore.c), run with `make test`.
+//
+
+#include "YYImageCoreTestUtil.h"
+#include "YYAPNGCore.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define YY_TEST_SEED_COUNT 300
+#define YY_TEST_MAX_SIZE 40
+#define YY_TEST_MAX_FRAMES 8
+
+/// Premultiply a straight RGBA pixel to the format, as yy_png_decode_frame() does.
+static void yy_test_premultiply_pixel(const uint8_t *rgba, yy_png_pixel_format format, uint8_t *out) {
+    uint32_t a = rgba[3];
+    uint8_t r = (uint8_t)((rgba[0] * a + 127) / 255);
+    uint8_t g = (uint8_t)((rgba[1] * a + 127) / 255);
+    uint8_t b = (uint8_t)((rgba[2] * a + 127) / 255);
+    if (format == YY_PNG_PIXEL_FORMAT_BGRA) {
+        out[0] = b; out[1] = g; out[2] = r;
+    } else {
+        out[0] = r; out[1] = g; out[2] = b;
+    }
+    out[3] = (uint8_t)a;
+}
+
+/// The frames and pixels decoded from a generated apng are the ones written.
+static void yy_test_decode_frames(void) {
+    for (uint32_t seed = 1; seed <= YY_TEST_SEED_COUNT; seed++) {
+        yy_test_apng_options options;
+        if (!yy_test_apng_options_create_random(seed, YY_TEST_MAX_SIZE, YY_TEST_MAX_FRAMES, &options)) abort();
+        uint32_t length = 0;
+        uint8_t *data = yy_test_apng_create(&options, &length);
+        YY_TEST_ASSERT(data != NULL, "seed %u", seed);
+        yy_png_info *info = data ? yy_png_info_create(data, length) : NULL;
+        YY_TEST_ASSERT(info != NULL, "seed %u", seed);
+        if (!info) {
+            free(data);
+            yy_test_apng_options_free(&options);
+            continue;
+        }
+
+        uint32_t first = options.first_frame_is_cover ? 0 : 1;
+        YY_TEST_ASSERT(info->header.width == options.width && info->header.height == options.height, "seed %u", seed);
+        YY_TEST_ASSERT(info->apng_frame_num == options.frame_num - first, "seed %u: %u frames", seed, info->apng_frame_num);
+        YY_TEST_ASSERT(info->apng_first_frame_is_cover == options.first_frame_is_cover, "seed %u", seed);
+        YY_TEST_ASSERT(yy_png_has_color_space(info) == options.srgb, "seed %u", seed);
+
+        for (uint32_t i = 0; i < info->apng_frame_num; i++) {
+            const yy_test_apng_frame *frame = options.frames + first + i;
+            const yy_png_chunk_fcTL *fcTL = &info->apng_frames[i].frame_control;
+            YY_TEST_ASSERT(fcTL->width == frame->width && fcTL->height == frame->height &&
+                           fcTL->x_offset == frame->x_offset && fcTL->y_offset == frame->y_offset &&
+                           fcTL->dispose_op == frame->dispose_op && fcTL->blend_op == frame->blend_op,
+                           "seed %u frame %u", seed, i);
+
+            size_t stride = (size_t)frame->width * 4 + 12; // padded rows
+            uint8_t *pixels = malloc(stride * frame->height);
+            uint8_t expected[4];
+            for (int format = YY_PNG_PIXEL_FORMAT_RGBA; format <= YY_PNG_PIXEL_FORMAT_BGRA; format++) {
+                bool decoded = yy_png_decode_frame(data, info, i, format, pixels, stride);
+                YY_TEST_ASSERT(decoded, "seed %u frame %u", seed, i);
+                if (!decoded) continue;
+                bool equal = true;
+                for (uint32_t y = 0; y < frame->height && equal; y++) {
+                    for (uint32_t x = 0; x < frame->width && equal; x++) {
+                        yy_test_premultiply_pixel(frame->rgba + ((size_t)y * frame->width + x) * 4, format, expected);
+                        equal = memcmp(pixels + y * stride + x * 4, expected, 4) == 0;
+                    }
+                }
+                YY_TEST_ASSERT(equal, "seed %u frame %u format %d", seed, i, format);
+            }
+            free(pixels);
+        }
+
+        yy_png_info_release(info);
+        free(data);
+        yy_test_apng_options_free(&options);
+    }
+}
+
+/// The first `frame_num` frames of the infos are the same.
+static bool yy_test_frames_equal(const yy_png_info *a, const yy_png_info *b, uint32_t frame_num) {
+    if (memcmp(&a->header, &b->header, sizeof(a->header)) != 0) return false;
+    if (frame_num > a->apng_frame_num || frame_num > b->apng_frame_num) return false;
+    for (uint32_t i = 0; i < frame_num; i++) {
+        const yy_png_frame_info *x = a->apng_frames + i, *y = b->apng_frames + i;
+        if (x->chunk_index != y->chunk_index || x->chunk_num != y->chunk_num ||
+            x->chunk_size != y->chunk_size || x->blend_from_index != y->blend_from_index ||
+            memcmp(&x->frame_control, &y->frame_control, sizeof(x->frame_control)) != 0) return false;
+    }
+    return true;
+}
+
+static bool yy_test_infos_equal(const yy_png_info *a, const yy_png_info *b) {
+    if (a->chunk_num != b->chunk_num ||
+        memcmp(a->chunks, b->chunks, sizeof(yy_png_chunk_info) * a->chunk_num) != 0) return false;
+    if (a->apng_frame_num != b->apng_frame_num || a->apng_loop_num != b->apng_loop_num ||
+        a->apng_first_frame_is_cover != b->apng_first_frame_is_cover ||
+        a->apng_shared_chunk_num != b->apng_shared_chunk_num ||
+        a->apng_shared_chunk_size != b->apng_shared_chunk_size ||
+        a->apng_shared_insert_index != b->apng_shared_insert_index) return false;
+    if (a->apng_shared_chunk_num &&
+        memcmp(a->apng_shared_chunk_indexs, b->apng_shared_chunk_indexs,
+               sizeof(uint32_t) * a->apng_shared_chunk_num) != 0) return false;
+    return yy_test_frames_equal(a, b, a->apng_frame_num);
+}
+
+/**
+ Feed the data to a parser in pieces of `step` bytes (random pieces up to `-step`
+ bytes if it's negative), and compare it with the info parsed from the whole file.
+ If `move` is true, each call gets a new copy of the data received so far.
+ */
+static void yy_test_parse_in_pieces(const uint8_t *data, uint32_t length, const yy_png_info *whole,
+                                    int step, bool move, uint32_t seed) {
+    yy_png_parser *parser = yy_png_parser_create();
+    uint32_t state = seed + 1, received = 0, frame_num = 0;
+    yy_png_parser_status status = YY_PNG_PARSER_STATUS_NEED_MORE_DATA;
+    while (status == YY_PNG_PARSER_STATUS_NEED_MORE_DATA && received < length) {
+        uint32_t piece = step > 0 ? (uint32_t)step : yy_test_rand_range(&state, 1, (uint32_t)-step);
+        received = length - received < piece ? length : received + piece;
+        uint8_t *copy = NULL;
+        if (move) {
+            copy = malloc(received);
+            memcpy(copy, data, received);
+        }
+        status = yy_png_parser_update(parser, move ? copy : data, received, received == length);
+        free(copy);
+
+        // frames are only added, and are the same as the whole file's
+        const yy_png_info *info = yy_png_parser_get_info(parser);
+        if (info && yy_png_parser_is_apng(parser)) {
+            YY_TEST_ASSERT(info->apng_frame_num >= frame_num, "seed %u: frame count decreased at %u", seed, received);
+            frame_num = info->apng_frame_num;
+            YY_TEST_ASSERT(yy_test_frames_equal(info, whole, frame_num),
+                           "seed %u step %d: frames differ at %u bytes", seed, step, received);
+        }
+    }
+    YY_TEST_ASSERT(status == YY_PNG_PARSER_STATUS_FINISHED, "seed %u step %d: status %d", seed, step, status);
+    YY_TEST_ASSERT(yy_png_parser_is_apng(parser), "seed %u step %d", seed, step);
+    const yy_png_info *info = yy_png_parser_get_info(parser);
+    YY_TEST_ASSERT(info && yy_test_infos_equal(info, whole), "seed %u step %d: info differs", seed, step);
+    yy_png_parser_release(parser);
+}
+
+/// Parsing a file received in pieces gives the same info as parsing the whole file.
+static void yy_test_parse_incrementally(void) {
+    for (uint32_t seed = 1; seed <= YY_TEST_SEED_COUNT / 3; seed++) {
+        yy_test_apng_options options;
+        if (!yy_test_apng_options_create_random(seed, YY_TEST_MAX_SIZE / 2, YY_TEST_MAX_FRAMES, &options)) abort();
+        uint32_t length = 0;
+        uint8_t *data = yy_test_apng_create(&options, &length);
+        yy_png_info *whole = data ? yy_png_info_create(data, length) : NULL;
+        YY_TEST_ASSERT(whole != NULL, "seed %u", seed);
+        if (whole) {
+            yy_test_parse_in_pieces(data, length, whole, 1, false, seed); // byte by byte
+            yy_test_parse_in_pieces(data, length, whole, 13, false, seed);
+            yy_test_parse_in_pieces(data, length, whole, -200, true, seed);
+            yy_test_parse_in_pieces(data, length, whole, (int)length, false, seed);
+
+            // all data without `final`, then the end
+            yy_png_parser *parser = yy_png_parser_create();
+            yy_png_parser_update(parser, data, length, false);
+            YY_TEST_ASSERT(yy_png_parser_update(parser, data, length, true) == YY_PNG_PARSER_STATUS_FINISHED, "seed %u", seed);
+            YY_TEST_ASSERT(yy_test_infos_equal(yy_png_parser_get_info(parser), whole), "seed %u", seed);
+            yy_png_parser_release(parser);
+        }
+        yy_png_info_release(whole);
+        free(data);
+        yy_test_apng_options_free(&options);
+    }
+}
+
+/// Decode the frame to a new buffer, `width * 4` bytes per row.
+static uint8_t *yy_test_decode_frame(const uint8_t *data, const yy_png_info *info, uint32_t index) {
+    const yy_png_chunk_fcTL *fcTL = &info->apng_frames[index].frame_control;
+    uint8_t *pixels = malloc((size_t)fcTL->width * fcTL->height * 4);
+    if (!yy_png_decode_frame(data, info, index, YY_PNG_PIXEL_FORMAT_BGRA, pixels, (size_t)fcTL->width * 4)) {
+        free(pixels);
+        return NULL;
+    }
+    return pixels;
+}
+
+/// Compare the canvas pixels, not the row paddings.
+static bool yy_test_canvas_equal(const uint8_t *a, const uint8_t *b, const yy_png_info *info, size_t stride) {
+    for (uint32_t y = 0; y < info->header.height; y++) {
+        if (memcmp(a + y * stride, b + y * stride, (size_t)info->header.width * 4) != 0) return false;
+    }
+    return true;
+}
+
+/**
+ Rendering the frames in order with yy_png_compositor_render(), with pre-decoded
+ pixels and yy_png_compositor_render_pixels(), and rendering a random frame from a
+ cleared canvas give the same canvas.
+ */
+static void yy_test_render_pixels(void) {
+    for (uint32_t seed = 1; seed <= YY_TEST_SEED_COUNT; seed++) {
+        yy_test_apng_options options;
+        if (!yy_test_apng_options_create_random(seed, YY_TEST_MAX_SIZE, YY_TEST_MAX_FRAMES, &options)) abort();
+        uint32_t length = 0;
+        uint8_t *data = yy_test_apng_create(&options, &length);
+        yy_png_info *info = data ? yy_png_info_create(data, length) : NULL;
+        YY_TEST_ASSERT(info != NULL, "seed %u", seed);
+        if (!info) {
+            free(data);
+            yy_test_apng_options_free(&options);
+            continue;
+        }
+
+        uint32_t frame_num = info->apng_frame_num;
+        size_t stride = (size_t)info->header.width * 4 + 8, canvas_size = stride * info->header.height;
+        uint8_t *canvases = calloc(frame_num, canvas_size); // sequential render of each frame
+        uint8_t *canvas = calloc(1, canvas_size);
+        uint8_t **pixels = calloc(frame_num, sizeof(uint8_t *));
+        yy_png_compositor *sequential = yy_png_compositor_create(info, YY_PNG_PIXEL_FORMAT_BGRA);
+        yy_png_compositor *compositor = yy_png_compositor_create(info, YY_PNG_PIXEL_FORMAT_BGRA);
+        for (uint32_t i = 0; i < frame_num; i++) {
+            uint8_t *expected = canvases + i * canvas_size;
+            if (i > 0) memcpy(expected, expected - canvas_size, canvas_size);
+            YY_TEST_ASSERT(yy_png_compositor_render(sequential, data, i, expected, stride), "seed %u frame %u", seed, i);
+            pixels[i] = yy_test_decode_frame(data, info, i);
+            YY_TEST_ASSERT(pixels[i] != NULL, "seed %u frame %u", seed, i);
+            YY_TEST_ASSERT(yy_png_compositor_render_pixels(compositor, i, pixels[i],
+                                                           (size_t)info->apng_frames[i].frame_control.width * 4,
+                                                           canvas, stride), "seed %u frame %u", seed, i);
+            YY_TEST_ASSERT(yy_test_canvas_equal(canvas, expected, info, stride), "seed %u: render_pixels differs at frame %u", seed, i);
+        }
+
+        uint32_t state = seed;
+        for (int round = 0; round < 8; round++) {
+            uint32_t index = yy_test_rand_range(&state, 0, frame_num - 1);
+            const uint8_t *expected = canvases + index * canvas_size;
+
+            // random access: the compositor restarts from `blend_from_index`
+            yy_png_compositor_reset(sequential);
+            memset(canvas, 0xA5, canvas_size);
+            YY_TEST_ASSERT(yy_png_compositor_render(sequential, data, index, canvas, stride), "seed %u frame %u", seed, index);
+            YY_TEST_ASSERT(yy_test_canvas_equal(canvas, expected, info, stride), "seed %u: render differs at frame %u", seed, index);
+
+            // the same range with pre-decoded pixels, frames before `index` may skip drawing
+            yy_png_compositor_reset(compositor);
+            memset(canvas, 0, canvas_size);
+            for (uint32_t i = info->apng_frames[index].blend_from_index; i <= index; i++) {
+                bool skip = i < index && info->apng_frames[i].frame_control.dispose_op != YY_PNG_DISPOSE_OP_NONE &&
+                            (yy_test_rand(&state) & 1);
+                size_t pixels_stride = (size_t)info->apng_frames[i].frame_control.width * 4;
+                yy_png_compositor_render_pixels(compositor, i, skip ? NULL : pixels[i], pixels_stride, canvas, stride);
+            }
+            YY_TEST_ASSERT(yy_test_canvas_equal(canvas, expected, info, stride), "seed %u: range differs at frame %u", seed, index);
+        }
+
+        for (uint32_t i = 0; i < frame_num; i++) free(pixels[i]);
+        free(pixels);
+        free(canvas);
+        free(canvases);
+        yy_png_compositor_release(sequential);
+        yy_png_compositor_release(compositor);
+        yy_png_info_release(info);
+        free(data);
+        yy_test_apng_options_free(&options);
+    }
+}
+
+/// Broken files are rejected instead of read out of bounds.
+static void yy_test_truncated_files(void) {
+    yy_test_apng_options options;
+    if (!yy_test_apng_options_create_random(7, YY_TEST_MAX_SIZE, YY_TEST_MAX_FRAMES, &options)) abort();
+    uint32_t length = 0;
+    uint8_t *data = yy_test_apng_create(&options, &length);
+    for (uint32_t size = 0; size < length; size++) {
+        uint8_t *copy = malloc(size ? size : 1);
+        memcpy(copy, data, size);
+        yy_png_info *info = yy_png_info_create(copy, size);
+        if (info) {
+            uint32_t width = info->header.width, height = info->header.height;
+            uint8_t *canvas = malloc((size_t)width * height * 4);
+            yy_png_compositor *compositor = yy_png_compositor_create(info, YY_PNG_PIXEL_FORMAT_BGRA);
+            for (uint32_t i = 0; compositor && i < info->apng_frame_num; i++) {
+                yy_png_compositor_render(compositor, copy, i, canvas, (size_t)width * 4);
+            }
+            yy_png_compositor_release(compositor);
+            free(canvas);
+            yy_png_info_release(info);
+        }
+        free(copy);
+    }
+    free(data);
+    yy_test_apng_options_free(&options);
+}
+
+int main(void) {
+    yy_test_decode_frames();
+    yy_test_parse_incrementally();
+    yy_test_render_pixels();
+    yy_test_truncated_files();
+    if (yy_test_failures) {
+        fprintf(stderr, "YYAPNGCoreTests: %d failure(s)\n", yy_test_failures);
+        return 1;
+    }
+    printf("YYAPNGCoreTests: ok\n");
+    return 0;
+}
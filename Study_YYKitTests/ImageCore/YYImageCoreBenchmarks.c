@@ -0,0 +1,402 @@
+//
+//  YYImageCoreBenchmarks.c
+//  Study_YYKitTests
+//
+//  Benchmarks of the portable image cores, run with `make bench`.
+//  The sticker benchmark plays the apng files in the directory at $YY_APNG_CORPUS,
+//  or a generated set of sticker-sized files if it's not set.
+//
+
+#include "YYImageCoreTestUtil.h"
+#include "YYImagePixel.h"
+#include "YYAPNGCore.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define YY_BENCH_CANVAS_SIZE 1024
+#define YY_BENCH_MIN_TIME 0.5
+#define YY_BENCH_APNG_SIZE 512
+#define YY_BENCH_APNG_FRAMES 24
+#define YY_BENCH_STICKER_MAX 256
+#define YY_BENCH_STICKER_MIN_TIME 0.05
+
+typedef void (*yy_bench_blend_kernel)(uint8_t *dst, size_t dst_stride,
+                                      const uint8_t *src, size_t src_stride,
+                                      uint32_t width, uint32_t height);
+typedef void (*yy_bench_unary_kernel)(uint8_t *pixels, size_t stride, uint32_t width, uint32_t height);
+
+static void yy_bench_report(const char *name, double seconds, uint64_t count, uint64_t pixels) {
+    printf("%-32s %9.3f ms/op %9.1f Mpixel/s\n", name, seconds / count * 1e3, pixels * count / seconds / 1e6);
+}
+
+/// Time to composite a frame over a canvas (the cost of a YY_PNG_BLEND_OP_OVER frame).
+static void yy_bench_blend(const char *name, yy_bench_blend_kernel kernel) {
+    uint32_t size = YY_BENCH_CANVAS_SIZE, state = 1;
+    size_t stride = (size_t)size * 4;
+    uint8_t *src = malloc(stride * size), *dst = malloc(stride * size);
+    yy_test_fill_random(&state, src, stride * size, true);
+    yy_pixel_premultiply_scalar(src, stride, size, size);
+    yy_test_fill_random(&state, dst, stride * size, true);
+    yy_pixel_premultiply_scalar(dst, stride, size, size);
+    uint64_t count = 0;
+    double begin = yy_test_now(), seconds;
+    do {
+        kernel(dst, stride, src, stride, size, size);
+        count++;
+    } while ((seconds = yy_test_now() - begin) < YY_BENCH_MIN_TIME);
+    yy_bench_report(name, seconds, count, (uint64_t)size * size);
+    free(src);
+    free(dst);
+}
+
+/// Time of a kernel call on a rect of the canvas, in seconds.
+static double yy_bench_blend_time(yy_bench_blend_kernel kernel, uint8_t *dst, const uint8_t *src,
+                                  size_t stride, uint32_t rect) {
+    uint64_t count = 0;
+    double begin = yy_test_now(), seconds;
+    do {
+        kernel(dst, stride, src, stride, rect, rect);
+        count++;
+    } while ((seconds = yy_test_now() - begin) < YY_BENCH_MIN_TIME / 4);
+    return seconds / count;
+}
+
+/// Per-frame composite time of frames of a few sizes, the kernels touch only the frame's rect
+/// of the canvas (CoreGraphics redrew the whole canvas for each frame).
+static void yy_bench_blend_rects(void) {
+    uint32_t size = YY_BENCH_CANVAS_SIZE, state = 4;
+    size_t stride = (size_t)size * 4;
+    uint8_t *src = malloc(stride * size), *dst = malloc(stride * size);
+    yy_test_fill_random(&state, src, stride * size, true);
+    yy_pixel_premultiply_scalar(src, stride, size, size);
+    yy_test_fill_random(&state, dst, stride * size, true);
+    yy_pixel_premultiply_scalar(dst, stride, size, size);
+    printf("\nblend_over a frame rect on the %ux%u canvas\n", size, size);
+    for (uint32_t rect = 32; rect <= size; rect *= 4) {
+        double simd = yy_bench_blend_time(yy_pixel_blend_over, dst, src, stride, rect);
+        double scalar = yy_bench_blend_time(yy_pixel_blend_over_scalar, dst, src, stride, rect);
+        char name[64];
+        snprintf(name, sizeof(name), "%ux%u frame", rect, rect);
+        printf("%-32s %9.2f us/frame %9.2f us/frame scalar %5.2fx\n", name, simd * 1e6, scalar * 1e6, scalar / simd);
+    }
+    free(src);
+    free(dst);
+}
+
+static void yy_bench_unary(const char *name, yy_bench_unary_kernel kernel, bool premultiplied) {
+    uint32_t size = YY_BENCH_CANVAS_SIZE, state = 2;
+    size_t stride = (size_t)size * 4;
+    uint8_t *source = malloc(stride * size), *pixels = malloc(stride * size);
+    yy_test_fill_random(&state, source, stride * size, true);
+    if (premultiplied) yy_pixel_premultiply_scalar(source, stride, size, size);
+    uint64_t count = 0;
+    double seconds = 0;
+    while (seconds < YY_BENCH_MIN_TIME) { // the kernels work in place, don't time the copy
+        memcpy(pixels, source, stride * size);
+        double begin = yy_test_now();
+        kernel(pixels, stride, size, size);
+        seconds += yy_test_now() - begin;
+        count++;
+    }
+    yy_bench_report(name, seconds, count, (uint64_t)size * size);
+    free(source);
+    free(pixels);
+}
+
+/// A square apng: a gradient cover, then smaller frames with the dispose and blend ops mixed.
+static uint8_t *yy_bench_apng_create(uint32_t size, uint32_t frame_num, uint32_t seed, uint32_t *length) {
+    uint32_t state = seed;
+    yy_test_apng_frame *frames = calloc(frame_num, sizeof(yy_test_apng_frame));
+    for (uint32_t i = 0; i < frame_num; i++) {
+        yy_test_apng_frame *frame = frames + i;
+        memset(frame, 0, sizeof(*frame));
+        frame->width = i == 0 ? size : yy_test_rand_range(&state, size / 4, size);
+        frame->height = i == 0 ? size : yy_test_rand_range(&state, size / 4, size);
+        frame->x_offset = i == 0 ? 0 : yy_test_rand_range(&state, 0, size - frame->width);
+        frame->y_offset = i == 0 ? 0 : yy_test_rand_range(&state, 0, size - frame->height);
+        frame->dispose_op = (uint8_t)(i % 3);
+        frame->blend_op = (uint8_t)(i % 2);
+        frame->delay_num = 1;
+        frame->delay_den = 30;
+        uint8_t *rgba = malloc((size_t)frame->width * frame->height * 4);
+        for (uint32_t y = 0; y < frame->height; y++) {
+            for (uint32_t x = 0; x < frame->width; x++) {
+                uint8_t *p = rgba + ((size_t)y * frame->width + x) * 4;
+                p[0] = (uint8_t)(x + i * 8);
+                p[1] = (uint8_t)(y + i * 4);
+                p[2] = (uint8_t)((x ^ y) + (yy_test_rand(&state) & 7)); // a little noise
+                p[3] = (uint8_t)(((x / 32 + y / 32 + i) % 4) * 85);
+            }
+        }
+        frame->rgba = rgba;
+    }
+    yy_test_apng_options options = {size, size, frames, frame_num, true, false, 0};
+    uint8_t *data = yy_test_apng_create(&options, length);
+    for (uint32_t i = 0; i < frame_num; i++) free((void *)frames[i].rgba);
+    free(frames);
+    return data;
+}
+
+typedef struct {
+    const uint8_t *data;
+    const yy_png_info *info;
+    uint8_t **pixels;
+    uint32_t next;       ///< next frame to decode
+    pthread_mutex_t lock;
+} yy_bench_decode_context;
+
+static void *yy_bench_decode_worker(void *arg) {
+    yy_bench_decode_context *context = arg;
+    for (;;) {
+        pthread_mutex_lock(&context->lock);
+        uint32_t index = context->next++;
+        pthread_mutex_unlock(&context->lock);
+        if (index >= context->info->apng_frame_num) break;
+        const yy_png_chunk_fcTL *fcTL = &context->info->apng_frames[index].frame_control;
+        yy_png_decode_frame(context->data, context->info, index, YY_PNG_PIXEL_FORMAT_BGRA,
+                            context->pixels[index], (size_t)fcTL->width * 4);
+    }
+    return NULL;
+}
+
+/// Decode all frames with the threads, then composite them in order (as YYImageDecoder does for a range).
+static void yy_bench_decode_parallel(const uint8_t *data, const yy_png_info *info, uint8_t **pixels, uint32_t thread_num) {
+    yy_bench_decode_context context = {data, info, pixels, 0, PTHREAD_MUTEX_INITIALIZER};
+    pthread_t threads[16];
+    for (uint32_t t = 0; t < thread_num; t++) pthread_create(threads + t, NULL, yy_bench_decode_worker, &context);
+    for (uint32_t t = 0; t < thread_num; t++) pthread_join(threads[t], NULL);
+}
+
+/// Parse the file with the incremental parser, fed in pieces of `step` bytes (0 for all at once).
+static void yy_bench_parse(const char *name, const uint8_t *data, uint32_t length, uint32_t step) {
+    uint64_t count = 0;
+    double begin = yy_test_now(), seconds;
+    do {
+        yy_png_parser *parser = yy_png_parser_create();
+        yy_png_parser_status status = YY_PNG_PARSER_STATUS_NEED_MORE_DATA;
+        uint32_t received = 0;
+        while (received < length && status == YY_PNG_PARSER_STATUS_NEED_MORE_DATA) {
+            received = (step == 0 || length - received < step) ? length : received + step;
+            status = yy_png_parser_update(parser, data, received, received == length);
+        }
+        if (status != YY_PNG_PARSER_STATUS_FINISHED) {
+            fprintf(stderr, "failed to parse the apng\n");
+            exit(1);
+        }
+        yy_png_parser_release(parser);
+        count++;
+    } while ((seconds = yy_test_now() - begin) < YY_BENCH_MIN_TIME);
+    printf("%-32s %9.1f us/file %9.1f MB/s\n", name, seconds / count * 1e6, (double)length * count / seconds / 1e6);
+}
+
+/// Frames per second of decoding and compositing an apng, and the composite time of a frame.
+static void yy_bench_apng(void) {
+    uint32_t length = 0;
+    uint8_t *data = yy_bench_apng_create(YY_BENCH_APNG_SIZE, YY_BENCH_APNG_FRAMES, 3, &length);
+    yy_png_info *info = data ? yy_png_info_create(data, length) : NULL;
+    if (!info) {
+        fprintf(stderr, "failed to create the apng\n");
+        exit(1);
+    }
+    uint32_t frame_num = info->apng_frame_num;
+    size_t stride = (size_t)info->header.width * 4;
+    uint8_t *canvas = malloc(stride * info->header.height);
+    uint8_t **pixels = calloc(frame_num, sizeof(uint8_t *));
+    for (uint32_t i = 0; i < frame_num; i++) {
+        const yy_png_chunk_fcTL *fcTL = &info->apng_frames[i].frame_control;
+        pixels[i] = malloc((size_t)fcTL->width * fcTL->height * 4);
+    }
+    yy_png_compositor *compositor = yy_png_compositor_create(info, YY_PNG_PIXEL_FORMAT_BGRA);
+    printf("\napng, %ux%u, %u frames, %u bytes\n", info->header.width, info->header.height, frame_num, length);
+
+    // the parse cost of a progressive download, the data is appended and parsed again
+    yy_bench_parse("parse byte by byte", data, length, 1);
+    yy_bench_parse("parse in 64 byte pieces", data, length, 64);
+    yy_bench_parse("parse in 4 KB pieces", data, length, 4096);
+    yy_bench_parse("parse all at once", data, length, 0);
+
+    // decode and composite frame by frame, like playing the animation
+    uint64_t count = 0;
+    double begin = yy_test_now(), seconds;
+    do {
+        yy_png_compositor_render(compositor, data, (uint32_t)(count % frame_num), canvas, stride);
+        count++;
+    } while ((seconds = yy_test_now() - begin) < YY_BENCH_MIN_TIME || count % frame_num);
+    printf("%-32s %9.3f ms/frame %8.1f frames/s\n", "render (decode + composite)", seconds / count * 1e3, count / seconds);
+
+    // composite only, with the decoded pixels
+    for (uint32_t i = 0; i < frame_num; i++) {
+        const yy_png_chunk_fcTL *fcTL = &info->apng_frames[i].frame_control;
+        yy_png_decode_frame(data, info, i, YY_PNG_PIXEL_FORMAT_BGRA, pixels[i], (size_t)fcTL->width * 4);
+    }
+    count = 0;
+    begin = yy_test_now();
+    do {
+        uint32_t index = (uint32_t)(count % frame_num);
+        if (index == 0) {
+            yy_png_compositor_reset(compositor);
+            yy_pixel_clear(canvas, stride, info->header.width, info->header.height);
+        }
+        yy_png_compositor_render_pixels(compositor, index, pixels[index],
+                                        (size_t)info->apng_frames[index].frame_control.width * 4, canvas, stride);
+        count++;
+    } while ((seconds = yy_test_now() - begin) < YY_BENCH_MIN_TIME || count % frame_num);
+    printf("%-32s %9.3f ms/frame %8.1f frames/s\n", "composite (render_pixels)", seconds / count * 1e3, count / seconds);
+
+    // decode all frames in parallel, then composite, the speedup is against 1 thread
+    long cpu_num = sysconf(_SC_NPROCESSORS_ONLN);
+    double single_rate = 0;
+    for (uint32_t thread_num = 1; thread_num <= 8; thread_num *= 2) {
+        count = 0;
+        begin = yy_test_now();
+        do {
+            yy_bench_decode_parallel(data, info, pixels, thread_num);
+            yy_png_compositor_reset(compositor);
+            yy_pixel_clear(canvas, stride, info->header.width, info->header.height);
+            for (uint32_t i = 0; i < frame_num; i++) {
+                yy_png_compositor_render_pixels(compositor, i, pixels[i],
+                                                (size_t)info->apng_frames[i].frame_control.width * 4, canvas, stride);
+            }
+            count += frame_num;
+        } while ((seconds = yy_test_now() - begin) < YY_BENCH_MIN_TIME);
+        double rate = count / seconds;
+        if (thread_num == 1) single_rate = rate;
+        char name[64];
+        snprintf(name, sizeof(name), "parallel decode (%u thread%s)", thread_num, thread_num > 1 ? "s" : "");
+        printf("%-32s %9.3f ms/frame %8.1f frames/s %5.2fx%s\n", name, seconds / count * 1e3, rate, rate / single_rate,
+               thread_num > (uint32_t)cpu_num ? " (more threads than cpus)" : "");
+    }
+
+    for (uint32_t i = 0; i < frame_num; i++) free(pixels[i]);
+    free(pixels);
+    free(canvas);
+    yy_png_compositor_release(compositor);
+    yy_png_info_release(info);
+    free(data);
+}
+
+typedef struct {
+    char name[256];
+    uint8_t *data;
+    uint32_t length;
+} yy_bench_sticker;
+
+/// Read a whole file, returns NULL if failed.
+static uint8_t *yy_bench_read_file(const char *path, uint32_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    uint8_t *data = NULL;
+    long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if (size > 0 && size < UINT32_MAX && fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc((size_t)size);
+        if (data && fread(data, 1, (size_t)size, file) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    *length = data ? (uint32_t)size : 0;
+    return data;
+}
+
+/// The .png and .apng files in the directory, returns the count.
+static uint32_t yy_bench_stickers_load(const char *path, yy_bench_sticker *stickers) {
+    DIR *dir = opendir(path);
+    if (!dir) return 0;
+    uint32_t count = 0;
+    struct dirent *entry;
+    while (count < YY_BENCH_STICKER_MAX && (entry = readdir(dir))) {
+        const char *extension = strrchr(entry->d_name, '.');
+        if (!extension || (strcmp(extension, ".png") != 0 && strcmp(extension, ".apng") != 0)) continue;
+        char file[1024];
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        yy_bench_sticker *sticker = stickers + count;
+        sticker->data = yy_bench_read_file(file, &sticker->length);
+        if (!sticker->data) continue;
+        snprintf(sticker->name, sizeof(sticker->name), "%s", entry->d_name);
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+/// 16 stickers from 120x120 to 320x320, with 8 to 31 frames.
+static uint32_t yy_bench_stickers_create(yy_bench_sticker *stickers) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < 16; i++) {
+        yy_bench_sticker *sticker = stickers + count;
+        uint32_t size = 120 + i * 37 % 201, frame_num = 8 + i * 5 % 24;
+        sticker->data = yy_bench_apng_create(size, frame_num, i + 1, &sticker->length);
+        if (!sticker->data) continue;
+        snprintf(sticker->name, sizeof(sticker->name), "sticker-%u (%ux%u, %u frames)", i, size, size, frame_num);
+        count++;
+    }
+    return count;
+}
+
+/// Frames per second of playing each sticker (decode + composite every frame in order, as
+/// an animated image view does), and of all of them.
+static void yy_bench_stickers(void) {
+    const char *path = getenv("YY_APNG_CORPUS");
+    yy_bench_sticker *stickers = calloc(YY_BENCH_STICKER_MAX, sizeof(yy_bench_sticker));
+    uint32_t sticker_num = path ? yy_bench_stickers_load(path, stickers) : yy_bench_stickers_create(stickers);
+    printf("\nstickers, %u files in %s\n", sticker_num, path ? path : "a generated set");
+
+    uint64_t total_frames = 0, played = 0;
+    double total_seconds = 0, slowest_rate = 0;
+    const char *slowest = NULL;
+    for (uint32_t s = 0; s < sticker_num; s++) {
+        yy_bench_sticker *sticker = stickers + s;
+        yy_png_info *info = yy_png_info_create(sticker->data, sticker->length);
+        if (!info || info->apng_frame_num == 0) { // not an apng
+            if (info) yy_png_info_release(info);
+            continue;
+        }
+        uint32_t frame_num = info->apng_frame_num;
+        size_t stride = (size_t)info->header.width * 4;
+        uint8_t *canvas = malloc(stride * info->header.height);
+        yy_png_compositor *compositor = yy_png_compositor_create(info, YY_PNG_PIXEL_FORMAT_BGRA);
+        uint64_t count = 0;
+        double begin = yy_test_now(), seconds;
+        do {
+            yy_png_compositor_render(compositor, sticker->data, (uint32_t)(count % frame_num), canvas, stride);
+            count++;
+        } while ((seconds = yy_test_now() - begin) < YY_BENCH_STICKER_MIN_TIME || count % frame_num);
+        double rate = count / seconds;
+        if (!slowest || rate < slowest_rate) {
+            slowest = sticker->name;
+            slowest_rate = rate;
+        }
+        total_frames += count;
+        total_seconds += seconds;
+        played++;
+        yy_png_compositor_release(compositor);
+        yy_png_info_release(info);
+        free(canvas);
+    }
+    if (played) {
+        printf("%-32s %9.3f ms/frame %8.1f frames/s (%llu files)\n", "render all stickers",
+               total_seconds / total_frames * 1e3, total_frames / total_seconds, (unsigned long long)played);
+        printf("%-32s %9.3f ms/frame %8.1f frames/s %s\n", "render the slowest sticker",
+               1e3 / slowest_rate, slowest_rate, slowest);
+    }
+    for (uint32_t s = 0; s < sticker_num; s++) free(stickers[s].data);
+    free(stickers);
+}
+
+int main(void) {
+    printf("pixel kernels, %ux%u canvas\n", YY_BENCH_CANVAS_SIZE, YY_BENCH_CANVAS_SIZE);
+    yy_bench_blend("blend_over", yy_pixel_blend_over);
+    yy_bench_blend("blend_over_scalar", yy_pixel_blend_over_scalar);
+    yy_bench_unary("premultiply", yy_pixel_premultiply, false);
+    yy_bench_unary("premultiply_scalar", yy_pixel_premultiply_scalar, false);
+    yy_bench_unary("unpremultiply", yy_pixel_unpremultiply, true);
+    yy_bench_unary("unpremultiply_scalar", yy_pixel_unpremultiply_scalar, true);
+    yy_bench_blend_rects();
+    yy_bench_apng();
+    yy_bench_stickers();
+    return 0;
+}
@@ -0,0 +1,284 @@
+//
+//  YYImageCoreTestUtil.c
+//  Study_YYKitTests
+//
+
+#include "YYImageCoreTestUtil.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+int yy_test_failures = 0;
+
+uint32_t yy_test_rand(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+uint32_t yy_test_rand_range(uint32_t *state, uint32_t min, uint32_t max) {
+    if (max <= min) return min;
+    return min + yy_test_rand(state) % (max - min + 1);
+}
+
+void yy_test_fill_random(uint32_t *state, uint8_t *buffer, size_t length, bool pixels) {
+    for (size_t i = 0; i < length; i++) {
+        uint8_t value = (uint8_t)yy_test_rand(state);
+        if (pixels && i % 4 == 3) {
+            switch (value % 4) { // most pixels are opaque or transparent
+                case 0: value = 0; break;
+                case 1: value = 0xFF; break;
+                default: value = (uint8_t)yy_test_rand(state); break;
+            }
+        }
+        buffer[i] = value;
+    }
+}
+
+double yy_test_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// APNG writer
+
+typedef struct {
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} yy_test_buffer;
+
+static void yy_test_buffer_append(yy_test_buffer *buffer, const void *bytes, size_t length) {
+    if (buffer->failed) return;
+    if (buffer->length + length > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 1024;
+        while (capacity < buffer->length + length) capacity *= 2;
+        uint8_t *data = realloc(buffer->data, capacity);
+        if (!data) {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+static void yy_test_write_u32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static void yy_test_write_u16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)value;
+}
+
+static void yy_test_append_chunk(yy_test_buffer *buffer, const char *fourcc, const uint8_t *data, uint32_t length) {
+    uint8_t head[8], tail[4];
+    yy_test_write_u32(head, length);
+    memcpy(head + 4, fourcc, 4);
+    uLong crc = crc32(0, head + 4, 4);
+    if (length) crc = crc32(crc, data, length);
+    yy_test_write_u32(tail, (uint32_t)crc);
+    yy_test_buffer_append(buffer, head, 8);
+    if (length) yy_test_buffer_append(buffer, data, length);
+    yy_test_buffer_append(buffer, tail, 4);
+}
+
+static uint8_t yy_test_paeth(uint8_t a, uint8_t b, uint8_t c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+/// Filter the rows (row y uses filter type y % 5) and deflate them.
+static uint8_t *yy_test_compress_frame(const yy_test_apng_frame *frame, uint32_t *length) {
+    size_t row_size = (size_t)frame->width * 4;
+    size_t raw_size = (row_size + 1) * frame->height;
+    uint8_t *raw = malloc(raw_size);
+    if (!raw) return NULL;
+    for (uint32_t y = 0; y < frame->height; y++) {
+        const uint8_t *row = frame->rgba + y * row_size;
+        const uint8_t *prev = y > 0 ? row - row_size : NULL;
+        uint8_t *out = raw + y * (row_size + 1);
+        uint8_t type = (uint8_t)(y % 5);
+        out[0] = type;
+        for (size_t i = 0; i < row_size; i++) {
+            uint8_t a = i >= 4 ? row[i - 4] : 0;
+            uint8_t b = prev ? prev[i] : 0;
+            uint8_t c = prev && i >= 4 ? prev[i - 4] : 0;
+            uint8_t predictor = 0;
+            switch (type) {
+                case 1: predictor = a; break;
+                case 2: predictor = b; break;
+                case 3: predictor = (uint8_t)((a + b) / 2); break;
+                case 4: predictor = yy_test_paeth(a, b, c); break;
+            }
+            out[i + 1] = (uint8_t)(row[i] - predictor);
+        }
+    }
+    uLongf size = compressBound((uLong)raw_size);
+    uint8_t *compressed = malloc(size);
+    if (!compressed || compress2(compressed, &size, raw, (uLong)raw_size, 6) != Z_OK) {
+        free(raw);
+        free(compressed);
+        return NULL;
+    }
+    free(raw);
+    *length = (uint32_t)size;
+    return compressed;
+}
+
+static void yy_test_append_fcTL(yy_test_buffer *buffer, const yy_test_apng_frame *frame, uint32_t *sequence) {
+    uint8_t fcTL[26];
+    yy_test_write_u32(fcTL, (*sequence)++);
+    yy_test_write_u32(fcTL + 4, frame->width);
+    yy_test_write_u32(fcTL + 8, frame->height);
+    yy_test_write_u32(fcTL + 12, frame->x_offset);
+    yy_test_write_u32(fcTL + 16, frame->y_offset);
+    yy_test_write_u16(fcTL + 20, frame->delay_num);
+    yy_test_write_u16(fcTL + 22, frame->delay_den);
+    fcTL[24] = frame->dispose_op;
+    fcTL[25] = frame->blend_op;
+    yy_test_append_chunk(buffer, "fcTL", fcTL, sizeof(fcTL));
+}
+
+/// Append the image data as `IDAT` (sequence is NULL) or `fdAT` chunks.
+static bool yy_test_append_frame_data(yy_test_buffer *buffer, const yy_test_apng_frame *frame,
+                                      uint32_t max_chunk_size, uint32_t *sequence) {
+    uint32_t length = 0;
+    uint8_t *compressed = yy_test_compress_frame(frame, &length);
+    if (!compressed) return false;
+    uint32_t chunk_size = max_chunk_size ? max_chunk_size : length;
+    uint8_t *chunk = malloc((size_t)chunk_size + 4);
+    if (!chunk) {
+        free(compressed);
+        return false;
+    }
+    for (uint32_t offset = 0; offset < length; offset += chunk_size) {
+        uint32_t size = length - offset < chunk_size ? length - offset : chunk_size;
+        if (sequence) {
+            yy_test_write_u32(chunk, (*sequence)++);
+            memcpy(chunk + 4, compressed + offset, size);
+            yy_test_append_chunk(buffer, "fdAT", chunk, size + 4);
+        } else {
+            yy_test_append_chunk(buffer, "IDAT", compressed + offset, size);
+        }
+    }
+    free(chunk);
+    free(compressed);
+    return true;
+}
+
+uint8_t *yy_test_apng_create(const yy_test_apng_options *options, uint32_t *length) {
+    if (!options || options->frame_num == 0) return NULL;
+    uint32_t animated_num = options->frame_num - (options->first_frame_is_cover ? 0 : 1);
+    if (animated_num == 0) return NULL;
+
+    yy_test_buffer buffer = {0};
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    yy_test_buffer_append(&buffer, signature, sizeof(signature));
+
+    uint8_t IHDR[13] = {0};
+    yy_test_write_u32(IHDR, options->width);
+    yy_test_write_u32(IHDR + 4, options->height);
+    IHDR[8] = 8; // bit depth
+    IHDR[9] = 6; // RGBA
+    yy_test_append_chunk(&buffer, "IHDR", IHDR, sizeof(IHDR));
+    if (options->srgb) {
+        uint8_t intent = 0;
+        yy_test_append_chunk(&buffer, "sRGB", &intent, 1);
+    }
+    uint8_t acTL[8];
+    yy_test_write_u32(acTL, animated_num);
+    yy_test_write_u32(acTL + 4, 0);
+    yy_test_append_chunk(&buffer, "acTL", acTL, sizeof(acTL));
+    static const char text[] = "Comment\0YYImageCoreTests";
+    yy_test_append_chunk(&buffer, "tEXt", (const uint8_t *)text, sizeof(text) - 1);
+
+    uint32_t sequence = 0;
+    bool succeed = true;
+    for (uint32_t i = 0; i < options->frame_num && succeed; i++) {
+        const yy_test_apng_frame *frame = options->frames + i;
+        if (i == 0) {
+            if (options->first_frame_is_cover) yy_test_append_fcTL(&buffer, frame, &sequence);
+            succeed = yy_test_append_frame_data(&buffer, frame, options->max_chunk_size, NULL);
+        } else {
+            yy_test_append_fcTL(&buffer, frame, &sequence);
+            succeed = yy_test_append_frame_data(&buffer, frame, options->max_chunk_size, &sequence);
+        }
+    }
+    yy_test_append_chunk(&buffer, "IEND", NULL, 0);
+
+    if (!succeed || buffer.failed || buffer.length > UINT32_MAX) {
+        free(buffer.data);
+        return NULL;
+    }
+    *length = (uint32_t)buffer.length;
+    return buffer.data;
+}
+
+bool yy_test_apng_options_create_random(uint32_t seed, uint32_t max_size, uint32_t max_frames,
+                                        yy_test_apng_options *options) {
+    uint32_t state = seed * 2654435761u + 1;
+    if (state == 0) state = 1;
+    memset(options, 0, sizeof(*options));
+    options->width = yy_test_rand_range(&state, 1, max_size);
+    options->height = yy_test_rand_range(&state, 1, max_size);
+    options->first_frame_is_cover = yy_test_rand(&state) % 2;
+    options->srgb = yy_test_rand(&state) % 2;
+    options->max_chunk_size = yy_test_rand(&state) % 2 ? yy_test_rand_range(&state, 1, 64) : 0;
+    options->frame_num = yy_test_rand_range(&state, options->first_frame_is_cover ? 1 : 2, max_frames);
+
+    yy_test_apng_frame *frames = calloc(options->frame_num, sizeof(yy_test_apng_frame));
+    if (!frames) return false;
+    options->frames = frames;
+    for (uint32_t i = 0; i < options->frame_num; i++) {
+        yy_test_apng_frame *frame = frames + i;
+        if (i == 0) { // the first frame covers the canvas
+            frame->width = options->width;
+            frame->height = options->height;
+        } else { // may go past the right or bottom edge
+            frame->width = yy_test_rand_range(&state, 1, options->width);
+            frame->height = yy_test_rand_range(&state, 1, options->height);
+            frame->x_offset = yy_test_rand_range(&state, 0, options->width - 1);
+            frame->y_offset = yy_test_rand_range(&state, 0, options->height - 1);
+        }
+        frame->dispose_op = (uint8_t)(yy_test_rand(&state) % 3);
+        frame->blend_op = (uint8_t)(yy_test_rand(&state) % 2);
+        frame->delay_num = (uint16_t)yy_test_rand_range(&state, 1, 10);
+        frame->delay_den = 100;
+        size_t size = (size_t)frame->width * frame->height * 4;
+        uint8_t *rgba = malloc(size);
+        if (!rgba) {
+            yy_test_apng_options_free(options);
+            return false;
+        }
+        yy_test_fill_random(&state, rgba, size, true);
+        frame->rgba = rgba;
+    }
+    return true;
+}
+
+void yy_test_apng_options_free(yy_test_apng_options *options) {
+    if (!options || !options->frames) return;
+    yy_test_apng_frame *frames = (yy_test_apng_frame *)options->frames;
+    for (uint32_t i = 0; i < options->frame_num; i++) {
+        free((void *)frames[i].rgba);
+    }
+    free(frames);
+    options->frames = NULL;
+    options->frame_num = 0;
+}
@@ -0,0 +1,79 @@
+//
+//  YYImageCoreTestUtil.h
+//  Study_YYKitTests
+//
+//  Shared helpers of the YYAPNGCore / YYImagePixel tests and benchmarks (C only,
+//  build with the Makefile in this directory).
+//
+
+#ifndef YYImageCoreTestUtil_h
+#define YYImageCoreTestUtil_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+extern int yy_test_failures;
+
+/// Record a failure with its location if the condition is false.
+#define YY_TEST_ASSERT(cond, ...) do { \
+    if (!(cond)) { \
+        yy_test_failures++; \
+        fprintf(stderr, "%s:%d: assertion failed: %s: ", __FILE__, __LINE__, #cond); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+    } \
+} while (0)
+
+/// A small deterministic random generator (xorshift32), the state should not be zero.
+uint32_t yy_test_rand(uint32_t *state);
+
+/// Random number in [min, max].
+uint32_t yy_test_rand_range(uint32_t *state, uint32_t min, uint32_t max);
+
+/// Fill the buffer with random bytes, the alpha is biased to 0 and 255 if `pixels` is true.
+void yy_test_fill_random(uint32_t *state, uint8_t *buffer, size_t length, bool pixels);
+
+/// Monotonic time in seconds.
+double yy_test_now(void);
+
+typedef struct {
+    uint32_t x_offset, y_offset;
+    uint32_t width, height;
+    uint8_t dispose_op;
+    uint8_t blend_op;
+    uint16_t delay_num, delay_den;
+    const uint8_t *rgba; ///< straight alpha, RGBA, `width * 4` bytes per row
+} yy_test_apng_frame;
+
+typedef struct {
+    uint32_t width, height;         ///< canvas size
+    const yy_test_apng_frame *frames;
+    uint32_t frame_num;
+    bool first_frame_is_cover;      ///< otherwise a default image (frame 0) is written before the animation
+    bool srgb;                      ///< write a `sRGB` chunk
+    uint32_t max_chunk_size;        ///< split the image data to chunks of this size, 0 for one chunk per frame
+} yy_test_apng_options;
+
+/**
+ Write an 8 bits RGBA apng with the frames, filtered with all five filter types.
+
+ @discussion If `first_frame_is_cover` is false, the first frame is written as the
+ default image (`IDAT` without `fcTL`) and the others are the animation.
+ @return The file data, call free() to release it. NULL if an error occurs.
+ */
+uint8_t *yy_test_apng_create(const yy_test_apng_options *options, uint32_t *length);
+
+/**
+ Generate the options of a random apng with the seed: random frame rects (some of
+ them partly outside the canvas), dispose ops, blend ops and pixels.
+
+ @return Whether succeed, call yy_test_apng_options_free() to release the frames.
+ */
+bool yy_test_apng_options_create_random(uint32_t seed, uint32_t max_size, uint32_t max_frames,
+                                        yy_test_apng_options *options);
+
+void yy_test_apng_options_free(yy_test_apng_options *options);
+
+#endif /* YYImageCoreTestUtil_h */
@@ -0,0 +1,173 @@
+//
+//  YYImagePixelTests.c
+//  Study_YYKitTests
+//
+//  Tests of the pixel kernels (YYImagePixel.c): the vectorized kernels should
+//  return exactly the same bytes as the scalar ones. Run with `make test`.
+//
+
+#include "YYImageCoreTestUtil.h"
+#include "YYImagePixel.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef void (*yy_test_unary_kernel)(uint8_t *pixels, size_t stride, uint32_t width, uint32_t height);
+
+/// Run the kernel and its scalar version on random rects: odd widths (tail pixels),
+/// padded strides and unaligned buffers.
+static void yy_test_unary_random(const char *name, yy_test_unary_kernel kernel, yy_test_unary_kernel scalar) {
+    uint32_t state = 0x9E3779B9;
+    for (int round = 0; round < 2000; round++) {
+        uint32_t width = yy_test_rand_range(&state, 0, 70);
+        uint32_t height = yy_test_rand_range(&state, 1, 5);
+        size_t stride = (size_t)width * 4 + yy_test_rand_range(&state, 0, 3) * 4;
+        size_t offset = yy_test_rand_range(&state, 0, 15);
+        size_t size = stride * height + offset;
+        uint8_t *a = malloc(size + 1), *b = malloc(size + 1);
+        yy_test_fill_random(&state, a + offset, stride * height, true);
+        memcpy(b, a, size);
+        kernel(a + offset, stride, width, height);
+        scalar(b + offset, stride, width, height);
+        YY_TEST_ASSERT(memcmp(a + offset, b + offset, stride * height) == 0,
+                       "%s: width %u height %u stride %zu offset %zu", name, width, height, stride, offset);
+        free(a);
+        free(b);
+    }
+}
+
+/// Premultiply every (color, alpha) pair.
+static void yy_test_premultiply_all(void) {
+    uint8_t *a = malloc(256 * 256 * 4), *b = malloc(256 * 256 * 4);
+    for (uint32_t i = 0; i < 256 * 256; i++) {
+        uint8_t color = (uint8_t)(i & 0xFF), alpha = (uint8_t)(i >> 8);
+        a[i * 4 + 0] = color;
+        a[i * 4 + 1] = (uint8_t)(255 - color);
+        a[i * 4 + 2] = (uint8_t)(color * 7);
+        a[i * 4 + 3] = alpha;
+    }
+    memcpy(b, a, 256 * 256 * 4);
+    yy_pixel_premultiply(a, 256 * 4, 256, 256);
+    yy_pixel_premultiply_scalar(b, 256 * 4, 256, 256);
+    YY_TEST_ASSERT(memcmp(a, b, 256 * 256 * 4) == 0, "premultiply");
+    for (uint32_t i = 0; i < 256 * 256; i++) {
+        uint32_t color = i & 0xFF, alpha = i >> 8;
+        if (b[i * 4] != (color * alpha + 127) / 255) {
+            YY_TEST_ASSERT(false, "premultiply_scalar: color %u alpha %u -> %u", color, alpha, b[i * 4]);
+            break;
+        }
+    }
+    free(a);
+    free(b);
+}
+
+/// Unpremultiply every (color, alpha) pair, including invalid colors larger than the alpha.
+static void yy_test_unpremultiply_all(void) {
+    uint8_t *a = malloc(256 * 256 * 4), *b = malloc(256 * 256 * 4);
+    for (uint32_t i = 0; i < 256 * 256; i++) {
+        uint8_t color = (uint8_t)(i & 0xFF), alpha = (uint8_t)(i >> 8);
+        a[i * 4 + 0] = color;
+        a[i * 4 + 1] = (uint8_t)(color / 2);
+        a[i * 4 + 2] = (uint8_t)(255 - color);
+        a[i * 4 + 3] = alpha;
+    }
+    memcpy(b, a, 256 * 256 * 4);
+    yy_pixel_unpremultiply(a, 256 * 4, 256, 256);
+    yy_pixel_unpremultiply_scalar(b, 256 * 4, 256, 256);
+    YY_TEST_ASSERT(memcmp(a, b, 256 * 256 * 4) == 0, "unpremultiply");
+    free(a);
+    free(b);
+}
+
+/// Blend every (src color, src alpha) pair over every dst value.
+static void yy_test_blend_over_all(void) {
+    uint8_t *src = malloc(256 * 256 * 4);
+    uint8_t *a = malloc(256 * 256 * 4), *b = malloc(256 * 256 * 4);
+    for (uint32_t i = 0; i < 256 * 256; i++) {
+        uint8_t alpha = (uint8_t)(i >> 8);
+        uint8_t color = (uint8_t)((i & 0xFF) * alpha / 255); // premultiplied
+        src[i * 4 + 0] = color;
+        src[i * 4 + 1] = (uint8_t)(alpha - color);
+        src[i * 4 + 2] = (uint8_t)(color / 3);
+        src[i * 4 + 3] = alpha;
+    }
+    for (uint32_t value = 0; value < 256; value++) {
+        memset(a, (int)value, 256 * 256 * 4);
+        memset(b, (int)value, 256 * 256 * 4);
+        yy_pixel_blend_over(a, 256 * 4, src, 256 * 4, 256, 256);
+        yy_pixel_blend_over_scalar(b, 256 * 4, src, 256 * 4, 256, 256);
+        if (memcmp(a, b, 256 * 256 * 4) != 0) {
+            YY_TEST_ASSERT(false, "blend_over: dst %u", value);
+            break;
+        }
+    }
+    free(src);
+    free(a);
+    free(b);
+}
+
+/// Blend random rects with different src and dst strides and alignments.
+static void yy_test_blend_over_random(void) {
+    uint32_t state = 0x2545F491;
+    for (int round = 0; round < 2000; round++) {
+        uint32_t width = yy_test_rand_range(&state, 0, 70);
+        uint32_t height = yy_test_rand_range(&state, 1, 5);
+        size_t src_stride = (size_t)width * 4 + yy_test_rand_range(&state, 0, 3) * 4;
+        size_t dst_stride = (size_t)width * 4 + yy_test_rand_range(&state, 0, 3) * 4;
+        size_t src_offset = yy_test_rand_range(&state, 0, 15), dst_offset = yy_test_rand_range(&state, 0, 15);
+        uint8_t *src = malloc(src_stride * height + src_offset + 1);
+        uint8_t *a = malloc(dst_stride * height + dst_offset + 1), *b = malloc(dst_stride * height + dst_offset + 1);
+        yy_test_fill_random(&state, src + src_offset, src_stride * height, true);
+        yy_pixel_premultiply_scalar(src + src_offset, src_stride, width, height);
+        yy_test_fill_random(&state, a + dst_offset, dst_stride * height, true);
+        yy_pixel_premultiply_scalar(a + dst_offset, dst_stride, width, height);
+        memcpy(b, a, dst_stride * height + dst_offset);
+        yy_pixel_blend_over(a + dst_offset, dst_stride, src + src_offset, src_stride, width, height);
+        yy_pixel_blend_over_scalar(b + dst_offset, dst_stride, src + src_offset, src_stride, width, height);
+        YY_TEST_ASSERT(memcmp(a + dst_offset, b + dst_offset, dst_stride * height) == 0,
+                       "blend_over: width %u height %u", width, height);
+        free(src);
+        free(a);
+        free(b);
+    }
+}
+
+/// A uniform image stays uniform, and a 2x box filter averages 2x2 blocks.
+static void yy_test_downsample(void) {
+    uint8_t src[8 * 6 * 4], dst[5 * 5 * 4];
+    for (size_t i = 0; i < sizeof(src); i += 4) {
+        src[i] = 10; src[i + 1] = 20; src[i + 2] = 30; src[i + 3] = 40;
+    }
+    YY_TEST_ASSERT(yy_pixel_downsample(dst, 3 * 4, 3, 5, src, 8 * 4, 8, 6), "downsample");
+    bool uniform = true;
+    for (size_t i = 0; i < 3 * 5 * 4; i += 4) {
+        uniform = uniform && dst[i] == 10 && dst[i + 1] == 20 && dst[i + 2] == 30 && dst[i + 3] == 40;
+    }
+    YY_TEST_ASSERT(uniform, "downsample: uniform");
+
+    for (uint32_t y = 0; y < 6; y++) {
+        for (uint32_t x = 0; x < 8; x++) {
+            memset(src + (y * 8 + x) * 4, (int)((x + y) % 2 ? 200 : 100), 4);
+        }
+    }
+    YY_TEST_ASSERT(yy_pixel_downsample(dst, 4 * 4, 4, 3, src, 8 * 4, 8, 6), "downsample");
+    YY_TEST_ASSERT(dst[0] == 150 && dst[3] == 150, "downsample: average %u", dst[0]);
+
+    YY_TEST_ASSERT(!yy_pixel_downsample(dst, 5 * 4, 9, 1, src, 8 * 4, 8, 6), "downsample: larger");
+    YY_TEST_ASSERT(!yy_pixel_downsample(dst, 5 * 4, 0, 1, src, 8 * 4, 8, 6), "downsample: empty");
+}
+
+int main(void) {
+    yy_test_premultiply_all();
+    yy_test_unpremultiply_all();
+    yy_test_blend_over_all();
+    yy_test_unary_random("premultiply", yy_pixel_premultiply, yy_pixel_premultiply_scalar);
+    yy_test_unary_random("unpremultiply", yy_pixel_unpremultiply, yy_pixel_unpremultiply_scalar);
+    yy_test_blend_over_random();
+    yy_test_downsample();
+    if (yy_test_failures) {
+        fprintf(stderr, "YYImagePixelTests: %d failure(s)\n", yy_test_failures);
+        return 1;
+    }
+    printf("YYImagePixelTests: ok\n");
+    return 0;
+}
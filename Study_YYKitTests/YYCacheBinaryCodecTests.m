@@ -0,0 +1,154 @@
+//
+//  YYCacheBinaryCodecTests.m
+//  Study_YYKitTests
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYCacheBinaryCodec.h>
+#import <YYKit/YYDiskCache.h>
+#import <YYKit/NSObject+YYModel.h>
+
+@interface YYCacheBinaryCodecTestUser : NSObject <YYModel, NSCoding>
+@property (nonatomic, copy) NSString *name;
+@property (nonatomic, assign) NSInteger age;
+@property (nonatomic, assign) double score;
+@property (nonatomic, assign) BOOL verified;
+@property (nonatomic, strong) NSDate *created;
+@property (nonatomic, copy) NSArray *tags;
+@property (nonatomic, strong) YYCacheBinaryCodecTestUser *friend;
+@end
+
+@implementation YYCacheBinaryCodecTestUser
+- (void)encodeWithCoder:(NSCoder *)aCoder { [self modelEncodeWithCoder:aCoder]; }
+- (id)initWithCoder:(NSCoder *)aDecoder { self = [super init]; return [self modelInitWithCoder:aDecoder]; }
+- (NSUInteger)hash { return [self modelHash]; }
+- (BOOL)isEqual:(id)object { return [self modelIsEqual:object]; }
+@end
+
+@interface YYCacheBinaryCodecTests : YYCacheTestCase
+@end
+
+@implementation YYCacheBinaryCodecTests
+
+- (id)roundTrip:(id)object {
+    NSData *data = [YYCacheBinaryCodec dataWithObject:object];
+    XCTAssertNotNil(data, @"%@", object);
+    XCTAssertTrue([YYCacheBinaryCodec isBinaryData:data]);
+    return [YYCacheBinaryCodec objectWithData:data];
+}
+
+- (YYCacheBinaryCodecTestUser *)userWithName:(NSString *)name {
+    YYCacheBinaryCodecTestUser *user = [YYCacheBinaryCodecTestUser new];
+    user.name = name;
+    user.age = 30;
+    user.score = 4.75;
+    user.verified = YES;
+    user.created = [NSDate dateWithTimeIntervalSinceReferenceDate:500000000.125];
+    user.tags = @[@"a", @"b"];
+    return user;
+}
+
+- (void)testPropertyListRoundTrip {
+    NSMutableString *longString = [NSMutableString new];
+    for (int i = 0; i < 100; i++) [longString appendString:@"x"];
+    NSArray *values = @[@"", @"ascii", @"中文 émoji 😀", [NSString stringWithFormat:@"nul%Cinside", (unichar)0], longString,
+                        @0, @-1, @(INT64_MIN), @(INT64_MAX), @(UINT64_MAX), @3.25, @(-0.5f), @YES, @NO,
+                        [NSData data], [self dataWithLength:1000 seed:1],
+                        [NSDate dateWithTimeIntervalSinceReferenceDate:-12345.5], [NSNull null],
+                        @[], @{}, @[@1, @[@2, @[@3]]], @{@"key" : @{@"nested" : @[@"value", [NSNull null]]}, @7 : @"number key"}];
+    for (id value in values) {
+        XCTAssertEqualObjects([self roundTrip:value], value);
+    }
+    XCTAssertEqualObjects([self roundTrip:values], values);
+
+    // booleans are not decoded as integers
+    XCTAssertEqual([self roundTrip:@YES], (id)kCFBooleanTrue);
+    XCTAssertEqual([self roundTrip:@NO], (id)kCFBooleanFalse);
+    XCTAssertEqual(CFNumberIsFloatType((__bridge CFNumberRef)[self roundTrip:@1.0]), (Boolean)true);
+}
+
+- (void)testRepeatedStringsAreReferenced {
+    NSDictionary *status = @{@"screen_name" : @"a", @"profile_image_url" : @"b", @"created_at" : @"c"};
+    NSMutableArray *statuses = [NSMutableArray new];
+    for (int i = 0; i < 100; i++) [statuses addObject:status];
+    NSUInteger one = [YYCacheBinaryCodec dataWithObject:@[status]].length;
+    NSUInteger hundred = [YYCacheBinaryCodec dataWithObject:statuses].length;
+    XCTAssertLessThan(hundred, one * 100 / 4);
+    XCTAssertEqualObjects([self roundTrip:statuses], statuses);
+}
+
+- (void)testModelRoundTrip {
+    YYCacheBinaryCodecTestUser *user = [self userWithName:@"user"];
+    user.friend = [self userWithName:@"friend"];
+    YYCacheBinaryCodecTestUser *decoded = [self roundTrip:user];
+    XCTAssertTrue([decoded isKindOfClass:[YYCacheBinaryCodecTestUser class]]);
+    XCTAssertEqualObjects(decoded, user);
+    XCTAssertEqualObjects(decoded.friend.name, @"friend");
+    XCTAssertEqual(decoded.age, (NSInteger)30);
+    XCTAssertEqual(decoded.score, 4.75);
+    XCTAssertTrue(decoded.verified);
+
+    NSArray *users = @[user, [self userWithName:@"other"]];
+    XCTAssertEqualObjects([self roundTrip:@{@"users" : users}], @{@"users" : users});
+}
+
+- (void)testOtherCodingObjectsAreArchived {
+    NSArray *values = @[[NSURL URLWithString:@"https://example.com/a.png"], [NSDecimalNumber decimalNumberWithString:@"12.345"],
+                        [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(3, 5)]];
+    for (id value in values) {
+        XCTAssertEqualObjects([self roundTrip:value], value);
+    }
+    XCTAssertEqualObjects([self roundTrip:@{@"values" : values}], @{@"values" : values});
+
+    // not NSCoding
+    XCTAssertNil([YYCacheBinaryCodec dataWithObject:[NSObject new]]);
+    XCTAssertNil(([YYCacheBinaryCodec dataWithObject:@[@1, [NSObject new]]]));
+    XCTAssertNil([YYCacheBinaryCodec dataWithObject:@{@"key" : [NSObject new]}]);
+}
+
+- (void)testNestingLimit {
+    id object = @1;
+    for (int i = 0; i < 63; i++) object = @[object];
+    XCTAssertEqualObjects([self roundTrip:object], object);
+    XCTAssertNil([YYCacheBinaryCodec dataWithObject:@[object]]);
+}
+
+- (void)testInvalidData {
+    XCTAssertNil([YYCacheBinaryCodec objectWithData:[NSData data]]);
+    XCTAssertNil([YYCacheBinaryCodec objectWithData:[NSKeyedArchiver archivedDataWithRootObject:@"archived"]]);
+    XCTAssertFalse([YYCacheBinaryCodec isBinaryData:[NSKeyedArchiver archivedDataWithRootObject:@"archived"]]);
+
+    YYCacheBinaryCodecTestUser *user = [self userWithName:@"user"];
+    NSData *data = [YYCacheBinaryCodec dataWithObject:@[@"string", @"string", @(INT64_MIN), @{@"user" : user}, [NSData data]]];
+    for (NSUInteger length = 0; length < data.length; length++) {
+        XCTAssertNil([YYCacheBinaryCodec objectWithData:[data subdataWithRange:NSMakeRange(0, length)]], @"length %lu", (unsigned long)length);
+    }
+    NSMutableData *trailing = data.mutableCopy;
+    [trailing appendBytes:"\0" length:1];
+    XCTAssertNil([YYCacheBinaryCodec objectWithData:trailing]);
+
+    // random bytes after the header don't crash
+    uint8_t header[4] = {'Y', 'Y', 'B', 1};
+    for (int i = 0; i < 1000; i++) {
+        NSMutableData *random = [NSMutableData dataWithBytes:header length:4];
+        [random appendData:[self randomDataWithLength:1 + arc4random_uniform(64)]];
+        [YYCacheBinaryCodec objectWithData:random];
+    }
+}
+
+- (void)testDiskCacheReadsBothFormats {
+    YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path];
+    YYCacheBinaryCodecTestUser *user = [self userWithName:@"user"];
+    [cache setObject:user forKey:@"archived"];
+    cache.binaryCodecEnabled = YES;
+    [cache setObject:user forKey:@"binary"];
+    [cache setObject:@{@"list" : @[@1, @"2"]} forKey:@"plist"];
+
+    XCTAssertEqualObjects([cache objectForKey:@"archived"], user);
+    XCTAssertEqualObjects([cache objectForKey:@"binary"], user);
+    cache.binaryCodecEnabled = NO;
+    XCTAssertEqualObjects([cache objectForKey:@"binary"], user);
+    XCTAssertEqualObjects([cache objectForKey:@"plist"], (@{@"list" : @[@1, @"2"]}));
+}
+
+@end
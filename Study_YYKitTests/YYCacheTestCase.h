@@ -0,0 +1,51 @@
+//
+//  YYCacheTestCase.h
+//  Study_YYKitTests
+//
+
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ The base class of the cache tests and benchmarks.
+ Each test gets its own temporary directory, which is removed after the test.
+ */
+@interface YYCacheTestCase : XCTestCase
+
+/// An unique path in the temporary directory, it doesn't exist before the test.
+@property (nonatomic, copy, readonly) NSString *path;
+
+/// The data directory of a YYKVStorage at `path`.
+@property (nonatomic, copy, readonly) NSString *dataPath;
+
+/// The file names in `dataPath`, sorted.
+- (NSArray<NSString *> *)dataFiles;
+
+/// Data of a pattern which differs for each seed, it doesn't compress well.
+- (NSData *)dataWithLength:(NSUInteger)length seed:(uint8_t)seed;
+
+/// Random data, it doesn't compress at all.
+- (NSData *)randomDataWithLength:(NSUInteger)length;
+
+/// Text-like data which compresses well.
+- (NSData *)compressibleDataWithLength:(NSUInteger)length;
+
+/// The memory of this process which counts against its limit (dirty and compressed pages).
+- (int64_t)physicalFootprint;
+
+/// Run the SQL statements on another connection to the manifest of a YYKVStorage
+/// at `path`, returns the first column of the last row (0 if no row).
+- (int64_t)executeSQL:(NSString *)sql;
+
+/// Wait until the object is deallocated (e.g. a cache whose blocks are still running,
+/// so the next `initWithPath:` of its path creates a new instance), returns NO if timed out.
+- (BOOL)waitForReleaseOfObject:(__weak id)object;
+
+/// Run a block on `threadCount` threads (not a thread pool, so it may be more
+/// than the CPU count), and returns the wall time from start to the last finish.
+- (NSTimeInterval)runThreads:(NSUInteger)threadCount block:(void (^)(NSUInteger thread))block;
+
+@end
+
+NS_ASSUME_NONNULL_END
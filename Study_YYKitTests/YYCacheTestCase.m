@@ -0,0 +1,126 @@
+//
+//  YYCacheTestCase.m
+//  Study_YYKitTests
+//
+
+#import "YYCacheTestCase.h"
+#import <QuartzCore/QuartzCore.h>
+#import <pthread.h>
+#import <mach/mach.h>
+#import <sqlite3.h>
+
+static void *YYCacheTestThread(void *context) {
+    void (^block)(void) = (__bridge_transfer id)context;
+    block();
+    return NULL;
+}
+
+@implementation YYCacheTestCase
+
+- (void)setUp {
+    [super setUp];
+    NSString *name = [NSString stringWithFormat:@"%@-%@", NSStringFromClass(self.class), [NSUUID UUID].UUIDString];
+    _path = [NSTemporaryDirectory() stringByAppendingPathComponent:name];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:_path error:NULL];
+    [super tearDown];
+}
+
+- (NSString *)dataPath {
+    return [_path stringByAppendingPathComponent:@"data"];
+}
+
+- (NSArray<NSString *> *)dataFiles {
+    NSArray *files = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:self.dataPath error:NULL];
+    return [files sortedArrayUsingSelector:@selector(compare:)] ?: @[];
+}
+
+- (NSData *)dataWithLength:(NSUInteger)length seed:(uint8_t)seed {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    uint8_t *bytes = data.mutableBytes;
+    for (NSUInteger i = 0; i < length; i++) bytes[i] = (uint8_t)(i * 31 + seed);
+    return data;
+}
+
+- (NSData *)randomDataWithLength:(NSUInteger)length {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    arc4random_buf(data.mutableBytes, length);
+    return data;
+}
+
+- (NSData *)compressibleDataWithLength:(NSUInteger)length {
+    NSMutableData *data = [NSMutableData dataWithCapacity:length];
+    for (NSUInteger i = 0; data.length < length; i++) {
+        NSString *line = [NSString stringWithFormat:@"{\"id\":%lu,\"name\":\"item\",\"tags\":[\"a\",\"b\"]}\n", (unsigned long)(i % 100)];
+        [data appendData:[line dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+    data.length = length;
+    return data;
+}
+
+- (int64_t)physicalFootprint {
+    task_vm_info_data_t info;
+    mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+    if (task_info(mach_task_self(), TASK_VM_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+    return (int64_t)info.phys_footprint;
+}
+
+- (int64_t)executeSQL:(NSString *)sql {
+    NSString *dbPath = [self.path stringByAppendingPathComponent:@"manifest.sqlite"];
+    sqlite3 *db = NULL;
+    if (sqlite3_open(dbPath.UTF8String, &db) != SQLITE_OK) {
+        XCTFail(@"open %@ failed", dbPath);
+        sqlite3_close(db);
+        return 0;
+    }
+    sqlite3_busy_timeout(db, 1000);
+    int64_t value = 0;
+    const char *tail = sql.UTF8String;
+    while (tail && *tail) {
+        sqlite3_stmt *stmt = NULL;
+        if (sqlite3_prepare_v2(db, tail, -1, &stmt, &tail) != SQLITE_OK) {
+            XCTFail(@"%@: %s", sql, sqlite3_errmsg(db));
+            break;
+        }
+        if (!stmt) break; // trailing whitespace
+        int result;
+        while ((result = sqlite3_step(stmt)) == SQLITE_ROW) value = sqlite3_column_int64(stmt, 0);
+        if (result != SQLITE_DONE) XCTFail(@"%@: %s", sql, sqlite3_errmsg(db));
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+- (BOOL)waitForReleaseOfObject:(__weak id)object {
+    for (int i = 0; i < 5000 && object; i++) usleep(1000);
+    return object == nil;
+}
+
+- (NSTimeInterval)runThreads:(NSUInteger)threadCount block:(void (^)(NSUInteger thread))block {
+    dispatch_semaphore_t start = dispatch_semaphore_create(0);
+    dispatch_group_t group = dispatch_group_create();
+    for (NSUInteger i = 0; i < threadCount; i++) {
+        dispatch_group_enter(group);
+        void (^body)(void) = ^{
+            dispatch_semaphore_wait(start, DISPATCH_TIME_FOREVER);
+            block(i);
+            dispatch_group_leave(group);
+        };
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, YYCacheTestThread, (__bridge_retained void *)[body copy]) != 0) {
+            dispatch_group_leave(group);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    [NSThread sleepForTimeInterval:0.01]; // all threads are waiting
+    CFTimeInterval begin = CACurrentMediaTime();
+    for (NSUInteger i = 0; i < threadCount; i++) dispatch_semaphore_signal(start);
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    return CACurrentMediaTime() - begin;
+}
+
+@end
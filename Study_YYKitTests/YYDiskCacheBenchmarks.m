@@ -0,0 +1,578 @@
+//
+//  YYDiskCacheBenchmarks.m
+//  Study_YYKitTests
+//
+//  The results are printed to the test log, run them with a release build on a
+//  device, the simulator's file system is the Mac's.
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYKVStorage.h>
+#import <YYKit/YYDiskCache.h>
+#import <YYKit/YYCacheBinaryCodec.h>
+#import <QuartzCore/QuartzCore.h>
+#import <sqlite3.h>
+
+#pragma mark - counting VFS
+
+/// The I/O calls of the sqlite connections opened while the counting VFS is the default.
+static struct {
+    int64_t syncCount;
+    int64_t writeCount;
+    int64_t writeBytes;
+} YYBenchmarkIO;
+
+typedef struct {
+    sqlite3_file base;
+    sqlite3_file *real; ///< the file of the real VFS, allocated after this struct
+} YYBenchmarkFile;
+
+#define YY_REAL(file) (((YYBenchmarkFile *)(file))->real)
+
+static int YYBenchmarkClose(sqlite3_file *f) {
+    int result = YY_REAL(f)->pMethods ? YY_REAL(f)->pMethods->xClose(YY_REAL(f)) : SQLITE_OK;
+    f->pMethods = NULL;
+    return result;
+}
+static int YYBenchmarkRead(sqlite3_file *f, void *buf, int amount, sqlite3_int64 offset) {
+    return YY_REAL(f)->pMethods->xRead(YY_REAL(f), buf, amount, offset);
+}
+static int YYBenchmarkWrite(sqlite3_file *f, const void *buf, int amount, sqlite3_int64 offset) {
+    __atomic_fetch_add(&YYBenchmarkIO.writeCount, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&YYBenchmarkIO.writeBytes, amount, __ATOMIC_RELAXED);
+    return YY_REAL(f)->pMethods->xWrite(YY_REAL(f), buf, amount, offset);
+}
+static int YYBenchmarkTruncate(sqlite3_file *f, sqlite3_int64 size) {
+    return YY_REAL(f)->pMethods->xTruncate(YY_REAL(f), size);
+}
+static int YYBenchmarkSync(sqlite3_file *f, int flags) {
+    __atomic_fetch_add(&YYBenchmarkIO.syncCount, 1, __ATOMIC_RELAXED);
+    return YY_REAL(f)->pMethods->xSync(YY_REAL(f), flags);
+}
+static int YYBenchmarkFileSize(sqlite3_file *f, sqlite3_int64 *size) {
+    return YY_REAL(f)->pMethods->xFileSize(YY_REAL(f), size);
+}
+static int YYBenchmarkLock(sqlite3_file *f, int lock) {
+    return YY_REAL(f)->pMethods->xLock(YY_REAL(f), lock);
+}
+static int YYBenchmarkUnlock(sqlite3_file *f, int lock) {
+    return YY_REAL(f)->pMethods->xUnlock(YY_REAL(f), lock);
+}
+static int YYBenchmarkCheckReservedLock(sqlite3_file *f, int *result) {
+    return YY_REAL(f)->pMethods->xCheckReservedLock(YY_REAL(f), result);
+}
+static int YYBenchmarkFileControl(sqlite3_file *f, int op, void *arg) {
+    return YY_REAL(f)->pMethods->xFileControl(YY_REAL(f), op, arg);
+}
+static int YYBenchmarkSectorSize(sqlite3_file *f) {
+    return YY_REAL(f)->pMethods->xSectorSize(YY_REAL(f));
+}
+static int YYBenchmarkDeviceCharacteristics(sqlite3_file *f) {
+    return YY_REAL(f)->pMethods->xDeviceCharacteristics(YY_REAL(f));
+}
+static int YYBenchmarkShmMap(sqlite3_file *f, int page, int size, int extend, void volatile **memory) {
+    return YY_REAL(f)->pMethods->xShmMap(YY_REAL(f), page, size, extend, memory);
+}
+static int YYBenchmarkShmLock(sqlite3_file *f, int offset, int n, int flags) {
+    return YY_REAL(f)->pMethods->xShmLock(YY_REAL(f), offset, n, flags);
+}
+static void YYBenchmarkShmBarrier(sqlite3_file *f) {
+    YY_REAL(f)->pMethods->xShmBarrier(YY_REAL(f));
+}
+static int YYBenchmarkShmUnmap(sqlite3_file *f, int deleteFlag) {
+    return YY_REAL(f)->pMethods->xShmUnmap(YY_REAL(f), deleteFlag);
+}
+
+// version 2 methods, so sqlite doesn't use the (not forwarded) memory-mapped I/O
+static const sqlite3_io_methods YYBenchmarkIOMethods = {
+    2, YYBenchmarkClose, YYBenchmarkRead, YYBenchmarkWrite, YYBenchmarkTruncate, YYBenchmarkSync,
+    YYBenchmarkFileSize, YYBenchmarkLock, YYBenchmarkUnlock, YYBenchmarkCheckReservedLock,
+    YYBenchmarkFileControl, YYBenchmarkSectorSize, YYBenchmarkDeviceCharacteristics,
+    YYBenchmarkShmMap, YYBenchmarkShmLock, YYBenchmarkShmBarrier, YYBenchmarkShmUnmap, NULL, NULL
+};
+
+static sqlite3_vfs YYBenchmarkVFS;
+
+static int YYBenchmarkOpen(sqlite3_vfs *vfs, const char *name, sqlite3_file *f, int flags, int *outFlags) {
+    sqlite3_vfs *real = vfs->pAppData;
+    YYBenchmarkFile *file = (YYBenchmarkFile *)f;
+    file->real = (sqlite3_file *)(file + 1);
+    int result = real->xOpen(real, name, file->real, flags, outFlags);
+    file->base.pMethods = file->real->pMethods ? &YYBenchmarkIOMethods : NULL;
+    return result;
+}
+
+/// Make the counting VFS the default, the storages must be opened after it and closed before `YYBenchmarkVFSEnd`.
+static void YYBenchmarkVFSBegin(void) {
+    if (!YYBenchmarkVFS.zName) {
+        sqlite3_vfs *real = sqlite3_vfs_find(NULL);
+        YYBenchmarkVFS = *real;
+        YYBenchmarkVFS.iVersion = real->iVersion < 3 ? real->iVersion : 3;
+        YYBenchmarkVFS.zName = "yy_benchmark";
+        YYBenchmarkVFS.pAppData = real;
+        YYBenchmarkVFS.szOsFile = (int)sizeof(YYBenchmarkFile) + real->szOsFile;
+        YYBenchmarkVFS.xOpen = YYBenchmarkOpen;
+        YYBenchmarkVFS.pNext = NULL;
+    }
+    sqlite3_vfs_register(&YYBenchmarkVFS, 1);
+    memset(&YYBenchmarkIO, 0, sizeof(YYBenchmarkIO));
+}
+
+static void YYBenchmarkVFSEnd(void) {
+    sqlite3_vfs_unregister(&YYBenchmarkVFS);
+}
+
+#pragma mark -
+
+@interface YYDiskCacheBenchmarks : YYCacheTestCase
+@end
+
+@implementation YYDiskCacheBenchmarks
+
+/// The value at a percentile (0 to 100) of the times, in milliseconds.
+- (double)millisecondsAtPercentile:(double)percentile ofTimes:(NSArray<NSNumber *> *)times {
+    if (times.count == 0) return 0;
+    NSArray *sorted = [times sortedArrayUsingSelector:@selector(compare:)];
+    NSUInteger index = MIN((NSUInteger)(percentile / 100 * sorted.count), sorted.count - 1);
+    return [sorted[index] doubleValue] * 1e3;
+}
+
+/// The total size of the files in a directory (not recursive).
+- (int64_t)sizeOfFilesAtPath:(NSString *)path {
+    int64_t size = 0;
+    for (NSString *name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:path error:NULL]) {
+        NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:[path stringByAppendingPathComponent:name] error:NULL];
+        size += [attributes fileSize];
+    }
+    return size;
+}
+
+/// The disk space allocated to the files under a directory (recursive).
+- (int64_t)allocatedSizeAtPath:(NSString *)path {
+    int64_t size = 0;
+    NSDirectoryEnumerator *enumerator = [[NSFileManager defaultManager] enumeratorAtURL:[NSURL fileURLWithPath:path]
+                                                             includingPropertiesForKeys:@[NSURLTotalFileAllocatedSizeKey]
+                                                                                options:0 errorHandler:nil];
+    for (NSURL *url in enumerator) {
+        NSNumber *allocated = nil;
+        [url getResourceValue:&allocated forKey:NSURLTotalFileAllocatedSizeKey error:NULL];
+        size += allocated.longLongValue;
+    }
+    return size;
+}
+
+/**
+ Writes per second and the sqlite I/O of 10k writes of 1KB values, each in its
+ own transaction and with the write-behind queue (group commit). The journal is
+ WAL with `synchronous = normal`, so a commit only appends to the WAL file, and
+ the syncs are done by the checkpoints.
+ */
+- (void)testWriteBehind {
+    int count = 10000;
+    NSMutableArray *values = [NSMutableArray new];
+    for (int i = 0; i < count; i++) [values addObject:[self dataWithLength:1024 seed:(uint8_t)i]];
+
+    NSMutableString *report = [NSMutableString stringWithFormat:@"\nYYKVStorage %d writes of 1KB\n%-14s %10s %8s %8s %10s\n",
+                               count, "mode", "writes/s", "fsyncs", "writes", "MB written"];
+    for (NSNumber *writeBehind in @[@NO, @YES]) {
+        NSString *path = [self.path stringByAppendingPathComponent:writeBehind.stringValue];
+        YYBenchmarkVFSBegin();
+        @autoreleasepool {
+            YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:path type:YYKVStorageTypeSQLite];
+            kv.writeBehindEnabled = writeBehind.boolValue;
+            memset(&YYBenchmarkIO, 0, sizeof(YYBenchmarkIO)); // not the initialization
+            CFTimeInterval begin = CACurrentMediaTime();
+            for (int i = 0; i < count; i++) {
+                [kv saveItemWithKey:@(i).stringValue value:values[i]];
+            }
+            [kv flushPendingWrites];
+            CFTimeInterval time = CACurrentMediaTime() - begin;
+            [report appendFormat:@"%-14s %10.0f %8lld %8lld %10.1f\n", writeBehind.boolValue ? "write-behind" : "per-item",
+             count / time, YYBenchmarkIO.syncCount, YYBenchmarkIO.writeCount, YYBenchmarkIO.writeBytes / 1e6];
+            XCTAssertEqual([kv getItemsCount], count);
+        }
+        YYBenchmarkVFSEnd();
+    }
+    NSLog(@"%@", report);
+}
+
+/**
+ Read latency and memory of file values from 1KB to 20MB, copied to heap and
+ mapped. A read is timed with one pass over the bytes (as a decoder does), so
+ the page faults of a mapped value are counted. The memory is the growth of
+ the physical footprint while 8 values of the size are alive.
+ */
+- (void)testMappedReads {
+    NSArray *sizes = @[@1024, @(64 * 1024), @(1024 * 1024), @(20 * 1024 * 1024)];
+    NSMutableString *report = [NSMutableString stringWithFormat:@"\nYYKVStorage file reads\n%-10s %-7s %9s %9s %11s\n",
+                               "size", "mode", "p50 ms", "p99 ms", "memory MB"];
+    for (NSNumber *size in sizes) {
+        NSUInteger length = size.unsignedIntegerValue;
+        int itemCount = 8, readCount = length > 1024 * 1024 ? 24 : 400;
+        NSString *path = [self.path stringByAppendingPathComponent:size.stringValue];
+        @autoreleasepool {
+            YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:path type:YYKVStorageTypeFile];
+            for (int i = 0; i < itemCount; i++) {
+                NSString *key = @(i).stringValue;
+                [kv saveItemWithKey:key value:[self dataWithLength:length seed:(uint8_t)i] filename:key extendedData:nil];
+            }
+        }
+        for (NSNumber *mapped in @[@NO, @YES]) {
+            @autoreleasepool {
+                YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:path type:YYKVStorageTypeFile];
+                kv.mappedReadsEnabled = mapped.boolValue;
+                NSMutableArray *times = [NSMutableArray new];
+                volatile uint8_t sum = 0;
+                for (int i = 0; i < readCount; i++) {
+                    CFTimeInterval begin = CACurrentMediaTime();
+                    NSData *value = [kv getItemValueForKey:@(i % itemCount).stringValue];
+                    const uint8_t *bytes = value.bytes;
+                    for (NSUInteger j = 0; j < value.length; j += 4096) sum += bytes[j];
+                    [times addObject:@(CACurrentMediaTime() - begin)];
+                }
+
+                NSMutableArray *alive = [NSMutableArray new];
+                int64_t footprint = [self physicalFootprint];
+                for (int i = 0; i < itemCount; i++) {
+                    NSData *value = [kv getItemValueForKey:@(i).stringValue];
+                    const uint8_t *bytes = value.bytes;
+                    for (NSUInteger j = 0; j < value.length; j += 4096) sum += bytes[j];
+                    [alive addObject:value];
+                }
+                int64_t growth = [self physicalFootprint] - footprint;
+                [report appendFormat:@"%-10s %-7s %9.3f %9.3f %11.1f\n",
+                 [NSByteCountFormatter stringFromByteCount:length countStyle:NSByteCountFormatterCountStyleBinary].UTF8String,
+                 mapped.boolValue ? "mapped" : "copied", [self millisecondsAtPercentile:50 ofTimes:times],
+                 [self millisecondsAtPercentile:99 ofTimes:times], growth / 1048576.0];
+            }
+        }
+    }
+    NSLog(@"%@", report);
+}
+
+/**
+ Disk usage and writes per second of 2000 values of 32KB (stored in files), 30%
+ of which repeat an earlier value (the same image with another URL). The disk
+ usage is the size of the data files, the manifest is about the same for both.
+ */
+- (void)testDeduplication {
+    int count = 2000, length = 32 * 1024;
+    NSMutableArray *values = [NSMutableArray new];
+    uint32_t state = 12345;
+    for (int i = 0; i < count; i++) {
+        state = state * 1103515245 + 12345;
+        if (i > 0 && (state >> 16) % 100 < 30) {
+            [values addObject:values[(state >> 8) % i]];
+        } else {
+            NSMutableData *value = [self dataWithLength:length seed:(uint8_t)i].mutableCopy;
+            [value replaceBytesInRange:NSMakeRange(0, sizeof(i)) withBytes:&i]; // the seed repeats after 256
+            [values addObject:value];
+        }
+    }
+
+    NSMutableString *report = [NSMutableString stringWithFormat:@"\nYYDiskCache %d writes of 32KB, 30%% duplicates\n%-8s %10s %8s %10s %10s\n",
+                               count, "dedup", "writes/s", "files", "disk MB", "saved MB"];
+    int64_t baseline = 0;
+    for (NSNumber *deduplication in @[@NO, @YES]) {
+        NSString *path = [self.path stringByAppendingPathComponent:deduplication.stringValue];
+        @autoreleasepool {
+            YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:path inlineThreshold:20 * 1024];
+            cache.customArchiveBlock = ^NSData *(id object) { return object; };
+            cache.customUnarchiveBlock = ^id(NSData *data) { return data; };
+            cache.deduplicationEnabled = deduplication.boolValue;
+            CFTimeInterval begin = CACurrentMediaTime();
+            for (int i = 0; i < count; i++) {
+                [cache setObject:values[i] forKey:@(i).stringValue];
+            }
+            CFTimeInterval time = CACurrentMediaTime() - begin;
+            NSString *dataPath = [path stringByAppendingPathComponent:@"data"];
+            int64_t size = [self sizeOfFilesAtPath:dataPath];
+            if (!deduplication.boolValue) baseline = size;
+            [report appendFormat:@"%-8s %10.0f %8lu %10.1f %10.1f\n", deduplication.boolValue ? "YES" : "NO", count / time,
+             (unsigned long)[[NSFileManager defaultManager] contentsOfDirectoryAtPath:dataPath error:NULL].count,
+             size / 1048576.0, (baseline - size) / 1048576.0];
+            XCTAssertEqualObjects([cache objectForKey:@(count - 1).stringValue], values[count - 1]);
+        }
+    }
+    NSLog(@"%@", report);
+}
+
+/// A page of a feed as it's parsed from JSON: 50 statuses with the same keys.
+- (NSArray *)feedPayload {
+    NSMutableArray *statuses = [NSMutableArray new];
+    for (int i = 0; i < 50; i++) {
+        NSMutableArray *pictures = [NSMutableArray new];
+        for (int j = 0; j < i % 4; j++) {
+            [pictures addObject:@{@"url" : [NSString stringWithFormat:@"https://example.com/pic/%d-%d.jpg", i, j],
+                                  @"width" : @(1080), @"height" : @(720 + j)}];
+        }
+        [statuses addObject:@{@"id" : @(4000000000LL + i),
+                              @"created_at" : [NSDate dateWithTimeIntervalSince1970:1500000000 + i * 60],
+                              @"text" : [NSString stringWithFormat:@"Status %d, a short text with a link https://example.com/s/%d", i, i],
+                              @"reposts_count" : @(i * 3), @"comments_count" : @(i * 2), @"attitudes_count" : @(i * 7),
+                              @"favorited" : @(i % 2 == 0), @"pictures" : pictures,
+                              @"user" : @{@"id" : @(1000 + i % 10),
+                                          @"screen_name" : [NSString stringWithFormat:@"user %d", i % 10],
+                                          @"avatar" : [NSString stringWithFormat:@"https://example.com/avatar/%d.jpg", i % 10],
+                                          @"verified" : @(i % 10 == 0)}}];
+    }
+    return statuses;
+}
+
+/**
+ Encode and decode time and size of a feed page with YYCacheBinaryCodec and
+ NSKeyedArchiver (the default archiver of YYDiskCache).
+ */
+- (void)testBinaryCodec {
+    NSArray *payload = [self feedPayload];
+    int count = 1000;
+    NSMutableString *report = [NSMutableString stringWithString:@"\nYYDiskCache codecs, a feed page of 50 statuses\n"];
+    [report appendFormat:@"%-16s %8s %12s %12s\n", "codec", "bytes", "encode us", "decode us"];
+    for (NSNumber *binary in @[@NO, @YES]) {
+        NSData *data = nil;
+        CFTimeInterval begin = CACurrentMediaTime();
+        for (int i = 0; i < count; i++) {
+            @autoreleasepool {
+                data = binary.boolValue ? [YYCacheBinaryCodec dataWithObject:payload] : [NSKeyedArchiver archivedDataWithRootObject:payload];
+            }
+        }
+        CFTimeInterval encode = CACurrentMediaTime() - begin;
+        id object = nil;
+        begin = CACurrentMediaTime();
+        for (int i = 0; i < count; i++) {
+            @autoreleasepool {
+                object = binary.boolValue ? [YYCacheBinaryCodec objectWithData:data] : [NSKeyedUnarchiver unarchiveObjectWithData:data];
+            }
+        }
+        CFTimeInterval decode = CACurrentMediaTime() - begin;
+        XCTAssertEqualObjects(object, payload);
+        [report appendFormat:@"%-16s %8lu %12.1f %12.1f\n", binary.boolValue ? "binary codec" : "NSKeyedArchiver",
+         (unsigned long)data.length, encode / count * 1e6, decode / count * 1e6];
+    }
+    NSLog(@"%@", report);
+}
+
+/**
+ Foreground read latency while the files of 1000 removed items (64MB) are purged
+ from trash, with the default rate limit and pause latency and without them. The
+ purge progress is the files removed per second of the purge. The reads are
+ timed here (with the value bytes touched) and by the storage's histogram.
+ */
+- (void)testTrashPurge {
+    int keepCount = 200, removeCount = 1000, length = 64 * 1024;
+    NSMutableString *report = [NSMutableString stringWithFormat:@"\nYYKVStorage purge of %d files of 64KB\n%-12s %8s %9s %9s %9s %9s %9s\n",
+                               removeCount, "mode", "purge s", "files/s", "reads", "p50 ms", "p99 ms", "hist p99"];
+    for (NSNumber *throttled in @[@YES, @NO]) {
+        NSString *path = [self.path stringByAppendingPathComponent:throttled.stringValue];
+        @autoreleasepool {
+            YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:path type:YYKVStorageTypeFile];
+            if (!throttled.boolValue) {
+                kv.trashPurgeFilesPerSecond = 0;
+                kv.trashPurgeBytesPerSecond = 0;
+                kv.trashPurgePauseLatency = 0;
+            }
+            NSMutableArray *removeKeys = [NSMutableArray new];
+            for (int i = 0; i < keepCount + removeCount; i++) {
+                NSString *key = @(i).stringValue;
+                [kv saveItemWithKey:key value:[self dataWithLength:length seed:(uint8_t)i] filename:key extendedData:nil];
+                if (i >= keepCount) [removeKeys addObject:key];
+            }
+            [kv resetTrashPurgeStatistics];
+
+            NSMutableArray *times = [NSMutableArray new];
+            volatile uint8_t sum = 0;
+            uint32_t state = 12345;
+            CFTimeInterval begin = CACurrentMediaTime();
+            [kv removeItemForKeys:removeKeys];
+            while (kv.purgingTrash && CACurrentMediaTime() - begin < 60) {
+                state = state * 1103515245 + 12345;
+                CFTimeInterval readBegin = CACurrentMediaTime();
+                NSData *value = [kv getItemValueForKey:@((state >> 16) % keepCount).stringValue];
+                const uint8_t *bytes = value.bytes;
+                for (NSUInteger j = 0; j < value.length; j += 4096) sum += bytes[j];
+                [times addObject:@(CACurrentMediaTime() - readBegin)];
+                usleep(1000); // a list scrolling, not a read loop
+            }
+            CFTimeInterval time = CACurrentMediaTime() - begin;
+            XCTAssertFalse(kv.purgingTrash);
+            XCTAssertEqual(kv.trashPurgedFileCount, (uint64_t)removeCount);
+            [report appendFormat:@"%-12s %8.2f %9.0f %9lu %9.3f %9.3f %9.3f\n", throttled.boolValue ? "throttled" : "unthrottled",
+             time, kv.trashPurgedFileCount / time, (unsigned long)times.count,
+             [self millisecondsAtPercentile:50 ofTimes:times], [self millisecondsAtPercentile:99 ofTimes:times],
+             [kv.trashPurgeReadLatency nanosecondsAtPercentile:99] / 1e6];
+        }
+    }
+    NSLog(@"%@", report);
+}
+
+/**
+ Reads per second of 2KB values (inline in sqlite) from 1 to 16 threads, with one
+ connection behind the cache's lock and with a pool of 4 and 16 reader connections.
+ */
+- (void)testConcurrentReads {
+    int count = 5000, readCount = 64000;
+    NSArray *threadCounts = @[@1, @2, @4, @8, @16];
+    NSMutableArray *keys = [NSMutableArray new];
+    for (int i = 0; i < count; i++) [keys addObject:@(i).stringValue];
+
+    NSMutableString *report = [NSMutableString stringWithString:@"\nYYDiskCache concurrent reads of 2KB (kreads/s)\n"];
+    [report appendFormat:@"%-8s", "readers"];
+    for (NSNumber *threadCount in threadCounts) [report appendFormat:@" %8lu", threadCount.unsignedLongValue];
+    [report appendString:@"\n"];
+    for (NSNumber *readers in @[@0, @4, @16]) {
+        NSString *path = [self.path stringByAppendingPathComponent:readers.stringValue];
+        @autoreleasepool {
+            YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:path inlineThreshold:NSUIntegerMax];
+            cache.customArchiveBlock = ^NSData *(id object) { return object; };
+            cache.customUnarchiveBlock = ^id(NSData *data) { return data; };
+            for (int i = 0; i < count; i++) [cache setObject:[self dataWithLength:2048 seed:(uint8_t)i] forKey:keys[i]];
+            cache.readerConnectionCount = readers.unsignedIntegerValue;
+            for (int i = 0; i < count; i++) [cache objectForKey:keys[i]]; // warm up the page cache
+
+            [report appendFormat:@"%-8lu", (unsigned long)cache.readerConnectionCount];
+            for (NSNumber *threadCount in threadCounts) {
+                NSUInteger threads = threadCount.unsignedIntegerValue;
+                __block int64_t misses = 0;
+                NSTimeInterval time = [self runThreads:threads block:^(NSUInteger thread) {
+                    uint32_t state = (uint32_t)thread * 2654435761U + 1;
+                    for (NSUInteger i = readCount / threads; i > 0; i--) {
+                        state = state * 1103515245 + 12345;
+                        if (![cache objectForKey:keys[(state >> 8) % count]]) __atomic_fetch_add(&misses, 1, __ATOMIC_RELAXED);
+                    }
+                }];
+                XCTAssertEqual(misses, (int64_t)0);
+                [report appendFormat:@" %8.1f", readCount / time / 1e3];
+            }
+            [report appendString:@"\n"];
+        }
+    }
+    NSLog(@"%@", report);
+}
+
+/**
+ Writes, reads and removes per second of 4000 values of 10KB to 50KB (about two
+ segments), stored in segment files and one file per value, and the disk space
+ (allocated blocks of all files) after the writes, after removing 3/4 of the
+ values, and after `compactSegments` (the segment being appended is not compacted).
+ */
+- (void)testSegmentStorage {
+    int count = 4000;
+    NSMutableArray *values = [NSMutableArray new];
+    uint32_t state = 12345;
+    for (int i = 0; i < count; i++) {
+        state = state * 1103515245 + 12345;
+        [values addObject:[self dataWithLength:10 * 1024 + (state >> 8) % (40 * 1024) seed:(uint8_t)i]];
+    }
+    NSMutableArray *removeKeys = [NSMutableArray new];
+    for (int i = 0; i < count; i++) {
+        if (i % 4) [removeKeys addObject:@(i).stringValue];
+    }
+
+    NSMutableString *report = [NSMutableString stringWithFormat:@"\nYYKVStorage %d values of 10KB to 50KB\n%-8s %9s %9s %9s %9s %9s %9s\n",
+                               count, "type", "writes/s", "reads/s", "removes/s", "disk MB", "removed", "compacted"];
+    for (NSNumber *type in @[@(YYKVStorageTypeFile), @(YYKVStorageTypeSegment)]) {
+        BOOL segment = type.unsignedIntegerValue == YYKVStorageTypeSegment;
+        NSString *path = [self.path stringByAppendingPathComponent:type.stringValue];
+        @autoreleasepool {
+            YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:path type:type.unsignedIntegerValue];
+            CFTimeInterval begin = CACurrentMediaTime();
+            for (int i = 0; i < count; i++) {
+                NSString *key = @(i).stringValue;
+                [kv saveItemWithKey:key value:values[i] filename:key extendedData:nil]; // the segment ignores the filename
+            }
+            CFTimeInterval writeTime = CACurrentMediaTime() - begin;
+            int64_t written = [self allocatedSizeAtPath:path];
+
+            int misses = 0;
+            begin = CACurrentMediaTime();
+            for (int i = 0; i < count; i++) {
+                state = state * 1103515245 + 12345;
+                int index = (state >> 8) % count;
+                if ([kv getItemValueForKey:@(index).stringValue].length != [values[index] length]) misses++;
+            }
+            CFTimeInterval readTime = CACurrentMediaTime() - begin;
+            XCTAssertEqual(misses, 0);
+
+            begin = CACurrentMediaTime();
+            for (NSString *key in removeKeys) [kv removeItemForKey:key];
+            CFTimeInterval removeTime = CACurrentMediaTime() - begin;
+            while (kv.purgingTrash) usleep(10000);
+            int64_t removed = [self allocatedSizeAtPath:path];
+            [kv compactSegments];
+            while (kv.purgingTrash) usleep(10000);
+            int64_t compacted = [self allocatedSizeAtPath:path];
+            XCTAssertEqual([kv getItemsCount], count / 4);
+
+            [report appendFormat:@"%-8s %9.0f %9.0f %9.0f %9.1f %9.1f %9.1f\n", segment ? "segment" : "file",
+             count / writeTime, count / readTime, removeKeys.count / removeTime,
+             written / 1048576.0, removed / 1048576.0, compacted / 1048576.0];
+        }
+    }
+    NSLog(@"%@", report);
+}
+
+/**
+ The time of `initWithPath:` of a cache with 100k items, and the latency of the
+ first miss and the first hit after it, opened at init and lazily (with the key
+ filter persisted by the last launch). A lazy hit waits for the open. The files
+ are in the page cache, the first launch after a reboot is slower.
+ */
+- (void)testLazyOpen {
+    int count = 100000, runCount = 5;
+    @autoreleasepool {
+        YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+        NSData *value = [self dataWithLength:100 seed:0];
+        NSMutableArray *items = [NSMutableArray new];
+        for (int i = 0; i < count; i++) {
+            YYKVStorageItem *item = [YYKVStorageItem new];
+            item.key = @(i).stringValue;
+            item.value = value;
+            [items addObject:item];
+            if (items.count == 1000 || i == count - 1) {
+                [kv saveItems:items];
+                [items removeAllObjects];
+            }
+        }
+    }
+
+    NSMutableString *report = [NSMutableString stringWithFormat:@"\nYYDiskCache open with %d items (ms, average of %d)\n%-6s %9s %11s %11s\n",
+                               count, runCount, "lazy", "init", "first miss", "first hit"];
+    NSString *filterPath = [self.path stringByAppendingPathComponent:@"manifest.filter"];
+    for (NSNumber *lazy in @[@NO, @YES]) {
+        if (lazy.boolValue) { // the filter is built and persisted after the first lazy open, and removed by an open at init
+            __weak YYDiskCache *weakCache;
+            @autoreleasepool {
+                YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path inlineThreshold:NSUIntegerMax lazyOpen:YES];
+                weakCache = cache;
+                [cache containsObjectForKey:@"0"];
+                for (int i = 0; i < 10000 && ![[NSFileManager defaultManager] fileExistsAtPath:filterPath]; i++) usleep(1000);
+            }
+            XCTAssertTrue([self waitForReleaseOfObject:weakCache]);
+            XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:filterPath]);
+        }
+        CFTimeInterval initTime = 0, missTime = 0, hitTime = 0;
+        for (int run = 0; run < runCount; run++) {
+            __weak YYDiskCache *weakCache;
+            @autoreleasepool {
+                CFTimeInterval begin = CACurrentMediaTime();
+                YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path inlineThreshold:NSUIntegerMax lazyOpen:lazy.boolValue];
+                initTime += CACurrentMediaTime() - begin;
+                weakCache = cache;
+
+                begin = CACurrentMediaTime();
+                XCTAssertFalse([cache containsObjectForKey:[NSString stringWithFormat:@"missing-%d", run]]);
+                missTime += CACurrentMediaTime() - begin;
+
+                begin = CACurrentMediaTime();
+                XCTAssertTrue([cache containsObjectForKey:@(run).stringValue]);
+                hitTime += CACurrentMediaTime() - begin;
+            }
+            XCTAssertTrue([self waitForReleaseOfObject:weakCache]);
+        }
+        [report appendFormat:@"%-6s %9.2f %11.3f %11.3f\n", lazy.boolValue ? "YES" : "NO",
+         initTime / runCount * 1e3, missTime / runCount * 1e3, hitTime / runCount * 1e3];
+    }
+    NSLog(@"%@", report);
+}
+
+@end
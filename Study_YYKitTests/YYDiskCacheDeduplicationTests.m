@@ -0,0 +1,106 @@
+//
+//  YYDiskCacheDeduplicationTests.m
+//  Study_YYKitTests
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYKVStorage.h>
+#import <YYKit/YYDiskCache.h>
+
+@interface YYDiskCacheDeduplicationTests : YYCacheTestCase
+@end
+
+@implementation YYDiskCacheDeduplicationTests
+
+- (YYKVStorage *)sharedFileStorage {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeFile];
+    kv.sharedFilesEnabled = YES;
+    return kv;
+}
+
+- (void)testSharedFileIsDeletedWithLastReference {
+    YYKVStorage *kv = [self sharedFileStorage];
+    NSData *a = [self dataWithLength:4096 seed:1], *b = [self dataWithLength:4096 seed:2];
+    XCTAssertTrue([kv saveItemWithKey:@"k1" value:a filename:@"content-a" extendedData:nil]);
+    XCTAssertTrue([kv saveItemWithKey:@"k2" value:a filename:@"content-a" extendedData:nil]);
+    XCTAssertTrue([kv saveItemWithKey:@"k3" value:a filename:@"content-a" extendedData:nil]);
+    XCTAssertEqualObjects([self dataFiles], @[@"content-a"]);
+    XCTAssertEqual([kv getItemsSize], (int)a.length * 3); // counted for each key
+
+    XCTAssertTrue([kv removeItemForKey:@"k1"]);
+    XCTAssertEqualObjects([self dataFiles], @[@"content-a"]);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"k2"], a);
+
+    // replacing an item releases its old file
+    XCTAssertTrue([kv saveItemWithKey:@"k2" value:b filename:@"content-b" extendedData:nil]);
+    XCTAssertEqualObjects(([self dataFiles]), (@[@"content-a", @"content-b"]));
+    XCTAssertEqualObjects([kv getItemValueForKey:@"k3"], a);
+
+    XCTAssertTrue([kv removeItemForKey:@"k3"]);
+    XCTAssertEqualObjects([self dataFiles], @[@"content-b"]);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"k2"], b);
+}
+
+- (void)testBatchRemoveReleasesEachReference {
+    YYKVStorage *kv = [self sharedFileStorage];
+    NSData *a = [self dataWithLength:4096 seed:1];
+    for (int i = 0; i < 4; i++) {
+        [kv saveItemWithKey:@(i).stringValue value:a filename:@"content-a" extendedData:nil];
+    }
+    XCTAssertTrue([kv removeItemForKeys:@[@"0", @"1", @"2"]]);
+    XCTAssertEqualObjects([self dataFiles], @[@"content-a"]);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"3"], a);
+
+    XCTAssertTrue([kv removeItemForKeys:@[@"3"]]);
+    XCTAssertEqual([self dataFiles].count, (NSUInteger)0);
+    XCTAssertEqual([kv getItemsCount], 0);
+}
+
+- (void)testTrimReleasesReferences {
+    YYKVStorage *kv = [self sharedFileStorage];
+    NSData *a = [self dataWithLength:4096 seed:1];
+    for (int i = 0; i < 4; i++) {
+        [kv saveItemWithKey:@(i).stringValue value:a filename:@"content-a" extendedData:nil];
+    }
+    XCTAssertTrue([kv removeItemsToFitCount:1]);
+    XCTAssertEqual([kv getItemsCount], 1);
+    XCTAssertEqualObjects([self dataFiles], @[@"content-a"]);
+    XCTAssertTrue([kv removeItemsToFitCount:0]);
+    XCTAssertEqual([self dataFiles].count, (NSUInteger)0);
+}
+
+- (void)testReferencesSurviveReopen {
+    NSData *a = [self dataWithLength:4096 seed:1];
+    @autoreleasepool {
+        YYKVStorage *kv = [self sharedFileStorage];
+        [kv saveItemWithKey:@"k1" value:a filename:@"content-a" extendedData:nil];
+        [kv saveItemWithKey:@"k2" value:a filename:@"content-a" extendedData:nil];
+    }
+    YYKVStorage *kv = [self sharedFileStorage];
+    XCTAssertTrue([kv removeItemForKey:@"k1"]);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"k2"], a);
+    XCTAssertTrue([kv removeItemForKey:@"k2"]);
+    XCTAssertEqual([self dataFiles].count, (NSUInteger)0);
+}
+
+- (void)testDiskCacheStoresSameDataOnce {
+    YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path inlineThreshold:0];
+    cache.deduplicationEnabled = YES;
+    cache.customArchiveBlock = ^(id object) { return (NSData *)object; }; // store the data as it is
+    cache.customUnarchiveBlock = ^(NSData *data) { return (id)data; };
+    NSData *a = [self dataWithLength:64 * 1024 seed:1], *b = [self dataWithLength:64 * 1024 seed:2];
+    [cache setObject:a forKey:@"url-1"];
+    [cache setObject:a forKey:@"url-2"];
+    [cache setObject:b forKey:@"url-3"];
+    XCTAssertEqual([self dataFiles].count, (NSUInteger)2);
+    XCTAssertEqual(cache.totalCount, (NSInteger)3);
+
+    [cache removeObjectForKey:@"url-1"];
+    XCTAssertEqualObjects([cache objectForKey:@"url-2"], a);
+    XCTAssertEqual([self dataFiles].count, (NSUInteger)2);
+    [cache removeObjectForKey:@"url-2"];
+    XCTAssertEqual([self dataFiles].count, (NSUInteger)1);
+    XCTAssertEqualObjects([cache objectForKey:@"url-3"], b);
+}
+
+@end
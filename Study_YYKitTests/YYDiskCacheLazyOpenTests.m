@@ -0,0 +1,181 @@
+//
+//  YYDiskCacheLazyOpenTests.m
+//  Study_YYKitTests
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYDiskCache.h>
+#import <YYKit/YYKVStorage.h>
+#import <YYKit/YYCacheKeyFilter.h>
+
+@interface YYDiskCacheLazyOpenTests : YYCacheTestCase
+@end
+
+@implementation YYDiskCacheLazyOpenTests
+
+- (NSString *)filterPath {
+    return [self.path stringByAppendingPathComponent:@"manifest.filter"];
+}
+
+- (BOOL)filterExists {
+    return [[NSFileManager defaultManager] fileExistsAtPath:[self filterPath]];
+}
+
+- (BOOL)waitForFilter {
+    for (int i = 0; i < 5000 && ![self filterExists]; i++) usleep(1000);
+    return [self filterExists];
+}
+
+/// Write the items with a cache opened at init, and persist the filter with a lazy open.
+- (void)prepareCacheWithCount:(int)count {
+    __weak YYDiskCache *weakCache;
+    @autoreleasepool {
+        YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path inlineThreshold:NSUIntegerMax lazyOpen:NO];
+        weakCache = cache;
+        for (int i = 0; i < count; i++) [cache setObject:@(i).stringValue forKey:@(i).stringValue];
+    }
+    XCTAssertTrue([self waitForReleaseOfObject:weakCache]);
+    XCTAssertFalse([self filterExists]);
+
+    @autoreleasepool {
+        YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path inlineThreshold:NSUIntegerMax lazyOpen:YES];
+        weakCache = cache;
+        XCTAssertTrue([cache containsObjectForKey:@"0"]); // opens the storage, the filter is built after
+        XCTAssertTrue([self waitForFilter]);
+    }
+    XCTAssertTrue([self waitForReleaseOfObject:weakCache]);
+}
+
+- (void)testKeyFilter {
+    YYCacheKeyFilter *filter = [[YYCacheKeyFilter alloc] initWithCapacity:10];
+    XCTAssertEqual(filter.capacity, (NSUInteger)1024);
+    for (int i = 0; i < 1000; i++) [filter addKey:@(i).stringValue];
+    XCTAssertEqual(filter.count, (NSUInteger)1000);
+    XCTAssertFalse(filter.saturated);
+    int falsePositives = 0;
+    for (int i = 0; i < 1000; i++) {
+        XCTAssertTrue([filter mayContainKey:@(i).stringValue]);
+        if ([filter mayContainKey:[NSString stringWithFormat:@"missing-%d", i]]) falsePositives++;
+    }
+    XCTAssertLessThan(falsePositives, 50);
+
+    NSString *path = [self.path stringByAppendingPathComponent:@"filter"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:self.path withIntermediateDirectories:YES attributes:nil error:NULL];
+    XCTAssertTrue([filter writeToFile:path]);
+    YYCacheKeyFilter *read = [YYCacheKeyFilter filterWithContentsOfFile:path];
+    XCTAssertEqual(read.capacity, filter.capacity);
+    XCTAssertEqual(read.count, filter.count);
+    for (int i = 0; i < 1000; i++) {
+        XCTAssertEqual([read mayContainKey:@(i).stringValue], YES);
+        NSString *missing = [NSString stringWithFormat:@"missing-%d", i];
+        XCTAssertEqual([read mayContainKey:missing], [filter mayContainKey:missing]);
+    }
+
+    for (int i = 1000; i < 1025; i++) [filter addKey:@(i).stringValue];
+    XCTAssertTrue(filter.saturated);
+    [filter removeAllKeys];
+    XCTAssertEqual(filter.count, (NSUInteger)0);
+    XCTAssertFalse(filter.saturated);
+    XCTAssertFalse([filter mayContainKey:@"0"]);
+
+    XCTAssertNil([YYCacheKeyFilter filterWithContentsOfFile:[self.path stringByAppendingPathComponent:@"missing"]]);
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    [[data subdataWithRange:NSMakeRange(0, data.length / 2)] writeToFile:path atomically:YES];
+    XCTAssertNil([YYCacheKeyFilter filterWithContentsOfFile:path]);
+}
+
+- (void)testFilterIsPersistedByLazyOpen {
+    [self prepareCacheWithCount:100];
+    YYCacheKeyFilter *filter = [YYCacheKeyFilter filterWithContentsOfFile:[self filterPath]];
+    XCTAssertEqual(filter.count, (NSUInteger)100);
+    for (int i = 0; i < 100; i++) XCTAssertTrue([filter mayContainKey:@(i).stringValue]);
+
+    // kept by the next lazy open
+    __weak YYDiskCache *weakCache;
+    @autoreleasepool {
+        YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path inlineThreshold:NSUIntegerMax lazyOpen:YES];
+        weakCache = cache;
+        XCTAssertEqualObjects([cache objectForKey:@"5"], @"5");
+        XCTAssertTrue([self filterExists]);
+    }
+    XCTAssertTrue([self waitForReleaseOfObject:weakCache]);
+    XCTAssertTrue([self filterExists]);
+
+    // removed by an open at init, the keys added in that session are not in it
+    @autoreleasepool {
+        YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path inlineThreshold:NSUIntegerMax lazyOpen:NO];
+        weakCache = cache;
+        XCTAssertFalse([self filterExists]);
+    }
+    XCTAssertTrue([self waitForReleaseOfObject:weakCache]);
+}
+
+- (void)testEarlyMissesAreAnsweredByFilter {
+    [self prepareCacheWithCount:100];
+
+    // added behind the filter, a lazy open doesn't see it until the storage is opened
+    @autoreleasepool {
+        YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+        XCTAssertTrue([kv saveItemWithKey:@"behind" value:[NSKeyedArchiver archivedDataWithRootObject:@"behind"]]);
+    }
+
+    __weak YYDiskCache *weakCache;
+    @autoreleasepool {
+        YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path inlineThreshold:NSUIntegerMax lazyOpen:YES];
+        weakCache = cache;
+        XCTAssertFalse([cache containsObjectForKey:@"behind"]);
+        XCTAssertNil([cache objectForKey:@"behind"]);
+        XCTAssertEqual([cache objectsForKeys:@[@"behind"]].count, (NSUInteger)0);
+
+        // a key which may exist opens the storage, then the filter is not used
+        XCTAssertEqualObjects([cache objectForKey:@"7"], @"7");
+        XCTAssertTrue([cache containsObjectForKey:@"behind"]);
+        XCTAssertEqualObjects([cache objectForKey:@"behind"], @"behind");
+    }
+    XCTAssertTrue([self waitForReleaseOfObject:weakCache]);
+}
+
+- (void)testWriteRemovesFilter {
+    [self prepareCacheWithCount:100];
+    __weak YYDiskCache *weakCache;
+    @autoreleasepool {
+        YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path inlineThreshold:NSUIntegerMax lazyOpen:YES];
+        weakCache = cache;
+        [cache setObject:@"new" forKey:@"new"];
+        XCTAssertFalse([self filterExists]); // the file should never miss a key
+    }
+    XCTAssertTrue([self waitForReleaseOfObject:weakCache]);
+
+    // rebuilt by the next lazy open
+    @autoreleasepool {
+        YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path inlineThreshold:NSUIntegerMax lazyOpen:YES];
+        weakCache = cache;
+        XCTAssertEqualObjects([cache objectForKey:@"new"], @"new");
+        XCTAssertTrue([self waitForFilter]);
+    }
+    XCTAssertTrue([self waitForReleaseOfObject:weakCache]);
+    XCTAssertTrue([[YYCacheKeyFilter filterWithContentsOfFile:[self filterPath]] mayContainKey:@"new"]);
+}
+
+- (void)testSaturatedFilterIsDiscarded {
+    [self prepareCacheWithCount:100];
+    YYCacheKeyFilter *filter = [[YYCacheKeyFilter alloc] initWithCapacity:1024];
+    for (int i = 0; i < 2000; i++) [filter addKey:[NSString stringWithFormat:@"other-%d", i]];
+    XCTAssertTrue(filter.saturated);
+    XCTAssertTrue([filter writeToFile:[self filterPath]]);
+
+    __weak YYDiskCache *weakCache;
+    @autoreleasepool {
+        YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path inlineThreshold:NSUIntegerMax lazyOpen:YES];
+        weakCache = cache;
+        XCTAssertFalse([self filterExists]);
+        for (int i = 0; i < 100; i++) XCTAssertTrue([cache containsObjectForKey:@(i).stringValue], @"%d", i);
+        XCTAssertTrue([self waitForFilter]);
+    }
+    XCTAssertTrue([self waitForReleaseOfObject:weakCache]);
+    filter = [YYCacheKeyFilter filterWithContentsOfFile:[self filterPath]];
+    XCTAssertFalse(filter.saturated);
+    XCTAssertEqual(filter.count, (NSUInteger)100);
+}
+
+@end
@@ -0,0 +1,98 @@
+//
+//  YYImageCacheBenchmarks.m
+//  Study_YYKitTests
+//
+//  The results are printed to the test log, run them with a release build on a
+//  device, the simulator decodes JPEG with the Mac's codec.
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYImageCoder.h>
+#import <YYKit/YYImageCache.h>
+#import <YYKit/YYDiskCache.h>
+#import <QuartzCore/QuartzCore.h>
+
+@interface YYImageCacheBenchmarks : YYCacheTestCase
+@end
+
+@implementation YYImageCacheBenchmarks
+
+/// A photo-like image: blocks of random colors with a gradient, so it doesn't compress to nothing.
+- (UIImage *)imageWithPixelSize:(CGSize)size opaque:(BOOL)opaque {
+    UIGraphicsBeginImageContextWithOptions(size, opaque, 1);
+    CGContextRef context = UIGraphicsGetCurrentContext();
+    uint32_t state = 12345;
+    for (CGFloat y = 0; y < size.height; y += 50) {
+        for (CGFloat x = 0; x < size.width; x += 50) {
+            state = state * 1103515245 + 12345;
+            CGContextSetRGBFillColor(context, (state >> 8 & 0xFF) / 255.0, (state >> 16 & 0xFF) / 255.0,
+                                     x / size.width, opaque ? 1 : y / size.height);
+            CGContextFillRect(context, CGRectMake(x, y, 50, 50));
+        }
+    }
+    UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+    return image;
+}
+
+/**
+ Decode time and memory of a 4000x3000 JPEG and a 2000x1500 PNG, at full size and
+ downsampled to 200x150 (JPEG is scaled by ImageIO when decoding, PNG is reduced
+ with the box filter). The memory is the growth of the physical footprint while
+ the decoded image is alive.
+ */
+- (void)testDownsampleOnDecode {
+    NSArray *sources = @[@[@"jpeg 4000x3000", UIImageJPEGRepresentation([self imageWithPixelSize:CGSizeMake(4000, 3000) opaque:YES], 0.9)],
+                         @[@"png 2000x1500", UIImagePNGRepresentation([self imageWithPixelSize:CGSizeMake(2000, 1500) opaque:NO])]];
+    CGSize target = CGSizeMake(200, 150);
+    int runCount = 5;
+    NSMutableString *report = [NSMutableString stringWithFormat:@"\nYYImageDecoder downsample on decode (average of %d)\n%-16s %-10s %9s %11s %11s\n",
+                               runCount, "source", "target", "ms", "memory MB", "output"];
+    for (NSArray *source in sources) {
+        for (NSValue *size in @[[NSValue valueWithCGSize:CGSizeZero], [NSValue valueWithCGSize:target]]) {
+            CFTimeInterval time = 0;
+            int64_t growth = 0;
+            CGSize output = CGSizeZero;
+            for (int run = 0; run < runCount; run++) {
+                @autoreleasepool {
+                    int64_t footprint = [self physicalFootprint];
+                    CFTimeInterval begin = CACurrentMediaTime();
+                    YYImageDecoder *decoder = [YYImageDecoder decoderWithData:source[1] scale:1 targetPixelSize:size.CGSizeValue];
+                    UIImage *image = [decoder frameAtIndex:0 decodeForDisplay:YES].image;
+                    time += CACurrentMediaTime() - begin;
+                    growth += [self physicalFootprint] - footprint;
+                    output = CGSizeMake(CGImageGetWidth(image.CGImage), CGImageGetHeight(image.CGImage));
+                    XCTAssertNotNil(image);
+                }
+            }
+            NSString *targetName = CGSizeEqualToSize(size.CGSizeValue, CGSizeZero) ? @"full" : @"200x150";
+            [report appendFormat:@"%-16s %-10s %9.2f %11.1f %5.0fx%-5.0f\n", [source[0] UTF8String], targetName.UTF8String,
+             time / runCount * 1e3, growth / runCount / 1048576.0, output.width, output.height];
+        }
+    }
+    NSLog(@"%@", report);
+}
+
+/**
+ Latency of a 200x150 thumbnail of a 4000x3000 JPEG from YYImageCache: the first
+ get decodes from the disk cache, the next ones hit the variant in memory cache.
+ */
+- (void)testDownsampledVariant {
+    YYImageCache *cache = [[YYImageCache alloc] initWithPath:self.path];
+    NSData *data = UIImageJPEGRepresentation([self imageWithPixelSize:CGSizeMake(4000, 3000) opaque:YES], 0.9);
+    [cache.diskCache setObject:data forKey:@"photo"];
+
+    CFTimeInterval begin = CACurrentMediaTime();
+    UIImage *first = [cache getImageForKey:@"photo" targetPixelSize:CGSizeMake(200, 150) withType:YYImageCacheTypeAll];
+    CFTimeInterval firstTime = CACurrentMediaTime() - begin;
+    int count = 1000;
+    begin = CACurrentMediaTime();
+    for (int i = 0; i < count; i++) {
+        XCTAssertEqual([cache getImageForKey:@"photo" targetPixelSize:CGSizeMake(200, 150) withType:YYImageCacheTypeAll], first);
+    }
+    CFTimeInterval hitTime = (CACurrentMediaTime() - begin) / count;
+    NSLog(@"\nYYImageCache 200x150 variant of a 4000x3000 jpeg: first get %.2f ms, memory hit %.2f us",
+          firstTime * 1e3, hitTime * 1e6);
+}
+
+@end
@@ -0,0 +1,61 @@
+//
+//  YYImageCacheVariantTests.m
+//  Study_YYKitTests
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYImageCache.h>
+#import <YYKit/YYMemoryCache.h>
+#import <YYKit/YYDiskCache.h>
+
+@interface YYImageCacheVariantTests : YYCacheTestCase
+@property (nonatomic, strong) YYImageCache *cache;
+@end
+
+@implementation YYImageCacheVariantTests
+
+- (void)setUp {
+    [super setUp];
+    self.cache = [[YYImageCache alloc] initWithPath:self.path];
+    // a 40x40 png in disk cache, the downsampled images are decoded from it
+    UIGraphicsBeginImageContextWithOptions(CGSizeMake(40, 40), YES, 1);
+    [[UIColor redColor] setFill];
+    UIRectFill(CGRectMake(0, 0, 40, 40));
+    UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+    [self.cache.diskCache setObject:UIImagePNGRepresentation(image) forKey:@"image"];
+}
+
+- (void)tearDown {
+    self.cache = nil;
+    [super tearDown];
+}
+
+- (void)testVariantDoesNotCollideWithUserKey {
+    UIImage *other = [UIImage new];
+    [self.cache.memoryCache setObject:other forKey:@"image#10x10"]; // the old variant key format
+    UIImage *variant = [self.cache getImageForKey:@"image" targetPixelSize:CGSizeMake(10, 10) withType:YYImageCacheTypeAll];
+    XCTAssertNotNil(variant);
+    XCTAssertNotEqual(variant, other);
+    XCTAssertEqual([self.cache.memoryCache objectForKey:@"image#10x10"], other);
+
+    // removing the image removes its variants, not the user's object
+    [self.cache removeImageForKey:@"image" withType:YYImageCacheTypeMemory];
+    XCTAssertNil([self.cache getImageForKey:@"image" targetPixelSize:CGSizeMake(10, 10) withType:YYImageCacheTypeMemory]);
+    XCTAssertEqual([self.cache.memoryCache objectForKey:@"image#10x10"], other);
+}
+
+- (void)testFractionalSizesAreRoundedUp {
+    UIImage *variant = [self.cache getImageForKey:@"image" targetPixelSize:CGSizeMake(9.2, 9.7) withType:YYImageCacheTypeAll];
+    XCTAssertNotNil(variant);
+    XCTAssertEqual([self.cache getImageForKey:@"image" targetPixelSize:CGSizeMake(10, 10) withType:YYImageCacheTypeMemory], variant);
+
+    // 10.4 is not merged into 10
+    XCTAssertNil([self.cache getImageForKey:@"image" targetPixelSize:CGSizeMake(10.4, 10) withType:YYImageCacheTypeMemory]);
+    UIImage *larger = [self.cache getImageForKey:@"image" targetPixelSize:CGSizeMake(10.4, 10) withType:YYImageCacheTypeAll];
+    XCTAssertNotNil(larger);
+    XCTAssertNotEqual(larger, variant);
+    XCTAssertEqual([self.cache getImageForKey:@"image" targetPixelSize:CGSizeMake(11, 10) withType:YYImageCacheTypeMemory], larger);
+}
+
+@end
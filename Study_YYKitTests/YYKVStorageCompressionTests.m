@@ -0,0 +1,101 @@
+//
+//  YYKVStorageCompressionTests.m
+//  Study_YYKitTests
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYKVStorage.h>
+#import <YYKit/YYDiskCache.h>
+
+@interface YYKVStorageCompressionTests : YYCacheTestCase
+@end
+
+@implementation YYKVStorageCompressionTests
+
+- (NSString *)pathForType:(YYKVStorageType)type codec:(YYKVStorageCompression)codec {
+    return [self.path stringByAppendingPathComponent:[NSString stringWithFormat:@"%lu-%lu", (unsigned long)type, (unsigned long)codec]];
+}
+
+- (void)testRoundTrip {
+    NSArray *types = @[@(YYKVStorageTypeSQLite), @(YYKVStorageTypeFile), @(YYKVStorageTypeMixed), @(YYKVStorageTypeSegment)];
+    NSArray *codecs = @[@(YYKVStorageCompressionZlib), @(YYKVStorageCompressionLZ4)];
+    NSData *small = [self compressibleDataWithLength:100];
+    NSData *large = [self compressibleDataWithLength:256 * 1024];
+    NSData *random = [self randomDataWithLength:64 * 1024];
+    for (NSNumber *type in types) {
+        for (NSNumber *codec in codecs) {
+            NSString *path = [self pathForType:type.unsignedIntegerValue codec:codec.unsignedIntegerValue];
+            @autoreleasepool {
+                YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:path type:type.unsignedIntegerValue];
+                kv.compression = codec.unsignedIntegerValue;
+                XCTAssertTrue([kv saveItemWithKey:@"small" value:small filename:@"small" extendedData:nil]);
+                XCTAssertTrue([kv saveItemWithKey:@"large" value:large filename:@"large" extendedData:nil]);
+                XCTAssertTrue([kv saveItemWithKey:@"random" value:random filename:@"random" extendedData:nil]);
+
+                XCTAssertEqualObjects([kv getItemValueForKey:@"small"], small, @"type %@ codec %@", type, codec);
+                XCTAssertEqualObjects([kv getItemValueForKey:@"large"], large, @"type %@ codec %@", type, codec);
+                XCTAssertEqualObjects([kv getItemForKey:@"large"].value, large, @"type %@ codec %@", type, codec);
+                XCTAssertEqualObjects([kv getItemValueForKeys:@[@"large", @"random"]][@"random"], random);
+
+                // only the large text is compressed, the size counts the bytes written
+                int64_t logicalSize = small.length + large.length + random.length;
+                XCTAssertEqual([kv getItemsTotalLogicalSize], logicalSize, @"type %@ codec %@", type, codec);
+                XCTAssertLessThan([kv getItemsTotalSize], logicalSize - (int64_t)large.length / 2, @"type %@ codec %@", type, codec);
+                XCTAssertEqual([kv getItemInfoForKey:@"random"].size, (int)random.length);
+                XCTAssertEqual([kv getItemInfoForKey:@"small"].size, (int)small.length);
+            }
+
+            // the codec of each value is in the manifest, it doesn't depend on the current setting
+            YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:path type:type.unsignedIntegerValue];
+            XCTAssertEqual((NSUInteger)kv.compression, (NSUInteger)YYKVStorageCompressionNone);
+            XCTAssertEqualObjects([kv getItemValueForKey:@"large"], large, @"type %@ codec %@", type, codec);
+            kv.compression = codec.unsignedIntegerValue == YYKVStorageCompressionZlib ? YYKVStorageCompressionLZ4 : YYKVStorageCompressionZlib;
+            XCTAssertEqualObjects([kv getItemValueForKey:@"large"], large, @"type %@ codec %@", type, codec);
+
+            // replace a compressed value with an uncompressed one
+            kv.compression = YYKVStorageCompressionNone;
+            XCTAssertTrue([kv saveItemWithKey:@"large" value:large filename:@"large" extendedData:nil]);
+            XCTAssertEqualObjects([kv getItemValueForKey:@"large"], large, @"type %@ codec %@", type, codec);
+            XCTAssertEqual([kv getItemInfoForKey:@"large"].size, (int)large.length);
+            XCTAssertTrue([kv removeItemForKey:@"large"]);
+            XCTAssertNil([kv getItemValueForKey:@"large"]);
+        }
+    }
+}
+
+- (void)testCompressedFormatIsStoredAsIs {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    kv.compression = YYKVStorageCompressionZlib;
+    NSMutableData *png = [NSMutableData dataWithBytes:"\x89PNG\r\n\x1a\n" length:8];
+    [png appendData:[self compressibleDataWithLength:8 * 1024]];
+    XCTAssertTrue([kv saveItemWithKey:@"png" value:png]);
+    XCTAssertEqual([kv getItemInfoForKey:@"png"].size, (int)png.length);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"png"], png);
+}
+
+- (void)testThreshold {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    kv.compression = YYKVStorageCompressionLZ4;
+    kv.compressionSizeThreshold = 16 * 1024;
+    NSData *below = [self compressibleDataWithLength:16 * 1024 - 1];
+    NSData *above = [self compressibleDataWithLength:16 * 1024];
+    [kv saveItemWithKey:@"below" value:below];
+    [kv saveItemWithKey:@"above" value:above];
+    XCTAssertEqual([kv getItemInfoForKey:@"below"].size, (int)below.length);
+    XCTAssertLessThan([kv getItemInfoForKey:@"above"].size, (int)above.length);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"above"], above);
+}
+
+- (void)testDiskCacheRoundTrip {
+    YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path];
+    cache.compression = YYKVStorageCompressionZlib;
+    NSMutableArray *object = [NSMutableArray new];
+    for (int i = 0; i < 2000; i++) {
+        [object addObject:@{@"id" : @(i % 10), @"name" : @"item"}];
+    }
+    [cache setObject:object forKey:@"list"];
+    XCTAssertEqualObjects([cache objectForKey:@"list"], object);
+    XCTAssertLessThan(cache.totalCost, cache.totalLogicalCost);
+}
+
+@end
@@ -0,0 +1,152 @@
+//
+//  YYKVStorageConcurrentReadTests.m
+//  Study_YYKitTests
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYKVStorage.h>
+#import <YYKit/YYDiskCache.h>
+#import <stdatomic.h>
+
+@interface YYKVStorageConcurrentReadTests : YYCacheTestCase
+@end
+
+@implementation YYKVStorageConcurrentReadTests
+
+- (void)testReaderConnectionCount {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    XCTAssertEqual(kv.readerConnectionCount, (NSUInteger)0);
+    kv.readerConnectionCount = 4;
+    XCTAssertEqual(kv.readerConnectionCount, (NSUInteger)4);
+    kv.readerConnectionCount = 100;
+    XCTAssertEqual(kv.readerConnectionCount, (NSUInteger)16);
+    kv.readerConnectionCount = 0;
+    XCTAssertEqual(kv.readerConnectionCount, (NSUInteger)0);
+}
+
+- (void)testConcurrentGets {
+    int itemCount = 500;
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeMixed];
+    for (int i = 0; i < itemCount; i++) {
+        NSString *key = @(i).stringValue;
+        // the odd ones are in files
+        NSData *value = [self dataWithLength:(i % 2 ? 30000 : 1000) seed:(uint8_t)i];
+        [kv saveItemWithKey:key value:value filename:(i % 2 ? key : nil) extendedData:nil];
+    }
+    kv.readerConnectionCount = 4;
+
+    __block atomic_int failures = 0;
+    [self runThreads:16 block:^(NSUInteger thread) {
+        for (int n = 0; n < 500; n++) {
+            int i = (int)((thread * 131 + n * 7) % itemCount);
+            NSString *key = @(i).stringValue;
+            NSData *expected = [self dataWithLength:(i % 2 ? 30000 : 1000) seed:(uint8_t)i];
+            switch (n % 4) {
+                case 0: {
+                    if (![[kv getItemValueForKey:key] isEqualToData:expected]) atomic_fetch_add(&failures, 1);
+                } break;
+                case 1: {
+                    YYKVStorageItem *item = [kv getItemForKey:key];
+                    if (![item.key isEqualToString:key] || ![item.value isEqualToData:expected]) atomic_fetch_add(&failures, 1);
+                } break;
+                case 2: {
+                    NSString *next = @((i + 1) % itemCount).stringValue;
+                    NSDictionary *values = [kv getItemValueForKeys:@[key, next, @"missing"]];
+                    if (values.count != 2 || ![values[key] isEqualToData:expected]) atomic_fetch_add(&failures, 1);
+                } break;
+                default: {
+                    if (![kv itemExistsForKey:key] || [kv itemExistsForKey:@"missing"]) atomic_fetch_add(&failures, 1);
+                } break;
+            }
+        }
+    }];
+    XCTAssertEqual(atomic_load(&failures), 0);
+}
+
+- (void)testWritesAreVisibleToReaders {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    kv.readerConnectionCount = 2;
+    for (int i = 0; i < 20; i++) {
+        NSString *key = @(i).stringValue;
+        [kv saveItemWithKey:key value:[self dataWithLength:100 seed:(uint8_t)i]];
+        __block NSData *value = nil;
+        [self runThreads:1 block:^(NSUInteger thread) {
+            value = [kv getItemValueForKey:key];
+        }];
+        XCTAssertEqualObjects(value, [self dataWithLength:100 seed:(uint8_t)i]);
+    }
+    [kv removeItemForKey:@"0"];
+    __block BOOL exists = YES;
+    [self runThreads:1 block:^(NSUInteger thread) {
+        exists = [kv itemExistsForKey:@"0"];
+    }];
+    XCTAssertFalse(exists);
+}
+
+- (void)testConcurrentReadsKeepLeastRecentlyUsedOrder {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    for (int i = 0; i < 100; i++) {
+        [kv saveItemWithKey:@(i).stringValue value:[self dataWithLength:100 seed:(uint8_t)i]];
+    }
+    kv.readerConnectionCount = 4;
+    sleep(1); // the access time is in seconds
+
+    // the access times are recorded in memory, and written before trimming
+    [self runThreads:4 block:^(NSUInteger thread) {
+        for (NSUInteger i = 50 + thread; i < 100; i += 4) [kv getItemValueForKey:@(i).stringValue];
+    }];
+    XCTAssertTrue([kv removeItemsToFitCount:50]);
+    for (int i = 0; i < 50; i++) XCTAssertFalse([kv itemExistsForKey:@(i).stringValue], @"%d", i);
+    for (int i = 50; i < 100; i++) XCTAssertTrue([kv itemExistsForKey:@(i).stringValue], @"%d", i);
+}
+
+- (void)testBrokenItemsAreRemovedByFlush {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeFile];
+    for (int i = 0; i < 10; i++) {
+        NSString *key = @(i).stringValue;
+        [kv saveItemWithKey:key value:[self dataWithLength:100 seed:(uint8_t)i] filename:key extendedData:nil];
+    }
+    kv.readerConnectionCount = 2;
+    [[NSFileManager defaultManager] removeItemAtPath:[self.dataPath stringByAppendingPathComponent:@"3"] error:NULL];
+
+    __block NSData *value = nil;
+    [self runThreads:1 block:^(NSUInteger thread) {
+        value = [kv getItemValueForKey:@"3"];
+    }];
+    XCTAssertNil(value);
+    XCTAssertEqual([kv getItemsCount], 10);
+    XCTAssertTrue([kv flushAccessTimes]);
+    XCTAssertEqual([kv getItemsCount], 9);
+    XCTAssertFalse([kv itemExistsForKey:@"3"]);
+}
+
+- (void)testDiskCacheReadsWhileWriting {
+    YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path inlineThreshold:4096];
+    cache.readerConnectionCount = 4;
+    XCTAssertEqual(cache.readerConnectionCount, (NSUInteger)4);
+    for (int i = 0; i < 200; i++) {
+        [cache setObject:[self dataWithLength:(i % 2 ? 8000 : 1000) seed:(uint8_t)i] forKey:@(i).stringValue];
+    }
+
+    __block atomic_int failures = 0;
+    [self runThreads:12 block:^(NSUInteger thread) {
+        for (int n = 0; n < 300; n++) {
+            if (thread < 2) {
+                // the writers use their own keys, and trim the count
+                NSString *key = [NSString stringWithFormat:@"w%lu-%d", (unsigned long)thread, n % 50];
+                [cache setObject:[self dataWithLength:2000 seed:(uint8_t)n] forKey:key];
+                if (n % 100 == 99) [cache trimToCount:1000];
+            } else {
+                int i = (int)((thread * 37 + n) % 200);
+                NSData *expected = [self dataWithLength:(i % 2 ? 8000 : 1000) seed:(uint8_t)i];
+                id object = [cache objectForKey:@(i).stringValue];
+                if (![object isEqual:expected]) atomic_fetch_add(&failures, 1);
+                if (![cache containsObjectForKey:@(i).stringValue]) atomic_fetch_add(&failures, 1);
+            }
+        }
+    }];
+    XCTAssertEqual(atomic_load(&failures), 0);
+    XCTAssertEqual(cache.totalCount, (NSInteger)300);
+}
+
+@end
@@ -0,0 +1,157 @@
+//
+//  YYKVStorageReconcileTests.m
+//  Study_YYKitTests
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYKVStorage.h>
+
+@interface YYKVStorageReconcileTests : YYCacheTestCase
+@end
+
+@implementation YYKVStorageReconcileTests
+
+- (NSString *)dataPathWithName:(NSString *)name {
+    return [self.dataPath stringByAppendingPathComponent:name];
+}
+
+- (NSString *)sessionPath {
+    return [self.path stringByAppendingPathComponent:@"session"];
+}
+
+- (NSData *)valueWithIndex:(int)index length:(NSUInteger)length {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    memset(data.mutableBytes, index, length);
+    return data;
+}
+
+/// Leave the session file behind, as if the app was killed while the storage was open.
+- (void)simulateCrash {
+    XCTAssertTrue([[NSData data] writeToFile:[self sessionPath] atomically:NO]);
+}
+
+- (void)reconcile:(YYKVStorage *)kv {
+    int calls = 0;
+    while (![kv reconcileWithTimeLimit:0.001]) {
+        calls++;
+        XCTAssertLessThan(calls, 10000);
+        if (calls >= 10000) break;
+    }
+}
+
+- (void)testCleanSessionNeedsNoReconcile {
+    @autoreleasepool {
+        YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeFile];
+        [kv saveItemWithKey:@"key" value:[self valueWithIndex:1 length:100] filename:@"file" extendedData:nil];
+        XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[self sessionPath]]);
+        [kv endSession];
+        XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[self sessionPath]]);
+
+        // the session is opened again by the next change
+        [kv saveItemWithKey:@"key2" value:[self valueWithIndex:2 length:100] filename:@"file2" extendedData:nil];
+        XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[self sessionPath]]);
+    }
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[self sessionPath]]);
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeFile];
+    XCTAssertTrue([kv reconcileWithTimeLimit:0]);
+    XCTAssertEqual([kv getItemsCount], 2);
+}
+
+- (void)testBrokenRowsAndOrphanFilesAreRemoved {
+    @autoreleasepool {
+        YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeMixed];
+        for (int i = 0; i < 200; i++) { // more than one batch
+            NSString *key = @(i).stringValue;
+            [kv saveItemWithKey:key value:[self valueWithIndex:i length:1000] filename:(i % 2 ? key : nil) extendedData:nil];
+        }
+        [kv endSession];
+    }
+    [self simulateCrash];
+    NSFileManager *manager = [NSFileManager defaultManager];
+    XCTAssertTrue([manager removeItemAtPath:[self dataPathWithName:@"1"] error:NULL]);          // missing
+    XCTAssertTrue([[NSData dataWithBytes:"x" length:1] writeToFile:[self dataPathWithName:@"3"] atomically:NO]); // truncated
+    XCTAssertTrue([[NSData dataWithBytes:"x" length:1] writeToFile:[self dataPathWithName:@"orphan"] atomically:NO]);
+    NSString *tempFile = [[self.path stringByAppendingPathComponent:@"temp"] stringByAppendingPathComponent:@"half-written"];
+    XCTAssertTrue([[NSData dataWithBytes:"x" length:1] writeToFile:tempFile atomically:NO]);
+
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeMixed];
+    XCTAssertFalse([manager fileExistsAtPath:tempFile]);
+    XCTAssertFalse([kv reconcileWithTimeLimit:0]); // one batch per call at least
+    [self reconcile:kv];
+
+    XCTAssertEqual([kv getItemsCount], 198);
+    XCTAssertFalse([kv itemExistsForKey:@"1"]);
+    XCTAssertFalse([kv itemExistsForKey:@"3"]);
+    XCTAssertFalse([manager fileExistsAtPath:[self dataPathWithName:@"3"]]);
+    XCTAssertFalse([manager fileExistsAtPath:[self dataPathWithName:@"orphan"]]);
+    for (int i = 0; i < 200; i++) {
+        if (i == 1 || i == 3) continue;
+        XCTAssertEqualObjects([kv getItemValueForKey:@(i).stringValue], [self valueWithIndex:i length:1000], @"%d", i);
+    }
+
+    // the session is closed normally after the reconciliation
+    [kv endSession];
+    XCTAssertFalse([manager fileExistsAtPath:[self sessionPath]]);
+}
+
+- (void)testSharedFileRefCountsAreRebuilt {
+    NSData *a = [self valueWithIndex:1 length:4096], *b = [self valueWithIndex:2 length:4096];
+    @autoreleasepool {
+        YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeFile];
+        kv.sharedFilesEnabled = YES;
+        [kv saveItemWithKey:@"a1" value:a filename:@"content-a" extendedData:nil];
+        [kv saveItemWithKey:@"a2" value:a filename:@"content-a" extendedData:nil];
+        [kv saveItemWithKey:@"b1" value:b filename:@"content-b" extendedData:nil];
+        [kv saveItemWithKey:@"b2" value:b filename:@"content-b" extendedData:nil];
+        [kv endSession];
+    }
+    [self simulateCrash];
+    XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:[self dataPathWithName:@"content-b"] error:NULL]);
+
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeFile];
+    kv.sharedFilesEnabled = YES;
+    [self reconcile:kv];
+    XCTAssertEqual([kv getItemsCount], 2);
+    XCTAssertNil([kv getItemValueForKey:@"b1"]);
+
+    // content-a is still shared by two rows
+    XCTAssertTrue([kv removeItemForKey:@"a1"]);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"a2"], a);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[self dataPathWithName:@"content-a"]]);
+    XCTAssertTrue([kv removeItemForKey:@"a2"]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[self dataPathWithName:@"content-a"]]);
+
+    // a new file with the removed name is written again
+    XCTAssertTrue([kv saveItemWithKey:@"b3" value:b filename:@"content-b" extendedData:nil]);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"b3"], b);
+}
+
+- (void)testTruncatedSegmentRowsAreRemoved {
+    NSUInteger length = 10000;
+    @autoreleasepool {
+        YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSegment];
+        for (int i = 0; i < 100; i++) {
+            [kv saveItemWithKey:@(i).stringValue value:[self valueWithIndex:i length:length]];
+        }
+        [kv endSession];
+    }
+    [self simulateCrash];
+    NSString *dataPath = self.dataPath;
+    NSArray *segments = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:dataPath error:NULL];
+    XCTAssertEqual(segments.count, (NSUInteger)1);
+    NSString *segmentPath = [dataPath stringByAppendingPathComponent:segments.firstObject];
+    XCTAssertEqual(truncate(segmentPath.fileSystemRepresentation, (off_t)(length * 50 + length / 2)), 0);
+
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSegment];
+    [self reconcile:kv];
+    int count = [kv getItemsCount];
+    XCTAssertGreaterThan(count, 0);
+    XCTAssertLessThan(count, 100);
+    for (int i = 0; i < 100; i++) {
+        NSData *value = [kv getItemValueForKey:@(i).stringValue];
+        if (value) XCTAssertEqualObjects(value, [self valueWithIndex:i length:length], @"%d", i);
+    }
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:segmentPath]);
+}
+
+@end
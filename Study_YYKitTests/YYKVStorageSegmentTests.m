@@ -0,0 +1,117 @@
+//
+//  YYKVStorageSegmentTests.m
+//  Study_YYKitTests
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYKVStorage.h>
+
+static const NSUInteger kValueLength = 1024 * 1024; // 64 values fill a segment
+
+@interface YYKVStorageSegmentTests : YYCacheTestCase
+@end
+
+@implementation YYKVStorageSegmentTests
+
+- (NSData *)valueAtIndex:(int)index {
+    return [self dataWithLength:kValueLength seed:(uint8_t)index];
+}
+
+- (unsigned long long)sizeOfDataFile:(NSString *)name {
+    NSString *path = [self.dataPath stringByAppendingPathComponent:name];
+    return [[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL].fileSize;
+}
+
+- (int64_t)liveSizeOfSegment:(int)segmentID {
+    return [self executeSQL:[NSString stringWithFormat:@"select live_size from segment where id = %d;", segmentID]];
+}
+
+- (void)waitForTrashOfStorage:(YYKVStorage *)kv {
+    for (int i = 0; i < 5000 && kv.purgingTrash; i++) usleep(1000);
+}
+
+- (void)testAppendAndRead {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSegment];
+    int64_t size = 0;
+    for (int i = 0; i < 100; i++) {
+        [kv saveItemWithKey:@(i).stringValue value:[self dataWithLength:1000 + i seed:(uint8_t)i] filename:@"ignored" extendedData:nil];
+        size += 1000 + i;
+    }
+    XCTAssertEqualObjects(self.dataFiles, @[@"segment-1"]);
+    XCTAssertEqual([self sizeOfDataFile:@"segment-1"], (unsigned long long)size);
+    XCTAssertEqual([self liveSizeOfSegment:1], size);
+    for (int i = 0; i < 100; i++) {
+        XCTAssertEqualObjects([kv getItemValueForKey:@(i).stringValue], [self dataWithLength:1000 + i seed:(uint8_t)i]);
+    }
+    XCTAssertEqualObjects([kv getItemForKey:@"5"].value, [self dataWithLength:1005 seed:5]);
+    XCTAssertEqual([kv getItemValueForKeys:@[@"1", @"2", @"missing"]].count, (NSUInteger)2);
+
+    // the replaced and removed values stay in the segment as dead bytes
+    [kv saveItemWithKey:@"0" value:[self dataWithLength:500 seed:200]];
+    [kv removeItemForKey:@"1"];
+    XCTAssertEqualObjects([kv getItemValueForKey:@"0"], [self dataWithLength:500 seed:200]);
+    XCTAssertNil([kv getItemValueForKey:@"1"]);
+    XCTAssertEqual([self sizeOfDataFile:@"segment-1"], (unsigned long long)(size + 500));
+    XCTAssertEqual([self liveSizeOfSegment:1], size - 1000 - 1001 + 500);
+
+    // the next session appends to the same segment
+    kv = nil;
+    kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSegment];
+    XCTAssertEqualObjects([kv getItemValueForKey:@"99"], [self dataWithLength:1099 seed:99]);
+    [kv saveItemWithKey:@"new" value:[self dataWithLength:100 seed:1]];
+    XCTAssertEqualObjects(self.dataFiles, @[@"segment-1"]);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"new"], [self dataWithLength:100 seed:1]);
+}
+
+- (void)testCompactSegment {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSegment];
+    for (int i = 0; i < 70; i++) [kv saveItemWithKey:@(i).stringValue value:[self valueAtIndex:i]];
+    XCTAssertEqualObjects((self.dataFiles), (@[@"segment-1", @"segment-2"]));
+    XCTAssertEqual([self liveSizeOfSegment:1], (int64_t)(64 * kValueLength));
+    XCTAssertEqual([self liveSizeOfSegment:2], (int64_t)(6 * kValueLength));
+
+    // 40 of 64 live, it's above the ratio
+    for (int i = 0; i < 24; i++) [kv removeItemForKey:@(i).stringValue];
+    XCTAssertEqual([self liveSizeOfSegment:1], (int64_t)(40 * kValueLength));
+    XCTAssertTrue([kv compactSegments]);
+    XCTAssertEqualObjects((self.dataFiles), (@[@"segment-1", @"segment-2"]));
+
+    // 16 of 64 live, the live values are moved to the current segment
+    for (int i = 24; i < 48; i++) [kv removeItemForKey:@(i).stringValue];
+    XCTAssertTrue([kv compactSegments]);
+    [self waitForTrashOfStorage:kv];
+    XCTAssertEqualObjects(self.dataFiles, @[@"segment-2"]);
+    XCTAssertEqual([self sizeOfDataFile:@"segment-2"], (unsigned long long)(22 * kValueLength));
+    XCTAssertEqual([self liveSizeOfSegment:2], (int64_t)(22 * kValueLength));
+    XCTAssertEqual([self executeSQL:@"select count(*) from segment;"], (int64_t)1);
+    XCTAssertEqual([kv getItemsCount], 22);
+    for (int i = 48; i < 70; i++) XCTAssertEqualObjects([kv getItemValueForKey:@(i).stringValue], [self valueAtIndex:i], @"%d", i);
+}
+
+- (void)testRemoveDeadSegment {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSegment];
+    for (int i = 0; i < 130; i++) [kv saveItemWithKey:@(i).stringValue value:[self valueAtIndex:i]];
+    XCTAssertEqualObjects((self.dataFiles), (@[@"segment-1", @"segment-2", @"segment-3"]));
+
+    // segment 1 is dead, segment 3 is the current one, it's never compacted
+    for (int i = 0; i < 64; i++) [kv removeItemForKey:@(i).stringValue];
+    for (int i = 128; i < 130; i++) [kv removeItemForKey:@(i).stringValue];
+    // replaced, the value is moved to segment 3
+    [kv saveItemWithKey:@"64" value:[self valueAtIndex:1]];
+    XCTAssertEqual([self liveSizeOfSegment:1], (int64_t)0);
+    XCTAssertEqual([self liveSizeOfSegment:2], (int64_t)(63 * kValueLength));
+    XCTAssertEqual([self liveSizeOfSegment:3], (int64_t)kValueLength);
+
+    XCTAssertTrue([kv compactSegments]);
+    [self waitForTrashOfStorage:kv];
+    XCTAssertEqualObjects((self.dataFiles), (@[@"segment-2", @"segment-3"]));
+    XCTAssertEqualObjects([kv getItemValueForKey:@"64"], [self valueAtIndex:1]);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"127"], [self valueAtIndex:127]);
+
+    [kv removeAllItems];
+    XCTAssertEqual(self.dataFiles.count, (NSUInteger)0);
+    [kv saveItemWithKey:@"0" value:[self valueAtIndex:0]];
+    XCTAssertEqualObjects([kv getItemValueForKey:@"0"], [self valueAtIndex:0]);
+}
+
+@end
@@ -0,0 +1,103 @@
+//
+//  YYKVStorageStatementTests.m
+//  Study_YYKitTests
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYKVStorage.h>
+
+@interface YYKVStorageStatementTests : YYCacheTestCase
+@end
+
+@implementation YYKVStorageStatementTests
+
+/// The key counts around each arity bucket (powers of 2 up to 512) and the batch size.
+- (NSArray<NSNumber *> *)keyCounts {
+    NSMutableOrderedSet *counts = [NSMutableOrderedSet new];
+    for (NSUInteger arity = 1; arity <= 512; arity *= 2) {
+        [counts addObject:@(arity - 1)];
+        [counts addObject:@(arity)];
+        [counts addObject:@(arity + 1)];
+    }
+    [counts addObject:@600];
+    [counts removeObject:@0];
+    return counts.array;
+}
+
+- (NSString *)keyAtIndex:(NSUInteger)index {
+    return [NSString stringWithFormat:@"key-%lu", (unsigned long)index];
+}
+
+- (void)assertGetForKeysInStorage:(YYKVStorage *)kv itemCount:(NSUInteger)itemCount {
+    for (NSNumber *count in [self keyCounts]) {
+        NSUInteger n = count.unsignedIntegerValue;
+        NSMutableArray *keys = [NSMutableArray new];
+        for (NSUInteger i = 0; i < n; i++) [keys addObject:[self keyAtIndex:(i * 7 + n) % itemCount]];
+        NSArray *distinct = keys.copy;
+        [keys addObject:@"missing"]; // the unused parameters are bound to null, they don't match
+        if (n < 512) [keys addObject:keys.firstObject]; // a key repeated in one batch is one row
+
+        NSArray *items = [kv getItemForKeys:keys];
+        XCTAssertEqual(items.count, distinct.count, @"%lu keys", (unsigned long)n);
+        for (YYKVStorageItem *item in items) {
+            NSUInteger index = [[item.key substringFromIndex:4] integerValue];
+            XCTAssertEqualObjects(item.value, [self dataWithLength:64 seed:(uint8_t)index], @"%lu keys", (unsigned long)n);
+        }
+        XCTAssertEqual([kv getItemInfoForKeys:keys].count, distinct.count, @"%lu keys", (unsigned long)n);
+        NSDictionary *values = [kv getItemValueForKeys:keys];
+        XCTAssertEqualObjects([NSSet setWithArray:values.allKeys], [NSSet setWithArray:distinct], @"%lu keys", (unsigned long)n);
+    }
+    XCTAssertNil([kv getItemForKeys:@[@"missing"]]);
+}
+
+- (void)testGetForKeysOfEachArity {
+    NSUInteger itemCount = 1000;
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    for (NSUInteger i = 0; i < itemCount; i++) {
+        [kv saveItemWithKey:[self keyAtIndex:i] value:[self dataWithLength:64 seed:(uint8_t)i]];
+    }
+    [self assertGetForKeysInStorage:kv itemCount:itemCount];
+
+    // the reader connections have their own statements
+    kv.readerConnectionCount = 2;
+    XCTAssertEqual(kv.readerConnectionCount, (NSUInteger)2);
+    [self assertGetForKeysInStorage:kv itemCount:itemCount];
+    kv.readerConnectionCount = 0;
+
+    // the statements are still valid after the store is reset
+    [kv removeAllItems];
+    for (NSUInteger i = 0; i < itemCount; i++) {
+        [kv saveItemWithKey:[self keyAtIndex:i] value:[self dataWithLength:64 seed:(uint8_t)i]];
+    }
+    [self assertGetForKeysInStorage:kv itemCount:itemCount];
+}
+
+- (void)testRemoveForKeysOfEachArity {
+    NSArray *counts = [self keyCounts];
+    NSUInteger itemCount = 0;
+    for (NSNumber *count in counts) itemCount += count.unsignedIntegerValue;
+    itemCount += 10; // not removed
+
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeFile];
+    for (NSUInteger i = 0; i < itemCount; i++) {
+        NSString *key = [self keyAtIndex:i];
+        [kv saveItemWithKey:key value:[self dataWithLength:64 seed:(uint8_t)i] filename:key extendedData:nil];
+    }
+    NSUInteger offset = 0;
+    for (NSNumber *count in counts) {
+        NSUInteger n = count.unsignedIntegerValue;
+        NSMutableArray *keys = [NSMutableArray new];
+        for (NSUInteger i = offset; i < offset + n; i++) [keys addObject:[self keyAtIndex:i]];
+        [keys addObject:@"missing"];
+        XCTAssertTrue([kv removeItemForKeys:keys], @"%lu keys", (unsigned long)n);
+        offset += n;
+        XCTAssertEqual((NSUInteger)[kv getItemsCount], itemCount - offset, @"%lu keys", (unsigned long)n);
+        XCTAssertFalse([kv itemExistsForKey:keys.firstObject]);
+        XCTAssertFalse([kv itemExistsForKey:keys[n - 1]]);
+        XCTAssertTrue([kv itemExistsForKey:[self keyAtIndex:offset]]);
+    }
+    for (int i = 0; i < 5000 && kv.purgingTrash; i++) usleep(1000);
+    XCTAssertEqual(self.dataFiles.count, (NSUInteger)10);
+}
+
+@end
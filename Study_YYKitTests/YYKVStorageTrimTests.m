@@ -0,0 +1,143 @@
+//
+//  YYKVStorageTrimTests.m
+//  Study_YYKitTests
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYKVStorage.h>
+
+@interface YYKVStorageTrimTests : YYCacheTestCase
+@end
+
+@implementation YYKVStorageTrimTests
+
+/// The running totals of the storage are the same as the aggregates of the manifest.
+- (void)assertTotalsOfStorage:(YYKVStorage *)kv {
+    XCTAssertEqual((int64_t)[kv getItemsCount], [self executeSQL:@"select count(*) from manifest;"]);
+    XCTAssertEqual([kv getItemsTotalSize], [self executeSQL:@"select coalesce(sum(size), 0) from manifest;"]);
+    XCTAssertEqual([kv getItemsTotalLogicalSize], [self executeSQL:@"select coalesce(sum(coalesce(logical_size, size)), 0) from manifest;"]);
+}
+
+- (void)testTotalsFollowInsertReplaceAndDelete {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    int64_t size = 0;
+    for (int i = 0; i < 20; i++) {
+        [kv saveItemWithKey:@(i).stringValue value:[self dataWithLength:100 + i seed:(uint8_t)i]];
+        size += 100 + i;
+    }
+    XCTAssertEqual([kv getItemsCount], 20);
+    XCTAssertEqual([kv getItemsTotalSize], size);
+    [self assertTotalsOfStorage:kv];
+
+    // `insert or replace` counts the old row out
+    [kv saveItemWithKey:@"0" value:[self dataWithLength:1000 seed:0]];
+    XCTAssertEqual([kv getItemsCount], 20);
+    XCTAssertEqual([kv getItemsTotalSize], size - 100 + 1000);
+    [self assertTotalsOfStorage:kv];
+
+    [kv removeItemForKey:@"1"];
+    [kv removeItemForKeys:@[@"2", @"3", @"missing"]];
+    XCTAssertEqual([kv getItemsCount], 16);
+    [self assertTotalsOfStorage:kv];
+
+    [kv removeItemsLargerThanSize:500];
+    XCTAssertFalse([kv itemExistsForKey:@"0"]);
+    [self assertTotalsOfStorage:kv];
+
+    [kv removeAllItems];
+    XCTAssertEqual([kv getItemsCount], 0);
+    XCTAssertEqual([kv getItemsTotalSize], (int64_t)0);
+}
+
+- (void)testTrimToCountRemovesLeastRecentlyUsed {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeFile];
+    for (int i = 0; i < 100; i++) {
+        NSString *key = @(i).stringValue;
+        [kv saveItemWithKey:key value:[self dataWithLength:100 seed:(uint8_t)i] filename:key extendedData:nil];
+    }
+    // saved again, so it's the most recently used
+    [kv saveItemWithKey:@"0" value:[self dataWithLength:100 seed:0] filename:@"0" extendedData:nil];
+
+    XCTAssertTrue([kv removeItemsToFitCount:50]);
+    XCTAssertEqual([kv getItemsCount], 50);
+    XCTAssertTrue([kv itemExistsForKey:@"0"]);
+    for (int i = 1; i <= 50; i++) XCTAssertFalse([kv itemExistsForKey:@(i).stringValue], @"%d", i);
+    for (int i = 51; i < 100; i++) XCTAssertTrue([kv itemExistsForKey:@(i).stringValue], @"%d", i);
+    [self assertTotalsOfStorage:kv];
+
+    // the files are moved to trash in one batch and removed in background
+    for (int i = 0; i < 5000 && kv.purgingTrash; i++) usleep(1000);
+    XCTAssertEqual(self.dataFiles.count, (NSUInteger)50);
+
+    XCTAssertTrue([kv removeItemsToFitCount:100]);
+    XCTAssertEqual([kv getItemsCount], 50);
+    XCTAssertTrue([kv removeItemsToFitCount:0]);
+    XCTAssertEqual([kv getItemsCount], 0);
+}
+
+- (void)testTrimToSize {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    for (int i = 0; i < 1000; i++) {
+        [kv saveItemWithKey:@(i).stringValue value:[self dataWithLength:100 seed:(uint8_t)i]];
+    }
+    XCTAssertTrue([kv removeItemsToFitSize:50000 + 99]);
+    XCTAssertEqual([kv getItemsCount], 500);
+    XCTAssertEqual([kv getItemsTotalSize], (int64_t)50000);
+    XCTAssertFalse([kv itemExistsForKey:@"499"]);
+    XCTAssertTrue([kv itemExistsForKey:@"500"]);
+    [self assertTotalsOfStorage:kv];
+
+    XCTAssertTrue([kv removeItemsToFitSize:INT_MAX]);
+    XCTAssertEqual([kv getItemsCount], 500);
+    XCTAssertTrue([kv removeItemsToFitTotalSize:0]);
+    XCTAssertEqual([kv getItemsCount], 0);
+}
+
+- (void)testTotalsLargerThan2GB {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    for (int i = 0; i < 3; i++) {
+        [kv saveItemWithKey:@(i).stringValue value:[self dataWithLength:100 seed:(uint8_t)i]];
+    }
+    // pretend the values are 1.5GB each, the update trigger keeps the totals
+    [self executeSQL:@"update manifest set size = 1500000000, logical_size = 1500000000;"];
+    XCTAssertEqual([kv getItemsTotalSize], (int64_t)4500000000);
+    XCTAssertEqual([kv getItemsTotalLogicalSize], (int64_t)4500000000);
+    XCTAssertEqual([kv getItemsSize], INT_MAX);
+    XCTAssertEqual([kv getItemsLogicalSize], INT_MAX);
+
+    XCTAssertTrue([kv removeItemsToFitTotalSize:3000000000]);
+    XCTAssertEqual([kv getItemsCount], 2);
+    XCTAssertFalse([kv itemExistsForKey:@"0"]);
+    XCTAssertEqual([kv getItemsTotalSize], (int64_t)3000000000);
+
+    // the int version doesn't trim against a wrapped total
+    XCTAssertTrue([kv removeItemsToFitSize:2000000000]);
+    XCTAssertEqual([kv getItemsCount], 1);
+    XCTAssertEqual([kv getItemsTotalSize], (int64_t)1500000000);
+    [self assertTotalsOfStorage:kv];
+}
+
+- (void)testTotalsOfOldSchema {
+    // a manifest of schema version 1, without the stats table and triggers
+    [[NSFileManager defaultManager] createDirectoryAtPath:self.path withIntermediateDirectories:YES attributes:nil error:NULL];
+    [self executeSQL:@"create table manifest (key text, filename text, size integer, inline_data blob, modification_time integer, "
+                     @"last_access_time integer, extended_data blob, codec integer default 0, logical_size integer, primary key(key)); "
+                     @"create index last_access_time_idx on manifest(last_access_time); "
+                     @"create table blob (filename text, ref_count integer, primary key(filename)); "
+                     @"insert into manifest (key, size, inline_data, modification_time, last_access_time) values "
+                     @"('a', 3, x'010203', 1, 1), ('b', 2, x'0405', 2, 2), ('c', 1, x'06', 3, 3); "
+                     @"pragma user_version = 1;"];
+
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    XCTAssertEqual([kv getItemsCount], 3);
+    XCTAssertEqual([kv getItemsTotalSize], (int64_t)6);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"b"], [NSData dataWithBytes:"\x04\x05" length:2]);
+
+    XCTAssertTrue([kv removeItemsToFitCount:2]);
+    XCTAssertFalse([kv itemExistsForKey:@"a"]);
+    [kv saveItemWithKey:@"d" value:[self dataWithLength:10 seed:0]];
+    XCTAssertEqual([kv getItemsTotalSize], (int64_t)13);
+    [self assertTotalsOfStorage:kv];
+}
+
+@end
@@ -0,0 +1,122 @@
+//
+//  YYKVStorageWriteBehindTests.m
+//  Study_YYKitTests
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYKVStorage.h>
+#import <YYKit/YYDiskCache.h>
+
+@interface YYKVStorageWriteBehindTests : YYCacheTestCase
+@end
+
+@implementation YYKVStorageWriteBehindTests
+
+- (NSData *)valueWithIndex:(int)index {
+    return [[NSString stringWithFormat:@"value-%d", index] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (YYKVStorage *)writeBehindStorage {
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    kv.writeBehindEnabled = YES;
+    kv.writeBehindInterval = 3600; // flushed by batch size or by hand only
+    return kv;
+}
+
+- (void)testQueuedItemsAreReadable {
+    YYKVStorage *kv = [self writeBehindStorage];
+    for (int i = 0; i < 3; i++) {
+        XCTAssertTrue([kv saveItemWithKey:@(i).stringValue value:[self valueWithIndex:i]]);
+    }
+    XCTAssertTrue(kv.hasPendingWrites);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"1"], [self valueWithIndex:1]);
+    XCTAssertTrue([kv itemExistsForKey:@"2"]);
+    NSDictionary *values = [kv getItemValueForKeys:@[@"0", @"2", @"3"]];
+    XCTAssertEqual(values.count, (NSUInteger)2);
+    XCTAssertEqualObjects(values[@"0"], [self valueWithIndex:0]);
+
+    // a queued item is replaced by the next save, and dropped by a remove
+    XCTAssertTrue([kv saveItemWithKey:@"1" value:[self valueWithIndex:100]]);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"1"], [self valueWithIndex:100]);
+    XCTAssertTrue([kv removeItemForKey:@"2"]);
+    XCTAssertNil([kv getItemValueForKey:@"2"]);
+
+    XCTAssertTrue([kv flushPendingWrites]);
+    XCTAssertFalse(kv.hasPendingWrites);
+    XCTAssertEqual([kv getItemsCount], 2);
+    XCTAssertEqualObjects([kv getItemValueForKey:@"1"], [self valueWithIndex:100]);
+    XCTAssertNil([kv getItemValueForKey:@"2"]);
+}
+
+- (void)testFlushCommitsToDisk {
+    YYKVStorage *kv = [self writeBehindStorage];
+    for (int i = 0; i < 10; i++) {
+        [kv saveItemWithKey:@(i).stringValue value:[self valueWithIndex:i]];
+    }
+
+    // another connection doesn't see the queued items until they are flushed
+    YYKVStorage *reader = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    XCTAssertEqual([reader getItemsCount], 0);
+    XCTAssertTrue([kv flushPendingWrites]);
+    XCTAssertEqual([reader getItemsCount], 10);
+    for (int i = 0; i < 10; i++) {
+        XCTAssertEqualObjects([reader getItemValueForKey:@(i).stringValue], [self valueWithIndex:i]);
+    }
+}
+
+- (void)testBatchSizeTriggersFlush {
+    YYKVStorage *kv = [self writeBehindStorage];
+    kv.writeBehindBatchSize = 4;
+    for (int i = 0; i < 3; i++) {
+        [kv saveItemWithKey:@(i).stringValue value:[self valueWithIndex:i]];
+    }
+    XCTAssertTrue(kv.hasPendingWrites);
+    [kv saveItemWithKey:@"3" value:[self valueWithIndex:3]];
+    XCTAssertFalse(kv.hasPendingWrites);
+
+    YYKVStorage *reader = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    XCTAssertEqual([reader getItemsCount], 4);
+}
+
+- (void)testDisableFlushesQueue {
+    YYKVStorage *kv = [self writeBehindStorage];
+    [kv saveItemWithKey:@"key" value:[self valueWithIndex:0]];
+    XCTAssertTrue(kv.hasPendingWrites);
+    kv.writeBehindEnabled = NO;
+    XCTAssertFalse(kv.hasPendingWrites);
+
+    YYKVStorage *reader = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    XCTAssertEqualObjects([reader getItemValueForKey:@"key"], [self valueWithIndex:0]);
+}
+
+- (void)testQueueIsFlushedOnDealloc {
+    @autoreleasepool {
+        YYKVStorage *kv = [self writeBehindStorage];
+        [kv saveItemWithKey:@"key" value:[self valueWithIndex:0]];
+        XCTAssertTrue(kv.hasPendingWrites);
+    }
+    YYKVStorage *kv = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+    XCTAssertEqualObjects([kv getItemValueForKey:@"key"], [self valueWithIndex:0]);
+}
+
+- (void)testDiskCacheFlushesInBackground {
+    YYDiskCache *cache = [[YYDiskCache alloc] initWithPath:self.path];
+    cache.writeBehindEnabled = YES;
+    for (int i = 0; i < 10; i++) {
+        [cache setObject:@(i) forKey:@(i).stringValue];
+    }
+    XCTAssertEqualObjects([cache objectForKey:@"5"], @5);
+
+    // the queue is flushed within `writeBehindInterval` without any other call
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+    int count = 0;
+    while ([deadline timeIntervalSinceNow] > 0) {
+        YYKVStorage *reader = [[YYKVStorage alloc] initWithPath:self.path type:YYKVStorageTypeSQLite];
+        count = [reader getItemsCount];
+        if (count == 10) break;
+        [NSThread sleepForTimeInterval:0.02];
+    }
+    XCTAssertEqual(count, 10);
+}
+
+@end
@@ -0,0 +1,191 @@
+//
+//  YYMemoryCacheBenchmarks.m
+//  Study_YYKitTests
+//
+//  The results are printed to the test log, run them with a release build on a
+//  device, the simulator's numbers don't say much about lock contention.
+//  testHitRatio reads a recorded key stream from the file at $YYCacheTracePath.
+//
+
+#import "YYCacheTestCase.h"
+#import <YYKit/YYMemoryCache.h>
+#import <QuartzCore/QuartzCore.h>
+
+static inline uint32_t YYMemoryCacheBenchmarkRandom(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+@interface YYMemoryCacheBenchmarks : YYCacheTestCase
+@end
+
+@implementation YYMemoryCacheBenchmarks
+
+/**
+ Throughput of mixed reads and writes from 1 to 64 threads. The cache holds half
+ of the keys, so about half of the reads miss and the writes evict. "1 shard LRU"
+ is the cache before sharding and CLOCK, the objects are released in the release
+ queue (the default). With only reads, a LRU hit still moves the node under the
+ write lock, a CLOCK hit only sets the reference bit under the read lock.
+ */
+- (void)testContention {
+    NSUInteger keyCount = 10000, operationCount = 400000;
+    NSMutableArray *keys = [NSMutableArray new];
+    for (NSUInteger i = 0; i < keyCount; i++) {
+        [keys addObject:[NSString stringWithFormat:@"key-%lu", (unsigned long)i]];
+    }
+    NSArray *threadCounts = @[@1, @2, @4, @8, @16, @32, @64];
+    NSArray *readPercents = @[@100, @95, @80, @50];
+    NSArray *configs = @[@[@1, @(YYMemoryCacheEvictionPolicyLRU), @"1 shard LRU"],
+                         @[@16, @(YYMemoryCacheEvictionPolicyLRU), @"16 shards LRU"],
+                         @[@16, @(YYMemoryCacheEvictionPolicyCLOCK), @"16 shards CLOCK"]];
+
+    NSMutableString *report = [NSMutableString stringWithString:@"\nYYMemoryCache contention (Mops/s)\n"];
+    [report appendFormat:@"%-18s %5s", "cache", "read"];
+    for (NSNumber *threadCount in threadCounts) [report appendFormat:@" %7lu", threadCount.unsignedLongValue];
+    [report appendString:@"\n"];
+    for (NSArray *config in configs) {
+        for (NSNumber *readPercent in readPercents) {
+            [report appendFormat:@"%-18s %4lu%%", [config[2] UTF8String], readPercent.unsignedLongValue];
+            for (NSNumber *threadCount in threadCounts) {
+                YYMemoryCache *cache = [[YYMemoryCache alloc] initWithShardCount:[config[0] unsignedIntegerValue]];
+                cache.evictionPolicy = [config[1] unsignedIntegerValue];
+                cache.countLimit = keyCount / 2;
+                for (NSUInteger i = 0; i < keyCount; i += 2) [cache setObject:keys[i] forKey:keys[i]];
+
+                NSUInteger threads = threadCount.unsignedIntegerValue;
+                uint32_t reads = (uint32_t)readPercent.unsignedIntegerValue;
+                NSTimeInterval time = [self runThreads:threads block:^(NSUInteger thread) {
+                    uint32_t state = (uint32_t)thread * 2654435761U + 1;
+                    for (NSUInteger i = operationCount / threads; i > 0; i--) {
+                        NSString *key = keys[YYMemoryCacheBenchmarkRandom(&state) % keyCount];
+                        if (YYMemoryCacheBenchmarkRandom(&state) % 100 < reads) {
+                            [cache objectForKey:key];
+                        } else {
+                            [cache setObject:key forKey:key withCost:1];
+                        }
+                    }
+                }];
+                [report appendFormat:@" %7.2f", operationCount / time / 1e6];
+            }
+            [report appendString:@"\n"];
+        }
+    }
+    NSLog(@"%@", report);
+}
+
+/**
+ How far a cache goes over its cost limit under write-only load from 8 threads,
+ and the time spent trimming. The old trimmer spun on trylock and slept 10 ms on
+ contention, so the cache could stay over budget for seconds.
+ */
+- (void)testTrimUnderWriteLoad {
+    NSUInteger keyCount = 100000, operationCount = 800000, costLimit = 16 * 1024 * 1024;
+    NSMutableArray *keys = [NSMutableArray new];
+    for (NSUInteger i = 0; i < keyCount; i++) {
+        [keys addObject:[NSString stringWithFormat:@"key-%lu", (unsigned long)i]];
+    }
+    YYMemoryCache *cache = [YYMemoryCache new];
+    cache.costLimit = costLimit;
+
+    __block BOOL finished = NO;
+    __block NSUInteger maxOver = 0, sumOver = 0, samples = 0;
+    dispatch_semaphore_t sampled = dispatch_semaphore_create(0);
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INTERACTIVE, 0), ^{
+        while (!__atomic_load_n(&finished, __ATOMIC_RELAXED)) {
+            NSUInteger over = cache.costOverLimit;
+            if (over > maxOver) maxOver = over;
+            sumOver += over;
+            samples++;
+            usleep(1000);
+        }
+        dispatch_semaphore_signal(sampled);
+    });
+    NSTimeInterval time = [self runThreads:8 block:^(NSUInteger thread) {
+        uint32_t state = (uint32_t)thread * 2654435761U + 1;
+        for (NSUInteger i = operationCount / 8; i > 0; i--) {
+            NSString *key = keys[YYMemoryCacheBenchmarkRandom(&state) % keyCount];
+            [cache setObject:key forKey:key withCost:1024];
+        }
+    }];
+    __atomic_store_n(&finished, YES, __ATOMIC_RELAXED);
+    dispatch_semaphore_wait(sampled, DISPATCH_TIME_FOREVER);
+
+    NSLog(@"\nYYMemoryCache trim under write load: %.2f Mops/s, trim %.1f ms, over budget max %.1f%% average %.1f%%",
+          operationCount / time / 1e6, cache.trimNanoseconds / 1e6,
+          maxOver * 100.0 / costLimit, samples ? sumOver * 100.0 / samples / costLimit : 0);
+}
+
+/// Parse a recorded key stream (one key per line) or make a synthetic one: Zipf
+/// distributed accesses to 50k keys, with a scan of 5k new keys every 20k accesses.
+- (NSArray<NSString *> *)trace {
+    NSString *path = [NSProcessInfo processInfo].environment[@"YYCacheTracePath"];
+    if (path) {
+        NSString *content = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL];
+        NSMutableArray *keys = [NSMutableArray new];
+        [content enumerateLinesUsingBlock:^(NSString *line, BOOL *stop) {
+            if (line.length) [keys addObject:line];
+        }];
+        if (keys.count) return keys;
+    }
+
+    NSUInteger keyCount = 50000, accessCount = 400000;
+    double *cumulative = malloc(sizeof(double) * keyCount);
+    double sum = 0;
+    for (NSUInteger i = 0; i < keyCount; i++) {
+        sum += 1.0 / pow(i + 1, 0.9);
+        cumulative[i] = sum;
+    }
+    NSMutableArray *keys = [NSMutableArray new];
+    uint32_t state = 12345;
+    NSUInteger scan = 0;
+    for (NSUInteger i = 0; i < accessCount; i++) {
+        if (i % 20000 == 19999) {
+            for (NSUInteger j = 0; j < 5000; j++) [keys addObject:[NSString stringWithFormat:@"scan-%lu", (unsigned long)scan++]];
+        }
+        double target = (YYMemoryCacheBenchmarkRandom(&state) / (double)UINT32_MAX) * sum;
+        NSUInteger low = 0, high = keyCount - 1;
+        while (low < high) {
+            NSUInteger mid = (low + high) / 2;
+            if (cumulative[mid] < target) low = mid + 1;
+            else high = mid;
+        }
+        [keys addObject:[NSString stringWithFormat:@"key-%lu", (unsigned long)low]];
+    }
+    free(cumulative);
+    return keys;
+}
+
+/**
+ Hit ratio of LRU and W-TinyLFU on a key stream. A miss loads the object into the
+ cache, as YYImageCache does.
+ */
+- (void)testHitRatio {
+    NSArray *trace = [self trace];
+    NSMutableString *report = [NSMutableString stringWithFormat:@"\nYYMemoryCache hit ratio (%lu accesses)\n", (unsigned long)trace.count];
+    [report appendFormat:@"%8s %8s %8s\n", "size", "LRU", "TinyLFU"];
+    for (NSNumber *size in @[@500, @2000, @8000]) {
+        double ratios[2];
+        for (int admission = 0; admission < 2; admission++) {
+            YYMemoryCache *cache = [YYMemoryCache new];
+            cache.countLimit = size.unsignedIntegerValue;
+            cache.admissionFilterEnabled = admission;
+            NSUInteger hits = 0;
+            for (NSString *key in trace) {
+                if ([cache objectForKey:key]) hits++;
+                else [cache setObject:key forKey:key];
+            }
+            ratios[admission] = (double)hits / trace.count;
+        }
+        [report appendFormat:@"%8lu %7.2f%% %7.2f%%\n", size.unsignedLongValue, ratios[0] * 100, ratios[1] * 100];
+        if (![NSProcessInfo processInfo].environment[@"YYCacheTracePath"]) {
+            XCTAssertGreaterThan(ratios[1], ratios[0], @"size %@", size);
+        }
+    }
+    NSLog(@"%@", report);
+}
+
+@end
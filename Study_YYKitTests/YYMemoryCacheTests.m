@@ -0,0 +1,439 @@
+//
+//  YYMemoryCacheTests.m
+//  Study_YYKitTests
+//
+
+#import <XCTest/XCTest.h>
+#import <YYKit/YYMemoryCache.h>
+#import <YYKit/YYCacheStatistics.h>
+#import <malloc/malloc.h>
+#import <pthread.h>
+
+/// A key with a chosen hash, so the keys can collide in the cache's hash table.
+@interface YYMemoryCacheTestKey : NSObject <NSCopying>
+@property (nonatomic, readonly) NSUInteger identifier;
+@property (nonatomic, readonly) NSUInteger keyHash;
++ (instancetype)keyWithIdentifier:(NSUInteger)identifier hash:(NSUInteger)hash;
+@end
+
+@implementation YYMemoryCacheTestKey
+
++ (instancetype)keyWithIdentifier:(NSUInteger)identifier hash:(NSUInteger)hash {
+    YYMemoryCacheTestKey *key = [self new];
+    key->_identifier = identifier;
+    key->_keyHash = hash;
+    return key;
+}
+
+- (NSUInteger)hash {
+    return _keyHash;
+}
+
+- (BOOL)isEqual:(id)object {
+    if (![object isKindOfClass:[YYMemoryCacheTestKey class]]) return NO;
+    return ((YYMemoryCacheTestKey *)object).identifier == _identifier;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+@end
+
+
+/// An object which runs a block when it's deallocated.
+@interface YYMemoryCacheTestValue : NSObject
+@property (nonatomic, copy) void (^deallocBlock)(void);
+@end
+
+@implementation YYMemoryCacheTestValue
+
+- (void)dealloc {
+    if (_deallocBlock) _deallocBlock();
+}
+
+@end
+
+// The logger which libmalloc calls for each allocation (used by malloc stack logging).
+typedef void (malloc_logger_t)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t num_hot_frames_to_skip);
+extern malloc_logger_t *malloc_logger;
+
+static pthread_t YYMemoryCacheTestAllocThread;
+static volatile NSUInteger YYMemoryCacheTestAllocCount;
+
+static void YYMemoryCacheTestCountAlloc(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t num_hot_frames_to_skip) {
+    if ((type & 2) && pthread_equal(pthread_self(), YYMemoryCacheTestAllocThread)) { // MALLOC_LOG_TYPE_ALLOCATE
+        YYMemoryCacheTestAllocCount++;
+    }
+}
+
+@interface YYMemoryCacheTests : XCTestCase
+@end
+
+@implementation YYMemoryCacheTests
+
+/// The configurations which every behavior test runs with.
+- (NSArray<YYMemoryCache *> *)cachesWithShardCount:(NSUInteger)shardCount {
+    NSMutableArray *caches = [NSMutableArray new];
+    for (int i = 0; i < 4; i++) {
+        YYMemoryCache *cache = [[YYMemoryCache alloc] initWithShardCount:shardCount];
+        cache.evictionPolicy = (i & 1) ? YYMemoryCacheEvictionPolicyCLOCK : YYMemoryCacheEvictionPolicyLRU;
+        cache.admissionFilterEnabled = (i & 2) != 0;
+        cache.name = [NSString stringWithFormat:@"shards:%lu policy:%@ admission:%@", (unsigned long)shardCount,
+                      (i & 1) ? @"CLOCK" : @"LRU", (i & 2) ? @"YES" : @"NO"];
+        [caches addObject:cache];
+    }
+    return caches;
+}
+
+/// Wait for the background trimmer, which enforces the limits that are not divided among shards.
+- (BOOL)waitForCache:(YYMemoryCache *)cache count:(NSUInteger)count cost:(NSUInteger)cost {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+    while (cache.totalCount > count || cache.totalCost > cost) {
+        if ([deadline timeIntervalSinceNow] < 0) return NO;
+        [NSThread sleepForTimeInterval:0.005];
+    }
+    return YES;
+}
+
+#pragma mark - access
+
+- (void)testAccessMethods {
+    for (NSNumber *shardCount in @[@1, @8]) {
+        for (YYMemoryCache *cache in [self cachesWithShardCount:shardCount.unsignedIntegerValue]) {
+            for (int i = 0; i < 1000; i++) {
+                [cache setObject:@(i) forKey:@(i).stringValue withCost:i];
+            }
+            XCTAssertEqual(cache.totalCount, (NSUInteger)1000, @"%@", cache.name);
+            XCTAssertEqual(cache.totalCost, (NSUInteger)(999 * 1000 / 2), @"%@", cache.name);
+            for (int i = 0; i < 1000; i++) {
+                XCTAssertEqualObjects([cache objectForKey:@(i).stringValue], @(i), @"%@", cache.name);
+                XCTAssertTrue([cache containsObjectForKey:@(i).stringValue], @"%@", cache.name);
+            }
+            XCTAssertNil([cache objectForKey:@"1000"]);
+            XCTAssertFalse([cache containsObjectForKey:@"1000"]);
+
+            // replace and remove update the totals
+            [cache setObject:@"new" forKey:@"10" withCost:1010];
+            XCTAssertEqualObjects([cache objectForKey:@"10"], @"new");
+            XCTAssertEqual(cache.totalCount, (NSUInteger)1000, @"%@", cache.name);
+            XCTAssertEqual(cache.totalCost, (NSUInteger)(999 * 1000 / 2 + 1000), @"%@", cache.name);
+            for (int i = 0; i < 1000; i += 2) {
+                [cache removeObjectForKey:@(i).stringValue];
+            }
+            [cache setObject:nil forKey:@"1"]; // same as remove
+            XCTAssertEqual(cache.totalCount, (NSUInteger)499, @"%@", cache.name);
+            XCTAssertEqual(cache.totalCost, (NSUInteger)(1000 * 1000 / 4 - 1), @"%@", cache.name);
+            for (int i = 0; i < 1000; i++) {
+                id expected = (i % 2 && i != 1) ? @(i) : nil;
+                XCTAssertEqualObjects([cache objectForKey:@(i).stringValue], expected, @"%@ %d", cache.name, i);
+            }
+
+            [cache removeAllObjects];
+            XCTAssertEqual(cache.totalCount, (NSUInteger)0, @"%@", cache.name);
+            XCTAssertEqual(cache.totalCost, (NSUInteger)0, @"%@", cache.name);
+            XCTAssertNil([cache objectForKey:@"3"]);
+            [cache setObject:@3 forKey:@"3"];
+            XCTAssertEqualObjects([cache objectForKey:@"3"], @3);
+        }
+    }
+}
+
+/// Keys with few distinct hashes make long probe sequences, and the removal must
+/// shift the following entries back without breaking any of them.
+- (void)testSlotDeletionWithCollisions {
+    YYMemoryCache *cache = [YYMemoryCache new];
+    NSMutableDictionary *expected = [NSMutableDictionary new];
+    NSMutableArray *keys = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 300; i++) {
+        [keys addObject:[YYMemoryCacheTestKey keyWithIdentifier:i hash:i % 7]];
+    }
+    srand48(7);
+    for (int step = 0; step < 20000; step++) {
+        YYMemoryCacheTestKey *key = keys[lrand48() % keys.count];
+        if (lrand48() % 3) {
+            [cache setObject:@(step) forKey:key];
+            expected[key] = @(step);
+        } else {
+            [cache removeObjectForKey:key];
+            [expected removeObjectForKey:key];
+        }
+        if (step % 500 == 0 || step == 19999) {
+            XCTAssertEqual(cache.totalCount, expected.count);
+            for (YYMemoryCacheTestKey *k in keys) {
+                XCTAssertEqualObjects([cache objectForKey:k], expected[k], @"step %d key %lu", step, (unsigned long)k.identifier);
+            }
+        }
+    }
+
+    // remove the whole cluster of one hash, from the middle out
+    NSMutableArray *cluster = [NSMutableArray new];
+    for (NSUInteger i = 3; i < 300; i += 7) {
+        [cache setObject:@(i) forKey:keys[i]];
+        expected[keys[i]] = @(i);
+        [cluster addObject:keys[i]];
+    }
+    NSUInteger middle = cluster.count / 2;
+    for (NSUInteger d = 0; d <= middle; d++) {
+        if (middle + d < cluster.count) [cache removeObjectForKey:cluster[middle + d]];
+        if (d > 0) [cache removeObjectForKey:cluster[middle - d]];
+    }
+    [expected removeObjectsForKeys:cluster];
+    XCTAssertEqual(cache.totalCount, expected.count);
+    for (YYMemoryCacheTestKey *k in keys) {
+        XCTAssertEqualObjects([cache objectForKey:k], expected[k], @"key %lu", (unsigned long)k.identifier);
+    }
+}
+
+#pragma mark - eviction
+
+- (void)testLRUEvictsLeastRecentlyUsed {
+    YYMemoryCache *cache = [YYMemoryCache new];
+    cache.countLimit = 3;
+    [cache setObject:@1 forKey:@"a"];
+    [cache setObject:@2 forKey:@"b"];
+    [cache setObject:@3 forKey:@"c"];
+    [cache objectForKey:@"a"];
+    [cache setObject:@4 forKey:@"d"];
+    XCTAssertEqual(cache.totalCount, (NSUInteger)3);
+    XCTAssertNotNil([cache objectForKey:@"a"]);
+    XCTAssertNil([cache objectForKey:@"b"]);
+    XCTAssertNotNil([cache objectForKey:@"c"]);
+    XCTAssertNotNil([cache objectForKey:@"d"]);
+    XCTAssertEqual([cache.statistics evictionCountForReason:YYCacheEvictionReasonCount], (uint64_t)1);
+}
+
+- (void)testCLOCKGivesReferencedObjectsASecondChance {
+    YYMemoryCache *cache = [YYMemoryCache new];
+    cache.evictionPolicy = YYMemoryCacheEvictionPolicyCLOCK;
+    cache.countLimit = 3;
+    [cache setObject:@1 forKey:@"a"];
+    [cache setObject:@2 forKey:@"b"];
+    [cache setObject:@3 forKey:@"c"];
+    [cache objectForKey:@"a"]; // sets the reference bit only
+    [cache setObject:@4 forKey:@"d"];
+    XCTAssertTrue([cache containsObjectForKey:@"a"]);
+    XCTAssertFalse([cache containsObjectForKey:@"b"]);
+
+    // the bit is cleared when the hand passes, so "a" is evicted in its turn
+    [cache setObject:@5 forKey:@"e"];
+    XCTAssertFalse([cache containsObjectForKey:@"c"]);
+    [cache setObject:@6 forKey:@"f"];
+    XCTAssertFalse([cache containsObjectForKey:@"d"]);
+    XCTAssertTrue([cache containsObjectForKey:@"a"]);
+    [cache setObject:@7 forKey:@"g"];
+    XCTAssertFalse([cache containsObjectForKey:@"a"]);
+    XCTAssertEqual(cache.totalCount, (NSUInteger)3);
+}
+
+- (void)testAdmissionFilterResistsScan {
+    for (NSNumber *admission in @[@NO, @YES]) {
+        YYMemoryCache *cache = [YYMemoryCache new];
+        cache.countLimit = 100;
+        cache.admissionFilterEnabled = admission.boolValue;
+        for (int i = 0; i < 100; i++) {
+            [cache setObject:@(i) forKey:[NSString stringWithFormat:@"hot-%d", i]];
+        }
+        for (int round = 0; round < 10; round++) {
+            for (int i = 0; i < 50; i++) {
+                [cache objectForKey:[NSString stringWithFormat:@"hot-%d", i]];
+            }
+        }
+        // a long scan of objects which are used once
+        for (int i = 0; i < 1000; i++) {
+            [cache setObject:@(i) forKey:[NSString stringWithFormat:@"scan-%d", i]];
+        }
+        XCTAssertLessThanOrEqual(cache.totalCount, (NSUInteger)100);
+        int hotCount = 0;
+        for (int i = 0; i < 50; i++) {
+            if ([cache containsObjectForKey:[NSString stringWithFormat:@"hot-%d", i]]) hotCount++;
+        }
+        if (admission.boolValue) {
+            XCTAssertGreaterThanOrEqual(hotCount, 30); // the sketch is small, some scanned keys collide with hot keys
+        } else {
+            XCTAssertEqual(hotCount, 0);
+        }
+    }
+}
+
+- (void)testTrim {
+    for (YYMemoryCache *cache in [self cachesWithShardCount:4]) {
+        for (int i = 0; i < 1000; i++) {
+            [cache setObject:@(i) forKey:@(i).stringValue withCost:10];
+        }
+        [cache trimToCount:500];
+        XCTAssertLessThanOrEqual(cache.totalCount, (NSUInteger)500, @"%@", cache.name);
+        XCTAssertGreaterThanOrEqual(cache.totalCount, (NSUInteger)490, @"%@", cache.name);
+        [cache trimToCost:2000];
+        XCTAssertLessThanOrEqual(cache.totalCost, (NSUInteger)2000, @"%@", cache.name);
+        XCTAssertEqual(cache.totalCost, cache.totalCount * 10, @"%@", cache.name);
+        if (!cache.admissionFilterEnabled) XCTAssertNotNil([cache objectForKey:@"999"], @"%@", cache.name);
+
+        [NSThread sleepForTimeInterval:0.05];
+        [cache setObject:@"young" forKey:@"young"];
+        [cache trimToAge:0.025];
+        XCTAssertEqual(cache.totalCount, (NSUInteger)1, @"%@", cache.name);
+        XCTAssertEqualObjects([cache objectForKey:@"young"], @"young", @"%@", cache.name);
+
+        [cache trimToCount:0];
+        XCTAssertEqual(cache.totalCount, (NSUInteger)0, @"%@", cache.name);
+        XCTAssertGreaterThan(cache.trimNanoseconds, (uint64_t)0, @"%@", cache.name);
+    }
+}
+
+- (void)testOverLimitIsTrimmedInBackground {
+    YYMemoryCache *cache = [YYMemoryCache new];
+    for (int i = 0; i < 10000; i++) {
+        [cache setObject:@(i) forKey:@(i).stringValue withCost:1];
+    }
+    cache.costLimit = 100;
+    XCTAssertEqual(cache.costOverLimit, (NSUInteger)(10000 - 100));
+
+    // the writer evicts one small batch inline, and leaves the rest to the trimmer
+    [cache setObject:@"new" forKey:@"new" withCost:1];
+    XCTAssertTrue([self waitForCache:cache count:100 cost:100]);
+    XCTAssertEqual(cache.costOverLimit, (NSUInteger)0);
+    XCTAssertEqualObjects([cache objectForKey:@"new"], @"new");
+    XCTAssertEqual(cache.statistics.evictionCount, (uint64_t)(10001 - 100));
+}
+
+#pragma mark - shards
+
+- (void)testLimitsAreDividedAmongShards {
+    YYMemoryCache *cache = [[YYMemoryCache alloc] initWithShardCount:4];
+    XCTAssertEqual(cache.shardCount, (NSUInteger)4);
+    cache.countLimit = 400; // 100 per shard
+    for (int i = 0; i < 2000; i++) {
+        [cache setObject:@(i) forKey:@(i).stringValue];
+        XCTAssertLessThanOrEqual(cache.totalCount, (NSUInteger)400);
+    }
+    XCTAssertGreaterThan(cache.totalCount, (NSUInteger)300); // keys are spread over the shards
+    for (int i = 1990; i < 2000; i++) {
+        XCTAssertNotNil([cache objectForKey:@(i).stringValue]);
+    }
+    XCTAssertEqual([[YYMemoryCache alloc] initWithShardCount:5].shardCount, (NSUInteger)8);
+    XCTAssertEqual([[YYMemoryCache alloc] initWithShardCount:1000].shardCount, (NSUInteger)64);
+}
+
+- (void)testSmallLimitsAreEnforcedOnWholeCache {
+    for (YYMemoryCache *cache in [self cachesWithShardCount:16]) {
+        cache.countLimit = 20; // less than one object per shard
+        for (int i = 0; i < 200; i++) {
+            [cache setObject:@(i) forKey:@(i).stringValue];
+        }
+        XCTAssertTrue([self waitForCache:cache count:20 cost:NSUIntegerMax], @"%@", cache.name);
+        XCTAssertEqual(cache.totalCount, (NSUInteger)20, @"%@", cache.name);
+        if (!cache.admissionFilterEnabled) {
+            // the least recently used objects of all shards go first
+            for (int i = 190; i < 200; i++) {
+                XCTAssertNotNil([cache objectForKey:@(i).stringValue], @"%@ %d", cache.name, i);
+            }
+        }
+
+        cache.countLimit = NSUIntegerMax;
+        cache.costLimit = 1000; // less than 1 MB per shard
+        for (int i = 0; i < 200; i++) {
+            [cache setObject:@(i) forKey:@(i).stringValue withCost:100];
+        }
+        XCTAssertTrue([self waitForCache:cache count:NSUIntegerMax cost:1000], @"%@", cache.name);
+        XCTAssertEqual(cache.totalCost, (NSUInteger)1000, @"%@", cache.name);
+        XCTAssertEqual(cache.costOverLimit, (NSUInteger)0, @"%@", cache.name);
+        [cache trimToCost:500];
+        XCTAssertEqual(cache.totalCost, (NSUInteger)500, @"%@", cache.name);
+    }
+}
+
+- (void)testConcurrentAccess {
+    YYMemoryCache *cache = [[YYMemoryCache alloc] initWithShardCount:8];
+    cache.evictionPolicy = YYMemoryCacheEvictionPolicyCLOCK;
+    cache.countLimit = 1000;
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+        for (int i = 0; i < 20000; i++) {
+            NSString *key = @((i * 7 + thread) % 3000).stringValue;
+            if (i % 4 == 0) [cache setObject:key forKey:key withCost:1];
+            else if (i % 97 == 0) [cache removeObjectForKey:key];
+            else {
+                id value = [cache objectForKey:key];
+                if (value) XCTAssertEqualObjects(value, key);
+            }
+        }
+    });
+    XCTAssertLessThanOrEqual(cache.totalCount, (NSUInteger)1000);
+    XCTAssertEqual(cache.totalCost, cache.totalCount);
+}
+
+#pragma mark - release
+
+- (void)testSynchronousReleaseAfterUnlock {
+    YYMemoryCache *cache = [YYMemoryCache new];
+    cache.releaseAsynchronously = NO;
+    __block BOOL released = NO;
+    @autoreleasepool {
+        YYMemoryCacheTestValue *value = [YYMemoryCacheTestValue new];
+        __weak YYMemoryCache *weakCache = cache;
+        value.deallocBlock = ^{
+            released = YES;
+            [weakCache objectForKey:@"other"]; // it would deadlock if released in the lock
+        };
+        [cache setObject:value forKey:@"key"];
+    }
+    XCTAssertFalse(released);
+    [cache removeObjectForKey:@"key"];
+    XCTAssertTrue(released);
+}
+
+- (void)testAsynchronousReleaseByTrim {
+    YYMemoryCache *cache = [YYMemoryCache new];
+    __block BOOL released = NO;
+    @autoreleasepool {
+        YYMemoryCacheTestValue *value = [YYMemoryCacheTestValue new];
+        value.deallocBlock = ^{ released = YES; };
+        [cache setObject:value forKey:@"key"];
+        [cache removeObjectForKey:@"key"];
+    }
+    // a partial batch is released by the next trim
+    [cache trimToAge:DBL_MAX];
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+    while (!released && [deadline timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.005];
+    }
+    XCTAssertTrue(released);
+}
+
+- (void)testSteadyStateInsertAndEvictDoNotAllocate {
+    NSMutableArray *keys = [NSMutableArray new];
+    NSMutableArray *values = [NSMutableArray new]; // keeps the objects alive, only the cache's own memory is counted
+    for (int i = 0; i < 6000; i++) {
+        [keys addObject:[NSString stringWithFormat:@"key-%d", i]];
+        [values addObject:[NSObject new]];
+    }
+    for (NSNumber *async in @[@NO, @YES]) {
+        YYMemoryCache *cache = [YYMemoryCache new];
+        cache.countLimit = 1000;
+        cache.releaseAsynchronously = async.boolValue;
+        for (int i = 0; i < 3000; i++) { // the slab and hash table reach their final size
+            [cache setObject:values[i] forKey:keys[i]];
+        }
+
+        YYMemoryCacheTestAllocThread = pthread_self();
+        YYMemoryCacheTestAllocCount = 0;
+        malloc_logger_t *logger = malloc_logger;
+        malloc_logger = YYMemoryCacheTestCountAlloc;
+        for (int i = 3000; i < 6000; i++) { // each insertion evicts one object
+            [cache setObject:values[i] forKey:keys[i]];
+        }
+        malloc_logger = logger;
+        NSUInteger allocCount = YYMemoryCacheTestAllocCount;
+
+        XCTAssertEqual(cache.totalCount, (NSUInteger)1000);
+        if (async.boolValue) {
+            // a batch is handed to the release queue per 32 evictions, the dispatch
+            // may allocate, and the buffer is recycled unless the queue is behind
+            XCTAssertLessThanOrEqual(allocCount, (NSUInteger)(3000 / 32 * 4), @"async");
+        } else {
+            XCTAssertEqual(allocCount, (NSUInteger)0, @"sync");
+        }
+    }
+}
+
+@end